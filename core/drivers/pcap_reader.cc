@@ -4,6 +4,7 @@
 #include <string>
 
 #include "../utils/checksum.h"
+#include "../utils/copy.h"
 #include "../utils/flow.h"
 #include "../utils/packet_tag.h"
 
@@ -308,6 +308,12 @@ CommandResponse PMDPort::Init(const bess::pb::PMDPortArg &arg) {
     bench_rss_ = true;
   }
 
+  nfv_rt_ = bess::ctrl::GetNFVRuntime(arg.nfv_instance());
+  if (nfv_rt_ == nullptr) {
+    return CommandFailure(EINVAL, "invalid nfv_instance %d",
+                          arg.nfv_instance());
+  }
+
   ret = rte_eth_dev_configure(ret_port_id, num_rxq, num_txq, &eth_conf);
   if (ret != 0) {
     return CommandFailure(-ret, "rte_eth_dev_configure() failed");
@@ -445,6 +451,17 @@ CommandResponse PMDPort::Init(const bess::pb::PMDPortArg &arg) {
   }
   rte_flow_id_ = 0;
 
+  // Nothing to drain until the first RSS rule takes effect
+  rss_generation_ = 0;
+  for (queue_t qid = 0; qid < MAX_QUEUES_PER_DIR; qid++) {
+    rss_queues_[qid].generation = 0;
+    rss_queues_[qid].stale_pkts = 0;
+  }
+  rss_active_queues_.reset();
+  rss_active_queues_.set(0);
+  rss_pending_queues_ = 0;
+  rss_flip_ns_ = 0;
+
   // Run a set of NIC RSS benchmarks
   if (bench_rss_) {
     BenchUpdateRssReta();
@@ -457,9 +474,9 @@ CommandResponse PMDPort::Init(const bess::pb::PMDPortArg &arg) {
     LOG(INFO) << "RX queue count func is not supported. Error code: " << q_pkt_count;
   }
 
-  // Set the global pmd pointer used by NFVCtrl
-  bess::ctrl::pmd_port = this;
-  bess::ctrl::NFVCtrlCheckAllComponents();
+  // Set the pmd pointer used by this port's NFVCtrl
+  nfv_rt_->pmd_port = this;
+  nfv_rt_->CheckAllComponents();
 
   return CommandSuccess();
 }
@@ -675,6 +692,9 @@ int PMDPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
 start_rx:
   int recv = rte_eth_rx_burst(dpdk_port_id_, qid,
                               reinterpret_cast<rte_mbuf **>(pkts), cnt);
+  if (unlikely(rss_pending_queues_.load(std::memory_order_relaxed) > 0)) {
+    TrackRssSwitchover(qid, pkts, recv);
+  }
   if (!intr_enabled_) {
     return recv;
   }
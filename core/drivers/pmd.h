@@ -31,6 +31,8 @@
 #ifndef BESS_DRIVERS_PMD_H_
 #define BESS_DRIVERS_PMD_H_
 
+#include <atomic>
+#include <bitset>
 #include <shared_mutex>
 #include <string>
 
@@ -41,8 +43,15 @@
 
 #include "../module.h"
 #include "../port.h"
+#include "../utils/latency_sketch.h"
 #include "../utils/regression.h"
 
+namespace bess {
+namespace ctrl {
+struct NFVRuntime;
+}  // namespace ctrl
+}  // namespace bess
+
 typedef uint16_t dpdk_port_t;
 
 #define DPDK_PORT_UNKNOWN RTE_MAX_ETHPORTS
@@ -56,6 +65,7 @@ class PMDPort final : public Port {
       : Port(),
         dpdk_port_id_(DPDK_PORT_UNKNOWN),
         hot_plugged_(false),
+        nfv_rt_(nullptr),
         node_placement_(UNCONSTRAINED_SOCKET) {}
 
   void InitDriver() override;
@@ -171,9 +181,44 @@ class PMDPort final : public Port {
   void UpdateRssFlow(std::map<uint16_t, uint16_t>& moves);
   void UpdateRssFlow(std::map<uint16_t, uint16_t>& shard_moves, uint16_t total_shards);
 
+  // A hardware-steered flow aggregate: IPv4 packets whose dst IP's lowest
+  // byte matches |prefix| under |mask| are tagged with |mark| (i.e., the
+  // mbuf's fdir.hi with PKT_RX_FDIR_ID set).
+  struct AggregateRule {
+    uint8_t prefix;
+    uint8_t mask;
+    uint32_t mark;
+  };
+
+  // Installs |rules| (as one batch) in the shadow aggregate group, and then
+  // points group 0 at it, so that the new steering takes effect at once.
+  // Returns 0 on success; on failure, the active rules stay in place.
+  // Aggregate rules and UpdateRssFlow()'s generation-marked RSS rules are
+  // mutually exclusive on a port: whichever is installed first wins, and
+  // the other fails (-EBUSY here).
+  // This makes several rte_flow calls; do not call it on the datapath.
+  int UpdateAggregateFlows(const std::vector<AggregateRule> &rules);
+  void ClearAggregateFlows();
+
   void BenchUpdateRssReta();
   void BenchRXQueueCount();
 
+  /*
+   * RSS switchover tracking. UpdateRssFlow() stages the new RSS rule in the
+   * shadow group (1 or 2) and then flips group 0's jump rule, so the NIC
+   * switches mappings at once. Each RSS rule marks packets with its
+   * generation; after a flip, an RX queue that had traffic on the old
+   * mapping drains until it delivers a packet of the new generation (or
+   * runs empty). The switchover completes when all such queues drained.
+   */
+  uint32_t rss_generation() const {
+    return rss_generation_.load(std::memory_order_acquire);
+  }
+  // True until the last switchover completes (or times out)
+  bool IsRssSwitchoverPending() const;
+  // Logs p50/p99 of the flip time and of the switchover (drain) time
+  void ReportRssSwitchover();
+
   // Mellanox: 512;
   uint32_t reta_size_;
   // NIC's RSS indirection table;
@@ -186,8 +231,18 @@ class PMDPort final : public Port {
   std::vector<rte_flow*> reta_flows_;
   // At this moment, the effective reta_flow* in |reta_flows_|.
   int rte_flow_id_;
+  // The generation of the effective RSS rule (i.e., its mark)
+  std::atomic<uint32_t> rss_generation_;
   bool is_use_group_table_ = true;
 
+  // Flow groups 3/4 hold the aggregate steering rules. A port uses either
+  // these or the RSS groups (1/2), as both are entered from group 0.
+  static constexpr uint32_t kAggregateFlowGroup = 3;
+  std::vector<rte_flow*> aggregate_flows_[2];
+  rte_flow* aggregate_jump_ = nullptr;
+  // The shadow group (0 or 1) for the next UpdateAggregateFlows()
+  int aggregate_group_id_ = 0;
+
  private:
   /*!
    * The DPDK port ID number (set after binding).
@@ -225,6 +280,34 @@ class PMDPort final : public Port {
    */
   bool bench_rss_;
 
+  /*!
+   * The Ironside instance whose NFVCtrl manages this port's RSS.
+   */
+  bess::ctrl::NFVRuntime *nfv_rt_;
+
+  /*!
+   * Per-RX-queue RSS switchover state; only touched by the queue's poller.
+   */
+  struct alignas(64) RssQueueState {
+    // The RSS generation this queue has fully switched to
+    std::atomic<uint32_t> generation;
+    // # of packets received on an old mapping
+    uint64_t stale_pkts;
+  };
+
+  // Called on RX while a switchover is pending
+  void TrackRssSwitchover(queue_t qid, bess::Packet **pkts, int cnt);
+
+  RssQueueState rss_queues_[MAX_QUEUES_PER_DIR];
+  // RX queues in the effective RSS rule, i.e., the ones to drain next time
+  std::bitset<MAX_QUEUES_PER_DIR> rss_active_queues_;
+  // # of RX queues that still have packets on the old mapping
+  std::atomic<int> rss_pending_queues_;
+  uint64_t rss_flip_ns_;
+  bess::utils::LatencySketch rss_flip_latency_;
+  // Written by the last drained queue's poller
+  bess::utils::LatencySketch rss_switchover_latency_;
+
   LinearRegression<uint64_t> linear_re_;
   std::shared_mutex linear_re_lock_;
   bool system_shutdown_;
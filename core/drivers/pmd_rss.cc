@@ -49,6 +49,12 @@ inline rte_flow* AddFlowRedirectRule(int port_id, int from, int to, int priority
   }
   return nullptr;
 }
+
+// RSS rules mark packets with (the low bits of) their generation
+constexpr uint32_t kRssMarkMask = 0xffffff;
+
+// A switchover is considered complete after this long
+constexpr uint64_t kRssSwitchoverTimeoutNs = 10000000;
 } // namespace
 
 void PMDPort::UpdateRssReta() {
@@ -110,11 +116,19 @@ void PMDPort::UpdateRssFlow() {
     LOG(INFO) << "Group flow table is not supported";
     return;
   }
+  if (aggregate_jump_ != nullptr) {
+    LOG(ERROR) << "RSS flow rules cannot be combined with aggregate rules";
+    return;
+  }
+
+  uint64_t start = rdtsc();
+  uint32_t generation = rss_generation_.load(std::memory_order_relaxed) + 1;
+  int shadow = 1 + (rte_flow_id_ % 2);
 
   struct rte_flow_attr attr;
   memset(&attr, 0, sizeof(struct rte_flow_attr));
   attr.ingress = 1;
-  attr.group = 1 + (rte_flow_id_ % 2);
+  attr.group = shadow;
 
   struct rte_flow_action action[3];
   memset(action, 0, sizeof(struct rte_flow_action) * 3);
@@ -123,7 +137,7 @@ void PMDPort::UpdateRssFlow() {
   action[0].type = RTE_FLOW_ACTION_TYPE_MARK;
   struct rte_flow_action_mark mark;
   memset((void*)&mark, 0, sizeof(struct rte_flow_action_mark));
-  mark.id = rte_flow_id_;
+  mark.id = generation & kRssMarkMask;
   action[0].conf = &mark;
   ++aid;
 
@@ -140,13 +154,6 @@ void PMDPort::UpdateRssFlow() {
   action[aid].conf = &rss;
   ++aid;
 
-  // Debug log
-  // std::string output;
-  // for (auto x : reta_table_) {
-  //   output += std::to_string(x);
-  // }
-  // LOG(INFO) << output;
-
   action[aid].type = RTE_FLOW_ACTION_TYPE_END;
   ++aid;
 
@@ -157,30 +164,109 @@ void PMDPort::UpdateRssFlow() {
 
   struct rte_flow_error error;
   int ret = rte_flow_validate(dpdk_port_id_, &attr, pattern.data(), action, &error);
-  if (ret == 0) {
-    // Delete the previous RSS rule (i.e. 2-update ago)
-    rte_flow* &prev = reta_flows_[1 + (rte_flow_id_ % 2)];
-    if (prev != nullptr) {
-      rte_flow_destroy(dpdk_port_id_, prev, &error);
+  if (ret != 0) {
+    LOG(ERROR) << "Flow rule (rss) cannot be validated. Error code: " << ret << "; msg: " << error.message;
+    return;
+  }
+
+  // 1) Stage the new RSS rule in the shadow group. Its previous rule (i.e.
+  // 2-update ago) is unreachable since the last flip.
+  rte_flow* &prev = reta_flows_[shadow];
+  if (prev != nullptr) {
+    rte_flow_destroy(dpdk_port_id_, prev, &error);
+    prev = nullptr;
+  }
+  struct rte_flow *flow = rte_flow_create(dpdk_port_id_, &attr, pattern.data(), action, &error);
+  if (flow == nullptr) {
+    LOG(ERROR) << "Flow rule (rss) cannot be created: " << (error.message ? error.message : "unknown");
+    return;
+  }
+  prev = flow;
+
+  // 2) Flip. The jump rule's priority is its group, so the two jump rules
+  // never tie and the NIC switches mappings at a single point.
+  rte_flow* re_dir = AddFlowRedirectRule(dpdk_port_id_, 0, shadow, shadow);
+  if (re_dir == nullptr) {
+    return;
+  }
+  if (reta_flows_[0] != nullptr) {
+    rte_flow_destroy(dpdk_port_id_, reta_flows_[0], &error);
+  }
+  reta_flows_[0] = re_dir;
+  rss_flip_latency_.Add(tsc_to_ns(rdtsc() - start));
+
+  // 3) Track in-flight packets on the old mapping: only queues that were in
+  // the old RSS rule may have them.
+  std::bitset<MAX_QUEUES_PER_DIR> new_queues;
+  for (uint16_t q : reta_table_) {
+    new_queues.set(q);
+  }
+  for (queue_t qid = 0; qid < MAX_QUEUES_PER_DIR; qid++) {
+    if (!rss_active_queues_.test(qid)) {
+      rss_queues_[qid].generation.store(generation, std::memory_order_relaxed);
     }
-    struct rte_flow *flow = rte_flow_create(dpdk_port_id_, &attr, pattern.data(), action, &error);
-    if (flow) {
-      prev = flow;
-
-      // Update the flow group redirection rule
-      rte_flow* re_dir = AddFlowRedirectRule(
-          dpdk_port_id_, 0,  1 + (rte_flow_id_ % 2), 1 + (rte_flow_id_ % 2));
-      if (reta_flows_[0] != nullptr) {
-        rte_flow_destroy(dpdk_port_id_, reta_flows_[0], &error);
-      }
-      reta_flows_[0] = re_dir;
+  }
+  rss_flip_ns_ = tsc_to_ns(rdtsc());
+  rss_pending_queues_.store(rss_active_queues_.count(), std::memory_order_relaxed);
+  rss_generation_.store(generation, std::memory_order_release);
+  rss_active_queues_ = new_queues;
+
+  // Set the next flow RSS rule's ID
+  rte_flow_id_ = (rte_flow_id_ + 1) % 2;
+}
+
+bool PMDPort::IsRssSwitchoverPending() const {
+  if (rss_pending_queues_.load(std::memory_order_acquire) <= 0) {
+    return false;
+  }
+  // A queue without a poller never drains
+  return tsc_to_ns(rdtsc()) - rss_flip_ns_ < kRssSwitchoverTimeoutNs;
+}
+
+void PMDPort::TrackRssSwitchover(queue_t qid, bess::Packet **pkts, int cnt) {
+  uint32_t generation = rss_generation_.load(std::memory_order_acquire);
+  RssQueueState &q = rss_queues_[qid];
+  // The queue may be ahead if the flip is still being published
+  uint32_t seen = q.generation.load(std::memory_order_relaxed);
+  if (static_cast<int32_t>(seen - generation) >= 0) {
+    return;
+  }
 
-      // Set the next flow RSS rule's ID
-      rte_flow_id_ = (rte_flow_id_ + 1) % 2;
+  // A queue is FIFO: once it delivers a packet marked by the new rule (or
+  // runs empty), it has no more packets on the old mapping.
+  int stale = 0;
+  while (stale < cnt) {
+    rte_mbuf *mbuf = reinterpret_cast<rte_mbuf *>(pkts[stale]);
+    if ((mbuf->ol_flags & PKT_RX_FDIR_ID) &&
+        mbuf->hash.fdir.hi == (generation & kRssMarkMask)) {
+      break;
     }
-  } else {
-    LOG(ERROR) << "Flow rule (rss) cannot be validated. Error code: " << ret << "; msg: " << error.message;
+    stale++;
+  }
+  q.stale_pkts += stale;
+  if (stale == cnt && cnt > 0) {
+    return;
+  }
+
+  q.generation.store(generation, std::memory_order_relaxed);
+  if (rss_pending_queues_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    rss_switchover_latency_.Add(tsc_to_ns(rdtsc()) - rss_flip_ns_);
+  }
+}
+
+void PMDPort::ReportRssSwitchover() {
+  uint64_t stale_pkts = 0;
+  for (const RssQueueState &q : rss_queues_) {
+    stale_pkts += q.stale_pkts;
   }
+
+  LOG(INFO) << "RSS switchover: " << rss_flip_latency_.count() << " flips";
+  LOG(INFO) << " - flip time: p50 " << rss_flip_latency_.Quantile(0.5)
+            << " ns, p99 " << rss_flip_latency_.Quantile(0.99) << " ns";
+  LOG(INFO) << " - drain time: p50 " << rss_switchover_latency_.Quantile(0.5)
+            << " ns, p99 " << rss_switchover_latency_.Quantile(0.99)
+            << " ns (" << rss_switchover_latency_.count() << " completed)";
+  LOG(INFO) << " - packets on old mappings: " << stale_pkts;
 }
 
 void PMDPort::UpdateRssFlow(std::map<uint16_t, uint16_t>& moves) {
@@ -219,6 +305,116 @@ void PMDPort::UpdateRssFlow(std::map<uint16_t, uint16_t>& moves, uint16_t total_
   }
 }
 
+int PMDPort::UpdateAggregateFlows(const std::vector<AggregateRule> &rules) {
+  if (!is_use_group_table_) {
+    LOG(INFO) << "Group flow table is not supported";
+    return -ENOTSUP;
+  }
+  if (reta_flows_[0] != nullptr) {
+    // Both would MARK packets, with generations vs. core indices
+    LOG(ERROR) << "Aggregate rules cannot be combined with RSS flow rules";
+    return -EBUSY;
+  }
+
+  int shadow = aggregate_group_id_;
+  uint32_t group = kAggregateFlowGroup + shadow;
+  std::vector<rte_flow*> &staged = aggregate_flows_[shadow];
+  struct rte_flow_error error;
+
+  // Packets of all aggregates are still spread with RSS
+  struct rte_flow_action_rss rss;
+  memset((void*)&rss, 0, sizeof(rss));
+  rss.types = dpdk_rss_hf_;
+  rss.queue_num = reta_size_;
+  rss.queue = reta_table_.data();
+  rss.func = RTE_ETH_HASH_FUNCTION_DEFAULT;
+
+  struct rte_flow_attr attr;
+  memset(&attr, 0, sizeof(struct rte_flow_attr));
+  attr.ingress = 1;
+  attr.group = group;
+
+  // 1) Stage all rules in the shadow group; it is not reachable yet
+  for (const AggregateRule &rule : rules) {
+    struct rte_flow_item_ipv4 ip_spec;
+    struct rte_flow_item_ipv4 ip_mask;
+    memset(&ip_spec, 0, sizeof(ip_spec));
+    memset(&ip_mask, 0, sizeof(ip_mask));
+    ip_spec.hdr.dst_addr = rte_cpu_to_be_32(rule.prefix & rule.mask);
+    ip_mask.hdr.dst_addr = rte_cpu_to_be_32(rule.mask);
+
+    struct rte_flow_item ipv4_item = IPV4_ITEM;
+    ipv4_item.spec = &ip_spec;
+    ipv4_item.mask = &ip_mask;
+    struct rte_flow_item pattern[3] = {ETH_ITEM, ipv4_item, END_ITEM};
+
+    struct rte_flow_action_mark mark;
+    memset((void*)&mark, 0, sizeof(struct rte_flow_action_mark));
+    mark.id = rule.mark;
+
+    struct rte_flow_action action[3];
+    memset(action, 0, sizeof(struct rte_flow_action) * 3);
+    action[0].type = RTE_FLOW_ACTION_TYPE_MARK;
+    action[0].conf = &mark;
+    action[1].type = RTE_FLOW_ACTION_TYPE_RSS;
+    action[1].conf = &rss;
+    action[2].type = RTE_FLOW_ACTION_TYPE_END;
+
+    struct rte_flow *flow =
+        rte_flow_create(dpdk_port_id_, &attr, pattern, action, &error);
+    if (flow == nullptr) {
+      LOG(ERROR) << "Flow rule (aggregate) cannot be created: "
+                 << (error.message ? error.message : "unknown");
+      for (rte_flow *f : staged) {
+        rte_flow_destroy(dpdk_port_id_, f, &error);
+      }
+      staged.clear();
+      return -EINVAL;
+    }
+    staged.push_back(flow);
+  }
+
+  // 2) Flip. The jump rule's priority is its group, so the two jump rules
+  // never tie: whichever of creating the new one or destroying the old one
+  // changes the winner is the single switchover point.
+  rte_flow *jump = AddFlowRedirectRule(dpdk_port_id_, 0, group, group);
+  if (jump == nullptr) {
+    for (rte_flow *f : staged) {
+      rte_flow_destroy(dpdk_port_id_, f, &error);
+    }
+    staged.clear();
+    return -EINVAL;
+  }
+  if (aggregate_jump_ != nullptr) {
+    rte_flow_destroy(dpdk_port_id_, aggregate_jump_, &error);
+  }
+  aggregate_jump_ = jump;
+
+  // 3) The old group is no longer reachable
+  std::vector<rte_flow*> &old = aggregate_flows_[1 - shadow];
+  for (rte_flow *f : old) {
+    rte_flow_destroy(dpdk_port_id_, f, &error);
+  }
+  old.clear();
+
+  aggregate_group_id_ = 1 - shadow;
+  return 0;
+}
+
+void PMDPort::ClearAggregateFlows() {
+  struct rte_flow_error error;
+  if (aggregate_jump_ != nullptr) {
+    rte_flow_destroy(dpdk_port_id_, aggregate_jump_, &error);
+    aggregate_jump_ = nullptr;
+  }
+  for (auto &flows : aggregate_flows_) {
+    for (rte_flow *f : flows) {
+      rte_flow_destroy(dpdk_port_id_, f, &error);
+    }
+    flows.clear();
+  }
+}
+
 // Performance benchmarks
 void PMDPort::BenchUpdateRssReta() {
   uint64_t start, sum_cycle;
@@ -236,7 +432,7 @@ void PMDPort::BenchUpdateRssReta() {
   LOG(INFO) << " - reta table size: " << reta_size_;
   LOG(INFO) << " - update time: " << tsc_to_us(sum_cycle / 3) << " usec";
 
-  // Flow update
+  // Flow update (staging + flip)
   sum_cycle = 0;
   for (int i = 0; i < 3; i++) {
     start = rdtsc();
@@ -247,6 +443,13 @@ void PMDPort::BenchUpdateRssReta() {
 
   LOG(INFO) << "Bench rss: flow table update";
   LOG(INFO) << " - update time: " << tsc_to_us(sum_cycle / 3) << " usec";
+
+  // Back-to-back flips, as in on-demand rebalancing
+  for (int i = 0; i < 100; i++) {
+    UpdateRssFlow();
+    rte_delay_ms(1);
+  }
+  ReportRssSwitchover();
 }
 
 void PMDPort::BenchRXQueueCount() {
@@ -39,6 +39,7 @@
 #include "packet_pool.h"
 #include "port.h"
 #include "utils/format.h"
+#include "utils/reassembly_buffer.h"
 #include "utils/sys_measure.h"
 #include "version.h"
 
@@ -87,6 +88,8 @@ int main(int argc, char *argv[]) {
   }
 
   bess::PacketPool::CreateDefaultPools(FLAGS_buffers);
+  bess::utils::ReassemblyArena::SetDefaultBudget(
+      static_cast<size_t>(FLAGS_reassembly_mem) << 20);
   bess::utils::SysMeasureInit();
   bess::ctrl::NFVCtrlMsgInit();
   PortBuilder::InitDrivers();
@@ -10,6 +10,7 @@
 
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
+#include "../utils/chacha.h"
 #include "../utils/ip.h"
 #include "../utils/tcp.h"
 #include "../utils/udp.h"
@@ -18,17 +19,6 @@ using bess::utils::be32_t;
 using bess::utils::be16_t;
 using bess::utils::Ipv4Prefix;
 
-// the chacha cipher context struct
-typedef struct {
-  uint32_t state[16];
-  uint8_t rounds;
-} chacha_ctx;
-
-void chacha_init_ctx(chacha_ctx *cctx, uint8_t rounds);
-void chacha_doublerounds(uint8_t output[64], const uint32_t input[16], uint8_t rounds);
-void chacha_init(chacha_ctx *cctx, uint8_t *key, uint32_t keylen, uint8_t *iv);
-void chacha_next(chacha_ctx *cctx, const uint8_t *m, const uint8_t *m_end, uint8_t *c);
-
 class CHACHA final : public Module {
 public:
   static const Commands cmds;
@@ -39,19 +29,16 @@ public:
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
 
+  std::string GetDesc() const override;
+
 private:
-  // This function runs the CHACHA cipher on the first 512-bit on the TCP
-  // payload. If the packet does not have enough payload countent, the
-  // function does the same processing until it reaches the payload's end.
-  // |payload| is the pointer of the packet payload.
-  // |payload_size| is the payload length.
-  void process_packet(char* payload, int payload_size);
-
-  // The chacha context for a packet.
-  chacha_ctx chacha_ctx_;
+  // The cipher, keyed once in Init(). Each packet's payload (from
+  // |chacha_offset_| on, whole 64-byte blocks only) is encrypted from
+  // keystream block 0, all packets of a batch at once. Read-only while
+  // processing, so workers can share it.
+  bess::utils::ChaCha chacha_;
   uint8_t tc_key_[32];
   uint8_t tc_iv_[8];
-  //uint8_t tc_res[64];
 
   int const_payload_size_; // the fixed payload size for all packets (for experiments)
   int chacha_offset_; // the payload offset (chacha starts at the payload+offset byte)
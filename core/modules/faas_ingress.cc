@@ -176,13 +176,13 @@ CommandResponse FaaSIngress::CommandMigrate(const bess::pb::FaaSIngressCommandMi
   double sum_rate = 0.0;
   while (from_it->second.size() > 0 && sum_rate < rate_diff) {
     auto head = from_it->second.front();
-    auto flow_it = flow_cache_.find(head);
-    if (flow_it == flow_cache_.end()) { continue; }
+    auto flow_it = flow_cache_.Find(head);
+    if (flow_it == nullptr) { continue; }
 
     from_it->second.pop_front();
     to_it->second.emplace_front(head);
-    sum_rate += flow_it->second.pkt_rate_;
-    flow_it->second.SetAction(mac_encoded_, egress_port_, to);
+    sum_rate += flow_it->value.pkt_rate_;
+    flow_it->value.SetAction(mac_encoded_, egress_port_, to);
   }
   return CommandSuccess();
 }
@@ -259,36 +259,34 @@ void FaaSIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     flow.dst_port = dport;
 
     // Find existing flow, if we have one.
-    std::unordered_map<Flow, FlowRoutingRule, FlowHash>::iterator it =
-        flow_cache_.find(flow);
+    FlowTable<Flow, FlowRoutingRule, FlowHash>::Entry *it =
+        flow_cache_.Find(flow);
 
     bool emitted = false;
-    if (it != flow_cache_.end()) {
-      if (now >= it->second.ExpiryTime()) { // an outdated flow
-        flow_cache_.erase(it);
+    if (it != nullptr) {
+      if (now >= it->value.ExpiryTime()) { // an outdated flow
+        flow_cache_.Erase(it);
         active_flows_ -= 1;
-        it = flow_cache_.end();
+        it = nullptr;
       } else { // an existing flow
         emitted = true;
-        eth->dst_addr = it->second.encoded_mac_;
+        eth->dst_addr = it->value.encoded_mac_;
       }
     }
 
-    if (it == flow_cache_.end()) {
+    if (it == nullptr) {
       FlowRoutingRule new_rule("02:42:01:c2:02:fe");
 
       if (!process_new_flow(flow, new_rule)) {
         emitted = false;
       } else {
-        std::tie(it, std::ignore) = flow_cache_.emplace(
-            std::piecewise_construct,
-            std::make_tuple(flow), std::make_tuple(new_rule));
+        it = flow_cache_.Emplace(flow, 0, new_rule).first;
         active_flows_ += 1;
 
-        eth->dst_addr = it->second.encoded_mac_;
-        it->second.packet_count_ += 1;
-        it->second.SetExpiryTime(now + TIME_OUT_NS);
-        it->second.UpdateRate(now);
+        eth->dst_addr = it->value.encoded_mac_;
+        it->value.packet_count_ += 1;
+        it->value.SetExpiryTime(now + TIME_OUT_NS);
+        it->value.UpdateRate(now);
         emitted = true;
       }
     }
@@ -301,7 +299,7 @@ void FaaSIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     }
 
     if (tcp != nullptr && tcp->flags & Tcp::Flag::kFin) {
-      //flow_cache_.erase(it);
+      //flow_cache_.Erase(it);
       active_flows_ -= 1;
     }
 
@@ -14,6 +14,7 @@
 #include "../pb/module_msg.pb.h"
 #include "../utils/ether.h"
 #include "../utils/flow.h"
+#include "../utils/flow_table.h"
 #include "../utils/ip.h"
 #include "../utils/mcslock.h"
 
@@ -25,6 +26,7 @@ using bess::utils::Ipv4Prefix;
 using bess::utils::Flow;
 using bess::utils::FlowHash;
 using bess::utils::FlowRoutingRule;
+using bess::utils::FlowTable;
 // For routing
 using bess::utils::FlowAction;
 using bess::utils::FlowLpmRule;
@@ -62,7 +64,7 @@ class FaaSIngress final : public Module {
   std::string convert_rule_to_string(Flow &flow, FlowRoutingRule &rule);
 
   // For monitoring per-flow packet rates
-  std::unordered_map<Flow, FlowRoutingRule, FlowHash> flow_cache_;
+  FlowTable<Flow, FlowRoutingRule, FlowHash> flow_cache_;
   // For tracking flow-to-chain mapping
   std::unordered_map<std::string, std::deque<Flow>> map_chain_to_flow_;
 
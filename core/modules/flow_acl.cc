@@ -67,7 +67,7 @@ void FlowACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     bool emitted = false;
 
     if (false && bess::ctrl::exp_id < 3) { // Ironside
-      FlowState *state = bess::ctrl::nfv_cores[0]->GetFlowState(pkt);
+      FlowState *state = bess::ctrl::GetNFVRuntime(0)->cores[0].nfv_core->GetFlowState(pkt);
       if (now >= state->acl.ExpiryTime()) {
         state->acl.pkt_cnt_ = 0;
       }
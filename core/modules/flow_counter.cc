@@ -64,7 +64,7 @@ void FlowCounter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     uint64_t now = ctx->current_ns;
 
     if (false && bess::ctrl::exp_id < 3) { // Ironside
-      FlowState *state = bess::ctrl::nfv_cores[0]->GetFlowState(pkt);
+      FlowState *state = bess::ctrl::GetNFVRuntime(0)->cores[0].nfv_core->GetFlowState(pkt);
       if (now >= state->monitor.ExpiryTime()) {
         state->monitor.pkt_cnt_ = 0;
       }
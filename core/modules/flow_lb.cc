@@ -58,7 +58,7 @@ void FlowLB::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     be32_t next_endpoint;
 
     if (false && bess::ctrl::exp_id < 3) { // Ironside
-      FlowState *state = bess::ctrl::nfv_cores[0]->GetFlowState(pkt);
+      FlowState *state = bess::ctrl::GetNFVRuntime(0)->cores[0].nfv_core->GetFlowState(pkt);
       if (now >= state->lb.ExpiryTime()) {
         state->lb.pkt_cnt_ = 0;
       }
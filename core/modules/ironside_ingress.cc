@@ -1,6 +1,10 @@
 #include "nfv_ctrl_msg.h"
 #include "ironside_ingress.h"
 
+#include <rte_hash_crc.h>
+
+#include <utility>
+
 #include "../utils/checksum.h"
 #include "../utils/ether.h"
 #include "../utils/ip.h"
@@ -15,7 +19,6 @@ CommandResponse IronsideIngress::Init(const bess::pb::IronsideIngressArg &arg) {
   bess::ctrl::exp_id = 0;
 
   // Init
-  flow_cache_.clear();
   ips_.clear();
   macs_.clear();
   pkt_cnts_.clear();
@@ -34,8 +37,11 @@ CommandResponse IronsideIngress::Init(const bess::pb::IronsideIngressArg &arg) {
     mode_ = arg.mode();
   }
 
+  endpoint_keys_.clear();
   for (const auto &host : arg.endpoints()) {
     macs_.push_back(Ethernet::Address(host.mac()));
+    endpoint_keys_.push_back(
+        rte_hash_crc(macs_.back().bytes, Ethernet::Address::kSize, 0));
 
     be32_t addr;
     auto host_addr = host.ip();
@@ -56,21 +62,78 @@ CommandResponse IronsideIngress::Init(const bess::pb::IronsideIngressArg &arg) {
     pkt_rate_thresh_ = (uint32_t)arg.pkt_rate_thresh();
   }
 
+  load_bound_ = 1.25;
+  if (arg.load_bound() > 1.0) {
+    load_bound_ = arg.load_bound();
+  }
+  endpoint_weights_.assign(macs_.size(), 0);
+  endpoint_weight_sum_ = 0;
+  maglev_.Build(endpoint_keys_, endpoint_weights_);
+  requested_weights_ = endpoint_weights_;
+
+  flow_timeout_ns_ = arg.flow_timeout_ns();
+  flow_cache_.Clear();
+  flow_cache_.set_timeout_ns(flow_timeout_ns_);
+
   // Init
   last_endpoint_update_ts_ = tsc_to_ns(rdtsc()) - 1000000000;
   for (size_t i = 0; i < pkt_cnts_.size(); i++) {
     pkt_cnts_[i] = 0;
   }
+  period_pkt_cnt_ = 0;
 
   for (uint32_t i = 0; i < macs_.size(); i++) {
     LOG(INFO) << "worker " << i << ": " << macs_[i].ToString() << ", " << ips_[i].value();
   }
   LOG(INFO) << "mode: " << mode_ << "; ncore thresh=" << ncore_thresh_ << "; rate thresh=" << pkt_rate_thresh_;
+
+  if (mode_ == 4) {
+    weights_pending_ = false;
+    next_maglev_ready_ = false;
+    stop_builder_ = false;
+    maglev_builder_ = std::thread([this]() { RunMaglevBuilder(); });
+  }
   return CommandSuccess();
 }
 
 void IronsideIngress::DeInit() {
-  flow_cache_.clear();
+  StopMaglevBuilder();
+  flow_cache_.Clear();
+}
+
+void IronsideIngress::RunMaglevBuilder() {
+  std::unique_lock<std::mutex> lock(maglev_mu_);
+  for (;;) {
+    maglev_cv_.wait(lock, [this]() { return weights_pending_ || stop_builder_; });
+    if (stop_builder_) {
+      return;
+    }
+    std::vector<uint32_t> weights;
+    weights.swap(pending_weights_);
+    weights_pending_ = false;
+
+    // |endpoint_keys_| does not change after Init
+    lock.unlock();
+    MaglevTable table;
+    table.Build(endpoint_keys_, weights);
+    lock.lock();
+
+    // Replaces a table that the datapath has not picked up yet
+    next_maglev_ = std::move(table);
+    next_weights_.swap(weights);
+    next_maglev_ready_ = true;
+  }
+}
+
+void IronsideIngress::StopMaglevBuilder() {
+  {
+    std::lock_guard<std::mutex> lock(maglev_mu_);
+    stop_builder_ = true;
+  }
+  maglev_cv_.notify_one();
+  if (maglev_builder_.joinable()) {
+    maglev_builder_.join();
+  }
 }
 
 void IronsideIngress::UpdateEndpointLB() {
@@ -148,6 +211,48 @@ void IronsideIngress::UpdateEndpointLB() {
       }
     }
     bess::ctrl::nfvctrl_worker_mu.unlock_shared();
+  } else if (mode_ == 4) { // consistent hashing
+    // A worker's weight is its # of idle cores; overloaded workers leave
+    // the table, so that only their share of flow aggregates is remapped
+    std::vector<uint32_t> weights(ips_.size(), 0);
+
+    bess::ctrl::nfvctrl_worker_mu.lock_shared();
+    for (size_t i = 0; i < ips_.size(); i++) {
+      if (bess::ctrl::worker_ncore[i] > ncore_thresh_) {
+        continue;
+      }
+      if (bess::ctrl::worker_packet_rate[i] > pkt_rate_thresh_) {
+        continue;
+      }
+      weights[i] = ncore_thresh_ - bess::ctrl::worker_ncore[i] + 1;
+    }
+    bess::ctrl::nfvctrl_worker_mu.unlock_shared();
+
+    if (weights != requested_weights_) {
+      requested_weights_ = weights;
+      {
+        std::lock_guard<std::mutex> lock(maglev_mu_);
+        pending_weights_.swap(weights);
+        weights_pending_ = true;
+      }
+      maglev_cv_.notify_one();
+    }
+
+    // Swapping only at a period boundary keeps each period's load bounds
+    // (see SelectEndpoint) consistent with the table in use
+    {
+      std::lock_guard<std::mutex> lock(maglev_mu_);
+      if (next_maglev_ready_) {
+        std::swap(maglev_, next_maglev_);
+        endpoint_weights_.swap(next_weights_);
+        next_maglev_ready_ = false;
+        endpoint_weight_sum_ = 0;
+        for (uint32_t w : endpoint_weights_) {
+          endpoint_weight_sum_ += w;
+        }
+      }
+    }
+    endpoint_id_ = maglev_.empty() ? -1 : 0;
   }
 
   // Debug log
@@ -157,11 +262,30 @@ void IronsideIngress::UpdateEndpointLB() {
   for (size_t i = 0; i < pkt_cnts_.size(); i++) {
     pkt_cnts_[i] = 0;
   }
+  period_pkt_cnt_ = 0;
+}
+
+int IronsideIngress::SelectEndpoint(uint64_t flow_id) {
+  // A worker's bound is |load_bound_| x its weighted share of this period's
+  // packets (+1, so that an idle cluster takes the first aggregate)
+  double per_weight_bound =
+      load_bound_ * (period_pkt_cnt_ + 1) / endpoint_weight_sum_;
+  uint16_t worker = maglev_.LookupBounded(
+      rte_hash_crc_8byte(flow_id, 0), [&](uint16_t w) {
+        return pkt_cnts_[w] > per_weight_bound * endpoint_weights_[w];
+      });
+  return worker == MaglevTable::kNoBackend ? -1 : worker;
 }
 
 void IronsideIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   UpdateEndpointLB();
 
+  uint64_t now_ns = tsc_to_ns(rdtsc());
+  if (flow_timeout_ns_ > 0) {
+    // Evicts idle flow aggregates a few groups at a time
+    flow_cache_.Expire(now_ns, 4);
+  }
+
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     bess::Packet *pkt = batch->pkts()[i];
@@ -181,20 +305,21 @@ void IronsideIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     uint64_t flow_id = (ip->src.value() & 0x0fff000) + (ip->dst.value() & 0x0fff);
 
     int dst_worker = 0;
-    auto it = flow_cache_.find(flow_id);
-    if (it == flow_cache_.end()) {
+    FlowTable<uint64_t, int>::Entry *e = flow_cache_.Lookup(flow_id, now_ns);
+    if (e == nullptr) {
       if (endpoint_id_ == -1) {
         DropPacket(ctx, pkt);
         continue;
       }
       // This is a new flow.
-      flow_cache_.emplace(flow_id, endpoint_id_);
-      dst_worker = endpoint_id_;
+      dst_worker = (mode_ == 4) ? SelectEndpoint(flow_id) : endpoint_id_;
+      flow_cache_.Emplace(flow_id, now_ns, dst_worker);
     } else {
-      dst_worker = it->second;
+      dst_worker = e->value;
     }
 
     pkt_cnts_[dst_worker] += 1;
+    period_pkt_cnt_ += 1;
     // Update Ether dst, IP dst, checksum, and TCP checksum
     eth->dst_addr = macs_[dst_worker];
     // be32_t before = ip->dst;
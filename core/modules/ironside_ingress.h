@@ -1,12 +1,16 @@
 #ifndef BESS_MODULES_IRONSIDE_INGRESS_H_
 #define BESS_MODULES_IRONSIDE_INGRESS_H_
 
-#include <map>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/flow.h"
+#include "../utils/flow_table.h"
+#include "../utils/maglev.h"
 #include "../utils/ip.h"
 
 using bess::utils::Ethernet;
@@ -16,6 +20,8 @@ using bess::utils::be16_t;
 using bess::utils::be32_t;
 using bess::utils::Flow;
 using bess::utils::FlowHash;
+using bess::utils::FlowTable;
+using bess::utils::MaglevTable;
 
 class IronsideIngress final : public Module {
  public:
@@ -28,6 +34,14 @@ class IronsideIngress final : public Module {
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
  private:
+  // Mode 4: picks the worker of a new flow aggregate from |maglev_|,
+  // skipping workers whose load in this period exceeds their bound.
+  int SelectEndpoint(uint64_t flow_id);
+
+  // The body of |maglev_builder_|
+  void RunMaglevBuilder();
+  void StopMaglevBuilder();
+
   int rewrite_ = 0;
   be32_t ip_mask_;
   be16_t tcp_port_mask_;
@@ -46,8 +60,32 @@ class IronsideIngress final : public Module {
   int endpoint_id_ = 0;
   uint64_t last_endpoint_update_ts_ = 0;
 
+  // Consistent hashing (mode 4)
+  MaglevTable maglev_;
+  std::vector<uint64_t> endpoint_keys_;     // stable IDs (from MACs)
+  std::vector<uint32_t> endpoint_weights_;  // # of idle cores (+1)
+  uint32_t endpoint_weight_sum_ = 0;
+  uint64_t period_pkt_cnt_ = 0;             // sum of |pkt_cnts_|
+  double load_bound_ = 1.25;
+
+  // Building a Maglev table takes far too long for the datapath, so a
+  // helper thread builds the latest requested weights into |next_maglev_|.
+  // UpdateEndpointLB() swaps it (and its weights) in at a period boundary.
+  std::thread maglev_builder_;
+  std::mutex maglev_mu_;
+  std::condition_variable maglev_cv_;
+  std::vector<uint32_t> requested_weights_;  // datapath only
+  std::vector<uint32_t> pending_weights_;
+  bool weights_pending_ = false;
+  bool stop_builder_ = false;
+  MaglevTable next_maglev_;
+  std::vector<uint32_t> next_weights_;
+  bool next_maglev_ready_ = false;
+
   // Per-flow-aggregate connection table
-  std::map<uint64_t, int> flow_cache_;
+  FlowTable<uint64_t, int> flow_cache_;
+  // Idle timeout (in ns) for |flow_cache_| entries; 0 means never
+  uint64_t flow_timeout_ns_ = 0;
 };
 
 #endif  // BESS_MODULES_IRONSIDE_INGRESS_H_
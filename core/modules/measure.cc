@@ -97,8 +97,8 @@ void Measure::IsCoreInfo(bess::Packet *pkt) {
 
   uint64_t max_delay = 0;
   bess::utils::GetUint64(pkt, WorkerDelayTsTagOffset, &max_delay);
-  if (bess::ctrl::pc_max_batch_delay[core_id] < max_delay) {
-    bess::ctrl::pc_max_batch_delay[core_id] = max_delay;
+  if (bess::ctrl::pc_max_batch_delay[core_id].value < max_delay) {
+    bess::ctrl::pc_max_batch_delay[core_id].value = max_delay;
   }
 }
 
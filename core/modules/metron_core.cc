@@ -10,7 +10,7 @@ const Commands MetronCore::cmds = {
 
 CommandResponse MetronCore::CommandGetCoreTime(const bess::pb::EmptyArg &) {
   uint64_t sum = 0;
-  for (int i = 0; i < bess::ctrl::ncore; i++) {
+  for (int i = 0; i < bess::ctrl::metron_ncore; i++) {
     if (bess::ctrl::metron_cores[i] != nullptr) {
       sum += bess::ctrl::metron_cores[i]->GetSumCoreTime();
     }
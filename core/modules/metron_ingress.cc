@@ -72,6 +72,22 @@ CommandResponse MetronIngress::Init(const bess::pb::MetronIngressArg& arg) {
     bess::utils::slo_ns = arg.slo_ns();
   }
 
+  hw_port_ = nullptr;
+  if (!arg.port().empty()) {
+    if (mode_ != 0) {
+      return CommandFailure(EINVAL, "Hardware steering requires mode 0");
+    }
+    const auto &it = PortBuilder::all_ports().find(arg.port());
+    if (it == PortBuilder::all_ports().end()) {
+      return CommandFailure(ENODEV, "Port %s not found", arg.port().c_str());
+    }
+    if (it->second->port_builder()->class_name() != "PMDPort") {
+      return CommandFailure(EINVAL, "Port %s is not a PMDPort",
+                            arg.port().c_str());
+    }
+    hw_port_ = static_cast<PMDPort *>(it->second);
+  }
+
   /// Init
   // Metron
   flow_aggregates_.emplace_back(FlowAggregate());
@@ -85,7 +101,7 @@ CommandResponse MetronIngress::Init(const bess::pb::MetronIngressArg& arg) {
   rte_atomic16_set(&selected_core_id_, 0);
 
   // Common
-  flow_cache_.clear();
+  flow_cache_.Clear();
 
   for (uint8_t i = 0; i < MaxCoreCount; i++) {
     quadrant_per_core_flow_ids_[i].clear();
@@ -98,12 +114,25 @@ CommandResponse MetronIngress::Init(const bess::pb::MetronIngressArg& arg) {
   lb_stage_ = 0;
   last_update_ts_ = tsc_to_ns(rdtsc());
 
+  if (hw_port_ != nullptr) {
+    rules_pending_ = false;
+    stop_installer_ = false;
+    rule_installer_ = std::thread([this]() { RunRuleInstaller(); });
+    InstallAggregateRules();
+  }
+
   LOG(INFO) << "metron ingress: pkt thresh " << pkt_rate_thresh_ << ", slo " << bess::utils::slo_ns;
 
   return CommandSuccess();
 }
 
 void MetronIngress::DeInit() {
+  if (hw_port_ != nullptr) {
+    StopRuleInstaller();
+    hw_port_->ClearAggregateFlows();
+    hw_port_ = nullptr;
+  }
+
   flow_aggregates_.clear();
   flow_to_core_.clear();
 
@@ -125,6 +154,60 @@ void MetronIngress::DeInit() {
   }
 }
 
+void MetronIngress::InstallAggregateRules() {
+  // Aggregates are split in halves, so each one is an aligned power-of-two
+  // range of flow IDs, i.e., a prefix of the dst IP's lowest byte.
+  std::vector<PMDPort::AggregateRule> rules;
+  for (const FlowAggregate &agg : flow_aggregates_) {
+    PMDPort::AggregateRule rule;
+    rule.prefix = agg.start;
+    rule.mask = ~(agg.length - 1) & 0xff;
+    rule.mark = agg.core;
+    rules.push_back(rule);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(rule_mu_);
+    pending_rules_.swap(rules);
+    rules_pending_ = true;
+  }
+  rule_cv_.notify_one();
+}
+
+void MetronIngress::RunRuleInstaller() {
+  std::unique_lock<std::mutex> lock(rule_mu_);
+  for (;;) {
+    rule_cv_.wait(lock, [this]() { return rules_pending_ || stop_installer_; });
+    if (stop_installer_) {
+      return;
+    }
+    std::vector<PMDPort::AggregateRule> rules;
+    rules.swap(pending_rules_);
+    rules_pending_ = false;
+
+    // The datapath may publish a newer rule set in the meantime
+    lock.unlock();
+    int ret = hw_port_->UpdateAggregateFlows(rules);
+    if (ret != 0) {
+      // |flow_id_to_core_| is still up to date for unmarked packets
+      LOG(WARNING) << "Failed to install " << rules.size()
+                   << " flow aggregate rules: " << rte_strerror(-ret);
+    }
+    lock.lock();
+  }
+}
+
+void MetronIngress::StopRuleInstaller() {
+  {
+    std::lock_guard<std::mutex> lock(rule_mu_);
+    stop_installer_ = true;
+  }
+  rule_cv_.notify_one();
+  if (rule_installer_.joinable()) {
+    rule_installer_.join();
+  }
+}
+
 uint8_t MetronIngress::GetFreeCore() {
   for (uint8_t i = 0; i < MaxCoreCount; i++) {
     if (!in_use_cores_[i]) {
@@ -157,7 +240,9 @@ void MetronIngress::MetronProcessOverloads() {
   }
 
   if (lb_stage_ == 1) {
-    if (time_diff_ms < MetronLoadBalancePeriodMs + HardwareRuleDelayMs) {
+    // With hardware steering, rules are handed to |rule_installer_| below
+    uint64_t rule_delay_ms = (hw_port_ != nullptr) ? 0 : HardwareRuleDelayMs;
+    if (time_diff_ms < MetronLoadBalancePeriodMs + rule_delay_ms) {
       return;
     }
 
@@ -212,6 +297,10 @@ void MetronIngress::MetronProcessOverloads() {
                 << "[" << new_left << ", " << right << "]";
     }
 
+    if (hw_port_ != nullptr) {
+      InstallAggregateRules();
+    }
+
     // Debug info
     LOG(INFO) << "total " << flow_aggregates_.size() << " flow aggregates";
 
@@ -246,25 +335,25 @@ void MetronIngress::QuadrantProcessOverloads() {
     bess::ctrl::sys_measure->QuadrantPauseUpdates();
     uint64_t max_delay = 0;
     for (uint8_t i = 0; i < MaxCoreCount; i++) {
-      if (bess::ctrl::pc_max_batch_delay[i] > (uint64_t)bess::utils::slo_ns) {
+      if (bess::ctrl::pc_max_batch_delay[i].value > (uint64_t)bess::utils::slo_ns) {
         if (in_use_cores_[i]) {
           is_overloaded_cores_[i] = true;
-          LOG(INFO) << "core " << (int)i << " overloaded. delay: " << bess::ctrl::pc_max_batch_delay[i];
+          LOG(INFO) << "core " << (int)i << " overloaded. delay: " << bess::ctrl::pc_max_batch_delay[i].value;
         } else {
-          LOG(INFO) << "core " << (int)i << " is strange. delay: " << bess::ctrl::pc_max_batch_delay[i];
+          LOG(INFO) << "core " << (int)i << " is strange. delay: " << bess::ctrl::pc_max_batch_delay[i].value;
         }
-      } else if (bess::ctrl::pc_max_batch_delay[i] < (uint64_t)bess::utils::slo_ns * 50 / 100) {
+      } else if (bess::ctrl::pc_max_batch_delay[i].value < (uint64_t)bess::utils::slo_ns * 50 / 100) {
         // pick the core with the highest load among all non-overloaded cores
         if (max_delay == 0) {
           max_delay = 1;
           selected_core = i;
-        } else if (max_delay < bess::ctrl::pc_max_batch_delay[i]) {
-          max_delay = bess::ctrl::pc_max_batch_delay[i];
+        } else if (max_delay < bess::ctrl::pc_max_batch_delay[i].value) {
+          max_delay = bess::ctrl::pc_max_batch_delay[i].value;
           selected_core = i;
         }
       }
       // reset
-      bess::ctrl::pc_max_batch_delay[i] = 0;
+      bess::ctrl::pc_max_batch_delay[i].value = 0;
     }
     bess::ctrl::sys_measure->QuadrantUnpauseUpdates();
 
@@ -305,7 +394,10 @@ void MetronIngress::QuadrantProcessOverloads() {
       for (auto flow_id : to_move_flows) {
         quadrant_per_core_flow_ids_[org_core].erase(flow_id);
         quadrant_per_core_flow_ids_[new_core].emplace(flow_id);
-        flow_cache_[flow_id].encode_ = new_core;
+        FlowTable<uint32_t, FlowRecord>::Entry *e = flow_cache_.Find(flow_id);
+        if (e != nullptr) {
+          e->value.encode_ = new_core;
+        }
       }
 
       // Set core states
@@ -375,7 +467,13 @@ void MetronIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     if (mode_ == 0) {
       // |flow_id|: [0, 255]
       uint32_t flow_id = ip->dst.value() & 0xff;
-      encode = flow_id_to_core_[flow_id];
+      rte_mbuf *mbuf = reinterpret_cast<rte_mbuf *>(pkt);
+      if (hw_port_ != nullptr && (mbuf->ol_flags & PKT_RX_FDIR_ID)) {
+        // Steered by the NIC
+        encode = mbuf->hash.fdir.hi;
+      } else {
+        encode = flow_id_to_core_[flow_id];
+      }
       dst_worker = (encode / MaxPerWorkerCoreCount) % MaxWorkerCount;
       // dst_core = encode % MaxPerWorkerCoreCount;
 
@@ -385,19 +483,17 @@ void MetronIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     } else if (mode_ == 1) {
       // Quadrant
       uint32_t flow_id = (ip->src.value() & 0xffff0000) + (ip->dst.value() & 0x0000ffff);
-      auto it = flow_cache_.find(flow_id);
-      if (it == flow_cache_.end()) {
+      auto ret = flow_cache_.Emplace(flow_id, 0);
+      FlowRecord &record = ret.first->value;
+      if (ret.second) {
         encode = selected_core;
         // This is a new flow
-        flow_cache_.emplace(std::piecewise_construct,
-                            std::forward_as_tuple(flow_id),
-                            std::forward_as_tuple());
-        flow_cache_[flow_id].encode_ = selected_core;
-        flow_cache_[flow_id].pkt_cnt_ += 1;
+        record.encode_ = selected_core;
+        record.pkt_cnt_ += 1;
         quadrant_per_core_flow_ids_[selected_core].emplace(flow_id);
       } else {
-        encode = it->second.encode_;
-        it->second.pkt_cnt_ += 1;
+        encode = record.encode_;
+        record.pkt_cnt_ += 1;
       }
       dst_worker = (encode / MaxPerWorkerCoreCount) % MaxWorkerCount;
       // dst_core = encode % MaxPerWorkerCoreCount;
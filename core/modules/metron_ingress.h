@@ -1,13 +1,18 @@
 #ifndef BESS_MODULES_METRON_INGRESS_H_
 #define BESS_MODULES_METRON_INGRESS_H_
 
+#include "../drivers/pmd.h"
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/checksum.h"
 #include "../utils/flow.h"
+#include "../utils/flow_table.h"
 #include "../utils/ip.h"
 
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #define MaxWorkerCount 3
@@ -26,6 +31,7 @@ using bess::utils::be32_t;
 using bess::utils::Flow;
 using bess::utils::FlowHash;
 using bess::utils::FlowRecord;
+using bess::utils::FlowTable;
 
 class MetronIngress final : public Module {
  public:
@@ -63,6 +69,9 @@ class MetronIngress final : public Module {
   void DeInit() override;
 
   void MetronProcessOverloads();
+  // Mirrors |flow_aggregates_| into |hw_port_|'s flow table. Only builds the
+  // rules; |rule_installer_| makes the (slow) rte_flow calls
+  void InstallAggregateRules();
   void QuadrantProcessOverloads();
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
@@ -70,6 +79,10 @@ class MetronIngress final : public Module {
  private:
   uint8_t GetFreeCore();
 
+  // The body of |rule_installer_|
+  void RunRuleInstaller();
+  void StopRuleInstaller();
+
   // 0: Metron; 1: Quadrant
   int mode_;
 
@@ -96,10 +109,21 @@ class MetronIngress final : public Module {
   // Per-flow-aggregate connection table
   // [0, 255] -> cpu core index
   uint8_t flow_id_to_core_[256];
+  // If set, the NIC marks each packet with its aggregate's core index
+  PMDPort *hw_port_ = nullptr;
+  // Creating and destroying rte_flow rules takes milliseconds of NIC
+  // firmware calls, so a helper thread installs the latest rule set
+  // published by the datapath. Rule sets that are overtaken are skipped.
+  std::thread rule_installer_;
+  std::mutex rule_mu_;
+  std::condition_variable rule_cv_;
+  std::vector<PMDPort::AggregateRule> pending_rules_;
+  bool rules_pending_ = false;
+  bool stop_installer_ = false;
   std::map<uint32_t, uint8_t> flow_to_core_;
 
   // Quadrant
-  std::map<uint32_t, FlowRecord> flow_cache_;
+  FlowTable<uint32_t, FlowRecord> flow_cache_;
   std::set<uint32_t> quadrant_per_core_flow_ids_[MaxCoreCount];
 
   // Common
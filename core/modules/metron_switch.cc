@@ -13,7 +13,7 @@ CommandResponse MetronSwitch::Init(const bess::pb::MetronSwitchArg& arg) {
   num_cores_ = 1;
   if (arg.ncore() > 0) {
     num_cores_ = int(arg.ncore());
-    bess::ctrl::ncore = num_cores_;
+    bess::ctrl::metron_ncore = num_cores_;
   }
 
   for (int i = 0; i < num_cores_; i++) {
@@ -21,7 +21,7 @@ CommandResponse MetronSwitch::Init(const bess::pb::MetronSwitchArg& arg) {
       (std::aligned_alloc(alignof(bess::PacketBatch), sizeof(bess::PacketBatch)));
   }
 
-  LOG(INFO) << "total normal cores " << bess::ctrl::ncore;
+  LOG(INFO) << "total normal cores " << bess::ctrl::metron_ncore;
 
   return CommandSuccess();
 }
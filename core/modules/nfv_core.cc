@@ -5,6 +5,9 @@
 
 #include <bitset>
 #include <fstream>
+#include <set>
+
+#include <rte_malloc.h>
 
 #include "../drivers/pmd.h"
 #include "../utils/format.h"
@@ -16,15 +19,21 @@ const Commands NFVCore::cmds = {
      Command::THREAD_SAFE},
     {"get_core_time", "EmptyArg", MODULE_CMD_FUNC(&NFVCore::CommandGetCoreTime),
      Command::THREAD_SAFE},
+    {"get_summary", "EmptyArg", MODULE_CMD_FUNC(&NFVCore::CommandGetSummary),
+     Command::THREAD_SAFE},
 };
 
 // NFVCore member functions
+// Compares the per-batch enqueue / dequeue cost of llring (mp and sp) and
+// BatchRing (copy from a PacketBatch and in-place reservation).
 void NFVCore::EnqueueDequeueBatchBenchmark() {
   int bytes = llring_bytes_with_slots(32768);
   llring* testq = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-  int ret = llring_init(testq, 32768, 1, 1);
-  if (ret) {
+  int ret = llring_init(testq, 32768, 0, 1);
+  BatchRing* test_ring = BatchRing::Create(32768, true);
+  if (ret || test_ring == nullptr) {
     std::free(testq);
+    BatchRing::Destroy(test_ring);
     return;
   }
 
@@ -38,37 +47,121 @@ void NFVCore::EnqueueDequeueBatchBenchmark() {
     }
   }
 
-  uint64_t start = rdtsc();
-  for (uint64_t i = 0; i < 100; i++) {
-    SpEnqueue(batch[i], testq);
+  // llring
+  for (int sp = 0; sp < 2; sp++) {
+    uint64_t start = rdtsc();
+    for (uint64_t i = 0; i < 100; i++) {
+      if (sp) {
+        llring_sp_enqueue_burst(testq, (void **)batch[i]->pkts(), 32);
+      } else {
+        llring_mp_enqueue_burst(testq, (void **)batch[i]->pkts(), 32);
+      }
+    }
+    uint64_t total_time = rdtsc() - start;
+    LOG(INFO) << "llring " << (sp ? "sp" : "mp") << " enqueue cost = " << total_time / 100
+              << " (queue size = " << llring_count(testq) << ")";
+
+    start = rdtsc();
+    for (uint64_t i = 0; i < 100; i++) {
+      int cnt = llring_sc_dequeue_burst(testq, (void **)batch[i]->pkts(), 32);
+      if (cnt == 0) {
+        break;
+      }
+    }
+    total_time = rdtsc() - start;
+    LOG(INFO) << "llring dequeue cost = " << total_time / 100
+              << " (queue size = " << llring_count(testq) << ")";
   }
-  uint64_t total_time = rdtsc() - start;
-  LOG(INFO) << "Test queue size = " << llring_count(testq);
-  LOG(INFO) << "Enqueue cost = " << total_time / 100;
 
-  start = rdtsc();
-  for (uint64_t i = 0; i < 100; i++) {
-    int cnt = llring_sc_dequeue_burst(testq, (void **)batch[i]->pkts(), 32);
-    if (cnt == 0) {
-      break;
+  // BatchRing
+  for (int in_place = 0; in_place < 2; in_place++) {
+    uint64_t start = rdtsc();
+    for (uint64_t i = 0; i < 100; i++) {
+      if (in_place) {
+        // As if packets were added one by one, e.g., by AddLocal()
+        BatchRing::Reservation r;
+        uint32_t cnt = test_ring->Reserve(32, &r);
+        for (uint32_t j = 0; j < cnt; j++) {
+          r[j] = batch[i]->pkts()[j];
+        }
+        test_ring->Commit(&r, cnt);
+      } else {
+        test_ring->EnqueueBurst((void **)batch[i]->pkts(), 32);
+      }
     }
+    uint64_t total_time = rdtsc() - start;
+    LOG(INFO) << "BatchRing " << (in_place ? "in-place" : "copy") << " enqueue cost = "
+              << total_time / 100 << " (queue size = " << test_ring->Count() << ")";
+
+    start = rdtsc();
+    for (uint64_t i = 0; i < 100; i++) {
+      int cnt = test_ring->DequeueBurst((void **)batch[i]->pkts(), 32);
+      if (cnt == 0) {
+        break;
+      }
+    }
+    total_time = rdtsc() - start;
+    LOG(INFO) << "BatchRing dequeue cost = " << total_time / 100
+              << " (queue size = " << test_ring->Count() << ")";
   }
-  total_time = rdtsc() - start;
-  LOG(INFO) << "Test queue size = " << llring_count(testq);
-  LOG(INFO) << "Dequeue cost = " << total_time / 100;
 
   // Clean up
   for (uint64_t i = 0; i < 100; i++) {
     bess::ctrl::FreePacketBatch(batch[i]);
   }
+  std::free(testq);
+  BatchRing::Destroy(test_ring);
+}
+
+// Compares the per-packet "is this sw_q active?" check and the per-batch
+// walk over active sw_qs with a std::set and with |SwQBitmap|.
+void NFVCore::SwQLookupBenchmark() {
+  const int kActive = 8;
+  const uint64_t kRounds = 100000;
+  SoftwareQueueState* lookups[32];
+
+  std::set<SoftwareQueueState*> q_set;
+  SwQBitmap q_bitmap;
+  for (int i = 0; i < kActive; i++) {
+    int qid = i * (DEFAULT_SWQ_COUNT / kActive);
+    q_set.emplace(rt_->sw_q_state[qid]);
+    q_bitmap.Set(qid);
+  }
+  for (int i = 0; i < 32; i++) {
+    lookups[i] = rt_->sw_q_state[(i * 7) % DEFAULT_SWQ_COUNT];
+  }
+
+  uint64_t hits = 0;
+  uint64_t start = rdtsc();
+  for (uint64_t r = 0; r < kRounds; r++) {
+    for (int i = 0; i < 32; i++) {
+      hits += (q_set.find(lookups[i]) != q_set.end());
+    }
+    for (auto& q : q_set) {
+      hits += q->sw_q_id;
+    }
+  }
+  uint64_t total_time = rdtsc() - start;
+  LOG(INFO) << "std::set sw_q cost per batch = " << total_time / kRounds << " (" << hits << ")";
+
+  hits = 0;
+  start = rdtsc();
+  for (uint64_t r = 0; r < kRounds; r++) {
+    for (int i = 0; i < 32; i++) {
+      hits += q_bitmap.Test(lookups[i]->sw_q_id);
+    }
+    for (int qid = q_bitmap.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+         qid = q_bitmap.NextSet(qid + 1)) {
+      hits += rt_->sw_q_state[qid]->sw_q_id;
+    }
+  }
+  total_time = rdtsc() - start;
+  LOG(INFO) << "Bitmap sw_q cost per batch = " << total_time / kRounds << " (" << hits << ")";
 }
 
 void NFVCore::ShortEpochProcessBenchmark() {
-  int bytes = llring_bytes_with_slots(4096);
-  llring* testq = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-  int ret = llring_init(testq, 4096, 1, 1);
-  if (ret) {
-    std::free(testq);
+  BatchRing* testq = BatchRing::Create(4096, true);
+  if (testq == nullptr) {
     return;
   }
 
@@ -80,20 +173,20 @@ void NFVCore::ShortEpochProcessBenchmark() {
       if (!pkt) { return; }
       batch->add(pkt);
     }
-    SpEnqueue(batch, testq);
+    Enqueue(batch, testq);
   }
 
-  LOG(INFO) << "testq size = " << llring_count(testq);
+  LOG(INFO) << "testq size = " << testq->Count();
 
   uint64_t start = rdtsc();
 
   int total_swq = 3;
-  uint32_t total_cnt = llring_count(testq);
+  uint32_t total_cnt = testq->Count();
   uint32_t curr_cnt = 0;
   // scan all packets only once
   while (curr_cnt < total_cnt) {
     batch->clear();
-    int cnt = llring_sc_dequeue_burst(testq, (void **)batch->pkts(), 32);
+    int cnt = testq->DequeueBurst((void **)batch->pkts(), 32);
     batch->set_cnt(cnt);
 
     for (int i = 0; i < cnt; i++) {
@@ -105,10 +198,10 @@ void NFVCore::ShortEpochProcessBenchmark() {
         continue;
       }
       int q_idx = i % total_swq;
-      bess::ctrl::sw_q_state[q_idx]->sw_batch->add(pkt);
+      rt_->sw_q_state[q_idx]->sw_batch->add(pkt);
     }
     for (int i = 0; i < total_swq; i++) {
-      MpEnqueue(bess::ctrl::sw_q_state[i]->sw_batch, bess::ctrl::sw_q[i]);
+      Enqueue(rt_->sw_q_state[i]->sw_batch, rt_->sw_q[i]);
     }
     curr_cnt += cnt;
   }
@@ -121,11 +214,42 @@ FlowState* NFVCore::GetFlowState(bess::Packet* pkt) {
   return *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt));
 }
 
+uint32_t NFVCore::CountReordered(bess::PacketBatch *batch) {
+  uint32_t reordered = 0;
+  int cnt = batch->cnt();
+  for (int i = 0; i < cnt; i++) {
+    bess::Packet *pkt = batch->pkts()[i];
+    FlowState *state = GetFlowState(pkt);
+    uint32_t seq = reinterpret_cast<rte_mbuf*>(pkt)->seqn;
+    // Gaps (i.e., drops) are fine
+    if ((int32_t)(seq - state->processed_seq) < 0) {
+      reordered += 1;
+    } else {
+      state->processed_seq = seq;
+    }
+  }
+  return reordered;
+}
+
+void NFVCore::ResetFlowStates() {
+  flow_state_pool_.Reset();
+  flow_state_sweep_idx_ = 0;
+
+  // Size the table up front so that it never expands on the RX path
+  uint32_t max_flow_count = flow_state_pool_.Capacity();
+  per_flow_states_ = HashTable(align_ceil_pow2(max_flow_count / 2 + 1), max_flow_count);
+}
+
 CommandResponse NFVCore::Init(const bess::pb::NFVCoreArg &arg) {
   const char *port_name;
   task_id_t tid;
   burst_ = bess::PacketBatch::kMaxBurst;
 
+  rt_ = bess::ctrl::GetNFVRuntime(arg.instance());
+  if (rt_ == nullptr) {
+    return CommandFailure(EINVAL, "invalid instance %d", arg.instance());
+  }
+
   // Configure the target CPU core ID
   core_id_ = 0;
   if (arg.core_id() > 0) {
@@ -159,6 +283,41 @@ CommandResponse NFVCore::Init(const bess::pb::NFVCoreArg &arg) {
   max_idle_epoch_count_ = 10;
   LOG(INFO) << "Core " << core_id_ << ": short-term epoch = " << short_epoch_period_ns_ << " ns, max idle epochs = " << max_idle_epoch_count_;
 
+  // Configure the short-term split policy
+  std::string split_policy = arg.split_policy().empty() ? "greedy" : arg.split_policy();
+  split_policy_ = bess::utils::SplitPolicy::Create(split_policy);
+  if (split_policy_ == nullptr) {
+    return CommandFailure(EINVAL, "Unknown split policy '%s'", split_policy.c_str());
+  }
+  LOG(INFO) << "Core " << core_id_ << ": split policy = " << split_policy_->name();
+
+  // Configure the per-core FlowState pool (default: 256K flows, 2 s idle timeout)
+  uint32_t max_flow_count = DEFAULT_FLOW_STATE_COUNT;
+  if (arg.max_flow_count() > 0) {
+    max_flow_count = arg.max_flow_count();
+  }
+  uint64_t flow_idle_timeout_ns = DEFAULT_FLOW_IDLE_TIMEOUT_NS;
+  if (arg.flow_idle_timeout_ns() > 0) {
+    flow_idle_timeout_ns = arg.flow_idle_timeout_ns();
+  }
+  flow_idle_epoch_count_ = std::max<uint64_t>(1, flow_idle_timeout_ns / short_epoch_period_ns_);
+
+  // Allocate from DPDK's (hugepage-backed) heap on the NIC's NUMA node
+  int socket_id = port_ ? rte_eth_dev_socket_id(port_id_) : SOCKET_ID_ANY;
+  size_t pool_bytes = FlowStatePool::BytesWithCapacity(max_flow_count);
+  flow_state_mem_ = rte_zmalloc_socket("nfv_flow_state", pool_bytes,
+                                       FlowStatePool::kAlign, socket_id);
+  if (flow_state_mem_ == nullptr) {
+    return CommandFailure(ENOMEM, "Failed to allocate %zu bytes for %u flow states",
+                          pool_bytes, max_flow_count);
+  }
+  flow_state_pool_.Init(flow_state_mem_, max_flow_count);
+  epoch_flow_cache_.reserve(max_flow_count);
+  unoffload_flows_.reserve(max_flow_count);
+  split_flows_.reserve(max_flow_count);
+  split_queues_.reserve(DEFAULT_SWQ_COUNT);
+  LOG(INFO) << "Core " << core_id_ << ": max flows = " << max_flow_count << ", flow idle epochs = " << flow_idle_epoch_count_;
+
   curr_ts_ns_ = tsc_to_ns(rdtsc());
   last_short_epoch_end_ns_ = curr_ts_ns_;
   curr_epoch_id_ = 0;
@@ -170,13 +329,13 @@ CommandResponse NFVCore::Init(const bess::pb::NFVCoreArg &arg) {
   LOG(INFO) << core_id_ << ": flow state metadata id = " << flow_stats_attr_id_;
 
   // Init
-  bess::ctrl::nfv_cores[core_id_] = this;
+  rt_->cores[core_id_].nfv_core = this;
 
   // Configure software queues
-  local_q_ = bess::ctrl::local_q[core_id_];
-  local_boost_q_ = bess::ctrl::local_boost_q[core_id_];
+  local_q_ = rt_->local_q[core_id_];
+  local_boost_q_ = rt_->local_boost_q[core_id_];
 
-  local_batch_ = bess::ctrl::CreatePacketBatch();
+  local_res_cnt_ = 0;
   local_rboost_batch_ = bess::ctrl::CreatePacketBatch();
   system_dump_batch_ = bess::ctrl::CreatePacketBatch();
   split_enqueue_batch_ = bess::ctrl::CreatePacketBatch();
@@ -184,20 +343,45 @@ CommandResponse NFVCore::Init(const bess::pb::NFVCoreArg &arg) {
     local_sw_batch_[i] = bess::ctrl::CreatePacketBatch();
   }
 
-  rcore_booster_q_state_ = bess::ctrl::rcore_booster_q_state;
-  system_dump_q_state_ = bess::ctrl::system_dump_q_state;
+  rcore_booster_q_state_ = rt_->rcore_booster_q_state;
+  system_dump_q_state_ = rt_->system_dump_q_state;
+
+  // Held packets of flows in handoff (at most one queue's worth)
+  handoff_q_ = BatchRing::Create(DEFAULT_SWQ_SIZE, true);
+  if (handoff_q_ == nullptr) {
+    return CommandFailure(ENOMEM, "Failed to allocate the handoff queue");
+  }
+  handoff_batch_ = bess::ctrl::CreatePacketBatch();
+  pending_markers_.clear();
+  boost_drain_.Reset();
+  boost_drain_seq_ = 0;
+  boost_q_used_ = false;
+  for (int i = 0; i < DEFAULT_SWQ_COUNT; i++) {
+    sw_q_drain_seq_[i] = 0;
+    sw_q_drain_epochs_[i] = 0;
+  }
+  draining_sw_q_.Clear();
+  boost_drain_epochs_ = 0;
+  forced_drain_count_ = 0;
+  handoff_count_ = 0;
+  held_packet_count_ = 0;
+  reorder_count_ = 0;
 
   // Init epoch thresholds and packet counters
-  if (bess::ctrl::short_flow_count_pkt_threshold.size() > 0) {
+  const bess::utils::NFPerfModel &short_term_model = rt_->short_term_model;
+  if (!short_term_model.empty()) {
     // op 1: exp with different thresh settings
-    epoch_packet_thresh_ = bess::ctrl::short_flow_count_pkt_threshold.begin()->second;
+    uint32_t pkt_size = rt_->nf_profile_pkt_size;
+    uint32_t min_fc_thresh = short_term_model.Get(0, pkt_size);
+    uint32_t max_fc_thresh = short_term_model.Get(short_term_model.max_flow_count(), pkt_size);
+    epoch_packet_thresh_ = min_fc_thresh;
 
-    large_queue_packet_thresh_ = (--bess::ctrl::short_flow_count_pkt_threshold.end())->second * bess::ctrl::rcore / bess::ctrl::ncore;
+    large_queue_packet_thresh_ = max_fc_thresh * rt_->rcore / rt_->ncore;
     if (arg.large_queue_scale() > 0) {
-      large_queue_packet_thresh_ = (--bess::ctrl::short_flow_count_pkt_threshold.end())->second * arg.large_queue_scale();
+      large_queue_packet_thresh_ = max_fc_thresh * arg.large_queue_scale();
     }
 
-    busy_pull_round_thresh_ = (--bess::ctrl::short_flow_count_pkt_threshold.end())->second / 32;
+    busy_pull_round_thresh_ = max_fc_thresh / 32;
     if (busy_pull_round_thresh_ < 1) {
       busy_pull_round_thresh_ = 1;
     }
@@ -216,31 +400,34 @@ CommandResponse NFVCore::Init(const bess::pb::NFVCoreArg &arg) {
   num_epoch_with_large_queue_ = 0;
   epoch_flow_cache_.clear();
   unoffload_flows_.clear();
-  per_flow_states_.Clear(); // CuckooMap
+  ResetFlowStates();
 
   update_bucket_stats_ = false;
   for (int i = 0; i < RETA_SIZE; i++) {
     local_bucket_stats_.per_bucket_packet_counter[i] = 0;
-    local_bucket_stats_.per_bucket_flow_cache[i].clear();
   }
+  local_bucket_stats_.ResetFlowCount();
 
   // Run!
-  rte_atomic16_set(&disabled_, 0);
+  stopped_ = false;
 
   // Benchmark
   // EnqueueDequeueBatchBenchmark();
+  // SwQLookupBenchmark();
   // ShortEpochProcessBenchmark();
 
   return CommandSuccess();
 }
 
 void NFVCore::DeInit() {
-  // Mark to stop the pipeline and wait until the pipeline stops
-  rte_atomic16_set(&disabled_, 1);
-  while (rte_atomic16_read(&disabled_) != 2) { usleep(100000); }
+  // Stop the pipeline and wait until it stops (within one round)
+  if (!bess::ctrl::StopAndWait(this, &mailbox_,
+                               "core " + std::to_string(core_id_))) {
+    stopped_ = true;
+  }
+  rt_->cores[core_id_].nfv_core = nullptr;
 
   // Clean the local batch / queue
-  bess::ctrl::FreePacketBatch(local_batch_);
   bess::ctrl::FreePacketBatch(local_rboost_batch_);
   bess::ctrl::FreePacketBatch(system_dump_batch_);
   bess::ctrl::FreePacketBatch(split_enqueue_batch_);
@@ -248,20 +435,40 @@ void NFVCore::DeInit() {
     bess::ctrl::FreePacketBatch(local_sw_batch_[i]);
   }
 
-  local_batch_ = nullptr;
+  CommandGetSummary(bess::pb::EmptyArg());
+  bess::ctrl::FreePacketBatch(handoff_batch_);
+  handoff_batch_ = nullptr;
+  if (handoff_q_) {
+    bess::Packet *pkt = nullptr;
+    while (handoff_q_->DequeueBurst((void **)&pkt, 1) == 1) {
+      bess::Packet::Free(pkt);
+    }
+    BatchRing::Destroy(handoff_q_);
+    handoff_q_ = nullptr;
+  }
+  pending_markers_.clear();
+
   local_rboost_batch_ = nullptr;
   local_q_ = nullptr;
   local_boost_q_ = nullptr;
 
-  active_sw_q_.clear();
-  terminating_sw_q_.clear();
+  active_sw_q_.Clear();
+  terminating_sw_q_.Clear();
+  draining_sw_q_.Clear();
+
+  epoch_flow_cache_.clear();
+  unoffload_flows_.clear();
+  per_flow_states_.Clear();
+  flow_state_pool_.Reset();
+  rte_free(flow_state_mem_);
+  flow_state_mem_ = nullptr;
 }
 
 CommandResponse NFVCore::CommandGetCoreTime(const bess::pb::EmptyArg &) {
   uint64_t sum = 0;
-  for (int i = 0; i < bess::ctrl::ncore; i++) {
-    if (bess::ctrl::nfv_cores[i] != nullptr) {
-      sum += bess::ctrl::nfv_cores[i]->GetSumCoreTime();
+  for (int i = 0; i < rt_->ncore; i++) {
+    if (rt_->cores[i].nfv_core != nullptr) {
+      sum += rt_->cores[i].nfv_core->GetSumCoreTime();
     }
   }
 
@@ -271,14 +478,17 @@ CommandResponse NFVCore::CommandGetCoreTime(const bess::pb::EmptyArg &) {
 }
 
 CommandResponse NFVCore::CommandClear(const bess::pb::EmptyArg &) {
-  for (auto it = per_flow_states_.begin(); it != per_flow_states_.end(); ++it) {
-    if (it->second != nullptr) {
-      free(it->second);
-      it->second = nullptr;
-    }
-  }
+  epoch_flow_cache_.clear();
+  unoffload_flows_.clear();
+  ResetFlowStates();
+  return CommandSuccess();
+}
 
-  per_flow_states_.Clear();
+CommandResponse NFVCore::CommandGetSummary(const bess::pb::EmptyArg &) {
+  LOG(INFO) << "Core " << core_id_ << ": " << handoff_count_ << " flow handoffs, "
+            << held_packet_count_ << " packets held, " << forced_drain_count_
+            << " markers force-drained, " << reorder_count_
+            << " packets reordered";
   return CommandSuccess();
 }
 
@@ -300,20 +510,20 @@ struct task_result NFVCore::RunTask(Context *ctx, bess::PacketBatch *batch,
   const queue_t qid = (queue_t)(uintptr_t)arg;
   bool epoch_advanced = false;
 
+  // Control messages (e.g., for graceful termination)
+  if (mailbox_.Pending()) {
+    HandleCtrlMsgs();
+  }
+  if (stopped_) {
+    return {.block = false, .packets = 0, .bits = 0};
+  }
+
   // Read the CPU cycle counter for better accuracy
   curr_ts_ns_ = tsc_to_ns(rdtsc());
   if (curr_ts_ns_ - last_short_epoch_end_ns_ > short_epoch_period_ns_) {
     epoch_advanced = true;
   }
 
-  // For graceful termination
-  if (epoch_advanced) {
-    if (rte_atomic16_read(&disabled_) == 1) {
-      rte_atomic16_set(&disabled_, 2);
-      return {.block = false, .packets = 0, .bits = 0};
-    }
-  }
-
   // status: -95 (not supported)
   // int status = rte_eth_rx_descriptor_status(port_id_, qid, large_queue_packet_thresh_);
 
@@ -337,10 +547,18 @@ struct task_result NFVCore::RunTask(Context *ctx, bess::PacketBatch *batch,
     }
   }
 
+  // Flow ownership handoff
+  if (!pending_markers_.empty()) {
+    FlushDrainMarkers();
+  }
+  if (!handoff_q_->Empty()) {
+    ReleaseHeldPackets();
+  }
+
   // Turn on boost mode only for Ironside's runtime
   if (bess::ctrl::exp_id == 0) {
     // Boost if 1) the core has pulled many packets (i.e. 128) in this round; 2) |local_q_| is large.
-    uint32_t queued_pkts = llring_count(local_q_);
+    uint32_t queued_pkts = local_q_->Count();
 
     if (last_boost_ts_ns_ == 0) {
       if (update_bucket_stats_ ||
@@ -354,25 +572,31 @@ struct task_result NFVCore::RunTask(Context *ctx, bess::PacketBatch *batch,
         uint64_t core_diff = tsc_to_ns(rdtsc()) - last_boost_ts_ns_;
         rte_atomic64_add(&sum_core_time_ns_, core_diff);
         last_boost_ts_ns_ = 0;
+        // Resume after the ncore booster drains the boosted packets
+        BoostDrainSeq();
       }
     }
   }
 
   if (update_bucket_stats_) {
     for (int i = 0; i < SHARD_NUM; i++) {
-      bess::ctrl::pcpb_packet_count[core_id_][i] = local_bucket_stats_.per_bucket_packet_counter[i];
-      bess::ctrl::pcpb_flow_count[core_id_][i] = local_bucket_stats_.per_bucket_flow_cache[i].size();
+      rt_->cores[core_id_].pcpb_packet_count[i] = local_bucket_stats_.per_bucket_packet_counter[i];
+      rt_->cores[core_id_].pcpb_flow_count[i] = local_bucket_stats_.FlowCount(i);
       local_bucket_stats_.per_bucket_packet_counter[i] = 0;
-      local_bucket_stats_.per_bucket_flow_cache[i].clear();
     }
-    bess::ctrl::nfv_ctrl->NotifyLongTermStatsReady();
+    local_bucket_stats_.ResetFlowCount();
+    rt_->nfv_ctrl->NotifyLongTermStatsReady(core_id_);
     update_bucket_stats_ = false;
   }
 
   if (last_boost_ts_ns_ == 0) {
-    // Process one batch
+    // Process one batch, unless the ncore booster may still be processing
+    // the same flows
     batch->clear();
-    cnt = llring_sc_dequeue_burst(local_q_, (void **)batch->pkts(), 32);
+    cnt = 0;
+    if (boost_drain_.IsDrained(boost_drain_seq_)) {
+      cnt = local_q_->DequeueBurst((void **)batch->pkts(), 32);
+    }
     if (cnt > 0) {
       batch->set_cnt(cnt);
       // Update |epoch_packet_processed_| and |per_flow_states_|, i.e.
@@ -381,13 +605,21 @@ struct task_result NFVCore::RunTask(Context *ctx, bess::PacketBatch *batch,
       ProcessBatch(ctx, batch);
     }
   } else { // boost!
+    // Move packets from |local_q_| to |local_boost_q_| slot-to-slot.
+    // Packets that do not fit stay in |local_q_|
     for (int i = 0; i < 2; i++) {
-      batch->clear();
-      cnt = llring_sc_dequeue_burst(local_q_, (void **)batch->pkts(), 32);
+      BatchRing::Reservation from;
+      BatchRing::Reservation to;
+      cnt = local_boost_q_->Reserve(local_q_->Peek(32, &from), &to);
+      for (int j = 0; j < cnt; j++) {
+        to[j] = from[j];
+      }
+      local_boost_q_->Commit(&to, cnt);
+      local_q_->Release(cnt);
       if (cnt > 0) {
-        batch->set_cnt(cnt);
-        SpEnqueue(batch, local_boost_q_);
-      } else {
+        boost_q_used_ = true;
+      }
+      if (cnt < 32) {
         break;
       }
     }
@@ -396,13 +628,13 @@ struct task_result NFVCore::RunTask(Context *ctx, bess::PacketBatch *batch,
   if (epoch_advanced) {
     // Get latency summaries to be used by the performance profiler.
     if (bess::ctrl::exp_id == 2 &&
-        bess::ctrl::nfv_monitors[core_id_] != nullptr) {
-      bess::ctrl::nfv_monitors[core_id_]->update_traffic_stats(curr_epoch_id_);
+        rt_->cores[core_id_].nfv_monitor != nullptr) {
+      rt_->cores[core_id_].nfv_monitor->update_traffic_stats(curr_epoch_id_);
     }
     if (bess::ctrl::exp_id == 7) {
-      uint32_t queued_pkts = llring_count(local_q_);
+      uint32_t queued_pkts = local_q_->Count();
       if (queued_pkts >= 512) {
-        bess::ctrl::nfv_ctrl->NotifyCtrlLoadBalanceNow(core_id_);
+        rt_->nfv_ctrl->NotifyCtrlLoadBalanceNow(core_id_);
       }
     }
 
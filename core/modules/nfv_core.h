@@ -6,12 +6,18 @@
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../port.h"
+#include "../utils/bitmap.h"
 #include "../utils/cpu_core.h"
 #include "../utils/cuckoo_map.h"
 #include "../utils/flow.h"
+#include "../utils/slab_pool.h"
+#include "../utils/split_policy.h"
 #include "../utils/sys_measure.h"
 
-#include <set>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
 
 using bess::utils::Flow;
 using bess::utils::FlowHash;
@@ -20,6 +26,7 @@ using bess::utils::CoreStats;
 using bess::utils::BucketStats;
 using bess::ctrl::SoftwareQueueState;
 using bess::ctrl::FlowState;
+using bess::ctrl::DrainMarker;
 
 // Assumption:
 // if |active_flow_count| increases, |packet_count| will decrease
@@ -29,16 +36,22 @@ class NFVCore final : public Module {
  public:
   static const Commands cmds;
 
-  NFVCore() : Module(), burst_(32) {
+  NFVCore() : Module(), burst_(32), rcore_pool_(this) {
+    rt_ = nullptr;
+    port_ = nullptr;
     local_q_ = nullptr;
     local_boost_q_ = nullptr;
+    handoff_q_ = nullptr;
+    flow_state_mem_ = nullptr;
     max_allowed_workers_ = 1;
+    stopped_ = false;
   }
 
   CommandResponse Init(const bess::pb::NFVCoreArg &arg);
   void DeInit() override;
 
   void EnqueueDequeueBatchBenchmark();
+  void SwQLookupBenchmark();
   void ShortEpochProcessBenchmark();
 
   struct task_result RunTask(Context *ctx, bess::PacketBatch *batch, void *arg);
@@ -64,29 +77,31 @@ class NFVCore final : public Module {
   // - Update epoch packet processed, flow processed
   void UpdateStatsPreProcessBatch(bess::PacketBatch *batch);
 
-  // Notify this core to upload per-bucket states
-  void UpdateBucketStats();
+  // Called by NFVCtrl: notify this core to upload per-bucket states.
+  // Returns false if the request cannot be posted
+  bool UpdateBucketStats() {
+    return mailbox_.Post(DEFAULT_NFVCTRL_CORE_ID,
+                         {bess::ctrl::CtrlMsg::kReportStats, 0});
+  }
+
+  // Return FlowStates that have been idle for |flow_idle_epoch_count_| epochs
+  // to |flow_state_pool_|. Each call scans a bounded slice of the pool.
+  void EvictIdleFlows();
 
   // EpochEndProcess:
   // - Scan all packets in |q| and split them to all software queues
-  void SplitQToSwQ(llring* q);
+  void SplitQToSwQ(BatchRing* q);
   // - Split |batch| into |local_queue_| and other software queues
   void SplitAndEnqueue(bess::PacketBatch *batch);
-  // - (sp) Enqueue all packets in |batch| to the software queue |q|
-  inline void SpEnqueue(bess::PacketBatch *batch, llring *q) {
+  // - Enqueue all packets in |batch| to the software queue |q|; drop the
+  // packets that do not fit
+  inline void Enqueue(bess::PacketBatch *batch, BatchRing *q) {
     if (batch->cnt()) {
-      int queued = llring_sp_enqueue_burst(q, (void **)batch->pkts(), batch->cnt());
-      if (queued < 0) {
-        queued = queued & (~RING_QUOT_EXCEED);
-      }
+      int queued = q->EnqueueBurst((void **)batch->pkts(), batch->cnt());
       if (queued < batch->cnt()) {
-        bess::Packet *pkt = nullptr;
-        FlowState *state = nullptr;
         int to_drop = batch->cnt() - queued;
         for (int i = 0; i < to_drop; ++i) {
-          pkt = batch->pkts()[queued + i];
-          state = *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt));
-          state->queued_packet_count -= 1;
+          DropQueuedPacket(batch->pkts()[queued + i], false);
         }
         bess::Packet::Free(batch->pkts() + queued, to_drop);
       }
@@ -94,38 +109,92 @@ class NFVCore final : public Module {
     }
   }
 
-  // - (mp) Enqueue all packets in |batch| to the software queue |q|
-  inline void MpEnqueue(bess::PacketBatch *batch, llring *q) {
-    if (batch->cnt()) {
-      int queued = llring_mp_enqueue_burst(q, (void **)batch->pkts(), batch->cnt());
-      if (queued < 0) {
-        queued = queued & (~RING_QUOT_EXCEED);
-      }
-      if (queued < batch->cnt()) {
-        bess::Packet *pkt = nullptr;
-        FlowState *state = nullptr;
-        int to_drop = batch->cnt() - queued;
-        for (int i = 0; i < to_drop; ++i) {
-          pkt = batch->pkts()[queued + i];
-          state = *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt));
-          state->queued_packet_count -= 1;
-        }
-        bess::Packet::Free(batch->pkts() + queued, to_drop);
-      }
-      batch->clear();
+  // - Fill |local_q_| in place (without staging packets in a batch):
+  // reserve room for up to |n| packets, add them, and then commit
+  inline void BeginLocalEnqueue(uint32_t n) {
+    local_q_->Reserve(n, &local_res_);
+    local_res_cnt_ = 0;
+  }
+  inline void AddLocal(bess::Packet *pkt) {
+    if (local_res_cnt_ < local_res_.cnt) {
+      local_res_[local_res_cnt_++] = pkt;
+    } else {
+      DropQueuedPacket(pkt, true);
+    }
+  }
+  inline void EndLocalEnqueue() {
+    local_q_->Commit(&local_res_, local_res_cnt_);
+  }
+
+  inline void DropQueuedPacket(bess::Packet *pkt, bool free) {
+    FlowState *state = *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt));
+    state->queued_packet_count -= 1;
+    if (free) {
+      bess::Packet::Free(pkt);
     }
   }
 
+  // Flow ownership handoff (see FlowState::handoff):
+  // - Issues a drain marker to |q| behind all packets sent so far, and sets
+  // |seq| to the marker's sequence number. If |q| is full, the marker is
+  // re-tried later if |may_defer| (only for queues that |this| core always
+  // produces to); otherwise, returns false
+  bool IssueDrainMarker(BatchRing *q, DrainMarker *m, bool may_defer, uint32_t *seq);
+  // - Re-tries markers that did not fit into their queues
+  void FlushDrainMarkers();
+  // - Returns the latest marker (issued on demand) in |local_boost_q_|
+  uint32_t BoostDrainSeq();
+  // - Starts to hold |state|'s packets until |m| drains |seq|.
+  // Returns false if it has drained already
+  bool StartHandOff(FlowState *state, DrainMarker *m, uint32_t seq);
+  // - Scans |handoff_q_| once and re-splits packets whose flows' handoff
+  // has completed; the others stay in |handoff_q_| in order
+  void ReleaseHeldPackets();
+  // - Called once per short-term epoch: force-drains the markers whose
+  // consumer is gone, so that held flows and |local_q_| never stall. A live
+  // consumer may still be processing the held flows, so its markers are
+  // only reported if pending for |DRAIN_MARKER_TIMEOUT_EPOCHS| epochs
+  void CheckDrainMarkers();
+  // - Drops all boosted packets and acknowledges their markers. Only when
+  // there is no ncore booster to consume |local_boost_q_|
+  void DropBoostedPackets();
+
   FlowState* GetFlowState(bess::Packet* pkt);
 
+  // Reordering guard: returns the number of packets in |batch| that arrive
+  // after a later packet of the same flow has been processed by |this|
+  // core. Only for |local_q_|; rcores keep their own state (see
+  // NFVRCore::CountReordered).
+  uint32_t CountReordered(bess::PacketBatch *batch);
+
   // std::string GetDesc() const override;
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
+  CommandResponse CommandGetSummary(const bess::pb::EmptyArg &arg);
   CommandResponse CommandSetBurst(const bess::pb::NFVCoreCommandSetBurstArg &arg);
 
  private:
   // For fast insertion (with a constant-time worse case insertion).
   using HashTable = bess::utils::CuckooMap<Flow, FlowState*, FlowHash, Flow::EqualTo>;
+  using FlowStatePool = bess::utils::SlabPool<FlowState>;
+
+  // Drop all FlowStates and re-size |per_flow_states_| for the pool's capacity
+  void ResetFlowStates();
+
+  // Handles all messages in |mailbox_|
+  void HandleCtrlMsgs();
 
+  // Lends rcores (and their software queues) from NFVCtrl to |split_policy_|
+  class RCorePool final : public bess::utils::SplitQueuePool {
+   public:
+    explicit RCorePool(NFVCore *core) : core_(core) {}
+    int Request() override;
+
+   private:
+    NFVCore *core_;
+  };
+
+  // The Ironside instance that |this| belongs to
+  bess::ctrl::NFVRuntime *rt_;
   uint16_t core_id_;
 
   // NIC queue (port, qid)
@@ -135,10 +204,12 @@ class NFVCore final : public Module {
   int burst_;
 
   // Software queue that holds packets
-  struct llring *local_q_;
-  struct llring *local_boost_q_;
+  BatchRing *local_q_;
+  BatchRing *local_boost_q_;
+  // Slots reserved in |local_q_|, and the number filled
+  BatchRing::Reservation local_res_;
+  uint32_t local_res_cnt_;
 
-  bess::PacketBatch *local_batch_;
   bess::PacketBatch *local_rboost_batch_;
   bess::PacketBatch *system_dump_batch_;
   bess::PacketBatch *local_sw_batch_[DEFAULT_SWQ_COUNT];
@@ -150,9 +221,34 @@ class NFVCore final : public Module {
   SoftwareQueueState* rcore_booster_q_state_;
   SoftwareQueueState* system_dump_q_state_;
 
-  // Software queues borrowed from NFVCtrl
-  std::set<SoftwareQueueState*> active_sw_q_;
-  std::set<SoftwareQueueState*> terminating_sw_q_;
+  // Software queues borrowed from NFVCtrl, indexed by |sw_q_id|
+  using SwQBitmap = bess::utils::Bitmap<DEFAULT_SWQ_COUNT>;
+  SwQBitmap active_sw_q_;
+  SwQBitmap terminating_sw_q_;
+
+  // Flow ownership handoff:
+  // Packets of flows waiting for a drain marker, in arrival order
+  BatchRing *handoff_q_;
+  bess::PacketBatch *handoff_batch_;
+  // Markers that did not fit into their queues
+  std::vector<std::pair<BatchRing*, DrainMarker*>> pending_markers_;
+  // Markers in |local_boost_q_|, acknowledged by the ncore booster.
+  // |boost_q_used_| is true if packets were boosted after the latest marker
+  DrainMarker boost_drain_;
+  uint32_t boost_drain_seq_;
+  bool boost_q_used_;
+  // The marker issued to sw_q |i| when |this| core released it, and the
+  // queues whose rcores have not drained it yet
+  uint32_t sw_q_drain_seq_[DEFAULT_SWQ_COUNT];
+  SwQBitmap draining_sw_q_;
+  // Epochs that each marker has been pending for (since the last warning)
+  uint32_t boost_drain_epochs_;
+  uint32_t sw_q_drain_epochs_[DEFAULT_SWQ_COUNT];
+  uint64_t forced_drain_count_;
+  uint64_t handoff_count_;
+  uint64_t held_packet_count_; // released from |handoff_q_|
+  // Packets processed by |this| core after a later packet of the same flow
+  uint64_t reorder_count_;
 
   // Metadata field ID
   int flow_stats_attr_id_; // for maintaining per-flow stats
@@ -190,22 +286,36 @@ class NFVCore final : public Module {
   bool update_bucket_stats_;
   BucketStats local_bucket_stats_;
 
-  // For recording active flows in an epoch
-  std::set<FlowState*> epoch_flow_cache_;
-  // For each epoch, the set of flows that are not migrated to aux cores
-  std::set<FlowState*> unoffload_flows_;
+  // For recording active flows in an epoch. A flow is appended on its first
+  // packet in an epoch (|last_epoch_id| != |curr_epoch_id_|), so there are no
+  // duplicates. Both lists reserve the pool's capacity and never re-allocate.
+  std::vector<FlowState*> epoch_flow_cache_;
+  // For each epoch, the list of flows that are not migrated to aux cores
+  std::vector<FlowState*> unoffload_flows_;
+
+  // Short-term flow split policy, selected by NFVCoreArg.split_policy
+  std::unique_ptr<bess::utils::SplitPolicy> split_policy_;
+  RCorePool rcore_pool_;
+  std::vector<bess::utils::SplitFlow> split_flows_;
+  std::vector<bess::utils::SplitQueue> split_queues_;
 
   // For maintaining (per-core) FlowState structs
   HashTable per_flow_states_;
+  // FlowStates are allocated from a hugepage-backed slab in |flow_state_mem_|
+  void *flow_state_mem_;
+  FlowStatePool flow_state_pool_;
+  // The next pool slot to be checked by |EvictIdleFlows|
+  uint32_t flow_state_sweep_idx_;
+  uint32_t flow_idle_epoch_count_;
 
   // For debugging
   uint32_t epoch_drop1_;
   uint32_t epoch_drop2_;
 
-  // Other threads can set |disabled_| to be 1 to stop this core.
-  // Once set, this core will set |disabled_| to be 2 to notify others
-  // that this core has stopped successfully.
-  rte_atomic16_t disabled_;
+  // Messages from NFVCtrl and the control thread. Once |stopped_| is set
+  // (by kStop or DeInit), this core no longer touches its queues and flows.
+  bess::ctrl::CtrlMailbox mailbox_;
+  std::atomic<bool> stopped_;
 };
 
 #endif // BESS_MODULES_NFV_CORE_H_
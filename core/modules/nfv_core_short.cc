@@ -15,56 +15,155 @@ using bess::utils::Udp;
 using bess::utils::TagUint32;
 using bess::utils::add_debug_tag_nfvcore;
 
+// The max number of FlowState slots checked for eviction per short-term epoch
+#define FLOW_STATE_SWEEP_BATCH 512
+
+// Short-term epochs before a pending drain marker is reported
+#define DRAIN_MARKER_TIMEOUT_EPOCHS 100
+
 namespace {
 } // namespace
 
-void NFVCore::UpdateBucketStats() {
-  update_bucket_stats_ = true;
+void NFVCore::HandleCtrlMsgs() {
+  using bess::ctrl::CtrlMsg;
+  mailbox_.Poll([this](uint32_t lane, const CtrlMsg &msg) {
+    switch (msg.type) {
+      case CtrlMsg::kStop:
+        stopped_ = true;
+        mailbox_.Complete(lane, msg);
+        break;
+      case CtrlMsg::kReportStats:
+        update_bucket_stats_ = true;
+        break;
+      default:
+        LOG(WARNING) << "core " << core_id_ << ": unexpected message " << msg.type;
+    }
+  });
 }
 
-void NFVCore::UpdateStatsOnFetchBatch(bess::PacketBatch *batch) {
-  Flow flow;
-  FlowState *state = nullptr;
+void NFVCore::EvictIdleFlows() {
+  uint32_t capacity = flow_state_pool_.Capacity();
+  uint32_t end = std::min(flow_state_sweep_idx_ + FLOW_STATE_SWEEP_BATCH, capacity);
+
+  for (uint32_t idx = flow_state_pool_.NextInUse(flow_state_sweep_idx_, end);
+       idx < end; idx = flow_state_pool_.NextInUse(idx + 1, end)) {
+    FlowState *state = flow_state_pool_.Get(idx);
+    // Queued packets point to their flow's state, so a flow is kept until
+    // they are all processed or dropped, however long it has been idle
+    // (e.g., on a stuck software queue). |queued_packet_count| only covers
+    // |local_q_|; an offloaded flow (|sw_q_state|) may still have packets
+    // in its sw_q, |rcore_boost_q| or |system_dump_q|, so it is kept until
+    // it comes back.
+    if (curr_epoch_id_ - state->last_epoch_id < flow_idle_epoch_count_ ||
+        state->handoff != nullptr || state->queued_packet_count != 0 ||
+        state->sw_q_state != nullptr) {
+      continue;
+    }
+    per_flow_states_.Remove(state->flow);
+    flow_state_pool_.Free(state);
+  }
 
-  int cnt = batch->cnt();
-  for (int i = 0; i < cnt; i++) {
+  flow_state_sweep_idx_ = (end == capacity) ? 0 : end;
+}
+
+void NFVCore::UpdateStatsOnFetchBatch(bess::PacketBatch *batch) {
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+  Flow flows[bess::PacketBatch::kMaxBurst];
+  FlowState *states[bess::PacketBatch::kMaxBurst];
+  HashTable::Entry *entries[bess::PacketBatch::kMaxBurst];
+
+  // Parse all packets first so that the flow table is probed once per batch.
+  int cnt = 0;
+  for (int i = 0; i < batch->cnt(); i++) {
     bess::Packet *pkt = batch->pkts()[i];
-    if (!bess::utils::ParseFlowFromPacket(&flow, pkt)) {
+    if (!bess::utils::ParseFlowFromPacket(&flows[cnt], pkt)) {
       // After this line, all packets must be associated with a flow.
       bess::Packet::Free(pkt);
       continue;
     }
+    pkts[cnt++] = pkt;
+  }
 
-    // Update per-core flow states
-    auto state_it = per_flow_states_.Find(flow);
-    if (state_it == nullptr) {
-      // Init a flow
-      state = new FlowState();
-      state->flow = flow;
-      state->rss = bess::utils::bucket_stats->RSSHashToID(reinterpret_cast<rte_mbuf*>(pkt)->hash.rss);
-      state->sw_q_state = nullptr;
-      per_flow_states_.Insert(flow, state);
-    } else {
-      state = state_it->second;
+  // Update per-core flow states. The lookups of all flows overlap.
+  per_flow_states_.FindBatch(flows, cnt, entries);
+
+  Flow new_flows[bess::PacketBatch::kMaxBurst];
+  FlowState *new_states[bess::PacketBatch::kMaxBurst];
+  int new_cnt = 0;
+  for (int i = 0; i < cnt; i++) {
+    if (entries[i] != nullptr) {
+      states[i] = entries[i]->second;
+      continue;
+    }
+
+    // A new flow may have several packets in this batch
+    states[i] = nullptr;
+    for (int j = 0; j < new_cnt; j++) {
+      if (new_flows[j] == flows[i]) {
+        states[i] = new_states[j];
+        break;
+      }
+    }
+    if (states[i] != nullptr) {
+      continue;
+    }
+
+    // Init a flow. If the flow table is full, the packet is dropped below
+    // until idle flows are evicted.
+    FlowState *state = flow_state_pool_.Alloc();
+    if (state == nullptr) {
+      continue;
+    }
+    state->flow = flows[i];
+    state->rss = bess::utils::bucket_stats->RSSHashToID(reinterpret_cast<rte_mbuf*>(pkts[i])->hash.rss);
+    state->sw_q_state = nullptr;
+    new_flows[new_cnt] = flows[i];
+    new_states[new_cnt] = state;
+    new_cnt += 1;
+    states[i] = state;
+  }
+  if (new_cnt > 0) {
+    per_flow_states_.InsertBatch(new_flows, new_states, new_cnt, entries);
+  }
+
+  // Local packets go to |local_q_| directly
+  BeginLocalEnqueue(cnt);
+  FlowState *state = nullptr;
+  for (int i = 0; i < cnt; i++) {
+    bess::Packet *pkt = pkts[i];
+    state = states[i];
+    if (state == nullptr) {
+      bess::Packet::Free(pkt);
+      continue;
     }
 
     // Append flow's stats pointer to pkt's metadata
     *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt)) = state;
+    state->arrival_seq += 1;
+    // Not a metadata attribute: nothing reads one, so it would share its
+    // (no-write) offset with |flow_stats|
+    reinterpret_cast<rte_mbuf*>(pkt)->seqn = state->arrival_seq;
     // LOG(INFO) << "set: " << *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt));
 
     // update per-bucket packet counter and per-bucket flow cache.
     uint32_t id = state->rss;
     local_bucket_stats_.per_bucket_packet_counter[id] += 1;
 
-    if (state->short_epoch_packet_count == 0) {
+    if (state->last_epoch_id != curr_epoch_id_) {
       // Update the per-epoch flow count
-      local_bucket_stats_.per_bucket_flow_cache[id].emplace(state->flow, true);
-      epoch_flow_cache_.emplace(state);
+      local_bucket_stats_.AddFlow(id, reinterpret_cast<rte_mbuf*>(pkt)->hash.rss);
+      epoch_flow_cache_.push_back(state);
+      state->last_epoch_id = curr_epoch_id_;
     }
     state->short_epoch_packet_count += 1;
     state->queued_packet_count += 1;
 
     // Determine the packet's destination queue
+    if (state->handoff != nullptr) {
+      // Egress 3: hold until the flow's old queue drains
+      handoff_batch_->add(pkt);
+      continue;
+    }
     auto& q_state = state->sw_q_state;
     if (q_state != nullptr) {
       if (q_state == system_dump_q_state_) {
@@ -81,10 +180,16 @@ void NFVCore::UpdateStatsOnFetchBatch(bess::PacketBatch *batch) {
         // epoch_drop4_ += 1;
         continue;
       }
-      if (active_sw_q_.find(state->sw_q_state) == active_sw_q_.end()) {
-        /// Option 1: go back to ncore
+      if (!active_sw_q_.Test(q_state->sw_q_id)) {
+        /// Option 1: go back to ncore once the rcore has drained |sw_q|
+        bool held = StartHandOff(state, &q_state->drain,
+                                 sw_q_drain_seq_[q_state->sw_q_id]);
         state->sw_q_state = nullptr;
-        local_batch_->add(pkt);
+        if (held) {
+          handoff_batch_->add(pkt);
+        } else {
+          AddLocal(pkt);
+        }
         continue;
       }
 
@@ -95,19 +200,21 @@ void NFVCore::UpdateStatsOnFetchBatch(bess::PacketBatch *batch) {
       continue;
     }
 
-    local_batch_->add(pkt);
+    AddLocal(pkt);
   }
 
   // Update per-epoch packet counter
-  epoch_packet_arrival_ += cnt;
-
-  // Egress 5: drop (|local_q_| overflow)
-  SpEnqueue(local_batch_, local_q_);
-  for (auto& q : active_sw_q_) {
-    MpEnqueue(local_sw_batch_[q->sw_q_id], q->sw_q);
+  epoch_packet_arrival_ += batch->cnt();
+
+  // Egress 5: drop (|local_q_| or |handoff_q_| overflow)
+  EndLocalEnqueue();
+  Enqueue(handoff_batch_, handoff_q_);
+  for (int qid = active_sw_q_.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+       qid = active_sw_q_.NextSet(qid + 1)) {
+    Enqueue(local_sw_batch_[qid], rt_->sw_q_state[qid]->sw_q);
   }
-  MpEnqueue(local_rboost_batch_, bess::ctrl::rcore_boost_q);
-  MpEnqueue(system_dump_batch_, bess::ctrl::system_dump_q);
+  Enqueue(local_rboost_batch_, rt_->rcore_boost_q);
+  Enqueue(system_dump_batch_, rt_->system_dump_q);
 }
 
 void NFVCore::UpdateStatsPreProcessBatch(bess::PacketBatch *batch) {
@@ -120,12 +227,13 @@ void NFVCore::UpdateStatsPreProcessBatch(bess::PacketBatch *batch) {
     state = *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt));
     state->queued_packet_count -= 1;
   }
+  reorder_count_ += CountReordered(batch);
 
   // Update for NFVMonitor (the current epoch info)
   if (bess::ctrl::exp_id == 2) {
     // Update per-epoch packet counter
     epoch_packet_processed_ += cnt;
-    epoch_packet_queued_ = llring_count(local_q_);
+    epoch_packet_queued_ = local_q_->Count();
 
     using bess::utils::all_local_core_stats;
     all_local_core_stats[core_id_]->active_flow_count = epoch_flow_cache_.size();
@@ -135,21 +243,21 @@ void NFVCore::UpdateStatsPreProcessBatch(bess::PacketBatch *batch) {
   }
 }
 
-void NFVCore::SplitQToSwQ(llring* q) {
-  uint32_t total_cnt = llring_count(q);
+void NFVCore::SplitQToSwQ(BatchRing* q) {
+  uint32_t total_cnt = q->Count();
 
   uint32_t curr_cnt = 0;
   while (curr_cnt < total_cnt) { // scan all packets only once
     split_enqueue_batch_->clear();
-    int cnt = llring_sc_dequeue_burst(q, (void **)split_enqueue_batch_->pkts(), 32);
+    int cnt = q->DequeueBurst((void **)split_enqueue_batch_->pkts(), 32);
     split_enqueue_batch_->set_cnt(cnt);
     SplitAndEnqueue(split_enqueue_batch_);
     curr_cnt += cnt;
   }
 
   // Debug log (unresolved)
-  // if (llring_count(q) > epoch_packet_thresh_) {
-  //   LOG(INFO) << "splitQ: error (large local_queue=" << llring_count(local_q_) << ", core=" << core_id_ << ")";
+  // if (q->Count() > epoch_packet_thresh_) {
+  //   LOG(INFO) << "splitQ: error (large local_queue=" << local_q_->Count() << ", core=" << core_id_ << ")";
   // }
 }
 
@@ -157,10 +265,16 @@ void NFVCore::SplitQToSwQ(llring* q) {
 void NFVCore::SplitAndEnqueue(bess::PacketBatch* batch) {
   FlowState* state;
   int cnt = batch->cnt();
+  BeginLocalEnqueue(cnt);
   for (int i = 0; i < cnt; i++) {
     bess::Packet *pkt = batch->pkts()[i];
     state = *(_ptr_attr_with_offset<FlowState*>(this->attr_offset(flow_stats_attr_id_), pkt));
 
+    if (state->handoff != nullptr) {
+      // Egress 9: hold until the flow's old queue drains
+      handoff_batch_->add(pkt);
+      continue;
+    }
     auto& q_state = state->sw_q_state;
     if (q_state != nullptr) {
       if (q_state == system_dump_q_state_) {
@@ -177,10 +291,16 @@ void NFVCore::SplitAndEnqueue(bess::PacketBatch* batch) {
         // epoch_drop4_ += 1;
         continue;
       }
-      if (active_sw_q_.find(state->sw_q_state) == active_sw_q_.end()) {
-        /// Option 1: go back to ncore
+      if (!active_sw_q_.Test(q_state->sw_q_id)) {
+        /// Option 1: go back to ncore once the rcore has drained |sw_q|
+        bool held = StartHandOff(state, &q_state->drain,
+                                 sw_q_drain_seq_[q_state->sw_q_id]);
         state->sw_q_state = nullptr;
-        local_batch_->add(pkt);
+        if (held) {
+          handoff_batch_->add(pkt);
+        } else {
+          AddLocal(pkt);
+        }
         continue;
       }
 
@@ -192,29 +312,175 @@ void NFVCore::SplitAndEnqueue(bess::PacketBatch* batch) {
     }
 
     // state->enqueued_packet_count += 1;
-    local_batch_->add(pkt);
+    AddLocal(pkt);
   }
 
   // Just drop excessive packets when a software queue is full
-  // Egress 11: drop (|local_q_| overflow)
-  SpEnqueue(local_batch_, local_q_);
-  for (auto& q : active_sw_q_) {
-    MpEnqueue(local_sw_batch_[q->sw_q_id], q->sw_q);
+  // Egress 11: drop (|local_q_| or |handoff_q_| overflow)
+  EndLocalEnqueue();
+  Enqueue(handoff_batch_, handoff_q_);
+  for (int qid = active_sw_q_.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+       qid = active_sw_q_.NextSet(qid + 1)) {
+    Enqueue(local_sw_batch_[qid], rt_->sw_q_state[qid]->sw_q);
   }
-  MpEnqueue(local_rboost_batch_, bess::ctrl::rcore_boost_q);
-  MpEnqueue(system_dump_batch_, bess::ctrl::system_dump_q);
+  Enqueue(local_rboost_batch_, rt_->rcore_boost_q);
+  Enqueue(system_dump_batch_, rt_->system_dump_q);
 }
 
-uint32_t GetMaxPktCountFromShortTermProfile(uint32_t fc) {
-  if (bess::ctrl::short_flow_count_pkt_threshold.size() == 0) {
-    return 512;
+bool NFVCore::IssueDrainMarker(BatchRing *q, DrainMarker *m, bool may_defer,
+                               uint32_t *seq) {
+  void *entry = bess::ctrl::DrainMarkerToEntry(m);
+  if (q->EnqueueBurst(&entry, 1) == 1) {
+    *seq = m->Issue();
+    return true;
   }
+  if (!may_defer) {
+    return false;
+  }
+  // Counted from now on: the marker is acknowledged only after it is flushed
+  *seq = m->Issue();
+  pending_markers_.emplace_back(q, m);
+  return true;
+}
 
-  const auto& it = bess::ctrl::short_flow_count_pkt_threshold.find(fc);
-  if (it != bess::ctrl::short_flow_count_pkt_threshold.end()) {
-    return it->second;
+void NFVCore::FlushDrainMarkers() {
+  size_t cnt = 0;
+  for (const auto &it : pending_markers_) {
+    void *entry = bess::ctrl::DrainMarkerToEntry(it.second);
+    if (it.first->EnqueueBurst(&entry, 1) == 0) {
+      pending_markers_[cnt++] = it;
+    }
   }
-  return (--bess::ctrl::short_flow_count_pkt_threshold.end())->second;
+  pending_markers_.resize(cnt);
+}
+
+uint32_t NFVCore::BoostDrainSeq() {
+  // Boosted packets are dropped from |local_boost_q_| if there is no booster
+  if (rt_->cores[core_id_].nfv_booster == nullptr) {
+    DropBoostedPackets();
+  } else if (boost_q_used_) {
+    IssueDrainMarker(local_boost_q_, &boost_drain_, true, &boost_drain_seq_);
+  }
+  boost_q_used_ = false;
+  return boost_drain_seq_;
+}
+
+void NFVCore::DropBoostedPackets() {
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+  uint32_t cnt;
+  while ((cnt = local_boost_q_->DequeueBurst((void **)pkts, 32)) > 0) {
+    for (uint32_t i = 0; i < cnt; i++) {
+      if (bess::ctrl::IsDrainMarkerEntry(pkts[i])) {
+        bess::ctrl::EntryToDrainMarker(pkts[i])->Ack();
+      } else {
+        DropQueuedPacket(pkts[i], true);
+      }
+    }
+  }
+  // Markers still in |pending_markers_| are absorbed once flushed
+  boost_drain_.ForceDrain();
+}
+
+void NFVCore::CheckDrainMarkers() {
+  if (rt_->cores[core_id_].nfv_booster == nullptr) {
+    DropBoostedPackets();
+    boost_drain_epochs_ = 0;
+  } else if (boost_drain_.IsDrained(boost_drain_seq_)) {
+    boost_drain_epochs_ = 0;
+  } else if (++boost_drain_epochs_ > DRAIN_MARKER_TIMEOUT_EPOCHS) {
+    // Keep waiting: the booster may still process the boosted flows
+    LOG(WARNING) << "core " << core_id_ << ": booster has not drained its "
+                 << "markers in " << DRAIN_MARKER_TIMEOUT_EPOCHS << " epochs";
+    boost_drain_epochs_ = 0;
+  }
+
+  for (int qid = draining_sw_q_.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+       qid = draining_sw_q_.NextSet(qid + 1)) {
+    SoftwareQueueState* q = rt_->sw_q_state[qid];
+    if (q->drain.IsDrained(sw_q_drain_seq_[qid])) {
+      draining_sw_q_.Reset(qid);
+      continue;
+    }
+    // The markers of a destroyed rcore are absorbed by the next rcore |qid|.
+    // Its sw_q then goes back to the pool, as it would after draining
+    bool gone = (rt_->cores[qid].nfv_rcore == nullptr);
+    if (!gone) {
+      // Keep holding: the rcore may still process the held flows
+      if (++sw_q_drain_epochs_[qid] > DRAIN_MARKER_TIMEOUT_EPOCHS) {
+        LOG(WARNING) << "core " << core_id_ << ": q" << qid
+                     << " is not drained in " << DRAIN_MARKER_TIMEOUT_EPOCHS
+                     << " epochs";
+        sw_q_drain_epochs_[qid] = 0;
+      }
+      continue;
+    }
+    LOG(WARNING) << "core " << core_id_ << ": q" << qid
+                 << " has no rcore; releasing its held flows";
+    q->drain.ForceDrain();
+    q->CASUpCoreID(core_id_, DEFAULT_INVALID_CORE_ID);
+    draining_sw_q_.Reset(qid);
+    forced_drain_count_ += 1;
+  }
+}
+
+bool NFVCore::StartHandOff(FlowState *state, DrainMarker *m, uint32_t seq) {
+  if (m->IsDrained(seq)) {
+    return false;
+  }
+  state->handoff = m;
+  state->handoff_seq = seq;
+  handoff_count_ += 1;
+  return true;
+}
+
+void NFVCore::ReleaseHeldPackets() {
+  uint32_t total_cnt = handoff_q_->Count();
+
+  uint32_t curr_cnt = 0;
+  while (curr_cnt < total_cnt) { // scan all held packets only once
+    split_enqueue_batch_->clear();
+    int cnt = handoff_q_->DequeueBurst((void **)split_enqueue_batch_->pkts(),
+                                       std::min<uint32_t>(32, total_cnt - curr_cnt));
+    if (cnt == 0) {
+      break;
+    }
+    split_enqueue_batch_->set_cnt(cnt);
+
+    // A flow's held packets are all released in this scan, before any of
+    // its new packets
+    for (int i = 0; i < cnt; i++) {
+      FlowState *state = GetFlowState(split_enqueue_batch_->pkts()[i]);
+      if (state->handoff != nullptr && state->handoff->IsDrained(state->handoff_seq)) {
+        state->handoff = nullptr;
+      }
+      if (state->handoff == nullptr) {
+        held_packet_count_ += 1;
+      }
+    }
+    SplitAndEnqueue(split_enqueue_batch_);
+    curr_cnt += cnt;
+  }
+}
+
+int NFVCore::RCorePool::Request() {
+  int qid = core_->rt_->nfv_ctrl->RequestRCore();
+  if (qid != -1) {
+    SoftwareQueueState* q = core_->rt_->sw_q_state[qid];
+    // sw_q |qid| is single-producer. Never take it over from another core
+    if (!q->CASUpCoreID(DEFAULT_INVALID_CORE_ID, core_->core_id_)) {
+      LOG(WARNING) << "core " << core_->core_id_ << ": q" << qid
+                   << " is still owned by core " << q->GetUpCoreID();
+      core_->rt_->ReleaseIdleRCore(qid);
+      return -1;
+    }
+    q->idle_epoch_count = 0;
+    q->assigned_packet_count = 0;
+
+    core_->active_sw_q_.Set(qid);
+    core_->curr_rcore_ += 1;
+    // LOG(INFO) << "core " << core_->core_id_ << " gets q" << qid << ". rcores=" << core_->active_sw_q_.Count();
+  }
+  return qid;
 }
 
 bool NFVCore::ShortEpochProcess() {
@@ -224,7 +490,7 @@ bool NFVCore::ShortEpochProcess() {
   // absorb the existing packet queue in the coming epoch.
   // |epoch_flow_cache_| has all flows that have arrivals in this epoch
   //
-  // Flow Assignment Algorithm: (Greedy) first-fit
+  // Flow Assignment Algorithm: |split_policy_| (default: greedy first-fit)
   // 0) check whether the NIC queue cannot be handled by NFVCore in the next epoch
   //    - if the number of packets in |local_q_| is too large, then go to the next step;
   //    - otherwise, stop here;
@@ -238,32 +504,35 @@ bool NFVCore::ShortEpochProcess() {
   //    - a) handle overloaded software queues
   // 5) Split the NF chain to deal with super-bursty flows
   // 6) release idle software queues if they have not been used for N epochs
+  // 7) evict flows that have been idle for |flow_idle_epoch_count_| epochs
+
+  // Never wait for a drain marker forever
+  CheckDrainMarkers();
 
   // Check qlen of exisitng software queues
-  for (auto qit = active_sw_q_.begin(); qit != active_sw_q_.end(); ++qit) {
-    SoftwareQueueState* q = *qit;
+  for (int qid = active_sw_q_.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+       qid = active_sw_q_.NextSet(qid + 1)) {
+    SoftwareQueueState* q = rt_->sw_q_state[qid];
     if (q->processed_packet_count == 0) {
       q->idle_epoch_count += 1;
     } else {
       q->idle_epoch_count = 0;
     }
-    q->assigned_packet_count = llring_count(q->sw_q);
+    q->assigned_packet_count = q->sw_q->Count();
   }
 
-  for (auto qit = terminating_sw_q_.begin(); qit != terminating_sw_q_.end(); ) {
-    SoftwareQueueState* q = *qit;
-    if (bess::ctrl::sw_q_state[q->sw_q_id]->GetUpCoreID() == DEFAULT_INVALID_CORE_ID) {
+  for (int qid = terminating_sw_q_.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+       qid = terminating_sw_q_.NextSet(qid + 1)) {
+    SoftwareQueueState* q = rt_->sw_q_state[qid];
+    if (q->GetUpCoreID() == DEFAULT_INVALID_CORE_ID) {
       q->idle_epoch_count = -2; // terminated
-      terminating_sw_q_.erase(qit++);
-    } else {
-      ++qit;
+      terminating_sw_q_.Reset(qid);
     }
   }
 
   // Update |unoffload_flows_|
   unoffload_flows_.clear();
-  for (auto it = epoch_flow_cache_.begin(); it != epoch_flow_cache_.end(); ++it) {
-    FlowState *state = *it;
+  for (FlowState *state : epoch_flow_cache_) {
     if (state != nullptr) {
       if (state->queued_packet_count > 10000) {
         // LOG(INFO) << "incorrect per-flow packet counter: " << state->queued_packet_count;
@@ -274,91 +543,91 @@ bool NFVCore::ShortEpochProcess() {
       state->enqueued_packet_count = 0;
       state->short_epoch_packet_count = 0;
 
-      // Skip flows that have been assigned to migrate to RCores
-      if (state->sw_q_state != nullptr) {
+      // Skip flows that have been assigned to migrate to RCores, or that
+      // are still being handed off
+      if (state->sw_q_state != nullptr || state->handoff != nullptr) {
         continue;
       }
-      unoffload_flows_.emplace(state);
+      unoffload_flows_.push_back(state);
     } else {
       LOG(FATAL) << "short-term: error (impossible non-flow packet)";
     }
   }
 
-  // Greedy assignment: first-fit
+  // Assign flows with |split_policy_|
   uint32_t local_flow_count = epoch_flow_cache_.size();
-  uint32_t local_pkt_thresh = GetMaxPktCountFromShortTermProfile(local_flow_count);
-  uint32_t local_pkt_assigned = 0;
+  bess::utils::SplitBudget budget = {
+      rt_->GetMaxPktCountFromShortTermProfile(local_flow_count), epoch_packet_thresh_};
+
+  split_flows_.clear();
+  for (FlowState *state : unoffload_flows_) {
+    split_flows_.push_back({state->queued_packet_count,
+                            static_cast<uint32_t>(FlowHash()(state->flow)),
+                            bess::utils::SplitPolicy::kLocal});
+  }
+  split_queues_.clear();
+  for (int qid = active_sw_q_.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+       qid = active_sw_q_.NextSet(qid + 1)) {
+    split_queues_.push_back({qid, rt_->sw_q_state[qid]->assigned_packet_count});
+  }
 
-  for (auto it = unoffload_flows_.begin(); it != unoffload_flows_.end(); ++it) {
-    FlowState *state = *it;
-    uint32_t task_size = state->queued_packet_count;
+  split_policy_->Split(&split_flows_, budget, &split_queues_, &rcore_pool_);
 
-    if (task_size <= epoch_packet_thresh_) {
-      if (local_pkt_assigned + task_size < local_pkt_thresh) {
-        local_pkt_assigned += task_size;
-      } else {
-        // Prioritize sw queues that are active.
-        bool assigned = false;
-        SoftwareQueueState* q = nullptr;
-        for (auto qit = active_sw_q_.begin(); qit != active_sw_q_.end(); ++qit) {
-          q = *qit;
-          if (q->QLenAfterAssignment() + task_size < epoch_packet_thresh_) {
-            state->sw_q_state = q;
-            q->assigned_packet_count += task_size;
-            assigned = true;
-            break;
-          }
-        }
+  for (const auto& q : split_queues_) {
+    rt_->sw_q_state[q.id]->assigned_packet_count = q.load;
+  }
+  for (size_t i = 0; i < split_flows_.size(); i++) {
+    FlowState *state = unoffload_flows_[i];
+    int decision = split_flows_[i].decision;
+    if (decision == bess::utils::SplitPolicy::kLocal) {
+      continue;
+    }
 
-        if (!assigned) {
-          int qid = bess::ctrl::nfv_ctrl->RequestRCore();
-          if (qid != -1) {
-            q = bess::ctrl::sw_q_state[qid];
-            q->SetUpCoreID(core_id_);
-            q->idle_epoch_count = 0;
-            q->assigned_packet_count = task_size;
-
-            active_sw_q_.emplace(q);
-            curr_rcore_ += 1;
-            state->sw_q_state = q;
-            assigned = true;
-            // LOG(INFO) << "core " << core_id_ << " gets q" << qid << ". rcores=" << active_sw_q_.size();
-          } else {
-            // All rcores are busy now! Need to clean this flow anyway.
-            state->sw_q_state = system_dump_q_state_;
-          }
-        }
-      }
-    } else {
+    // The flow's boosted packets have to be processed first
+    StartHandOff(state, &boost_drain_, BoostDrainSeq());
+    if (decision == bess::utils::SplitPolicy::kBoost) {
       // This flow cannot be handled by only 1 core.
       state->sw_q_state = rcore_booster_q_state_;
+    } else if (decision == bess::utils::SplitPolicy::kDrop) {
+      // All rcores are busy now! Need to clean this flow anyway.
+      state->sw_q_state = system_dump_q_state_;
+    } else {
+      state->sw_q_state = rt_->sw_q_state[decision];
     }
   }
 
   // Reclaim idle rcores
-  for (auto qit = active_sw_q_.begin(); qit != active_sw_q_.end(); ) {
-    SoftwareQueueState* q = *qit;
+  for (int qid = active_sw_q_.NextSet(0); qid < DEFAULT_SWQ_COUNT;
+       qid = active_sw_q_.NextSet(qid + 1)) {
+    SoftwareQueueState* q = rt_->sw_q_state[qid];
     q->processed_packet_count = 0;
 
     if (q->idle_epoch_count >= max_idle_epoch_count_) { // idle for a while
+      // Flows that are still mapped to |q| come back after this marker.
+      // |q| must have room for it: a deferred marker could race with the
+      // next core that borrows |q|, so retry in the next epoch
+      if (!IssueDrainMarker(q->sw_q, &q->drain, false, &sw_q_drain_seq_[qid])) {
+        continue;
+      }
+      draining_sw_q_.Set(qid);
+      sw_q_drain_epochs_[qid] = 0;
       q->idle_epoch_count = -1; // terminating
-      bess::ctrl::nfv_ctrl->ReleaseRCore(q->sw_q_id);
+      rt_->nfv_ctrl->ReleaseRCore(core_id_, q->sw_q_id);
 
-      active_sw_q_.erase(qit++);
-      terminating_sw_q_.emplace(q);
+      active_sw_q_.Reset(qid);
+      terminating_sw_q_.Set(qid);
       curr_rcore_ -= 1;
-      // LOG(INFO) << "core " << core_id_ << " releases q" << q->sw_q_id << ". rcores=" << active_sw_q_.size();
-    } else {
-      ++qit;
+      // LOG(INFO) << "core " << core_id_ << " releases q" << q->sw_q_id << ". rcores=" << active_sw_q_.Count();
     }
   }
 
   // if (core_id_ == 2) {
-  //   LOG(INFO) << active_sw_q_.size() << ", " << terminating_sw_q_.size() << ", " << idle_sw_q_.size();
+  //   LOG(INFO) << active_sw_q_.Count() << ", " << terminating_sw_q_.Count() << ", " << idle_sw_q_.size();
   // }
 
   // Clear
   epoch_flow_cache_.clear();
+  EvictIdleFlows();
   if (bess::ctrl::exp_id == 2) {
     CoreStats* stats_ptr = nullptr;
     while (all_core_stats_chan[core_id_]->Size()) {
@@ -8,29 +8,57 @@
 
 // The time interval for the long term optimization to run
 #define LONG_TERM_UPDATE_PERIOD_NS 500000000
-#define MIN_NIC_RSS_UPDATE_PERIOD_NS 50000000
+// The max time to wait for all normal cores' long-term stats
+#define LONG_TERM_STATS_WAIT_NS 10000000
 
 namespace {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
-void DumpSoftwareQueue(struct llring* q, bess::PacketBatch *batch) {
+void DumpSoftwareQueue(BatchRing* q, bess::PacketBatch *batch) {
   uint32_t cnt = 0;
   batch->clear();
-  while ((cnt = llring_sc_dequeue_burst(q,
-                (void **)batch->pkts(), batch->kMaxBurst)) > 16) {
+  while ((cnt = q->DequeueBurst((void **)batch->pkts(), batch->kMaxBurst)) > 16) {
     bess::Packet::Free(batch->pkts(), cnt);
     batch->clear();
   }
 }
 
-void DumpOnceSoftwareQueue(struct llring* q, bess::PacketBatch *batch) {
+void DumpOnceSoftwareQueue(BatchRing* q, bess::PacketBatch *batch) {
   batch->clear();
-  int cnt = llring_sc_dequeue_burst(q, (void **)batch->pkts(), batch->kMaxBurst);
+  int cnt = q->DequeueBurst((void **)batch->pkts(), batch->kMaxBurst);
   if (cnt) {
     bess::Packet::Free(batch->pkts(), cnt);
   }
 }
 #pragma GCC diagnostic pop
+
+// Loads an NF chain's profile into |model|. If per-NF profiles |nf_fnames|
+// are given, they are composed into the chain's profile; otherwise, the
+// chain's profile is read from |chain_fname|.
+void LoadNFPerfModel(const std::string &chain_fname,
+                     const google::protobuf::RepeatedPtrField<std::string> &nf_fnames,
+                     bess::utils::NFPerfModel *model) {
+  if (nf_fnames.size() == 0) {
+    if (!model->LoadProfile(chain_fname)) {
+      LOG(INFO) << "Failed to read " + chain_fname;
+      return;
+    }
+    LOG(INFO) << "NF profile " + chain_fname;
+  } else {
+    std::vector<bess::utils::NFPerfModel> nfs(nf_fnames.size());
+    std::vector<const bess::utils::NFPerfModel*> nf_models;
+    for (int i = 0; i < nf_fnames.size(); i++) {
+      if (!nfs[i].LoadProfile(nf_fnames[i])) {
+        LOG(INFO) << "Failed to read " + nf_fnames[i];
+        return;
+      }
+      nf_models.push_back(&nfs[i]);
+    }
+    *model = bess::utils::NFPerfModel::Compose(nf_models);
+    LOG(INFO) << "NF profile: a chain of " << nf_fnames.size() << " NFs";
+  }
+  model->Build();
+}
 } // namespace
 
 /// NFVCtrl's own functions:
@@ -45,14 +73,11 @@ std::vector<int> NFVCtrl::RequestNSwQ(cpu_core_t core_id, int n) {
     return assigned;
   }
 
-  // Only one NFVCore can call the following session at a time.
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
-  // Find a (idle) software queue
+  // Find (idle) software queues. A queue is claimed by atomically setting
+  // its |up_core_id|, so concurrent NFVCores never get the same queue.
   for (int i = 0; (i < DEFAULT_SWQ_COUNT) && (int(assigned.size()) < n); i++) {
-    if (bess::ctrl::sw_q_state[i]->GetUpCoreID() == DEFAULT_INVALID_CORE_ID) {
+    if (rt_->sw_q_state[i]->CASUpCoreID(DEFAULT_INVALID_CORE_ID, core_id)) {
       assigned.push_back(i);
-      bess::ctrl::sw_q_state[i]->SetUpCoreID(core_id);
     }
   }
   return assigned;
@@ -63,12 +88,8 @@ int NFVCtrl::RequestSwQ(cpu_core_t core_id) {
     return DEFAULT_SWQ_COUNT;
   }
 
-  // Only one NFVCore can call the following session at a time.
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
   for (int i = 0; i < DEFAULT_SWQ_COUNT; i++) {
-    if (bess::ctrl::sw_q_state[i]->GetUpCoreID() == DEFAULT_INVALID_CORE_ID) {
-      bess::ctrl::sw_q_state[i]->SetUpCoreID(core_id);
+    if (rt_->sw_q_state[i]->CASUpCoreID(DEFAULT_INVALID_CORE_ID, core_id)) {
       return i;
     }
   }
@@ -76,28 +97,21 @@ int NFVCtrl::RequestSwQ(cpu_core_t core_id) {
 }
 
 void NFVCtrl::ReleaseNSwQ(cpu_core_t core_id, std::vector<int> qids) {
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
   for (auto qid : qids) {
-    if (qid >= 0 ||
-        qid < DEFAULT_SWQ_COUNT ||
-        bess::ctrl::sw_q_state[qid]->GetUpCoreID() == core_id) {
-      bess::ctrl::sw_q_state[qid]->SetUpCoreID(DEFAULT_INVALID_CORE_ID);
+    // A sw_q goes back to the pool only if core |core_id| owns it
+    if (qid >= 0 && qid < DEFAULT_SWQ_COUNT) {
+      rt_->sw_q_state[qid]->CASUpCoreID(core_id, DEFAULT_INVALID_CORE_ID);
     }
   }
 }
 
 void NFVCtrl::ReleaseSwQ(int q_id) {
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
-  bess::ctrl::sw_q_state[q_id]->SetUpCoreID(DEFAULT_INVALID_CORE_ID);
+  rt_->sw_q_state[q_id]->SetUpCoreID(DEFAULT_INVALID_CORE_ID);
 }
 
 int NFVCtrl::NotifyRCoreToWork(cpu_core_t core_id, int q_id) {
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
-  cpu_core_t up = bess::ctrl::sw_q_state[q_id]->GetUpCoreID();
-  cpu_core_t down = bess::ctrl::sw_q_state[q_id]->GetDownCoreID();
+  cpu_core_t up = rt_->sw_q_state[q_id]->GetUpCoreID();
+  cpu_core_t down = rt_->sw_q_state[q_id]->GetDownCoreID();
 
   // Do not assign if sw_q |q_id| does not belong to NFVCore |core_id|
   if (up != core_id) {
@@ -109,30 +123,22 @@ int NFVCtrl::NotifyRCoreToWork(cpu_core_t core_id, int q_id) {
   }
 
   // Find an idle reserved core
-  // [0, ncore - 1] are used for core-boost.
-  // [ncore, rcore - 1] are used for offloading.
-  for (uint16_t i = bess::ctrl::ncore; i < (uint16_t)bess::ctrl::rcore; i++) {
-    if (bess::ctrl::nfv_rcores[i] == nullptr ||
-        !bess::ctrl::rcore_state[i]) {
-      continue;
-    }
+  int rcore_id = rt_->AcquireIdleRCore();
+  if (rcore_id != -1) {
     // Success
-    bess::ctrl::rcore_state[i] = false;
-    bess::ctrl::nfv_rcores[i]->AddQueue(q_id);
+    rt_->cores[rcore_id].nfv_rcore->AddQueue(core_id, q_id);
     return 0;
   }
 
   // No RCores found. System Overloaded! Hand-off to NFVCtrl
-  this->AddQueue(bess::ctrl::sw_q[q_id]);
-  bess::ctrl::sw_q_state[q_id]->SetDownCoreID(DEFAULT_NFVCTRL_CORE_ID);
+  this->AddQueue(rt_->sw_q[q_id]);
+  rt_->sw_q_state[q_id]->SetDownCoreID(DEFAULT_NFVCTRL_CORE_ID);
   return 3;
 }
 
 int NFVCtrl::NotifyRCoreToRest(cpu_core_t core_id, int q_id) {
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
-  cpu_core_t up = bess::ctrl::sw_q_state[q_id]->GetUpCoreID();
-  cpu_core_t down = bess::ctrl::sw_q_state[q_id]->GetDownCoreID();
+  cpu_core_t up = rt_->sw_q_state[q_id]->GetUpCoreID();
+  cpu_core_t down = rt_->sw_q_state[q_id]->GetDownCoreID();
 
   // Do not change if sw_q |q_id| does not belong to NFVCore |core_id|
   if (up != core_id) {
@@ -145,50 +151,76 @@ int NFVCtrl::NotifyRCoreToRest(cpu_core_t core_id, int q_id) {
 
   if (down == DEFAULT_NFVCTRL_CORE_ID) {
     // Queue has been assigned to nfv_ctrl for dumping.
-    this->RemoveQueue(bess::ctrl::sw_q[q_id]);
-    bess::ctrl::sw_q_state[q_id]->SetDownCoreID(DEFAULT_INVALID_CORE_ID);
+    this->RemoveQueue(rt_->sw_q[q_id]);
+    rt_->sw_q_state[q_id]->SetDownCoreID(DEFAULT_INVALID_CORE_ID);
     return 3;
   }
 
   // Success
-  bess::ctrl::nfv_rcores[down]->RemoveQueue(q_id);
+  rt_->cores[down].nfv_rcore->RemoveQueue(core_id, q_id);
   return 0;
 }
 
 int NFVCtrl::RequestRCore() {
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
-  for (int i = 0; i < bess::ctrl::rcore; i++) {
-    if (bess::ctrl::nfv_rcores[i] == nullptr ||
-        !bess::ctrl::rcore_state[i]) {
-      continue;
-    }
-    // Success
-    bess::ctrl::rcore_state[i] = false;
-    return i;
-  }
-  return -1;
+  // Lock-free: many NFVCores may request rcores at the end of the same epoch
+  return rt_->AcquireIdleRCore();
 }
 
-int NFVCtrl::ReleaseRCore(int q_id) {
-  const std::lock_guard<std::mutex> lock(sw_q_mtx_);
-
-  bess::ctrl::nfv_rcores[q_id]->RemoveQueue(q_id);
+int NFVCtrl::ReleaseRCore(cpu_core_t core_id, int q_id) {
+  // The rcore goes back to |idle_rcore_q| once it has drained sw_q |q_id|.
+  // If it is gone, NFVCore::CheckDrainMarkers releases the queue
+  NFVRCore *rcore = rt_->cores[q_id].nfv_rcore;
+  if (rcore == nullptr) {
+    return 1;
+  }
+  rcore->RemoveQueue(core_id, q_id);
   return 0;
 }
 
 void NFVCtrl::NotifyCtrlLoadBalanceNow(uint16_t core_id) {
-  rte_atomic16_set(&is_rebalancing_load_now_, core_id + 1);
+  mailbox_.Post(core_id, {bess::ctrl::CtrlMsg::kLoadBalanceNow, 0});
+}
+
+void NFVCtrl::HandleCtrlMsgs() {
+  using bess::ctrl::CtrlMsg;
+  mailbox_.Poll([this](uint32_t lane, const CtrlMsg &msg) {
+    switch (msg.type) {
+      case CtrlMsg::kStop:
+        stopped_ = true;
+        mailbox_.Complete(lane, msg);
+        break;
+      case CtrlMsg::kStatsReady:
+        if (port_ != nullptr) {
+          CollectLongTermStats(lane);
+        }
+        break;
+      case CtrlMsg::kLoadBalanceNow:
+        load_balance_core_ = lane + 1;
+        break;
+      default:
+        LOG(WARNING) << "nfv_ctrl: unexpected message " << msg.type;
+    }
+  });
 }
 
 CommandResponse NFVCtrl::Init(const bess::pb::NFVCtrlArg &arg) {
-  bess::ctrl::nfv_ctrl = this;
-  bess::ctrl::NFVCtrlCheckAllComponents();
+  rt_ = bess::ctrl::GetNFVRuntime(arg.instance());
+  if (rt_ == nullptr) {
+    return CommandFailure(EINVAL, "invalid instance %d", arg.instance());
+  }
+  if (rt_->nfv_ctrl != nullptr) {
+    return CommandFailure(EEXIST, "instance %d already has an NFVCtrl",
+                          arg.instance());
+  }
 
+  // Publish |this| only once Init can no longer fail; otherwise the
+  // runtime would keep a pointer to a module that is never created
   task_id_t tid = RegisterTask(nullptr);
   if (tid == INVALID_TASK_ID) {
     return CommandFailure(ENOMEM, "Task creation failed");
   }
+  rt_->nfv_ctrl = this;
+  rt_->CheckAllComponents();
 
   worker_id_ = 0;
   if (arg.wid() > 0) {
@@ -203,13 +235,13 @@ CommandResponse NFVCtrl::Init(const bess::pb::NFVCtrlArg &arg) {
 
   total_core_count_ = 0;
   if (arg.ncore() > 0) {
-    bess::ctrl::ncore = arg.ncore();
-    total_core_count_ = bess::ctrl::ncore;
+    rt_->ncore = arg.ncore();
+    total_core_count_ = rt_->ncore;
   }
   if (arg.rcore() > 0) {
-    bess::ctrl::rcore = arg.rcore();
+    rt_->rcore = arg.rcore();
   }
-  LOG(INFO) << "ncore: " << bess::ctrl::ncore << ", rcore: " << bess::ctrl::rcore;
+  LOG(INFO) << "ncore: " << rt_->ncore << ", rcore: " << rt_->rcore;
 
   long_epoch_period_ns_ = LONG_TERM_UPDATE_PERIOD_NS;
   if (arg.long_epoch_period_ns() > 0) {
@@ -224,47 +256,23 @@ CommandResponse NFVCtrl::Init(const bess::pb::NFVCtrlArg &arg) {
   }
   LOG(INFO) << "target slo: " << bess::utils::slo_ns / 1000 << " us; Ironside long period: " << long_epoch_period_ns_ / 1000 << " us";
 
+  rt_->nf_profile_pkt_size = arg.nf_profile_pkt_size();
+
   // By default, open the example NF profile
   std::string long_profile_fname = "long_term_threshold";
   if (arg.nf_long_term_profile().size() > 0) {
     long_profile_fname = arg.nf_long_term_profile();
   }
 
-  std::ifstream long_profile_file(long_profile_fname, std::ifstream::in);
-  if (long_profile_file.is_open()) {
-    while (!long_profile_file.eof()) {
-      uint64_t pps;
-      uint64_t flow_count;
-      long_profile_file >> flow_count;
-      long_profile_file >> pps;
-      bess::ctrl::long_flow_count_pps_threshold[flow_count] = pps;
-    }
-    long_profile_file.close();
-    LOG(INFO) << "Long-term NF profile " + long_profile_fname;
-    LOG(INFO) << "Points: " << bess::ctrl::long_flow_count_pps_threshold.size();
-  } else {
-    LOG(INFO) << "Failed to read " + long_profile_fname;
-  }
+  LoadNFPerfModel(long_profile_fname, arg.nf_chain_long_term_profiles(),
+                  &rt_->long_term_model);
 
   std::string short_profile_fname = "nf_profiles/short_term.pro";
   if (arg.nf_short_term_profile().size() > 0) {
     short_profile_fname = arg.nf_short_term_profile();
   }
-  std::ifstream short_profile_file(short_profile_fname, std::ifstream::in);
-  if (short_profile_file.is_open()) {
-    while (!short_profile_file.eof()) {
-      uint32_t pkt_count;
-      uint32_t flow_count;
-      short_profile_file >> flow_count;
-      short_profile_file >> pkt_count;
-      bess::ctrl::short_flow_count_pkt_threshold[flow_count] = pkt_count;
-    }
-    short_profile_file.close();
-    LOG(INFO) << "Short-term NF profile " + short_profile_fname;
-    LOG(INFO) << "Points: " << bess::ctrl::short_flow_count_pkt_threshold.size();
-  } else {
-    LOG(INFO) << "Failed to read " + short_profile_fname;
-  }
+  LoadNFPerfModel(short_profile_fname, arg.nf_chain_short_term_profiles(),
+                  &rt_->short_term_model);
 
   if (arg.exp_id() > 0) {
     bess::ctrl::exp_id = (int)arg.exp_id();
@@ -273,24 +281,32 @@ CommandResponse NFVCtrl::Init(const bess::pb::NFVCtrlArg &arg) {
 
   // Waiting for long-term stats from all ncores
   msg_mode_ = false;
-  rte_atomic16_set(&long_term_stats_ready_cores_, 0);
+  long_term_stats_request_ns_ = curr_ts_ns_;
+  for (int i = 0; i < DEFAULT_INVALID_CORE_ID; i++) {
+    long_term_stats_pending_[i] = false;
+    long_term_stats_ts_ns_[i] = curr_ts_ns_;
+  }
+  memset(core_shard_pkt_rate_, 0, sizeof(core_shard_pkt_rate_));
+  memset(core_shard_flow_count_, 0, sizeof(core_shard_flow_count_));
 
   std::string ingress_ip = "10.10.1.1";
   bess::utils::ParseIpv4Address(ingress_ip, &monitor_dst_ip_);
 
+  long_term_stats_pending_count_ = 0;
+
   // Run!
-  rte_atomic16_set(&is_rebalancing_load_now_, 0);
-  rte_atomic16_set(&disabled_, 0);
+  load_balance_core_ = 0;
+  stopped_ = false;
   return CommandSuccess();
 }
 
 void NFVCtrl::DeInit() {
-  // Mark to stop the pipeline and wait until the pipeline stops
-  rte_atomic16_set(&is_rebalancing_load_now_, 0);
-  rte_atomic16_set(&disabled_, 1);
-  while (rte_atomic16_read(&disabled_) != 2) { usleep(100000); }
+  // Stop the pipeline and wait until it stops (within one round)
+  if (!bess::ctrl::StopAndWait(this, &mailbox_, "nfv_ctrl")) {
+    stopped_ = true;
+  }
 
-  llring* q;
+  BatchRing* q;
   if (to_add_queue_) {
     while (llring_sc_dequeue(to_add_queue_, (void **)&q) == 0) { continue; }
     std::free(to_add_queue_);
@@ -302,10 +318,13 @@ void NFVCtrl::DeInit() {
     to_remove_queue_ = nullptr;
   }
 
-  bess::ctrl::nfv_ctrl = nullptr;
+  rt_->nfv_ctrl = nullptr;
 }
 
 CommandResponse NFVCtrl::CommandGetSummary(const bess::pb::EmptyArg &arg) {
+  if (port_ != nullptr) {
+    port_->ReportRssSwitchover();
+  }
   for (const auto& it : ModuleGraph::GetAllModules()) {
     if (it.first.find("nfv_monitor") != std::string::npos) {
       ((NFVMonitor *)(it.second))->CommandGetSummary(arg);
@@ -315,25 +334,50 @@ CommandResponse NFVCtrl::CommandGetSummary(const bess::pb::EmptyArg &arg) {
 }
 
 struct task_result NFVCtrl::RunTask(Context *, bess::PacketBatch *, void *) {
-  if (port_ == nullptr) {
+  // Per-core loads are updated as soon as each normal core reports
+  if (mailbox_.Pending()) {
+    HandleCtrlMsgs();
+  }
+  if (stopped_ || port_ == nullptr) {
     return {.block = false, .packets = 1, .bits = 1};
   }
 
   uint64_t curr_ts_ns = tsc_to_ns(rdtsc());
+
   if (curr_ts_ns - last_long_epoch_end_ns_ > long_epoch_period_ns_) {
     if (!msg_mode_) {
-      for (int i = 0; i < bess::ctrl::ncore; i++) {
-        bess::ctrl::nfv_cores[i]->UpdateBucketStats();
+      for (int i = 0; i < rt_->ncore; i++) {
+        if (rt_->cores[i].nfv_core != nullptr &&
+            rt_->cores[i].nfv_core->UpdateBucketStats() &&
+            !long_term_stats_pending_[i]) {
+          long_term_stats_pending_[i] = true;
+          long_term_stats_pending_count_ += 1;
+        }
       }
+      long_term_stats_request_ns_ = curr_ts_ns;
       msg_mode_ = true;
       goto terminate;
     }
 
-    if (rte_atomic16_read(&long_term_stats_ready_cores_) != bess::ctrl::ncore) {
+    // Do not let a slow core block the long-term op. Its shards keep the
+    // stats from its last report
+    if (long_term_stats_pending_count_ > 0) {
+      if (curr_ts_ns - long_term_stats_request_ns_ < LONG_TERM_STATS_WAIT_NS) {
+        goto terminate;
+      }
+      LOG(INFO) << "Long-term op: " << long_term_stats_pending_count_ << " ncores missed stats";
+      for (int i = 0; i < rt_->ncore; i++) {
+        long_term_stats_pending_[i] = false;
+      }
+      long_term_stats_pending_count_ = 0;
+    }
+
+    // As with on-demand ops, wait until the NIC has switched to the last
+    // RSS rule; the stats collected above are kept until then
+    if (port_->IsRssSwitchoverPending()) {
       goto terminate;
     }
 
-    rte_atomic16_set(&long_term_stats_ready_cores_, 0);
     msg_mode_ = false;
 
     // Default long-term op
@@ -342,31 +386,24 @@ struct task_result NFVCtrl::RunTask(Context *, bess::PacketBatch *, void *) {
     if (moves > 0) {
       LOG(INFO) << "Long-term op: default, time = " << last_long_epoch_end_ns_;
     }
-    rte_atomic16_set(&is_rebalancing_load_now_, 0);
+    load_balance_core_ = 0;
     last_long_epoch_end_ns_ = tsc_to_ns(rdtsc());
-
-    // For graceful termination
-    if (rte_atomic16_read(&disabled_) == 1) {
-      rte_atomic16_set(&disabled_, 2);
-      return {.block = false, .packets = 1, .bits = 1};
-    }
   } else {
     if (bess::ctrl::exp_id == 7) {
       // On-demand long-term optimization
-      uint16_t core_id = rte_atomic16_read(&is_rebalancing_load_now_);
-      if (core_id > 0) {
+      uint16_t core_id = load_balance_core_;
+      // Keep the request until the NIC has switched to the last RSS rule
+      if (core_id > 0 && !port_->IsRssSwitchoverPending()) {
         core_id -= 1;
-        if (curr_ts_ns - last_long_epoch_end_ns_ > MIN_NIC_RSS_UPDATE_PERIOD_NS) {
-          // Re-group RSS buckets to cores to adpat to long-term load changes
-          uint32_t moves = OnDemandLongEpochProcess(core_id);
-          last_long_epoch_end_ns_ = tsc_to_ns(rdtsc());
-          if (moves > 0) {
-            LOG(INFO) << "Long-term op: on-demand, time = " << last_long_epoch_end_ns_;
-          }
+        // Re-group RSS buckets to cores to adpat to long-term load changes
+        uint32_t moves = OnDemandLongEpochProcess(core_id);
+        last_long_epoch_end_ns_ = tsc_to_ns(rdtsc());
+        if (moves > 0) {
+          LOG(INFO) << "Long-term op: on-demand, time = " << last_long_epoch_end_ns_;
         }
 
         // reset
-        rte_atomic16_set(&is_rebalancing_load_now_, 0);
+        load_balance_core_ = 0;
       }
     }
   }
@@ -1,13 +1,18 @@
 #ifndef BESS_MODULES_NFV_CTRL_H_
 #define BESS_MODULES_NFV_CTRL_H_
 
+#include <atomic>
 #include <shared_mutex>
 
+#include "nfv_ctrl_msg.h"
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../drivers/pmd.h"
 #include "../utils/cpu_core.h"
 #include "../utils/lock_less_queue.h"
+#include "../utils/shard_rebalancer.h"
+#include "../utils/sys_measure.h"
 
 using bess::utils::WorkerCore;
 
@@ -17,13 +22,18 @@ class NFVCtrl final : public Module {
   static const gate_idx_t kNumIGates = 0;
   static const gate_idx_t kNumOGates = 0;
 
-  NFVCtrl() : Module() { is_task_ = true; }
+  NFVCtrl() : Module(), rt_(nullptr), port_(nullptr), stopped_(false) {
+    is_task_ = true;
+  }
 
   CommandResponse Init(const bess::pb::NFVCtrlArg &arg);
   void DeInit() override;
 
   void InitPMD(PMDPort* port);
 
+  // Software queues and rcores are managed without locks, so that NFVCores
+  // can call the functions below from the datapath at the same time.
+
   // Returns |n| (idle) software queue's index as a bitmask.
   // Once assigned, the software queue is uniquely accessed by NFVCore (the caller).
   std::vector<int> RequestNSwQ(cpu_core_t core_id, int n);
@@ -41,21 +51,24 @@ class NFVCtrl final : public Module {
   // 2: wrong q_id
   // 3: no idle RCore
 
-  // Finds an idle NFVRCore to work on sw_q |q_id|.
+  // Finds an idle NFVRCore to work on sw_q |q_id|, and wakes it up if it is
+  // parked on its eventfd.
   int NotifyRCoreToWork(cpu_core_t core_id, int q_id);
   int RequestRCore();
   // Notifies the NFVRCore to stop working on sw_q |q_id|.
   int NotifyRCoreToRest(cpu_core_t core_id, int q_id);
-  int ReleaseRCore(int q_id);
+  // Called by normal core |core_id| to return the rcore of sw_q |q_id|.
+  int ReleaseRCore(cpu_core_t core_id, int q_id);
 
-  inline void AddQueue(struct llring* q) {
+  inline void AddQueue(BatchRing* q) {
     llring_mp_enqueue(to_add_queue_, (void*)q);
   }
-  inline void RemoveQueue(struct llring* q) {
+  inline void RemoveQueue(BatchRing* q) {
     llring_mp_enqueue(to_remove_queue_, (void*)q);
   }
-  inline void NotifyLongTermStatsReady() {
-    rte_atomic16_inc(&long_term_stats_ready_cores_);
+  // Called by normal core |core_id| once its bucket stats are published
+  inline void NotifyLongTermStatsReady(uint16_t core_id) {
+    mailbox_.Post(core_id, {bess::ctrl::CtrlMsg::kStatsReady, 0});
   }
 
   struct task_result RunTask(Context *ctx, bess::PacketBatch *batch, void *arg) override;
@@ -64,7 +77,8 @@ class NFVCtrl final : public Module {
   // This function runs a heurisics algorithm to re-group RSS buckets
   // to the minimal # of normal cores according to the long-term NF
   // performance profile. It returns the # of moves for rebalancing
-  // RSS buckets. 0 if nothing will change.
+  // RSS buckets. 0 if nothing will change. Only moved buckets are
+  // pushed to the NIC.
   uint32_t LongEpochProcess();
 
   // This function runs a heurisics algorithm to split RSS buckets
@@ -89,35 +103,34 @@ class NFVCtrl final : public Module {
   // Return the max packet rate under flow count |fc| given the input NF profile.
   // uint64_t GetMaxPktRateFromLongTermProfile(uint64_t fc);
 
-  // LongTermOptimzation adjusts the system for long term changes. It makes sure
-  // that no cores are violating p50 SLO. It also reduces resource consumption by
-  // packing flows tightly and freeing up CPU cores.
-  std::map<uint16_t, uint16_t> LongTermOptimization(
-      const std::vector<uint64_t>& per_bucket_pkt_rate,
-      const std::vector<uint64_t>& per_bucket_flow_count);
-
-  std::map<uint16_t, uint16_t> OnDemandLongTermOptimization(
-      uint16_t core_id,
-      const std::vector<uint64_t>& per_bucket_pkt_rate,
-      const std::vector<uint64_t>& per_bucket_flow_count);
-
-  // Apply first-fit to find the best core for the set of RSS buckets to be migrated
-  std::map<uint16_t, uint16_t> FindMoves(
-      std::vector<uint64_t>& per_core_pkt_rate,
-      std::vector<uint64_t>& per_core_flow_count,
-      const std::vector<uint64_t>& per_bucket_pkt_rate,
-      const std::vector<uint64_t>& per_bucket_flow_count,
-      std::vector<uint16_t>& to_move_cores);
+  // Handles all messages in |mailbox_|
+  void HandleCtrlMsgs();
+
+  // Folds the bucket stats that normal core |core_id| has just published
+  // into |rebalancer_|.
+  void CollectLongTermStats(uint16_t core_id);
+
+  // Updates the set of normal cores that can take over RSS shards.
+  void UpdateUsableCores();
+
+  // Copies the core assignment of |rebalancer_| to each core's |active| flag
+  // and |active_core_count_|.
+  void SyncCoreState();
+
+  // The Ironside instance that |this| manages
+  bess::ctrl::NFVRuntime *rt_;
 
   uint64_t long_epoch_period_ns_;
   uint64_t last_long_epoch_end_ns_;
 
   int worker_id_;
 
-  // For each normal CPU core, the set of assigned RSS shards
-  std::map<uint16_t, std::vector<uint16_t>> core_shard_mapping_;
+  // Keeps the RSS shard assignment and per-core loads up to date. Both
+  // default and on-demand long-term ops run on it incrementally
+  bess::utils::ShardRebalancer rebalancer_;
 
-  // For updating RSS bucket assignment
+  // For updating RSS bucket assignment. Set by InitPMD(); until then,
+  // RunTask() skips all long-term ops
   PMDPort *port_;
   queue_t qid_;
   bess::PacketBatch* local_batch_;
@@ -134,28 +147,36 @@ class NFVCtrl final : public Module {
   be32_t monitor_src_ip_;
   be32_t monitor_dst_ip_;
 
-  // The lock for maintaining a pool of software queues
-  mutable std::mutex sw_q_mtx_;
-
   bool msg_mode_;
-  rte_atomic16_t long_term_stats_ready_cores_;
+  uint64_t long_term_stats_request_ns_;
+  // True if a normal core has not reported in the current long epoch
+  bool long_term_stats_pending_[DEFAULT_INVALID_CORE_ID];
+  uint16_t long_term_stats_pending_count_;
+  // The last time that a normal core's bucket stats were collected
+  uint64_t long_term_stats_ts_ns_[DEFAULT_INVALID_CORE_ID];
+  // Each normal core's share of a shard's packet rate and flow count. A report
+  // from one core replaces only its own share
+  uint64_t core_shard_pkt_rate_[DEFAULT_INVALID_CORE_ID][SHARD_NUM];
+  uint64_t core_shard_flow_count_[DEFAULT_INVALID_CORE_ID][SHARD_NUM];
 
   // A vector of software queues that cannot be assigned to a reserved core
-  std::vector<struct llring*> to_dump_sw_q_;
+  std::vector<BatchRing*> to_dump_sw_q_;
   struct llring *to_add_queue_;
   struct llring *to_remove_queue_;
 
   uint64_t curr_ts_ns_;
 
-  // If true, |this| normal core stops pulling packets from its NIC queue
-  rte_atomic16_t disabled_;
-
-  // Set by |NFVCore| and |NFVRCore| when a persistent traffic burst is
-  // observed. |this| module will run a long-term optimization to rebalance
-  // traffic loads across cores now. However, it should still respect the
-  // NIC's hardware limitation: one cannot reprogram the NIC forwarding
-  // table rule within ~5 ms (according to our measurement results).
-  rte_atomic16_t is_rebalancing_load_now_;
+  // Messages from normal cores (stats reports, rebalancing requests) and
+  // the control thread. Once |stopped_| is set (by kStop or DeInit), |this|
+  // module no longer runs long-term ops.
+  bess::ctrl::CtrlMailbox mailbox_;
+  std::atomic<bool> stopped_;
+
+  // Set (to core ID + 1) when a normal core observes a persistent traffic
+  // burst (kLoadBalanceNow). |this| module will run a long-term optimization
+  // to rebalance traffic loads across cores as soon as the NIC has completed
+  // the last RSS switchover (see PMDPort::IsRssSwitchoverPending).
+  uint16_t load_balance_core_;
 };
 
 #endif // BESS_MODULES_NFV_CTRL_H_
\ No newline at end of file
@@ -98,22 +98,22 @@ void NFVCtrl::InitPMD(PMDPort* port) {
   local_batch_->clear();
 
   // Init the core-bucket mapping
-  for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-    core_shard_mapping_[i] = std::vector<uint16_t>();
-  }
+  bess::utils::ShardRebalancerOptions opts;
+  opts.migrate_head_room = MIGRATE_HEAD_ROOM;
+  opts.assign_head_room = ASSIGN_HEAD_ROOM;
+  bess::ctrl::NFVRuntime *rt = rt_;
+  rebalancer_.Init(SHARD_NUM, rt_->ncore,
+                   [rt](uint64_t fc) {
+                     return rt->GetMaxPktRateFromLongTermProfile(fc);
+                   },
+                   opts);
   for (uint16_t i = 0; i < SHARD_NUM; i++) {
-    uint16_t core_id = port_->reta_table_[i];
-    core_shard_mapping_[core_id].push_back(i);
+    rebalancer_.Assign(i, port_->reta_table_[i]);
   }
+  UpdateUsableCores();
 
   // Init the number of |active_core_count_|
-  active_core_count_ = 0;
-  for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-    if (core_shard_mapping_[i].size() > 0) {
-      bess::ctrl::core_state[i] = true;
-      active_core_count_ += 1;
-    }
-  }
+  SyncCoreState();
   rte_atomic16_set(&curr_active_core_count_, active_core_count_);
 
   // Update the NIC hardware
@@ -121,233 +121,57 @@ void NFVCtrl::InitPMD(PMDPort* port) {
   LOG(INFO) << "NIC init: " << active_core_count_ << " active normal cores";
 }
 
-uint64_t GetMaxPktRateFromLongTermProfile(uint64_t fc) {
-  if (bess::ctrl::long_flow_count_pps_threshold.size() == 0) {
-    return 1000000;
-  }
-
-  for (auto& it : bess::ctrl::long_flow_count_pps_threshold) {
-    if (it.first > fc) {
-      return it.second;
-    }
+void NFVCtrl::CollectLongTermStats(uint16_t j) {
+  uint64_t curr_ts_ns = tsc_to_ns(rdtsc());
+  // Get rate per second over the period since this core's last report
+  uint64_t time_diff_ns = std::max<uint64_t>(
+      curr_ts_ns - long_term_stats_ts_ns_[j], 1);
+  for (uint16_t i = 0; i < SHARD_NUM; i++) {
+    uint64_t pkt_rate =
+        rt_->cores[j].pcpb_packet_count[i] * 1000000000ULL / time_diff_ns;
+    uint64_t flow_count =
+        rt_->cores[j].pcpb_flow_count[i] * 1000000000ULL / time_diff_ns;
+    rt_->cores[j].pcpb_packet_count[i] = 0;
+    rt_->cores[j].pcpb_flow_count[i] = 0;
+
+    // O(1): replace this core's share and update the owner core's load
+    rebalancer_.UpdateShard(i,
+        rebalancer_.ShardPktRate(i) - core_shard_pkt_rate_[j][i] + pkt_rate,
+        rebalancer_.ShardFlowCount(i) - core_shard_flow_count_[j][i] + flow_count);
+    core_shard_pkt_rate_[j][i] = pkt_rate;
+    core_shard_flow_count_[j][i] = flow_count;
+  }
+
+  long_term_stats_ts_ns_[j] = curr_ts_ns;
+  if (long_term_stats_pending_[j]) {
+    long_term_stats_pending_[j] = false;
+    long_term_stats_pending_count_ -= 1;
   }
-  return (--bess::ctrl::long_flow_count_pps_threshold.end())->second;
 }
 
-std::map<uint16_t, uint16_t> NFVCtrl::FindMoves(std::vector<uint64_t>& per_cpu_pkt_rate,
-                                                std::vector<uint64_t>& per_cpu_flow_count,
-                                                const std::vector<uint64_t>& per_shard_pkt_rate,
-                                                const std::vector<uint64_t>& per_shard_flow_count,
-                                                std::vector<uint16_t>& to_move_shards) {
-  std::map<uint16_t, uint16_t> moves;
-  std::vector<uint16_t> skipped_shards;
-  uint64_t shard_pkt_rate, shard_flow_count;
-
-  for (auto shard : to_move_shards) {
-    shard_pkt_rate = per_shard_pkt_rate[shard];
-    shard_flow_count = per_shard_flow_count[shard];
-    bool found = false;
-    for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-      if (bess::ctrl::nfv_cores[i] &&
-          bess::ctrl::core_state[i] &&
-          per_cpu_pkt_rate[i] + shard_pkt_rate <
-          (GetMaxPktRateFromLongTermProfile(per_cpu_flow_count[i] + shard_flow_count) * (1 - ASSIGN_HEAD_ROOM))) {
-        per_cpu_pkt_rate[i] += shard_pkt_rate;
-        per_cpu_flow_count[i] += shard_flow_count;
-        moves[shard] = i;
-        core_shard_mapping_[i].push_back(shard);
-        found = true;
-        break;
-      }
-    }
-
-    // No core found. Need to add a new core
-    if (!found) {
-      for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-        if (bess::ctrl::nfv_cores[i] &&
-            !bess::ctrl::core_state[i]) {
-          per_cpu_pkt_rate[i] += shard_pkt_rate;
-          per_cpu_flow_count[i] += shard_flow_count;
-          moves[shard] = i;
-          core_shard_mapping_[i].push_back(shard);
-          found = true;
-
-          bess::ctrl::core_state[i] = true;
-          bess::ctrl::core_liveness[i] = 1;
-          active_core_count_ += 1;
-          break;
-        }
-      }
-
-      // No enough cores for handling the excessive load. (This should never happen)
-      if (!found) {
-        skipped_shards.push_back(shard);
-      }
-    }
+void NFVCtrl::UpdateUsableCores() {
+  for (uint16_t i = 0; i < rt_->ncore; i++) {
+    rebalancer_.SetCoreUsable(i, rt_->cores[i].nfv_core != nullptr);
   }
-
-  to_move_shards = skipped_shards;
-  size_t skip = to_move_shards.size();
-  if (skip > 0) {
-    LOG(INFO) << "No idle ncore found for " << skip << " buckets; active ncores: " << active_core_count_;
-  }
-  return moves;
 }
 
-std::map<uint16_t, uint16_t> NFVCtrl::LongTermOptimization(
-        const std::vector<uint64_t>& per_shard_pkt_rate,
-        const std::vector<uint64_t>& per_shard_flow_count) {
-  std::vector<uint64_t> per_cpu_pkt_rate(bess::ctrl::ncore, 0);
-  std::vector<uint64_t> per_cpu_flow_count(bess::ctrl::ncore, 0);
-  active_core_count_ = 0;
-
-  // Compute the aggregated packet rate for each core.
-  // Note: |core_state|: a normal core is in-use;
-  // |core_liveness|: # of long-term epochs that a core has been active
-  for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-    if (core_shard_mapping_[i].size() > 0) {
-      for (uint16_t shard : core_shard_mapping_[i]) {
-        per_cpu_pkt_rate[i] += per_shard_pkt_rate[shard];
-        per_cpu_flow_count[i] += per_shard_flow_count[shard];
-      }
-      // LOG(INFO) << "core" << i << ": pkt=" << per_cpu_pkt_rate[i] << ", flow=" << per_cpu_flow_count[i];
-      bess::ctrl::core_state[i] = true;
-      bess::ctrl::core_liveness[i] += 1;
-      active_core_count_ += 1;
-    }
-  }
-
-  // Find if any core is exceeding threshold and add it to the to be moved list
-  std::vector<uint16_t> to_move_shards;
-  std::map<uint16_t, uint16_t> to_move_shards_to_cores; // remember where to put back
-  for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-    if (!bess::ctrl::core_state[i]) {
-      continue;
-    }
-    // LOG(INFO) << "c" << i << ": " << per_cpu_pkt_rate[i] << ", " << per_cpu_flow_count[i] << ", " << GetMaxPktRateFromLongTermProfile(per_cpu_flow_count[i]);
-
-    // Move a shard and do this until the aggregated packet rate is below the threshold
-    while (per_cpu_pkt_rate[i] >
-          GetMaxPktRateFromLongTermProfile(per_cpu_flow_count[i]) * (1 - MIGRATE_HEAD_ROOM) &&
-          core_shard_mapping_[i].size() > 0) {
-      uint16_t shard = core_shard_mapping_[i].back();
-      to_move_shards.push_back(shard);
-      to_move_shards_to_cores.emplace(shard, i);
-      core_shard_mapping_[i].pop_back();
-
-      per_cpu_pkt_rate[i] -= per_shard_pkt_rate[shard];
-      per_cpu_flow_count[i] -= per_shard_flow_count[shard];
-      bess::ctrl::core_liveness[i] = 1;
-    }
-  }
-
-  // For all shards to be moved, assign them to a core
-  std::map<uint16_t, uint16_t> shard_moves = FindMoves(
-      per_cpu_pkt_rate, per_cpu_flow_count,
-      per_shard_pkt_rate, per_shard_flow_count,
-      to_move_shards);
-
-  // Keep track of these shards
-  for (auto shard : to_move_shards) {
-    uint16_t core = to_move_shards_to_cores[shard];
-    core_shard_mapping_[core].push_back(shard);
-    per_cpu_pkt_rate[core] += per_shard_pkt_rate[shard];
-    per_cpu_flow_count[core] += per_shard_flow_count[shard];
-  }
-
-  if (active_core_count_ == 1) {
-    return shard_moves;
-  }
-
-  // Find the CPU with minimum flow rate and (try to) delete it
-  uint16_t min_rate_core = DEFAULT_INVALID_CORE_ID;
-  uint64_t min_rate = 0;
-  for(uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-    if (!bess::ctrl::core_state[i] ||
-        bess::ctrl::core_liveness[i] <= 4) {
-      continue;
-    }
-
-    if (min_rate_core == DEFAULT_INVALID_CORE_ID) {
-      min_rate_core = i;
-      min_rate = per_cpu_pkt_rate[i];
-      continue;
-    }
-    if (per_cpu_pkt_rate[i] < min_rate) {
-      min_rate_core = i;
-      min_rate = per_cpu_pkt_rate[i];
-    }
-  }
-
-  // Do nothing to avoid oscillations. If:
-  // - no min-rate core is found;
-  // - the min-rate core's rate is too large;
-  if (min_rate_core == DEFAULT_INVALID_CORE_ID ||
-      min_rate > GetMaxPktRateFromLongTermProfile(per_cpu_flow_count[min_rate_core]) / 2) {
-    return shard_moves;
+void NFVCtrl::SyncCoreState() {
+  // Note: |active|: a normal core is in-use
+  for (uint16_t i = 0; i < rt_->ncore; i++) {
+    rt_->cores[i].active = rebalancer_.IsActive(i);
   }
-
-  // Move all buckets at the min-rate core; before that, save the current state
-  per_cpu_pkt_rate[min_rate_core] = 100000000;
-  int org_active_cores = active_core_count_;
-  std::vector<uint16_t> pack_shards = core_shard_mapping_[min_rate_core];
-  size_t pack_shard_cnt = pack_shards.size();
-
-  std::map<uint16_t, uint16_t> tmp_shard_moves = FindMoves(
-      per_cpu_pkt_rate, per_cpu_flow_count,
-      per_shard_pkt_rate, per_shard_flow_count,
-      pack_shards);
-
-  if (active_core_count_ > org_active_cores ||
-      pack_shards.size() > 0 ||
-      tmp_shard_moves.size() != pack_shard_cnt) {
-    // If this trial fails, undo all changes
-    // - case 1: |FindMoves| uses more cores;
-    // - case 2: |pack_shards| cannot be fit into normal cores;
-    per_cpu_pkt_rate[min_rate_core] = min_rate;
-    for (auto& m_it : tmp_shard_moves) {
-      core_shard_mapping_[m_it.second].pop_back();
-      per_cpu_pkt_rate[m_it.second] -= per_shard_pkt_rate[m_it.first];
-      per_cpu_flow_count[m_it.second] -= per_shard_flow_count[m_it.first];
-    }
-  } else {
-    // Reclaim the min-rate core successfully
-    core_shard_mapping_[min_rate_core].clear();
-    for (auto& m_it : tmp_shard_moves) {
-      shard_moves[m_it.first] = m_it.second;
-    }
-
-    bess::ctrl::core_state[min_rate_core] = false;
-    active_core_count_ -= 1;
-  }
-
-  return shard_moves;
+  active_core_count_ = rebalancer_.ActiveCoreCount();
 }
 
 uint32_t NFVCtrl::LongEpochProcess() {
-  // Per-bucket packet rate and flow count used by the long-term optimization.
-  std::vector<uint64_t> per_shard_pkt_rate(SHARD_NUM, 0);
-  std::vector<uint64_t> per_shard_flow_count(SHARD_NUM, 0);
-  uint64_t time_diff_ns = tsc_to_ns(rdtsc()) - last_long_epoch_end_ns_;
-  uint64_t pps = 0;
-
-  for (int i = 0; i < SHARD_NUM; i++) {
-    for (int j = 0; j < bess::ctrl::ncore; j++) {
-      per_shard_pkt_rate[i] += bess::ctrl::pcpb_packet_count[j][i];
-      per_shard_flow_count[i] += bess::ctrl::pcpb_flow_count[j][i];
-      bess::ctrl::pcpb_packet_count[j][i] = 0;
-      bess::ctrl::pcpb_flow_count[j][i] = 0;
-    }
-    // Get rate per second
-    per_shard_pkt_rate[i] = per_shard_pkt_rate[i] * 1000000000ULL / time_diff_ns;
-    per_shard_flow_count[i] = per_shard_flow_count[i] * 1000000000ULL / time_diff_ns;
-    pps += per_shard_pkt_rate[i];
-  }
-  curr_packet_rate_ = (uint32_t)pps;
+  UpdateUsableCores();
+  curr_packet_rate_ = (uint32_t)rebalancer_.TotalPktRate();
 
-  std::map<uint16_t, uint16_t> moves =
-    LongTermOptimization(per_shard_pkt_rate, per_shard_flow_count);
+  // Per-core loads are already up to date. This only looks at overloaded
+  // cores and the min-rate core, and returns the moved shards.
+  std::map<uint16_t, uint16_t> moves = rebalancer_.Rebalance();
 
+  SyncCoreState();
   rte_atomic16_set(&curr_active_core_count_, active_core_count_);
   SendWorkerInfo();
 
@@ -358,96 +182,14 @@ uint32_t NFVCtrl::LongEpochProcess() {
   return moves.size();
 }
 
-std::map<uint16_t, uint16_t> NFVCtrl::OnDemandLongTermOptimization(uint16_t core_id,
-        const std::vector<uint64_t>& per_shard_pkt_rate,
-        const std::vector<uint64_t>& per_shard_flow_count) {
-  std::vector<uint64_t> per_cpu_pkt_rate(bess::ctrl::ncore, 0);
-  std::vector<uint64_t> per_cpu_flow_count(bess::ctrl::ncore, 0);
-  active_core_count_ = 0;
-
-  for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-    per_cpu_pkt_rate[i] = 0;
-    if (core_shard_mapping_[i].size() > 0) {
-      for (uint16_t shard : core_shard_mapping_[i]) {
-        per_cpu_pkt_rate[i] += per_shard_pkt_rate[shard];
-        per_cpu_flow_count[i] += per_shard_flow_count[shard];
-      }
-      bess::ctrl::core_state[i] = true;
-      bess::ctrl::core_liveness[i] += 1;
-      active_core_count_ += 1;
-    }
-  }
-
-  // Add shards to |to_move_shards|.
-  std::vector<uint16_t> to_move_shards;
-  uint64_t target_pkt_rate = per_cpu_pkt_rate[core_id] / 2;
-  while (per_cpu_pkt_rate[core_id] > target_pkt_rate &&
-        core_shard_mapping_[core_id].size() > 0) {
-    uint16_t shard = core_shard_mapping_[core_id].back();
-    to_move_shards.push_back(shard);
-    core_shard_mapping_[core_id].pop_back();
-
-    per_cpu_pkt_rate[core_id] -= per_shard_pkt_rate[shard];
-    per_cpu_flow_count[core_id] -= per_shard_flow_count[shard];
-    bess::ctrl::core_liveness[core_id] = 1;
-  }
-
-  uint16_t mr_core = DEFAULT_INVALID_CORE_ID;
-  uint64_t min_rate = 0;
-  for (uint16_t i = 0; i < bess::ctrl::ncore; i++) {
-    if (i != core_id && bess::ctrl::nfv_cores[i]) {
-      if (mr_core == DEFAULT_INVALID_CORE_ID) {
-        mr_core = i;
-        min_rate = per_cpu_pkt_rate[i];
-        continue;
-      }
-      if (per_cpu_pkt_rate[i] < min_rate) {
-        mr_core = i;
-        min_rate = per_cpu_pkt_rate[i];
-      }
-    }
-  }
-
-  if (!bess::ctrl::core_state[mr_core]) {
-    bess::ctrl::core_state[mr_core] = true;
-    bess::ctrl::core_liveness[mr_core] = 1;
-    active_core_count_ += 1;
-  }
-
-  std::map<uint16_t, uint16_t> moves;
-  for (auto shard : to_move_shards) {
-    per_cpu_pkt_rate[mr_core] += per_shard_pkt_rate[shard];
-    per_cpu_flow_count[mr_core] += per_shard_flow_count[shard];
-    moves[shard] = mr_core;
-    core_shard_mapping_[mr_core].push_back(shard);
-  }
-  return moves;
-}
-
 uint32_t NFVCtrl::OnDemandLongEpochProcess(uint16_t core_id) {
-  // Per-bucket packet rate and flow count are to be used by the long-term op.
-  std::vector<uint64_t> per_shard_pkt_rate(SHARD_NUM, 0);
-  std::vector<uint64_t> per_shard_flow_count(SHARD_NUM, 0);
-  uint64_t time_diff_ns = tsc_to_ns(rdtsc()) - last_long_epoch_end_ns_;
-  uint64_t pps = 0;
-
-  for (int i = 0; i < SHARD_NUM; i++) {
-    for (int j = 0; j < bess::ctrl::ncore; j++) {
-      per_shard_pkt_rate[i] += bess::ctrl::pcpb_packet_count[j][i];
-      per_shard_flow_count[i] += bess::ctrl::pcpb_flow_count[j][i];
-      bess::ctrl::pcpb_packet_count[j][i] = 0;
-      bess::ctrl::pcpb_flow_count[j][i] = 0;
-    }
-    // Get rate per second
-    per_shard_pkt_rate[i] = per_shard_pkt_rate[i] * 1000000000ULL / time_diff_ns;
-    per_shard_flow_count[i] = per_shard_flow_count[i] * 1000000000ULL / time_diff_ns;
-    pps += per_shard_pkt_rate[i];
-  }
-  curr_packet_rate_ = (uint32_t)pps;
+  UpdateUsableCores();
+  curr_packet_rate_ = (uint32_t)rebalancer_.TotalPktRate();
 
-  std::map<uint16_t, uint16_t> moves =
-      OnDemandLongTermOptimization(core_id, per_shard_pkt_rate, per_shard_flow_count);
+  // Move half of |core_id|'s load to the min-rate core
+  std::map<uint16_t, uint16_t> moves = rebalancer_.Offload(core_id);
 
+  SyncCoreState();
   rte_atomic16_set(&curr_active_core_count_, active_core_count_);
   SendWorkerInfo();
 
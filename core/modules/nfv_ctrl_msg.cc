@@ -6,25 +6,110 @@
 #include "metron_core.h"
 #include "measure.h"
 
+#include <x86intrin.h>
+
+#include <thread>
+
 #include "../module_graph.h"
+#include "../scheduler.h"
+#include "../task.h"
+#include "../traffic_class.h"
+#include "../worker.h"
+#include "../utils/time.h"
 
 /// Initialize global NFV control messages
 namespace bess {
 namespace ctrl {
 
-// NFVCtrl system components
-NFVCtrl* nfv_ctrl = nullptr;
-NFVCore* nfv_cores[DEFAULT_INVALID_CORE_ID] = {nullptr};
-NFVRCore* nfv_booster[DEFAULT_INVALID_CORE_ID] = {nullptr};
-NFVRCore* nfv_rcores[DEFAULT_INVALID_CORE_ID] = {nullptr};
-NFVRCore* nfv_rcore_booster = nullptr;
-NFVRCore* nfv_system_dumper = nullptr;
+namespace {
+
+// Allocates and initializes a single-consumer llring with |slots| slots.
+struct llring* CreateQueue(size_t slots, int sp, int sc) {
+  int bytes = llring_bytes_with_slots(slots);
+  struct llring* q =
+      reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
+  if (q == nullptr || llring_init(q, slots, sp, sc)) {
+    std::free(q);
+    return nullptr;
+  }
+  return q;
+}
+
+// Frees all remaining packets in |q| and then |q| itself.
+void DestroyQueue(struct llring* q) {
+  if (q == nullptr) {
+    return;
+  }
+  bess::Packet *pkt = nullptr;
+  while (llring_sc_dequeue(q, (void **)&pkt) == 0) {
+    bess::Packet::Free(pkt);
+  }
+  std::free(q);
+}
+
+// Frees all remaining packets (but not drain markers) in |q| and then |q|.
+void DestroySwQueue(BatchRing* q) {
+  if (q == nullptr) {
+    return;
+  }
+  bess::Packet *pkt = nullptr;
+  while (q->DequeueBurst((void **)&pkt, 1) == 1) {
+    if (!IsDrainMarkerEntry(pkt)) {
+      bess::Packet::Free(pkt);
+    }
+  }
+  BatchRing::Destroy(q);
+}
+
+SoftwareQueueState* CreateQueueState(BatchRing* q) {
+  // Note: each SoftwareQueueState object has to be initialized as
+  // 'aligned_alloc' does not initialize it when allocating memory
+  SoftwareQueueState* q_state = reinterpret_cast<SoftwareQueueState*>(
+      std::aligned_alloc(alignof(SoftwareQueueState), sizeof(SoftwareQueueState)));
+  q_state->SetUpCoreID(DEFAULT_INVALID_CORE_ID);
+  q_state->SetDownCoreID(DEFAULT_INVALID_CORE_ID);
+  rte_atomic16_set(&q_state->in_pool, 0);
+  q_state->sw_q = q;
+  q_state->sw_batch = CreatePacketBatch();
+  q_state->sw_q_id = -1;
+  q_state->idle_epoch_count = -2;
+  q_state->assigned_packet_count = 0;
+  q_state->processed_packet_count = 0;
+  q_state->drain.Reset();
+  return q_state;
+}
+
+void DestroyQueueState(SoftwareQueueState* q_state) {
+  if (q_state) {
+    FreePacketBatch(q_state->sw_batch);
+    std::free(q_state);
+  }
+}
+
+NFVRuntime* nfv_runtimes[DEFAULT_NFV_INSTANCE_COUNT] = {nullptr};
+
+// Returns true if a worker that is running (or still pausing) may call a
+// task of |m|. A paused worker is blocked outside of all tasks.
+bool IsTaskRunning(const Module* m) {
+  for (const Task* t : m->tasks()) {
+    const bess::TrafficClass* root = t->GetTC() ? t->GetTC()->Root() : nullptr;
+    for (int wid = 0; root != nullptr && wid < Worker::kMaxWorkers; wid++) {
+      Worker* w = workers[wid];
+      if (w == nullptr || w->scheduler()->root() != root) {
+        continue;
+      }
+      return w->status() == WORKER_RUNNING || w->status() == WORKER_PAUSING;
+    }
+  }
+  return false;
+}
+
+} // namespace
 
-NFVMonitor* nfv_monitors[DEFAULT_INVALID_CORE_ID] = {nullptr};
 MetronCore* metron_cores[DEFAULT_INVALID_CORE_ID] = {nullptr};
+int metron_ncore = 0;
 
 Measure* sys_measure = nullptr;
-PMDPort* pmd_port = nullptr;
 
 std::shared_mutex nfvctrl_worker_mu;
 std::shared_mutex nfvctrl_bucket_mu;
@@ -39,253 +124,241 @@ std::shared_mutex nfvctrl_bucket_mu;
 // 7: Ironside (no booster + on-demand invocation)
 int exp_id = 0;
 
-// Long-term and short-term NF profiles
-std::map<uint64_t, uint64_t> long_flow_count_pps_threshold;
-std::map<uint32_t, uint32_t> short_flow_count_pkt_threshold;
 std::map<uint16_t, uint16_t> trans_buckets;
 
-// A software queue as this server's trash bin. Any packets that are
-// moved into this queue will be freed without any processing.
-struct llring* system_dump_q = nullptr;
-struct llring* rcore_boost_q = nullptr;
-struct llring* local_q[DEFAULT_LOCALQ_COUNT] = {nullptr};
-struct llring* local_boost_q[DEFAULT_LOCALQ_COUNT] = {nullptr};
 struct llring* local_mc_q[DEFAULT_NICQ_COUNT] = {nullptr};
-struct llring* sw_q[DEFAULT_SWQ_COUNT] = {nullptr};
-
-// sw_q can be assigned if |up_core_id| is invalid
-SoftwareQueueState* rcore_booster_q_state = nullptr;
-SoftwareQueueState* system_dump_q_state = nullptr;
-SoftwareQueueState* sw_q_state[DEFAULT_SWQ_COUNT] = {nullptr};
-
-// The number of dedicated cores and aux cores in an Ironside worker.
-int ncore = 0;
-int rcore = 0;
-
-uint64_t pc_max_batch_delay[100] = {0};
-uint64_t pcpb_packet_count[DEFAULT_INVALID_CORE_ID][512] = {0};
-uint64_t pcpb_flow_count[DEFAULT_INVALID_CORE_ID][512] = {0};
-
-// core is in-use if true
-bool core_state[DEFAULT_INVALID_CORE_ID] = {false};
-// rcore can be assigned if true
-bool rcore_state[DEFAULT_INVALID_CORE_ID] = {false};
-// the number of long epochs in which a core has been live
-int core_liveness[DEFAULT_INVALID_CORE_ID] = {0};
+
+PerCoreCounter pc_max_batch_delay[100] = {};
+
 // the number of in-use normal cores on a server
 int worker_ncore[DEFAULT_INVALID_WORKER_ID] = {0};
 
 // the packet rate on a server
 uint32_t worker_packet_rate[DEFAULT_INVALID_WORKER_ID] = {0};
 
-/// Global software queue / reserved core management functions
-// bess/core/main.cc calls this function to init when bessd starts
-void NFVCtrlMsgInit() {
+/// Per-instance software queue / reserved core management functions
+void NFVRuntime::Init() {
   size_t sw_qsize = DEFAULT_SWQ_SIZE;
-  int bytes = llring_bytes_with_slots(sw_qsize);
 
-  int ret;
   for (int i = 0; i < DEFAULT_LOCALQ_COUNT; i++) {
     // |local_q| used by all dedicated cores
-    local_q[i] = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-    ret = llring_init(local_q[i], sw_qsize, 1, 1);
-    if (ret) {
-      std::free(local_q[i]);
-      LOG(FATAL) << "llring_init failed on local queue " << i;
-      break;
-    }
-
+    local_q[i] = BatchRing::Create(sw_qsize, true);
     // |local_boost_q| is used by all dedicated cores in the 'boost' mode.
-    local_boost_q[i] = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-    ret = llring_init(local_boost_q[i], sw_qsize, 1, 1);
-    if (ret) {
-      std::free(local_boost_q[i]);
-      LOG(FATAL) << "llring_init failed on local boost queue " << i;
-      break;
+    local_boost_q[i] = BatchRing::Create(sw_qsize, true);
+    if (local_q[i] == nullptr || local_boost_q[i] == nullptr) {
+      LOG(FATAL) << "failed to allocate local queue " << i
+                 << " of instance " << id;
     }
   }
 
   for (int i = 0; i < DEFAULT_SWQ_COUNT; i++) {
-    // |sw_q| used by all aux cores:
-    // single-producer and single-consumer
-    sw_q[i] = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-    ret = llring_init(sw_q[i], sw_qsize, 0, 1);
-    if (ret) {
-      std::free(sw_q[i]);
-      LOG(FATAL) << "llring_init failed on software queue " << i;
-      break;
+    // |sw_q| used by all aux cores: single-producer (the NFVCore that
+    // borrows it; it changes only through |idle_rcore_q|) and single-consumer
+    sw_q[i] = BatchRing::Create(sw_qsize, true);
+    if (sw_q[i] == nullptr) {
+      LOG(FATAL) << "failed to allocate software queue " << i
+                 << " of instance " << id;
     }
-
-    // Note: each SoftwareQueueState object has to be initialized as
-    // 'rte_malloc' does not initialize it when allocating memory
-    sw_q_state[i] = reinterpret_cast<SoftwareQueueState*>(
-        std::aligned_alloc(alignof(SoftwareQueueState), sizeof(SoftwareQueueState)));
-
-    sw_q_state[i]->SetUpCoreID(DEFAULT_INVALID_CORE_ID);
-    sw_q_state[i]->SetDownCoreID(DEFAULT_INVALID_CORE_ID);
-    sw_q_state[i]->sw_q = sw_q[i];
-    sw_q_state[i]->sw_batch = reinterpret_cast<bess::PacketBatch *>
-        (std::aligned_alloc(alignof(bess::PacketBatch), sizeof(bess::PacketBatch)));
-    sw_q_state[i]->sw_batch->clear();
+    sw_q_state[i] = CreateQueueState(sw_q[i]);
     sw_q_state[i]->sw_q_id = i;
-    sw_q_state[i]->idle_epoch_count = -2;
-    sw_q_state[i]->assigned_packet_count = 0;
-    sw_q_state[i]->processed_packet_count = 0;
-  }
-
-  for (int i = 0; i < DEFAULT_NICQ_COUNT; i++) {
-    // |local_mc_q| is used by all Metron / Quadrant cores to receive tagged packets.
-    // mp: many software switch cores; sc: each worker core pulls from its own queue.
-    local_mc_q[i] = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-    ret = llring_init(local_mc_q[i], sw_qsize, 0, 1);
-    if (ret) {
-      std::free(local_mc_q[i]);
-      LOG(FATAL) << "llring_init failed on local boost queue " << i;
-      break;
-    }
   }
 
   // Assign a system-level rcore booster core and a dump queue.
   size_t dump_qsize = DEFAULT_DUMPQ_SIZE;
-  bytes = llring_bytes_with_slots(dump_qsize);
-
-  rcore_boost_q = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-  if (rcore_boost_q) {
-    llring_init(rcore_boost_q, dump_qsize, 0, 1);
-  } else {
-    std::free(rcore_boost_q);
-    LOG(FATAL) << "failed to allocate rcore_boost_q";
+  rcore_boost_q = BatchRing::Create(dump_qsize, false);
+  system_dump_q = BatchRing::Create(dump_qsize, false);
+  if (rcore_boost_q == nullptr || system_dump_q == nullptr) {
+    LOG(FATAL) << "failed to allocate the dump queues of instance " << id;
   }
-  rcore_booster_q_state = reinterpret_cast<SoftwareQueueState*>(
-        std::aligned_alloc(alignof(SoftwareQueueState), sizeof(SoftwareQueueState)));
-  rcore_booster_q_state->sw_q = rcore_boost_q;
-  rcore_booster_q_state->sw_batch = CreatePacketBatch();
-
-  system_dump_q = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-  if (system_dump_q) {
-    llring_init(system_dump_q, dump_qsize, 0, 1);
-  } else {
-    std::free(system_dump_q);
-    LOG(FATAL) << "failed to allocate system_dump_q";
+  rcore_booster_q_state = CreateQueueState(rcore_boost_q);
+  system_dump_q_state = CreateQueueState(system_dump_q);
+
+  // The idle rcore pool holds at most one entry per sw_q
+  idle_rcore_q = CreateQueue(align_ceil_pow2(DEFAULT_SWQ_COUNT), 0, 0);
+  if (idle_rcore_q == nullptr) {
+    LOG(FATAL) << "failed to allocate idle_rcore_q of instance " << id;
   }
-  system_dump_q_state = reinterpret_cast<SoftwareQueueState*>(
-        std::aligned_alloc(alignof(SoftwareQueueState), sizeof(SoftwareQueueState)));
-  system_dump_q_state->sw_q = system_dump_q;
-  system_dump_q_state->sw_batch = CreatePacketBatch();
+}
 
-  LOG(INFO) << "NFV control messages are initialized";
+void NFVRuntime::DeInit() {
+  for (int i = 0; i < DEFAULT_LOCALQ_COUNT; i++) {
+    DestroySwQueue(local_q[i]);
+    DestroySwQueue(local_boost_q[i]);
+    local_q[i] = local_boost_q[i] = nullptr;
+  }
+
+  for (int i = 0; i < DEFAULT_SWQ_COUNT; i++) {
+    DestroySwQueue(sw_q[i]);
+    DestroyQueueState(sw_q_state[i]);
+    sw_q[i] = nullptr;
+    sw_q_state[i] = nullptr;
+  }
+
+  DestroySwQueue(rcore_boost_q);
+  DestroySwQueue(system_dump_q);
+  DestroyQueueState(rcore_booster_q_state);
+  DestroyQueueState(system_dump_q_state);
+  rcore_boost_q = system_dump_q = nullptr;
+  rcore_booster_q_state = system_dump_q_state = nullptr;
+
+  // Only holds pointers to |sw_q_state|
+  std::free(idle_rcore_q);
+  idle_rcore_q = nullptr;
 }
 
-void NFVCtrlMsgDeInit() {
-  SoftwareQueueState *q_state = nullptr;
-  bess::Packet *pkt = nullptr;
-  struct llring *q = nullptr;
+void NFVRuntime::CheckAllComponents() {
+  if (nfv_ctrl == nullptr || pmd_port == nullptr) {
+    return;
+  }
+  nfv_ctrl->InitPMD(pmd_port);
+}
 
-  for (int i = 0; i < DEFAULT_LOCALQ_COUNT; i++) {
-    q = local_q[i];
-    if (q) {
-      while (llring_sc_dequeue(q, (void **)&pkt) == 0) {
-        bess::Packet::Free(pkt);
-      }
-      std::free(q);
+int NFVRuntime::AcquireIdleRCore() {
+  SoftwareQueueState *q_state = nullptr;
+  while (llring_mc_dequeue(idle_rcore_q, (void **)&q_state) == 0) {
+    q_state->LeavePool();
+    // Skip rcores that have been destroyed since they became idle
+    NFVRCore* rcore = cores[q_state->sw_q_id].nfv_rcore;
+    if (rcore != nullptr) {
+      // The rcore may be parked (see NFVRCore::Park)
+      rcore->Wake();
+      return q_state->sw_q_id;
     }
+  }
+  return -1;
+}
 
-    q = local_boost_q[i];
-    if (q) {
-      while (llring_sc_dequeue(q, (void **)&pkt) == 0) {
-        bess::Packet::Free(pkt);
-      }
-      std::free(q);
-    }
+void NFVRuntime::ReleaseIdleRCore(int rcore_id) {
+  // Already in the pool, e.g., from an rcore |rcore_id| that was destroyed
+  // while idle. Two entries would let two NFVCores feed the same sw_q
+  if (!sw_q_state[rcore_id]->EnterPool()) {
+    return;
+  }
+  llring_mp_enqueue(idle_rcore_q, (void *)sw_q_state[rcore_id]);
+}
+
+uint64_t NFVRuntime::GetMaxPktRateFromLongTermProfile(uint64_t fc) const {
+  if (long_term_model.empty()) {
+    return 1000000;
   }
+  return long_term_model.Get(fc, nf_profile_pkt_size);
+}
 
-  for (int i = 0; i < DEFAULT_SWQ_COUNT; i++) {
-    q = sw_q[i];
-    if (q) {
-      while (llring_sc_dequeue(q, (void **)&pkt) == 0) {
-        bess::Packet::Free(pkt);
-      }
-      std::free(q);
-    }
+uint32_t NFVRuntime::GetMaxPktCountFromShortTermProfile(uint32_t fc) const {
+  if (short_term_model.empty()) {
+    return 512;
+  }
+  return short_term_model.Get(fc, nf_profile_pkt_size);
+}
 
-    q_state = sw_q_state[i];
-    if (q_state) {
-      std::free(q_state);
-    }
+NFVRuntime* GetNFVRuntime(int instance) {
+  if (instance < 0 || instance >= DEFAULT_NFV_INSTANCE_COUNT) {
+    return nullptr;
+  }
+  return nfv_runtimes[instance];
+}
+
+/// Global software queue management functions
+// bess/core/main.cc calls this function to init when bessd starts
+void NFVCtrlMsgInit() {
+  for (int i = 0; i < DEFAULT_NFV_INSTANCE_COUNT; i++) {
+    nfv_runtimes[i] = new NFVRuntime(i);
+    nfv_runtimes[i]->Init();
   }
 
   for (int i = 0; i < DEFAULT_NICQ_COUNT; i++) {
-    q = local_mc_q[i];
-    if (q) {
-      while (llring_sc_dequeue(q, (void **)&pkt) == 0) {
-        bess::Packet::Free(pkt);
-      }
-      std::free(q);
+    // |local_mc_q| is used by all Metron / Quadrant cores to receive tagged packets.
+    // mp: many software switch cores; sc: each worker core pulls from its own queue.
+    local_mc_q[i] = CreateQueue(DEFAULT_SWQ_SIZE, 0, 1);
+    if (local_mc_q[i] == nullptr) {
+      LOG(FATAL) << "llring_init failed on local mc queue " << i;
     }
   }
 
-  if (rcore_boost_q) {
-    while (llring_sc_dequeue(rcore_boost_q, (void **)&pkt) == 0) {
-      bess::Packet::Free(pkt);
+  LOG(INFO) << "NFV control messages are initialized";
+}
+
+void NFVCtrlMsgDeInit() {
+  for (int i = 0; i < DEFAULT_NFV_INSTANCE_COUNT; i++) {
+    if (nfv_runtimes[i]) {
+      nfv_runtimes[i]->DeInit();
+      delete nfv_runtimes[i];
+      nfv_runtimes[i] = nullptr;
     }
-    std::free(rcore_boost_q);
-    rcore_boost_q = nullptr;
   }
 
-  if (system_dump_q) {
-    while (llring_sc_dequeue(system_dump_q, (void **)&pkt) == 0) {
-      bess::Packet::Free(pkt);
-    }
-    std::free(system_dump_q);
-    system_dump_q = nullptr;
+  for (int i = 0; i < DEFAULT_NICQ_COUNT; i++) {
+    DestroyQueue(local_mc_q[i]);
+    local_mc_q[i] = nullptr;
   }
 
   LOG(INFO) << "NFV control messages are de-initialized";
 }
 
-void NFVCtrlCheckAllComponents() {
-  if (nfv_ctrl == nullptr || pmd_port == nullptr) {
-    return;
+int StripDrainMarkers(bess::PacketBatch* batch, DrainMarker** markers) {
+  int cnt = 0;
+  int marker_cnt = 0;
+  for (int i = 0; i < batch->cnt(); i++) {
+    bess::Packet* pkt = batch->pkts()[i];
+    if (IsDrainMarkerEntry(pkt)) {
+      markers[marker_cnt++] = EntryToDrainMarker(pkt);
+    } else {
+      batch->pkts()[cnt++] = pkt;
+    }
   }
-  nfv_ctrl->InitPMD(pmd_port);
+  batch->set_cnt(cnt);
+  return marker_cnt;
 }
 
-// Transfer the ownership of (at most) |n| software packet queues
-// to NFVCore (who calls this function)
-// std::vector<int> NFVCtrlRequestNSwQ(cpu_core_t core_id, int n) {
-//   if (nfv_cores[core_id] == nullptr) {
-//     LOG(FATAL) << "Core " << core_id << " is used but not created";
-//     // To register all normal CPU cores
-//     for (int i = 0; i < DEFAULT_INVALID_CORE_ID; i++){
-//       std::string core_name = "nfv_core" + std::to_string(i);
-//       for (const auto &it : ModuleGraph::GetAllModules()) {
-//         if (it.first.find(core_name) != std::string::npos) {
-//           nfv_cores[i] = ((NFVCore *)(it.second));
-//         }
-//       }
-//     }
-//   }
-//   if (nfv_ctrl == nullptr) {
-//     LOG(FATAL) << "NFVCtrl is used but not created";
-//     std::vector<int> assigned;
-//     return assigned;
-//   }
-//   return nfv_ctrl->RequestNSwQ(core_id, n);
-// }
-
-// int NFVCtrlNotifyRCoreToWork(cpu_core_t core_id, int q_id) {
-//   if (nfv_ctrl == nullptr) {
-//     return -1;
-//   }
-//   return nfv_ctrl->NotifyRCoreToWork(core_id, q_id);
-// }
-
-// int NFVCtrlNotifyRCoreToRest(cpu_core_t core_id, int q_id) {
-//   if (nfv_ctrl == nullptr) {
-//     return -1;
-//   }
-//   return nfv_ctrl->NotifyRCoreToRest(core_id, q_id);
-// }
+bool StopAndWait(const Module* m, CtrlMailbox* mb, const std::string& who,
+                 const std::function<void()>& notify) {
+  // Spin for a few microseconds before yielding the control thread's core
+  const uint32_t kSpinRounds = 1000;
+  const uint64_t kWarnPeriodNs = 1000000000ULL;
+
+  if (!IsTaskRunning(m)) {
+    LOG(INFO) << who << ": not running; stopped inline";
+    return false;
+  }
+
+  CtrlMsg stop = {CtrlMsg::kStop, 0};
+  while (!mb->Post(kMasterLane, stop)) {
+    std::this_thread::yield();
+  }
+  if (notify) {
+    notify();
+  }
+
+  uint64_t start_ns = tsc_to_ns(rdtsc());
+  uint64_t warn_ns = start_ns + kWarnPeriodNs;
+  CtrlMsg done;
+  for (uint32_t rounds = 0;
+       mb->PollDone(kMasterLane, &done, 1) == 0 || done.type != CtrlMsg::kStop;
+       rounds++) {
+    if (rounds < kSpinRounds) {
+      _mm_pause();
+      continue;
+    }
+    std::this_thread::yield();
+    // The worker may have been paused after the kStop was posted
+    if (!IsTaskRunning(m)) {
+      LOG(INFO) << who << ": paused while stopping; stopped inline";
+      return false;
+    }
+    uint64_t now_ns = tsc_to_ns(rdtsc());
+    if (now_ns - start_ns > kStopTimeoutNs) {
+      LOG(FATAL) << who << ": no reply to kStop after "
+                 << (now_ns - start_ns) / 1000000 << " ms while still running";
+    }
+    if (now_ns > warn_ns) {
+      LOG(WARNING) << who << ": still waiting to stop after "
+                   << (now_ns - start_ns) / 1000000 << " ms";
+      warn_ns = now_ns + kWarnPeriodNs;
+    }
+  }
+  LOG(INFO) << who << ": stopped in " << tsc_to_ns(rdtsc()) - start_ns << " ns";
+  return true;
+}
 
 bess::PacketBatch* CreatePacketBatch() {
   bess::PacketBatch* b = reinterpret_cast<bess::PacketBatch *>
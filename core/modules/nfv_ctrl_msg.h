@@ -2,13 +2,19 @@
 #define BESS_MODULES_NFV_CTRL_MSG_H_
 
 #include "../drivers/pmd.h"
+#include "../utils/batch_ring.h"
 #include "../utils/cpu_core.h"
 #include "../utils/flow.h"
 #include "../utils/lock_less_queue.h"
+#include "../utils/mailbox.h"
+#include "../utils/nf_perf_model.h"
+#include "../utils/sys_measure.h"
 
+#include <functional>
 #include <mutex>
 #include <vector>
 
+using bess::utils::BatchRing;
 using bess::utils::Flow;
 using bess::utils::FlowRecord;
 
@@ -31,6 +37,10 @@ using bess::utils::FlowRecord;
 #define DEFAULT_SWQ_SIZE 2048
 #define DEFAULT_DUMPQ_SIZE 4096
 
+// Default per-core FlowState pool size and idle timeout (2 s)
+#define DEFAULT_FLOW_STATE_COUNT 262144
+#define DEFAULT_FLOW_IDLE_TIMEOUT_NS 2000000000
+
 // Forward declaration
 struct llring;
 class NFVCtrl;
@@ -43,6 +53,117 @@ class Measure;
 namespace bess {
 namespace ctrl {
 
+/// Flow ownership handoff between cores.
+// A drain marker travels through a software queue in place of a packet, so
+// that a flow can leave the queue without two cores touching its records
+// (e.g., |FlowState::acl|) at the same time:
+// - the producer issues a marker after sending the flow's last packet to the
+//   queue, and holds the flow's new packets until the marker is drained;
+// - the consumer acknowledges a marker after processing all packets ahead of it.
+// Markers are counted rather than identified: the |seq|-th marker issued to a
+// queue is drained once the queue's consumer has acknowledged |seq| markers.
+// If the consumer is gone or stuck, the producer force-drains all markers;
+// the consumer then absorbs (rather than counts) the stale ones it finds.
+struct DrainMarker {
+  void Reset() {
+    rte_atomic32_set(&issued, 0);
+    rte_atomic64_set(&acked, 0);
+  }
+  // Reserves the next marker. Returns its sequence number
+  uint32_t Issue() { return (uint32_t)rte_atomic32_add_return(&issued, 1); }
+  // Called by the consumer
+  void Ack() {
+    for (;;) {
+      uint64_t old = (uint64_t)rte_atomic64_read(&acked);
+      uint32_t cnt = (uint32_t)old;
+      uint32_t forced = (uint32_t)(old >> 32);
+      if (forced > 0) {
+        forced -= 1;
+      } else {
+        cnt += 1;
+      }
+      if (rte_atomic64_cmpset((volatile uint64_t *)&acked.cnt, old,
+                              ((uint64_t)forced << 32) | cnt)) {
+        return;
+      }
+    }
+  }
+  // Treats all markers issued so far as drained
+  void ForceDrain() {
+    for (;;) {
+      uint64_t old = (uint64_t)rte_atomic64_read(&acked);
+      uint32_t cnt = (uint32_t)old;
+      uint32_t forced = (uint32_t)(old >> 32);
+      uint32_t last = (uint32_t)rte_atomic32_read(&issued);
+      if ((int32_t)(cnt - last) >= 0) {
+        return;
+      }
+      forced += last - cnt;
+      if (rte_atomic64_cmpset((volatile uint64_t *)&acked.cnt, old,
+                              ((uint64_t)forced << 32) | last)) {
+        return;
+      }
+    }
+  }
+  bool IsDrained(uint32_t seq) {
+    return (int32_t)((uint32_t)rte_atomic64_read(&acked) - seq) >= 0;
+  }
+  bool IsDrained() { return IsDrained((uint32_t)rte_atomic32_read(&issued)); }
+
+  rte_atomic32_t issued;
+  // The acknowledged count (low 32 bits) and the number of force-drained
+  // markers still in the queue (high 32 bits)
+  rte_atomic64_t acked;
+};
+
+// Markers are enqueued as tagged pointers (packets are cache-line aligned)
+inline void* DrainMarkerToEntry(DrainMarker* m) {
+  return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(m) | 1);
+}
+inline bool IsDrainMarkerEntry(const void* e) {
+  return (reinterpret_cast<uintptr_t>(e) & 1) != 0;
+}
+inline DrainMarker* EntryToDrainMarker(void* e) {
+  return reinterpret_cast<DrainMarker*>(reinterpret_cast<uintptr_t>(e) & ~uintptr_t(1));
+}
+
+// Removes drain markers from |batch| and keeps packets in order.
+// Returns the number of markers, which are stored in |markers|.
+int StripDrainMarkers(bess::PacketBatch* batch, DrainMarker** markers);
+
+/// Control messages between the control thread, NFVCtrl, NFVCores and
+/// NFVRCores. Each of these modules has a mailbox with one lane per sender:
+/// normal core |i| sends on lane |i|, NFVCtrl on |DEFAULT_NFVCTRL_CORE_ID|,
+/// and the control thread (i.e., DeInit) on |kMasterLane|. The receiver
+/// polls its mailbox in RunTask.
+struct CtrlMsg {
+  enum Type : uint16_t {
+    kStop = 0,        // stop the pipeline; completed once stopped
+    kAssignQueue,     // NFVRCore: keep working on sw_q |arg|
+    kReleaseQueue,    // NFVRCore: release sw_q |arg| once drained
+    kReportStats,     // NFVCore: publish long-term bucket stats
+    kStatsReady,      // NFVCtrl: the sender has published its bucket stats
+    kLoadBalanceNow,  // NFVCtrl: the sender needs an immediate rebalancing
+  };
+  uint16_t type;
+  int16_t arg;
+};
+
+constexpr uint32_t kMasterLane = DEFAULT_INVALID_CORE_ID;
+using CtrlMailbox = bess::utils::Mailbox<CtrlMsg, DEFAULT_INVALID_CORE_ID + 1>;
+
+// Called by the control thread: asks the receiver of |mb|, i.e., task module
+// |m|, to stop, calls |notify| (e.g., to wake up a parked receiver), and
+// waits until the receiver completes the request. |who| is for logging.
+// Returns false without waiting if no worker runs |m| (e.g., bessctl pauses
+// all workers before destroying modules); the caller then stops |m| inline.
+// Never returns while a worker may still run |m|: if |m| does not stop
+// within |kStopTimeoutNs|, this aborts rather than let the caller free
+// state that |m| is using.
+constexpr uint64_t kStopTimeoutNs = 2000000000ULL;
+bool StopAndWait(const Module* m, CtrlMailbox* mb, const std::string& who,
+                 const std::function<void()>& notify = nullptr);
+
 /// States for maintaining software packet queues, normal and reserved cores.
 // |SoftwareQueueState| tracks the mapping of (NFVCore, sw_q, NFVRCore)
 // |sw_q|: the software queue's pointer;
@@ -57,8 +178,17 @@ struct SoftwareQueueState {
   void SetUpCoreID(uint16_t core_id) { rte_atomic16_set(&up_core_id, (int16_t)core_id); }
   void SetDownCoreID(uint16_t core_id) { rte_atomic16_set(&down_core_id, (int16_t)core_id); }
   uint16_t GetUpCoreID() { return (uint16_t)rte_atomic16_read(&up_core_id); }
+  // Sets |up_core_id| to |to| only if it is |from|. Returns true on success.
+  bool CASUpCoreID(uint16_t from, uint16_t to) {
+    return rte_atomic16_cmpset((volatile uint16_t *)&up_core_id.cnt, from, to);
+  }
   uint16_t GetDownCoreID() { return (uint16_t)rte_atomic16_read(&down_core_id); }
 
+  // |in_pool| is 1 while |this| queue's rcore has an entry in
+  // |idle_rcore_q|. Returns true if the caller flipped it.
+  bool EnterPool() { return rte_atomic16_cmpset((volatile uint16_t *)&in_pool.cnt, 0, 1); }
+  bool LeavePool() { return rte_atomic16_cmpset((volatile uint16_t *)&in_pool.cnt, 1, 0); }
+
   // Non atomic states
   inline bool IsIdle() {
     return idle_epoch_count == -2;
@@ -75,13 +205,17 @@ struct SoftwareQueueState {
 
   rte_atomic16_t up_core_id;
   rte_atomic16_t down_core_id;
+  rte_atomic16_t in_pool;
 
-  struct llring* sw_q;
+  BatchRing* sw_q;
   bess::PacketBatch* sw_batch;
   int sw_q_id;
   int idle_epoch_count; // -2: idle; -1: terminating; 0 and 0+: active
   uint32_t assigned_packet_count;
   uint32_t processed_packet_count;
+
+  // Markers in |sw_q|, issued by the up core and acknowledged by the rcore
+  DrainMarker drain;
 };
 
 struct FlowState {
@@ -90,44 +224,148 @@ struct FlowState {
     short_epoch_packet_count = 0;
     queued_packet_count = 0;
     enqueued_packet_count = 0;
+    last_epoch_id = UINT32_MAX;
     sw_q_state = nullptr;
+    handoff = nullptr;
+    handoff_seq = 0;
+    arrival_seq = 0;
+    processed_seq = 0;
   }
 
   uint32_t rss; // NIC's RSS-based hash for |flow|
   uint32_t short_epoch_packet_count; // short-term epoch packet counter
   uint32_t queued_packet_count; // packet count in the system
   uint32_t enqueued_packet_count; // packet count in the SplitAndEnqueue process
+  uint32_t last_epoch_id; // the last short-term epoch with packet arrivals (UINT32_MAX: none)
   SoftwareQueueState *sw_q_state; // |this| flow sent to software queue w/ valid |sw_q_state|
 
+  // Flow ownership: |acl|, |lb| and |monitor| are touched by one core at a
+  // time. After |this| flow moves to another queue, its packets are held by
+  // the NFVCore until the old queue drains the |handoff_seq|-th marker.
+  DrainMarker *handoff; // the old queue's markers (nullptr: no pending handoff)
+  uint32_t handoff_seq;
+  // Reordering guard: the sequence number of the latest packet arrival
+  // (tagged in each packet's mbuf seqn), and of the latest packet processed
+  // from |local_q_|
+  uint32_t arrival_seq;
+  uint32_t processed_seq;
+
   Flow flow; // for long-term flow counter
   FlowRecord acl;
   FlowRecord lb;
   FlowRecord monitor;
 };
 
+// The number of independent Ironside instances (e.g., one per NIC)
+#define DEFAULT_NFV_INSTANCE_COUNT 2
+
+// State of one normal core, e.g., core |i| in NFVRuntime::cores[i].
+// Each section starts at its own cache line so that cores that write
+// their own section never false-share with each other.
+struct alignas(64) NFVCoreSection {
+  // Set by each module on Init
+  NFVCore* nfv_core = nullptr;
+  NFVRCore* nfv_booster = nullptr;
+  NFVRCore* nfv_rcore = nullptr;  // the rcore that works on sw_q |i|
+  NFVMonitor* nfv_monitor = nullptr;
+
+  // Per-bucket stats. Written by NFVCore |i|; read and reset by NFVCtrl
+  // after NFVCore |i| calls NFVCtrl::NotifyLongTermStatsReady
+  uint64_t pcpb_packet_count[RETA_SIZE] = {0};
+  uint64_t pcpb_flow_count[RETA_SIZE] = {0};
+
+  // Written by NFVCtrl: true if NFVCore |i| is in use
+  alignas(64) bool active = false;
+};
+
+// All shared state of one Ironside instance: NFVCtrl, its NFVCores and
+// NFVRCores, the NIC port that they share, and the software queues between
+// them. Modules pick their instance with the |instance| field of their
+// Init arguments, so that one bessd can run independent pipelines.
+//
+// Ownership: the software queues are created and destroyed by the runtime;
+// NFVCtrl sets the configuration and profiles; every other field is set by
+// the module that it points to.
+struct NFVRuntime {
+  explicit NFVRuntime(int id) : id(id) {}
+
+  // Creates software queues and resets flags
+  void Init();
+  void DeInit();
+
+  // Checks if all NFV components are ready. If yes:
+  // 1) initialize all management data;
+  // 2) update NIC RSS;
+  // 3) start the long-term optimization;
+  void CheckAllComponents();
+
+  // Takes an idle NFVRCore from |idle_rcore_q|. NFVRCore |i| only works on
+  // sw_q |i|, so the returned ID is also the sw_q's ID.
+  // Returns -1 if all rcores are busy. Never blocks. The rcore is woken up
+  // if it is parked.
+  int AcquireIdleRCore();
+  // Returns NFVRCore |rcore_id| to |idle_rcore_q| once it is ready for new
+  // work. Each sw_q has at most one entry (see SoftwareQueueState::in_pool),
+  // so an entry left by a destroyed rcore is reused by the next rcore |i|.
+  void ReleaseIdleRCore(int rcore_id);
+
+  // The max packet rate (per second) and packet count (per short epoch)
+  // under |fc| flows, from the NF profiles
+  uint64_t GetMaxPktRateFromLongTermProfile(uint64_t fc) const;
+  uint32_t GetMaxPktCountFromShortTermProfile(uint32_t fc) const;
+
+  const int id;
+
+  // Components
+  NFVCtrl* nfv_ctrl = nullptr;  // the only instance of NFVCtrl
+  PMDPort* pmd_port = nullptr;
+  NFVRCore* nfv_rcore_booster = nullptr;
+  NFVRCore* nfv_system_dumper = nullptr;
+  NFVCoreSection cores[DEFAULT_INVALID_CORE_ID];
+
+  // Worker-layer core mapping
+  int ncore = 0;
+  int rcore = 0;
+
+  // packet rate (per second) and packet count (per short epoch) thresholds
+  // given the flow count. Interpolated from offline profiling results
+  bess::utils::NFPerfModel long_term_model;
+  bess::utils::NFPerfModel short_term_model;
+  // The packet size that both models are evaluated at
+  uint32_t nf_profile_pkt_size = 0;
+
+  // A pool of software packet queues. All are single-consumer; only
+  // |rcore_boost_q| and |system_dump_q| are multi-producer
+  BatchRing* rcore_boost_q = nullptr; // to boost rcores
+  BatchRing* system_dump_q = nullptr; // to drop
+  BatchRing* local_q[DEFAULT_LOCALQ_COUNT] = {nullptr}; // for ncores
+  BatchRing* local_boost_q[DEFAULT_LOCALQ_COUNT] = {nullptr}; // to boost ncores
+  BatchRing* sw_q[DEFAULT_SWQ_COUNT] = {nullptr}; // for rcores (fed by the up core)
+
+  SoftwareQueueState* rcore_booster_q_state = nullptr;
+  SoftwareQueueState* system_dump_q_state = nullptr;
+  SoftwareQueueState* sw_q_state[DEFAULT_SWQ_COUNT] = {nullptr};
+
+  // A lock-free (multi-producer, multi-consumer) pool of idle rcores
+  struct llring* idle_rcore_q = nullptr;
+};
+
+// Returns Ironside instance |instance|, or nullptr if out of range.
+NFVRuntime* GetNFVRuntime(int instance);
+
+/// Process-wide states, shared by all instances
+
 // Used in measure, ironside_ingress
 extern std::shared_mutex nfvctrl_worker_mu;
 // Used in nfvctrl, nfv_core
 extern std::shared_mutex nfvctrl_bucket_mu;
 
-// The only instance of NFVCtrl on this worker
-extern NFVCtrl* nfv_ctrl;
-
-// Ironside
-extern NFVCore* nfv_cores[DEFAULT_INVALID_CORE_ID];
-extern NFVRCore* nfv_booster[DEFAULT_INVALID_CORE_ID];
-extern NFVRCore* nfv_rcores[DEFAULT_INVALID_CORE_ID];
-extern NFVRCore* nfv_rcore_booster;
-extern NFVRCore* nfv_system_dumper;
-
-extern NFVMonitor* nfv_monitors[DEFAULT_INVALID_CORE_ID];
-
 extern MetronCore* metron_cores[DEFAULT_INVALID_CORE_ID];
+// The number of Metron / Quadrant worker cores
+extern int metron_ncore;
 
 extern Measure* sys_measure;
 
-extern PMDPort* pmd_port;
-
 // An integer number that identifies an Ironside's experiment.
 // 0: normal run;
 // 1: long-term profiling run (no boost mode);
@@ -139,9 +377,6 @@ extern PMDPort* pmd_port;
 // 7: Ironside (no boost-mode and hardware on-demand invocation) run;
 extern int exp_id;
 
-// packet rate threshold given the flow count. Values are found using offline profiling
-extern std::map<uint64_t, uint64_t> long_flow_count_pps_threshold;
-extern std::map<uint32_t, uint32_t> short_flow_count_pkt_threshold;
 extern std::map<uint16_t, uint16_t> trans_buckets;
 
 /// ToR-layer core mapping (used in Ironside ingress)
@@ -149,63 +384,18 @@ extern std::map<uint16_t, uint16_t> trans_buckets;
 extern int worker_ncore[DEFAULT_INVALID_WORKER_ID];
 extern uint32_t worker_packet_rate[DEFAULT_INVALID_WORKER_ID];
 
-// Note: only NFVCtrl can access data structures below
-
-// A pool of software packet queues
-extern struct llring* rcore_boost_q; // to boost rcores
-extern struct llring* system_dump_q; // to drop
-extern struct llring* local_q[DEFAULT_LOCALQ_COUNT]; // for ncores
-extern struct llring* local_boost_q[DEFAULT_LOCALQ_COUNT]; // to boost ncores
 extern struct llring* local_mc_q[DEFAULT_NICQ_COUNT]; // for metron / quadrant
-extern struct llring* sw_q[DEFAULT_SWQ_COUNT]; // for rcores
-
-/// Worker-layer core mapping
-extern int ncore;
-extern int rcore;
-
-// Performance states
-extern uint64_t pc_max_batch_delay[100]; // Quadrant
 
-extern uint64_t pcpb_packet_count[DEFAULT_INVALID_CORE_ID][512]; // Ironside
-extern uint64_t pcpb_flow_count[DEFAULT_INVALID_CORE_ID][512]; // Ironside
-
-extern SoftwareQueueState* rcore_booster_q_state;
-extern SoftwareQueueState* system_dump_q_state;
-extern SoftwareQueueState* sw_q_state[DEFAULT_SWQ_COUNT];
-
-extern bool core_state[DEFAULT_INVALID_CORE_ID];
-extern bool rcore_state[DEFAULT_INVALID_CORE_ID];
-extern int core_liveness[DEFAULT_INVALID_CORE_ID];
+// Performance states (Quadrant). Padded so that cores do not false-share
+struct alignas(64) PerCoreCounter {
+  uint64_t value;
+};
+extern PerCoreCounter pc_max_batch_delay[100];
 
-// Create software queues and reset flags
+// Creates all Ironside instances and Metron / Quadrant queues
 void NFVCtrlMsgInit();
 void NFVCtrlMsgDeInit();
 
-// Check if all NFV components are ready. If yes:
-// 1) initialize all management data;
-// 2) update NIC RSS;
-// 3) start the long-term optimization;
-void NFVCtrlCheckAllComponents();
-
-// Request |n| software queues from the global software queue pool.
-// The return value is a bit-mask that records the assignment of
-// software queues: if (1 << i) is set, then sw_q[i] is assigned.
-// std::vector<int> NFVCtrlRequestNSwQ(cpu_core_t core_id, int n);
-
-// Release software queues according to |q_mask|.
-// Note: a sw_q goes back to the pool only if core |core_id| owns it.
-// void NFVCtrlReleaseNSwQ(cpu_core_t core_id, std::vector<int> q_ids);
-
-// Request a reserved core to work on the software queue |q_id|.
-// Return 0 if an idle reserved core is found and notified to work.
-// int NFVCtrlNotifyRCoreToWork(cpu_core_t core_id, int q_id);
-
-// If sw_q |q_id| is currently handled by a reserved core.
-// This function will un-schedule the NFVRCore and make it idle.
-// Afterwards, the NFVRCore is ready to handle another sw_q.
-// Return 0 if the reserved core is released.
-// int NFVCtrlNotifyRCoreToRest(cpu_core_t core_id, int q_id);
-
 bess::PacketBatch* CreatePacketBatch();
 void FreePacketBatch(bess::PacketBatch* batch);
 
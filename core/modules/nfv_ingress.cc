@@ -108,7 +108,7 @@ CommandResponse NFVIngress::CommandAdd([[maybe_unused]]const bess::pb::NFVIngres
 }
 
 CommandResponse NFVIngress::CommandClear(const bess::pb::EmptyArg &) {
-  flow_cache_.clear();
+  flow_cache_.Clear();
   return CommandSuccess();
 }
 
@@ -153,21 +153,21 @@ void NFVIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     }
 
     // Find existing flow, if we have one.
-    std::unordered_map<Flow, FlowRoutingRule, FlowHash>::iterator it =
-        flow_cache_.find(flow);
+    FlowTable<Flow, FlowRoutingRule, FlowHash>::Entry *it =
+        flow_cache_.Find(flow);
 
     bool emitted = false;
-    if (it != flow_cache_.end()) {
-      if (curr_ts_ns_ >= it->second.ExpiryTime()) { // an outdated flow
-        flow_cache_.erase(it);
+    if (it != nullptr) {
+      if (curr_ts_ns_ >= it->value.ExpiryTime()) { // an outdated flow
+        flow_cache_.Erase(it);
         active_flows_ -= 1;
-        it = flow_cache_.end();
+        it = nullptr;
       } else { // an existing flow
         emitted = true;
       }
     }
 
-    if (it == flow_cache_.end()) {
+    if (it == nullptr) {
       FlowRoutingRule new_rule("02:42:01:c2:02:fe");
       // Assign this flow to a CPU core
       if (!process_new_flow(new_rule)) {
@@ -175,36 +175,34 @@ void NFVIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
         continue;
       }
 
-      std::tie(it, std::ignore) = flow_cache_.emplace(
-          std::piecewise_construct,
-          std::make_tuple(flow), std::make_tuple(new_rule));
+      it = flow_cache_.Emplace(flow, 0, new_rule).first;
       active_flows_ += 1;
 
       emitted = true;
     }
-    it->second.SetExpiryTime(curr_ts_ns_ + TIME_OUT_NS);
-    it->second.packet_count_ += 1;
+    it->value.SetExpiryTime(curr_ts_ns_ + TIME_OUT_NS);
+    it->value.packet_count_ += 1;
 
     // Handle bursty flows
-    if (it->second.packet_count_ > packet_count_thresh_) {
+    if (it->value.packet_count_ > packet_count_thresh_) {
       if (idle_core_count_ <= 0) { // No reserved cores
         emitted = false;
       } else {
         pick_next_idle_core();
 
-        it->second.SetAction(false, 0, cpu_cores_[next_idle_core_].nic_addr);
+        it->value.SetAction(false, 0, cpu_cores_[next_idle_core_].nic_addr);
         emitted = true;
       }
     }
 
     if (emitted) {
-      eth->dst_addr = it->second.encoded_mac_;
+      eth->dst_addr = it->value.encoded_mac_;
 
       // Update per-core traffic statistics. Do we have to do this in the fast path?
-      int cid = routing_to_core_id_[it->second.egress_mac_];
-      auto flow_it = cpu_cores_[cid].per_flow_packet_counter.find(it->first);
+      int cid = routing_to_core_id_[it->value.egress_mac_];
+      auto flow_it = cpu_cores_[cid].per_flow_packet_counter.find(it->key);
       if (flow_it == cpu_cores_[cid].per_flow_packet_counter.end()) {
-        cpu_cores_[cid].per_flow_packet_counter.emplace(it->first, 1);
+        cpu_cores_[cid].per_flow_packet_counter.emplace(it->key, 1);
       } else {
         flow_it->second += 1;
       }
@@ -215,7 +213,7 @@ void NFVIngress::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     }
 
     if (tcp != nullptr && tcp->flags & Tcp::Flag::kFin) {
-      flow_cache_.erase(it);
+      flow_cache_.Erase(it);
       active_flows_ -= 1;
     }
   }
@@ -314,12 +312,12 @@ int NFVIngress::quadrant_pick_core() {
 }
 
 void NFVIngress::migrate_flow(const Flow &f, int from_id, int to_id) {
-  auto it = flow_cache_.find(f);
-  if (it == flow_cache_.end()) {
+  FlowTable<Flow, FlowRoutingRule, FlowHash>::Entry *it = flow_cache_.Find(f);
+  if (it == nullptr) {
     return;
   }
 
-  it->second.SetAction(false, 0, cpu_cores_[to_id].nic_addr);
+  it->value.SetAction(false, 0, cpu_cores_[to_id].nic_addr);
 
   auto flow_it = cpu_cores_[from_id].per_flow_packet_counter.find(f);
   if (flow_it != cpu_cores_[from_id].per_flow_packet_counter.end()) {
@@ -386,13 +384,14 @@ bool NFVIngress::update_traffic_stats() {
 // Scaling: 1) overload detection; 2) CPU core set adjustment;
 
 CommandResponse NFVIngress::CommandGetSummary(const bess::pb::EmptyArg &) {
-  int total_flows = flow_cache_.size();
+  int total_flows = flow_cache_.Count();
   int num_flows = 0; // Count # of bursty flows
-  for (auto &x : flow_cache_) {
-    if (x.second.packet_count_ > packet_count_thresh_) {
-      num_flows += 1;
-    }
-  }
+  flow_cache_.ForEach(
+      [&](FlowTable<Flow, FlowRoutingRule, FlowHash>::Entry &x) {
+        if (x.value.packet_count_ > packet_count_thresh_) {
+          num_flows += 1;
+        }
+      });
 
   int sum_cores = 0;
   int total_epochs = cluster_snapshots_.size();
@@ -405,7 +404,7 @@ CommandResponse NFVIngress::CommandGetSummary(const bess::pb::EmptyArg &) {
     // Traffic
     out_fp << "Flow stats:" << std::endl;
     out_fp << "- Total flows: " << total_flows << std::endl;
-    out_fp << "- Flow entries" << flow_cache_.size() << std::endl;
+    out_fp << "- Flow entries" << flow_cache_.Count() << std::endl;
     out_fp << "- Bursty flows: " << num_flows << std::endl;
     out_fp << std::endl;
 
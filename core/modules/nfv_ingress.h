@@ -9,12 +9,14 @@
 #include "../pb/module_msg.pb.h"
 #include "../utils/cpu_core.h"
 #include "../utils/flow.h"
+#include "../utils/flow_table.h"
 #include "../utils/ip.h"
 #include "../utils/sys_measure.h"
 
 using bess::utils::Flow;
 using bess::utils::FlowHash;
 using bess::utils::FlowRoutingRule;
+using bess::utils::FlowTable;
 using bess::utils::Snapshot;
 using bess::utils::WorkerCore;
 
@@ -127,7 +129,7 @@ class NFVIngress final : public Module {
   uint32_t ta_flow_count_thresh_; // Stop assigning more flows
 
   // Per-flow connection table
-  std::unordered_map<Flow, FlowRoutingRule, FlowHash> flow_cache_;
+  FlowTable<Flow, FlowRoutingRule, FlowHash> flow_cache_;
 
   // Total number of active flows in the flow cache
   int active_flows_ = 0;
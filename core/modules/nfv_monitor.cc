@@ -14,7 +14,6 @@
 #define DEFAULT_PER_CORE_MIGRATION_PERIOD_US 200000000 // 200 ms
 #define DEFAULT_ACTIVE_FLOW_WINDOW_NS 2000000000 // 2000 ms
 #define DEFAULT_PACKET_COUNT_THRESH 1000000
-#define DEFAULT_LATENCY_QUEUE_SIZE 10000
 
 namespace {
 // The helper function for reading hw timestamp from |pkt| (unit: ns).
@@ -46,6 +45,11 @@ const Commands NFVMonitor::cmds = {
 };
 
 CommandResponse NFVMonitor::Init([[maybe_unused]]const bess::pb::NFVMonitorArg &arg) {
+  bess::ctrl::NFVRuntime *rt = bess::ctrl::GetNFVRuntime(arg.instance());
+  if (rt == nullptr) {
+    return CommandFailure(EINVAL, "invalid instance %d", arg.instance());
+  }
+
   core_id_ =0;
   if (arg.core_id() > 0) {
     core_id_ = arg.core_id();
@@ -55,15 +59,11 @@ CommandResponse NFVMonitor::Init([[maybe_unused]]const bess::pb::NFVMonitorArg &
   last_update_traffic_stats_ts_ns_ = curr_ts_ns_;
   next_epoch_id_ = 0;
 
-  // Initialize all elements in the buffer to avoid memory access bugs.
-  size_t buffer_size = (arg.latency_sample_buffer_size() > 0) ? arg.latency_sample_buffer_size():DEFAULT_LATENCY_QUEUE_SIZE;
-  per_core_latency_sample_.set_capacity(buffer_size);
-  for (size_t i = 0; i < buffer_size; i++) {
-    per_core_latency_sample_.push_back(0);
-  }
+  epoch_latency_.Reset();
+  total_latency_.Reset();
 
   // Init
-  bess::ctrl::nfv_monitors[core_id_] = this;
+  rt->cores[core_id_].nfv_monitor = this;
 
   epoch_packet_counter_ = 0;
   epoch_slo_violation_counter_ = 0;
@@ -74,7 +74,8 @@ CommandResponse NFVMonitor::Init([[maybe_unused]]const bess::pb::NFVMonitorArg &
 
 CommandResponse NFVMonitor::CommandClear(const bess::pb::EmptyArg &) {
   per_flow_packet_counter_.clear();
-  per_core_latency_sample_.clear();
+  epoch_latency_.Reset();
+  total_latency_.Reset();
   return CommandSuccess();
 }
 
@@ -111,6 +112,7 @@ void NFVMonitor::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       if (pkt_delay > bess::utils::slo_ns) {
         epoch_slo_violation_counter_ += 1;
       }
+      epoch_latency_.Add(pkt_delay);
     }
   }
 
@@ -129,6 +131,7 @@ bool NFVMonitor::update_traffic_stats(uint32_t curr_epoch_id) {
   // len(msg->bursty_flows) in the per-core epoch snapshot.
   bess::utils::CoreStats *msg = new bess::utils::CoreStats();
   msg->packet_rate = packet_rate_;
+  msg->p99_latency = epoch_latency_.Quantile(0.99);
   epoch_packet_thresh_ = epoch_packet_counter_ * 0.05;
   if (epoch_slo_violation_counter_ > epoch_packet_counter_ * 0.01) {
     for (auto &it : per_flow_packet_counter_) {
@@ -145,6 +148,7 @@ bool NFVMonitor::update_traffic_stats(uint32_t curr_epoch_id) {
     core_snapshots_[next_epoch_id_].slo_violation = epoch_slo_violation_counter_;
     core_snapshots_[next_epoch_id_].packet_delay_error = epoch_packet_delay_error_;
     core_snapshots_[next_epoch_id_].packet_delay_max = epoch_packet_delay_max_;
+    core_snapshots_[next_epoch_id_].packet_delay_p99 = msg->p99_latency;
     core_snapshots_[next_epoch_id_].active_flow_count = all_local_core_stats[core_id_]->active_flow_count;
     core_snapshots_[next_epoch_id_].bursty_flow_count = msg->bursty_flows.size();
 
@@ -155,6 +159,8 @@ bool NFVMonitor::update_traffic_stats(uint32_t curr_epoch_id) {
   }
 
   // Reset epoch
+  total_latency_.Merge(epoch_latency_);
+  epoch_latency_.Reset();
   per_flow_packet_counter_.clear();
   epoch_packet_counter_ = 0;
   epoch_slo_violation_counter_ = 0;
@@ -176,6 +182,7 @@ CommandResponse NFVMonitor::CommandGetSummary(const bess::pb::EmptyArg &) {
       out_fp << ", slo:" << core_snapshots_[i].slo_violation;
       out_fp << ", delaye:" << core_snapshots_[i].packet_delay_error;
       out_fp << ", delaym:" << core_snapshots_[i].packet_delay_max;
+      out_fp << ", delayp99:" << core_snapshots_[i].packet_delay_p99;
       out_fp << ", flowa:" << core_snapshots_[i].active_flow_count;
       out_fp << ", flowb:" << core_snapshots_[i].bursty_flow_count;
       out_fp << ", rate:" << core_snapshots_[i].packet_rate;
@@ -187,6 +194,7 @@ CommandResponse NFVMonitor::CommandGetSummary(const bess::pb::EmptyArg &) {
 
   out_fp << "P50 latency:" << GetTailLatency(50) << std::endl;
   out_fp << "P99 latency:" << GetTailLatency(99) << std::endl;
+  out_fp << "P999 latency:" << GetTailLatency(99.9) << std::endl;
 
   out_fp.close();
   return CommandResponse();
@@ -1,7 +1,6 @@
 #ifndef BESS_MODULES_NFV_MONITOR_H_
 #define BESS_MODULES_NFV_MONITOR_H_
 
-#include <boost/circular_buffer.hpp>
 #include <math.h>
 #include <map>
 #include <set>
@@ -13,6 +12,7 @@
 #include "../pb/module_msg.pb.h"
 #include "../utils/flow.h"
 #include "../utils/ip.h"
+#include "../utils/latency_sketch.h"
 #include "../utils/sys_measure.h"
 
 using bess::utils::be16_t;
@@ -36,15 +36,10 @@ class NFVMonitor final : public Module {
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
-  uint64_t GetTailLatency(uint32_t percentile) {
-    std::vector<uint64_t> latency_copy;
-    // Create a copy of the latency buffer
-    for (auto it = per_core_latency_sample_.begin(); it != per_core_latency_sample_.end(); it++) {
-      latency_copy.push_back(*it);
-    }
-    sort(latency_copy.begin(), latency_copy.end());
-    size_t idx = ceil((percentile / 100.0) * latency_copy.size());
-    return latency_copy[idx];
+  // Returns the |percentile|-th (e.g., 99.9) packet delay over all completed
+  // epochs. O(1): no samples are copied or sorted.
+  uint64_t GetTailLatency(double percentile) {
+    return total_latency_.Quantile(percentile / 100.0);
   }
 
   // Generate an epoch summary
@@ -66,7 +61,10 @@ class NFVMonitor final : public Module {
   std::unordered_map<Flow, uint32_t, FlowHash> per_flow_packet_counter_;
 
   // Core statistics
-  boost::circular_buffer<uint64_t> per_core_latency_sample_;
+  // Packet delays of the current epoch, merged into |total_latency_| and
+  // reset at each epoch boundary
+  bess::utils::LatencySketch epoch_latency_;
+  bess::utils::LatencySketch total_latency_;
   uint16_t epoch_packet_counter_;
   uint16_t epoch_queue_length_;
   uint16_t epoch_slo_violation_counter_;
@@ -1,14 +1,37 @@
 #include "nfv_rcore.h"
+#include "nfv_core.h"
+
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <x86intrin.h>
 
 #include "../drivers/pmd.h"
 #include "../port.h"
+#include "../task.h"
+#include "../traffic_class.h"
+#include "../utils/sys_measure.h"
 
 const Commands NFVRCore::cmds = {
   {"set_burst", "NFVRCoreCommandSetBurstArg", MODULE_CMD_FUNC(&NFVRCore::CommandSetBurst),
      Command::THREAD_SAFE},
+  {"get_summary", "EmptyArg", MODULE_CMD_FUNC(&NFVRCore::CommandGetSummary),
+     Command::THREAD_SAFE},
 };
 
 namespace {
+size_t CountLeaves(const bess::TrafficClass *tc) {
+  if (tc->policy() == bess::POLICY_LEAF) {
+    return 1;
+  }
+  size_t n = 0;
+  for (const bess::TrafficClass *child : tc->Children()) {
+    n += CountLeaves(child);
+  }
+  return n;
+}
+
 // uint64_t get_hw_timestamp_nic(bess::Packet *pkt) {
 //   uint64_t nic_cycle = reinterpret_cast<rte_mbuf*>(pkt)->timestamp;
 //   return nic_tsc_to_ns(nic_cycle);
@@ -22,6 +45,11 @@ CommandResponse NFVRCore::Init(const bess::pb::NFVRCoreArg &arg) {
     return CommandFailure(ENOMEM, "Task creation failed");
   }
 
+  rt_ = bess::ctrl::GetNFVRuntime(arg.instance());
+  if (rt_ == nullptr) {
+    return CommandFailure(EINVAL, "invalid instance %d", arg.instance());
+  }
+
   // Configure the target CPU core ID
   core_id_ = 0;
   if (arg.core_id() > 0) {
@@ -31,40 +59,61 @@ CommandResponse NFVRCore::Init(const bess::pb::NFVRCoreArg &arg) {
 
   burst_ = bess::PacketBatch::kMaxBurst;
 
-  // Init
-  size_t kQSize = 64;
-  int bytes = llring_bytes_with_slots(kQSize);
-  to_add_queue_ = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-  if (to_add_queue_) {
-    llring_init(to_add_queue_, kQSize, 0, 1);
-  }
-  to_remove_queue_ = reinterpret_cast<llring *>(std::aligned_alloc(alignof(llring), bytes));
-  if (to_remove_queue_) {
-    llring_init(to_remove_queue_, kQSize, 0, 1);
-  }
-
   // Set |mode_|
   mode_ = 0;
   if (arg.mode() > 0) {
     mode_ = arg.mode();
   }
 
+  // Adaptive polling. Only rcores (mode 1) are told when new work comes,
+  // so only they can park; other modes only back off
+  adaptive_poll_ = arg.adaptive_poll();
+  park_idle_ns_ = (mode_ == 1) ? arg.park_idle_ns() : 0;
+  wakeup_budget_ns_ = bess::utils::slo_ns / 10;
+  if (arg.wakeup_budget_ns() > 0) {
+    wakeup_budget_ns_ = arg.wakeup_budget_ns();
+  }
+  park_disabled_ = false;
+  in_idle_pool_ = false;
+  sole_task_ = false;
+  idle_rounds_ = 0;
+  pause_count_ = 0;
+  idle_since_ns_ = 0;
+  park_fd_ = -1;
+  if (adaptive_poll_ && park_idle_ns_ > 0) {
+    park_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (park_fd_ < 0) {
+      return CommandFailure(errno, "eventfd() failed");
+    }
+  }
+  rte_atomic16_set(&parked_, 0);
+  rte_atomic16_set(&wake_pending_, 0);
+  rte_atomic64_set(&wake_ts_ns_, 0);
+  park_count_ = 0;
+  wakeup_count_ = 0;
+  wakeup_latency_sum_ns_ = 0;
+  wakeup_latency_max_ns_ = 0;
+  flow_owner_ = nullptr;
+  memset(reorder_slots_, 0, sizeof(reorder_slots_));
+  reorder_count_ = 0;
+
   // Set |sw_q_|
   sw_q_ = nullptr;
   if (mode_ == 0) {
-    sw_q_ = bess::ctrl::local_boost_q[core_id_];
-    bess::ctrl::nfv_booster[core_id_] = this;
+    sw_q_ = rt_->local_boost_q[core_id_];
+    rt_->cores[core_id_].nfv_booster = this;
     LOG(INFO) << "ncore-booster: " << core_id_;
   }
   else if (mode_ == 1) {
-    sw_q_ = bess::ctrl::sw_q[core_id_];
-    bess::ctrl::nfv_rcores[core_id_] = this;
-    bess::ctrl::rcore_state[core_id_] = true; // ready for any new work
+    sw_q_ = rt_->sw_q[core_id_];
+    rt_->cores[core_id_].nfv_rcore = this;
+    in_idle_pool_ = true;
+    rt_->ReleaseIdleRCore(core_id_); // ready for any new work
     LOG(INFO) << "rcore: " << core_id_;
   }
   else if (mode_ == 2) {
-    sw_q_ = bess::ctrl::rcore_boost_q;
-    bess::ctrl::nfv_rcore_booster = this;
+    sw_q_ = rt_->rcore_boost_q;
+    rt_->nfv_rcore_booster = this;
     LOG(INFO) << "rcore-booster";
   }
   else if (mode_ == 3) {
@@ -74,38 +123,222 @@ CommandResponse NFVRCore::Init(const bess::pb::NFVRCoreArg &arg) {
     // A: if we don't free packets, these packets will accumulate. They
     // will use all free packet memory slots and prevent new incoming
     // packets from entering the server.
-    sw_q_ = bess::ctrl::system_dump_q;
-    bess::ctrl::nfv_system_dumper = this;
+    sw_q_ = rt_->system_dump_q;
+    rt_->nfv_system_dumper = this;
     LOG(INFO) << "sys-dump!";
   }
 
   // Run!
   is_cleanup_ = false;
-  rte_atomic16_set(&sw_q_id_, -1);
-  rte_atomic16_set(&disabled_, 0);
+  stopped_ = false;
   return CommandSuccess();
 }
 
 void NFVRCore::DeInit() {
-  // Mark to stop the pipeline and wait until the pipeline stops
-  rte_atomic16_set(&disabled_, 1);
-  while (rte_atomic16_read(&disabled_) == 2) { usleep(100000); }
+  // Stop the pipeline and wait until it stops (within one round, or one
+  // park timeout if the kick is missed)
+  if (!bess::ctrl::StopAndWait(this, &mailbox_,
+                               "rcore " + std::to_string(core_id_),
+                               [this]() { Kick(); })) {
+    stopped_ = true;
+  }
+
+  // Unregister from the runtime. An idle-pool entry of |this| rcore is
+  // skipped once |nfv_rcore| is cleared, or reused by the next rcore with
+  // the same ID
+  if (mode_ == 0) {
+    rt_->cores[core_id_].nfv_booster = nullptr;
+  } else if (mode_ == 1) {
+    rt_->cores[core_id_].nfv_rcore = nullptr;
+  } else if (mode_ == 2) {
+    rt_->nfv_rcore_booster = nullptr;
+  } else if (mode_ == 3) {
+    rt_->nfv_system_dumper = nullptr;
+  }
 
   // Clean the software queue that is currently being processed
   is_cleanup_ = false;
-  rte_atomic16_set(&sw_q_id_, -1);
   sw_q_ = nullptr;
 
-  // Clean any queues that are pending
-  if (to_add_queue_) {
-    while (llring_sc_dequeue(to_add_queue_, (void **)&sw_q_) == 0) { continue; }
-    std::free(to_add_queue_);
-    to_add_queue_ = nullptr;
+  if (park_fd_ >= 0) {
+    LOG(INFO) << "rcore " << core_id_ << ": parked " << park_count_ << " times";
+    close(park_fd_);
+    park_fd_ = -1;
   }
-  if (to_remove_queue_) {
-    while (llring_sc_dequeue(to_remove_queue_, (void **)&sw_q_) == 0) { continue; }
-    std::free(to_remove_queue_);
-    to_remove_queue_ = nullptr;
+}
+
+void NFVRCore::Wake() {
+  rte_atomic64_set(&wake_ts_ns_, tsc_to_ns(rdtsc()));
+  rte_atomic16_set(&wake_pending_, 1);
+  // Pairs with the barrier in |Park|: either the rcore sees |wake_pending_|
+  // before sleeping, or we see |parked_| and signal it
+  rte_smp_mb();
+  if (rte_atomic16_read(&parked_) && park_fd_ >= 0) {
+    eventfd_write(park_fd_, 1);
+  }
+}
+
+void NFVRCore::Kick() {
+  // Pairs with the barrier in |Park|
+  rte_smp_mb();
+  if (rte_atomic16_read(&parked_) && park_fd_ >= 0) {
+    eventfd_write(park_fd_, 1);
+  }
+}
+
+void NFVRCore::HandleCtrlMsgs() {
+  using bess::ctrl::CtrlMsg;
+  mailbox_.Poll([this](uint32_t lane, const CtrlMsg &msg) {
+    switch (msg.type) {
+      case CtrlMsg::kStop:
+        stopped_ = true;
+        mailbox_.Complete(lane, msg);
+        break;
+      case CtrlMsg::kAssignQueue:
+      case CtrlMsg::kReleaseQueue:
+        if (mode_ != 1) {
+          break;
+        }
+        if (msg.arg != core_id_) {
+          LOG(FATAL) << "rcore " << core_id_ << ": "
+                     << (msg.type == CtrlMsg::kAssignQueue ? "kAssignQueue"
+                                                           : "kReleaseQueue")
+                     << " for sw_q " << msg.arg << " is not its own";
+        }
+        is_cleanup_ = (msg.type == CtrlMsg::kReleaseQueue);
+        if (msg.type == CtrlMsg::kAssignQueue) {
+          // FlowStates of the last up core may be reused by the new one
+          memset(reorder_slots_, 0, sizeof(reorder_slots_));
+        }
+        break;
+      default:
+        LOG(WARNING) << "rcore " << core_id_ << ": unexpected message " << msg.type;
+    }
+  });
+}
+
+NFVCore *NFVRCore::FlowOwner() {
+  uint16_t owner_id = core_id_;
+  if (mode_ == 1) {
+    // Keeps the last up core after |sw_q_| is released
+    owner_id = rt_->sw_q_state[core_id_]->GetUpCoreID();
+  }
+  if (owner_id < DEFAULT_INVALID_CORE_ID && rt_->cores[owner_id].nfv_core != nullptr) {
+    flow_owner_ = rt_->cores[owner_id].nfv_core;
+  }
+  return flow_owner_;
+}
+
+uint32_t NFVRCore::CountReordered(bess::PacketBatch *batch) {
+  uint32_t reordered = 0;
+  int cnt = batch->cnt();
+  for (int i = 0; i < cnt; i++) {
+    bess::Packet *pkt = batch->pkts()[i];
+    // Only the pointer is used; the FlowState belongs to |flow_owner_|
+    const FlowState *state = flow_owner_->GetFlowState(pkt);
+    uint32_t seq = reinterpret_cast<rte_mbuf*>(pkt)->seqn;
+    uint64_t h = reinterpret_cast<uintptr_t>(state) * 0x9e3779b97f4a7c15ULL;
+    ReorderSlot &slot = reorder_slots_[(h >> 32) % kReorderSlots];
+    if (slot.flow != state) {
+      slot.flow = state;
+      slot.seq = seq;
+      continue;
+    }
+    // Gaps (i.e., drops) are fine
+    if ((int32_t)(seq - slot.seq) < 0) {
+      reordered += 1;
+    } else {
+      slot.seq = seq;
+    }
+  }
+  return reordered;
+}
+
+bool NFVRCore::CanPark() const {
+  return park_idle_ns_ > 0 && park_fd_ >= 0 && !park_disabled_ &&
+         in_idle_pool_ && !is_cleanup_ && sole_task_;
+}
+
+bool NFVRCore::IsSoleTask() const {
+  for (const Task *t : tasks()) {
+    const bess::TrafficClass *tc = t->GetTC();
+    if (tc == nullptr || CountLeaves(tc->Root()) != 1) {
+      return false;
+    }
+  }
+  return !tasks().empty();
+}
+
+void NFVRCore::Idle() {
+  uint64_t now = tsc_to_ns(rdtsc());
+  if (idle_rounds_ == 0) {
+    idle_since_ns_ = now;
+  }
+  idle_rounds_ += 1;
+  if (idle_rounds_ < kSpinRounds) {
+    return;
+  }
+  if (idle_rounds_ == kSpinRounds) {
+    // Walks the worker's TC tree, so do it once per idle period. Since
+    // parking resets |idle_rounds_|, a parked rcore re-checks every
+    // |kParkTimeoutMs|
+    sole_task_ = IsSoleTask();
+  }
+
+  if (CanPark() && now - idle_since_ns_ > park_idle_ns_) {
+    Park();
+    idle_rounds_ = 0;
+    pause_count_ = 0;
+    return;
+  }
+
+  // Exponential back-off, bounded so that a burst waits for at most
+  // |kMaxPauseCount| pause units
+  pause_count_ = std::min(std::max(pause_count_ * 2, 1U), kMaxPauseCount);
+#if defined(__WAITPKG__)
+  // Sleep in a light C-state until a producer updates |sw_q_|
+  _umonitor((void *)sw_q_->prod_tail_addr());
+  _umwait(0, rdtsc() + pause_count_ * kPauseCycles);
+#else
+  for (uint32_t i = 0; i < pause_count_; i++) {
+    _mm_pause();
+  }
+#endif
+}
+
+void NFVRCore::Park() {
+  rte_atomic16_set(&parked_, 1);
+  rte_smp_mb();
+
+  // Do not sleep through a wake-up or packets that came in the meantime
+  bool slept = false;
+  if (rte_atomic16_read(&wake_pending_) == 0 && sw_q_->Empty() &&
+      !mailbox_.Pending()) {
+    struct pollfd pfd = {.fd = park_fd_, .events = POLLIN, .revents = 0};
+    poll(&pfd, 1, kParkTimeoutMs);
+    park_count_ += 1;
+    slept = true;
+  }
+  rte_atomic16_set(&parked_, 0);
+
+  eventfd_t val;
+  eventfd_read(park_fd_, &val);  // non-blocking; drops stale signals
+
+  if (!slept || rte_atomic16_read(&wake_pending_) == 0) {
+    return;
+  }
+
+  // Woken up: check the latency against the budget
+  uint64_t latency = tsc_to_ns(rdtsc()) - rte_atomic64_read(&wake_ts_ns_);
+  wakeup_count_ += 1;
+  wakeup_latency_sum_ns_ += latency;
+  wakeup_latency_max_ns_ = std::max(wakeup_latency_max_ns_, latency);
+  if (wakeup_count_ >= kMinWakeupSamples &&
+      wakeup_latency_sum_ns_ / wakeup_count_ > wakeup_budget_ns_) {
+    park_disabled_ = true;
+    LOG(WARNING) << "rcore " << core_id_ << ": avg wake-up latency "
+                 << wakeup_latency_sum_ns_ / wakeup_count_ << " ns exceeds "
+                 << wakeup_budget_ns_ << " ns; parking is disabled";
   }
 }
 
@@ -120,30 +353,42 @@ CommandResponse NFVRCore::CommandSetBurst(
   }
 }
 
+CommandResponse NFVRCore::CommandGetSummary(const bess::pb::EmptyArg &) {
+  uint64_t avg = wakeup_count_ ? wakeup_latency_sum_ns_ / wakeup_count_ : 0;
+  LOG(INFO) << "rcore " << core_id_ << ": parked " << park_count_
+            << " times; wake-ups " << wakeup_count_ << ", avg " << avg
+            << " ns, max " << wakeup_latency_max_ns_ << " ns (budget "
+            << wakeup_budget_ns_ << " ns" << (park_disabled_ ? ", exceeded)" : ")")
+            << "; " << reorder_count_ << " packets reordered";
+  return CommandSuccess();
+}
+
 struct task_result NFVRCore::RunTask(Context *ctx, bess::PacketBatch *batch, void *) {
-  if (rte_atomic16_read(&disabled_) == 1) {
-    rte_atomic16_set(&disabled_, 2);
+  if (mailbox_.Pending()) {
+    HandleCtrlMsgs();
+  }
+  if (stopped_) {
     return {.block = false, .packets = 0, .bits = 0};
   }
 
   // check if |this| rcore is done with the current offloading assignment.
   if (mode_ == 1) {
-    int16_t qid = rte_atomic16_read(&sw_q_id_);
-    if (qid != -1) {
-      if (qid != core_id_) {
-        LOG(FATAL) << qid << ", " << core_id_;
-      }
-      is_cleanup_ = true;
-      rte_atomic16_set(&sw_q_id_, -1);
+    // Taken from the idle pool
+    if (rte_atomic16_read(&wake_pending_)) {
+      rte_atomic16_set(&wake_pending_, 0);
+      in_idle_pool_ = false;
+      idle_rounds_ = 0;
+      pause_count_ = 0;
     }
 
     // Done with processing |sw_q_|.
     // Tell everyone that |this| rcore can take any new work
     if (is_cleanup_) {
-      if (llring_count(sw_q_) < 128) {
+      if (sw_q_->Count() < 128) {
         is_cleanup_ = false;
-        bess::ctrl::sw_q_state[core_id_]->SetUpCoreID(DEFAULT_INVALID_CORE_ID);
-        bess::ctrl::rcore_state[core_id_] = true;
+        rt_->sw_q_state[core_id_]->SetUpCoreID(DEFAULT_INVALID_CORE_ID);
+        in_idle_pool_ = true;
+        rt_->ReleaseIdleRCore(core_id_);
         // LOG(INFO) << "q" << core_id_ << " is released at rcore" << core_id_;
       }
     }
@@ -152,17 +397,37 @@ struct task_result NFVRCore::RunTask(Context *ctx, bess::PacketBatch *batch, voi
   // 3) then, |sw_q_| != nullptr; start the NF chain
   uint64_t total_bytes = 0;
 
-  uint32_t cnt = llring_sc_dequeue_burst(sw_q_, (void **)batch->pkts(), 32);
+  uint32_t cnt = sw_q_->DequeueBurst((void **)batch->pkts(), 32);
   if (cnt == 0) {
+    if (adaptive_poll_) {
+      Idle();
+    }
     return {.block = false, .packets = 0, .bits = 0};
   }
+  idle_rounds_ = 0;
+  pause_count_ = 0;
   batch->set_cnt(cnt);
 
+  // Flows that leave |sw_q_| are handed off after their drain markers
+  bess::ctrl::DrainMarker *markers[bess::PacketBatch::kMaxBurst];
+  int marker_cnt = bess::ctrl::StripDrainMarkers(batch, markers);
+  cnt = batch->cnt();
+
   for (uint32_t i = 0; i < cnt; i++) {
     total_bytes += batch->pkts()[i]->total_len();
   }
 
-  RunNextModule(ctx, batch);
+  if (cnt > 0) {
+    if (mode_ <= 1 && FlowOwner() != nullptr) {
+      reorder_count_ += CountReordered(batch);
+    }
+    RunNextModule(ctx, batch);
+  }
+
+  // All packets ahead of the markers have been processed
+  for (int i = 0; i < marker_cnt; i++) {
+    markers[i]->Ack();
+  }
 
   return {.block = false,
           .packets = cnt,
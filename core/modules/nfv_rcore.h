@@ -1,6 +1,8 @@
 #ifndef BESS_MODULES_NFV_RCORE_H_
 #define BESS_MODULES_NFV_RCORE_H_
 
+#include <atomic>
+
 #include "nfv_ctrl_msg.h"
 
 #include "../module.h"
@@ -19,7 +21,7 @@ class NFVRCore final : public Module {
  public:
   static const Commands cmds;
 
-  NFVRCore() : Module(), burst_(32) {
+  NFVRCore() : Module(), rt_(nullptr), stopped_(false), burst_(32) {
     is_task_ = true; max_allowed_workers_ = 1;
   }
 
@@ -29,41 +31,108 @@ class NFVRCore final : public Module {
   struct task_result RunTask(Context *ctx, bess::PacketBatch *batch, void *arg) override;
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
-  // |NFVRCore| will start working on |q| when the next round starts
-  inline void AddQueue(struct llring* q) {
-    llring_mp_enqueue(to_add_queue_, (void*)q);
-  }
-  inline void AddQueue(int16_t qid) {
-    rte_atomic16_set(&sw_q_id_, qid);
+  // Called by normal core |core_id|: keep working on sw_q |qid|
+  inline void AddQueue(cpu_core_t core_id, int16_t qid) {
+    mailbox_.Post(core_id, {bess::ctrl::CtrlMsg::kAssignQueue, qid});
   }
 
-  // |NFVRCore| will stop working on |q| when the next round starts
-  inline void RemoveQueue(struct llring* q) {
-    llring_mp_enqueue(to_remove_queue_, (void*)q);
-  }
-  inline void RemoveQueue(int16_t qid) {
-    rte_atomic16_set(&sw_q_id_, qid);
+  // Called by normal core |core_id|: release sw_q |qid| once it is drained
+  inline void RemoveQueue(cpu_core_t core_id, int16_t qid) {
+    mailbox_.Post(core_id, {bess::ctrl::CtrlMsg::kReleaseQueue, qid});
   }
 
+  // Called by NFVCtrl when |this| rcore is taken from the idle pool.
+  // Wakes |this| rcore up if it is parked.
+  void Wake();
+
   CommandResponse CommandSetBurst(const bess::pb::NFVRCoreCommandSetBurstArg &arg);
+  CommandResponse CommandGetSummary(const bess::pb::EmptyArg &arg);
 
  private:
+  // Empty polls before backing off
+  static constexpr uint32_t kSpinRounds = 64;
+  // The max # of pause units per back-off round
+  static constexpr uint32_t kMaxPauseCount = 64;
+  // Cycles per pause unit when using umwait
+  static constexpr uint32_t kPauseCycles = 100;
+  // A parked rcore re-checks its state at least this often
+  static constexpr int kParkTimeoutMs = 10;
+  // Wake-ups to sample before checking the wake-up latency budget
+  static constexpr uint64_t kMinWakeupSamples = 8;
+
+  // Called after an empty poll: spins, then backs off with pause (or umwait),
+  // and finally parks if |this| rcore is in the idle pool.
+  void Idle();
+  bool CanPark() const;
+  // Parking blocks the whole worker, so it is only allowed if |this| rcore's
+  // task is the only one its worker schedules.
+  bool IsSoleTask() const;
+  // Blocks on |park_fd_| until woken up or timed out
+  void Park();
+
+  // Returns the NFVCore that owns flows in |sw_q_| (nullptr: unknown)
+  NFVCore *FlowOwner();
+
+  // Handles all messages in |mailbox_|
+  void HandleCtrlMsgs();
+  // Signals |park_fd_| if |this| rcore is parked
+  void Kick();
+
+  // Same as NFVCore::CountReordered, but against |reorder_slots_|, since
+  // |this| rcore must not write the owner's FlowStates
+  uint32_t CountReordered(bess::PacketBatch *batch);
+
+  // The Ironside instance that |this| belongs to
+  bess::ctrl::NFVRuntime *rt_;
   int mode_;
   cpu_core_t core_id_;
   WorkerCore core_;
 
-  // NFVCore -> NFVCtrl
-  struct llring *to_add_queue_;
-  struct llring *to_remove_queue_;
-  rte_atomic16_t sw_q_id_;
+  // Messages from normal cores (sw_q assignment) and the control thread.
+  // Once |stopped_| is set (by kStop or DeInit), |this| rcore no longer
+  // processes |sw_q_|.
+  bess::ctrl::CtrlMailbox mailbox_;
+  std::atomic<bool> stopped_;
 
-  // Set by myself after reading |sw_q_id_|
+  // Set by kReleaseQueue: release |sw_q_| once it is drained
   bool is_cleanup_;
-  struct llring* sw_q_;
+  BatchRing* sw_q_;
   int burst_;
 
-  // If true, |this| normal core stops pulling packets from its NIC queue
-  rte_atomic16_t disabled_;
+  // Adaptive polling
+  bool adaptive_poll_;
+  uint64_t park_idle_ns_;
+  uint64_t wakeup_budget_ns_;
+  bool park_disabled_;     // set if wake-ups are slower than the budget
+  bool in_idle_pool_;      // true from ReleaseIdleRCore until woken up
+  bool sole_task_;         // see IsSoleTask(); updated in Idle()
+  uint32_t idle_rounds_;   // consecutive empty polls
+  uint32_t pause_count_;
+  uint64_t idle_since_ns_;
+
+  // Parking: |Wake| sets |wake_pending_| and signals |park_fd_| if |parked_|
+  int park_fd_;
+  rte_atomic16_t parked_;
+  rte_atomic16_t wake_pending_;
+  rte_atomic64_t wake_ts_ns_;
+
+  // Wake-up latency of parked rcores
+  uint64_t park_count_;
+  uint64_t wakeup_count_;
+  uint64_t wakeup_latency_sum_ns_;
+  uint64_t wakeup_latency_max_ns_;
+
+  // Reordering guard (ncore boosters and rcores only). The latest sequence
+  // number processed per flow, direct-mapped by FlowState address. A flow
+  // that takes over a slot starts over, so collisions only miss reordering.
+  static constexpr uint32_t kReorderSlots = 1024;
+  struct ReorderSlot {
+    const FlowState *flow;
+    uint32_t seq;
+  };
+  NFVCore *flow_owner_;
+  ReorderSlot reorder_slots_[kReorderSlots];
+  uint64_t reorder_count_;
 };
 
 #endif // BESS_MODULES_NFV_RCORE_H_
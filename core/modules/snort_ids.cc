@@ -28,7 +28,6 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "snort_ids.h"
-#include "aho_corasick.h"
 
 #include <algorithm>
 #include <tuple>
@@ -53,25 +52,42 @@ const Commands SnortIDS::cmds = {
      Command::THREAD_UNSAFE}};
 
 CommandResponse SnortIDS::Init(const bess::pb::SnortIDSArg &arg) {
-  keyword_count_ = arg.keywords_size();
-  min_keyword_len_ = 100;
-  std::vector<std::string> words;
-  for (int i = 0; i < keyword_count_; i++) {
-    words.push_back(arg.keywords(i));
-    min_keyword_len_ = std::min(arg.keywords(i).length(), min_keyword_len_);
+  max_flow_bytes_ = bess::utils::ReassemblyBuffer::kDefaultMaxBytes;
+  if (arg.max_flow_bytes()) {
+    if (arg.max_flow_bytes() > bess::utils::ReassemblyArena::kMaxBlockSize) {
+      return CommandFailure(EINVAL, "max_flow_bytes must be at most %zu",
+                            bess::utils::ReassemblyArena::kMaxBlockSize);
+    }
+    max_flow_bytes_ = arg.max_flow_bytes();
   }
-  BuildMatchingMachine(words);
-
-  return CommandSuccess();
+  return BuildMatcher({arg.keywords().begin(), arg.keywords().end()});
 }
 
 CommandResponse SnortIDS::CommandAdd(const bess::pb::SnortIDSArg &arg) {
-  Init(arg);
-  return CommandSuccess();
+  std::vector<std::string> keywords = keywords_;
+  keywords.insert(keywords.end(), arg.keywords().begin(),
+                  arg.keywords().end());
+  return BuildMatcher(std::move(keywords));
 }
 
 CommandResponse SnortIDS::CommandClear(const bess::pb::EmptyArg &) {
-  keyword_count_ = 0;
+  return BuildMatcher({});
+}
+
+CommandResponse SnortIDS::BuildMatcher(std::vector<std::string> keywords) {
+  // On failure, keep matching the old keywords
+  MultiPatternMatcher matcher;
+  if (!matcher.Build(keywords)) {
+    return CommandFailure(EINVAL, "keywords are too long in total");
+  }
+  matcher_ = std::move(matcher);
+  keywords_ = std::move(keywords);
+
+  // States of the old matcher mean nothing to the new one
+  for (auto &it : flow_cache_) {
+    it.second.SetMatchState(MultiPatternMatcher::kRootState,
+                            it.second.ScannedLen());
+  }
   return CommandSuccess();
 }
 
@@ -127,6 +143,7 @@ void SnortIDS::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       if (tcp->flags & Tcp::Flag::kSyn) {
         std::tie(it, std::ignore) = flow_cache_.emplace(
             std::piecewise_construct, std::make_tuple(flow), std::make_tuple());
+        it->second.GetBuffer().set_max_bytes(max_flow_bytes_);
       } else {
         // Ignore non-SYN packet.
         continue;
@@ -150,25 +167,26 @@ void SnortIDS::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     record.pkt_cnt_ += 1;
     record.SetExpiryTime(now + TIME_OUT_NS);
 
+    // Scan the bytes that became contiguous with this packet, in place.
+    // The matcher's state carries keywords that span segments.
     bool matched = false;
-    if (record.pkt_cnt_ > 25 &&
-        record.pkt_cnt_ % 25 == 0 &&
-        buffer.contiguous_len() >= 5 * min_keyword_len_) {
-      const char *buffer_data = buffer.buf();
-      std::string payload_str(buffer_data);
-
-      std::vector<int> match_results = SearchWords(keyword_count_, payload_str);
-      for (int any_match : match_results) {
-        if (any_match > 0) {
-          matched = true;
-          break;
-        }
-      }
+    size_t scanned = record.ScannedLen();
+    size_t len = buffer.contiguous_len();
+    if (!matcher_.empty() && len > scanned) {
+      MultiPatternMatcher::State state = record.MatchState();
+      matcher_.Scan(buffer.buf() + scanned, len - scanned, &state,
+                    [&matched](uint32_t, size_t) {
+                      matched = true;
+                      return false;
+                    });
+      record.SetMatchState(state, len);
     }
 
-    if (matched) {
+    // Nothing more to scan once the per-flow cap is reached.
+    if (matched || (buffer.truncated() && len == buffer.max_bytes())) {
       // Mark the flow and record it.
       it->second.SetAnalyzed();
+      buffer.ReleaseBuffer();
     }
 
     // Once FIN is observed, or we've seen all the headers and decided
@@ -184,4 +202,4 @@ void SnortIDS::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 }
 
 ADD_MODULE(SnortIDS, "snort_ids",
-           "Intrusion detection that uses aho_corasick algorithm to match keyword strings")
+           "Intrusion detection that matches keyword strings in TCP payloads")
@@ -44,6 +44,7 @@
 #include "../packet.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/flow.h"
+#include "../utils/multi_pattern.h"
 #include "../utils/trie.h"
 
 using bess::utils::TcpFlowReconstruct;
@@ -53,6 +54,7 @@ using bess::utils::be32_t;
 using bess::utils::Flow;
 using bess::utils::FlowHash;
 using bess::utils::FlowRecord;
+using bess::utils::MultiPatternMatcher;
 
 // A module of HTTP URL filtering. Ends an HTTP connection if the Host field
 // matches the blacklist.
@@ -73,9 +75,15 @@ class SnortIDS final : public Module {
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
  private:
-  // Keyword count
-  int keyword_count_;
-  size_t min_keyword_len_;
+  // Replaces |keywords_| and |matcher_| only if |keywords| compile
+  CommandResponse BuildMatcher(std::vector<std::string> keywords);
+
+  std::vector<std::string> keywords_;
+  // Per-flow reassembly cap; later payload bytes are not scanned
+  size_t max_flow_bytes_;
+  // Per-instance, so that instances with different keywords can run on
+  // different cores
+  MultiPatternMatcher matcher_;
   // Per-flow payload buffer cache
   std::unordered_map<Flow, FlowRecord, FlowHash> flow_cache_;
 };
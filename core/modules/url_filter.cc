@@ -30,6 +30,8 @@
 #include "url_filter.h"
 #include "nfv_ctrl_msg.h"
 
+#include <strings.h>
+
 #include <algorithm>
 #include <tuple>
 
@@ -178,6 +180,7 @@ CommandResponse UrlFilter::Init(const bess::pb::UrlFilterArg &arg) {
   for (const auto &url : arg.blacklist()) {
     blacklist_[url.host()].Insert(url.path(), {});
   }
+  BuildHostTable();
   return CommandSuccess();
 }
 
@@ -188,9 +191,34 @@ CommandResponse UrlFilter::CommandAdd(const bess::pb::UrlFilterArg &arg) {
 
 CommandResponse UrlFilter::CommandClear(const bess::pb::EmptyArg &) {
   blacklist_.clear();
+  BuildHostTable();
   return CommandSuccess();
 }
 
+void UrlFilter::BuildHostTable() {
+  std::vector<std::pair<std::string, const Trie<std::tuple<>> *>> hosts;
+  for (const auto &it : blacklist_) {
+    hosts.emplace_back(it.first, &it.second);
+  }
+  // Hosts are unique keys of blacklist_, but Build() may still find no
+  // perfect hash (e.g., too many hosts share a CRC)
+  hosts_built_ = hosts_.Build(hosts);
+  if (!hosts_built_) {
+    LOG(WARNING) << "url_filter: no perfect hash for " << hosts.size()
+                 << " hosts; falling back to slower lookups";
+  }
+}
+
+const Trie<std::tuple<>> *UrlFilter::FindHost(const char *host,
+                                              size_t len) const {
+  if (hosts_built_) {
+    const Trie<std::tuple<>> *const *paths = hosts_.Find(host, len);
+    return paths ? *paths : nullptr;
+  }
+  auto it = blacklist_.find(std::string(host, len));
+  return it != blacklist_.end() ? &it->second : nullptr;
+}
+
 // Retrieves an argument that would re-create this module in
 // such a way that SetRuntimeConfig would build the same one.
 CommandResponse UrlFilter::GetInitialArg(const bess::pb::EmptyArg &) {
@@ -231,6 +259,7 @@ CommandResponse UrlFilter::SetRuntimeConfig(
   for (const auto &url : arg.blacklist()) {
     blacklist_[url.host()].Insert(url.path(), {});
   }
+  BuildHostTable();
   return CommandSuccess();
 }
 
@@ -303,21 +332,6 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     FlowRecord &record = it->second;
     TcpFlowReconstruct &buffer = record.GetBuffer();
 
-    // If the reconstruct code indicates failure, treat this
-    // as a flow to pass.  Note: we only get failure if there is
-    // something seriously wrong; we get success if there are holes
-    // in the data (in which case the contiguous_len() below is short).
-    bool success = buffer.InsertPacket(pkt);
-    if (!success) {
-      VLOG(1) << "Reconstruction failure";
-      flow_cache_.erase(it);
-      EmitPacket(ctx, pkt, 0);
-      continue;
-    }
-
-    // Have something on this flow; keep it alive for a while longer.
-    record.SetExpiryTime(now + TIME_OUT_NS);
-
     // We are by definition still analyzing.  See if we can determine
     // the final disposition of this flow.
     bool matched = false;
@@ -325,25 +339,60 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     size_t num_headers = 16, method_len, path_len;
     int minor_version;
     const char *method, *path;
-    int parse_result = 0;
-    if (bess::ctrl::exp_id > 10) {
+    // -2 means incomplete
+    int parse_result = -2;
+
+    // Fast path: most requests fit in their first segment, so parse that
+    // segment in place.  Reassembly state is only allocated when the
+    // headers continue in a later segment.
+    const char *payload =
+        reinterpret_cast<const char *>(tcp) + (tcp->offset << 2);
+    int payload_len = std::min<int>(
+        ip->length.value() - ip_bytes - (tcp->offset << 2),
+        pkt->head_len() - (payload - pkt->head_data<const char *>()));
+    if (payload_len > 0 && buffer.buf_size() == 0 && buffer.initialized() &&
+        !(tcp->flags & Tcp::Flag::kSyn) &&
+        tcp->seq_num.value() == buffer.init_seq() &&
+        bess::ctrl::exp_id > 10) {
       parse_result = phr_parse_request(
-          buffer.buf(), buffer.contiguous_len(), &method, &method_len, &path,
-          &path_len, &minor_version, headers, &num_headers, 0);
+          payload, payload_len, &method, &method_len, &path, &path_len,
+          &minor_version, headers, &num_headers, 0);
     }
 
-    // -2 means incomplete
-    if (parse_result > 0 || parse_result == -2) {
-      const std::string path_str(path, path_len);
+    if (parse_result == -2) {
+      // If the reconstruct code indicates failure, treat this
+      // as a flow to pass.  Note: we only get failure if there is
+      // something seriously wrong; we get success if there are holes
+      // in the data (in which case the contiguous_len() below is short).
+      bool success = buffer.InsertPacket(pkt);
+      if (!success) {
+        VLOG(1) << "Reconstruction failure";
+        flow_cache_.erase(it);
+        EmitPacket(ctx, pkt, 0);
+        continue;
+      }
 
-      // Look for the Host header
+      num_headers = 16;
+      parse_result = 0;
+      if (bess::ctrl::exp_id > 10) {
+        parse_result = phr_parse_request(
+            buffer.buf(), buffer.contiguous_len(), &method, &method_len, &path,
+            &path_len, &minor_version, headers, &num_headers, 0);
+      }
+    }
+
+    // Have something on this flow; keep it alive for a while longer.
+    record.SetExpiryTime(now + TIME_OUT_NS);
+
+    if (parse_result > 0 || parse_result == -2) {
+      // Look for the Host header, without copying it out of the packet
       for (size_t j = 0; j < num_headers && !matched; ++j) {
-        if (strncmp(headers[j].name, HTTP_HEADER_HOST, headers[j].name_len) ==
-            0) {
-          const std::string host(headers[j].value, headers[j].value_len);
-          const auto rule_iterator = blacklist_.find(host);
-          matched = rule_iterator != blacklist_.end() &&
-                    rule_iterator->second.Match(path_str);
+        if (headers[j].name_len == sizeof(HTTP_HEADER_HOST) - 1 &&
+            strncasecmp(headers[j].name, HTTP_HEADER_HOST,
+                        headers[j].name_len) == 0) {
+          const Trie<std::tuple<>> *paths =
+              FindHost(headers[j].value, headers[j].value_len);
+          matched = paths && paths->Match(path, path_len);
         }
       }
       // For Ironside experiments, do not drop any packets.
@@ -357,13 +406,16 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       // to pass the flow, there is no more need to reconstruct the flow.
       // NOTE: if FIN is lost on its way to destination, this will simply pass
       // the retransmitted packet.
-      if (parse_result != -2 || (tcp->flags & Tcp::Flag::kFin)) {
+      // Headers that do not fit in the per-flow cap never complete.
+      if (parse_result != -2 || buffer.truncated() ||
+          (tcp->flags & Tcp::Flag::kFin)) {
         flow_cache_.erase(it);
       }
     } else {
       // No need to keep reconstructing, just mark it as analyzed
       // (and hence blocked).
       it->second.SetAnalyzed();
+      buffer.ReleaseBuffer();
 
       // Inject RST to destination
       EmitPacket(ctx, GenerateResetPacket(eth->src_addr, eth->dst_addr, ip->src,
@@ -43,6 +43,7 @@
 #include "../packet.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/flow.h"
+#include "../utils/perfect_hash.h"
 #include "../utils/trie.h"
 
 using bess::utils::TcpFlowReconstruct;
@@ -78,7 +79,16 @@ class UrlFilter final : public Module {
   CommandResponse SetRuntimeConfig(const bess::pb::UrlFilterConfig &arg);
 
  private:
+  // Recompiles hosts_ after blacklist_ changes. If that fails, lookups
+  // fall back to blacklist_ itself
+  void BuildHostTable();
+  // Returns the path trie of |host|, or nullptr
+  const Trie<std::tuple<>> *FindHost(const char *host, size_t len) const;
+
   std::unordered_map<std::string, Trie<std::tuple<>>> blacklist_;
+  // Host -> path trie in blacklist_, for lookups straight from packet data
+  bess::utils::PerfectHashMap<const Trie<std::tuple<>> *> hosts_;
+  bool hosts_built_ = false;
   std::unordered_map<Flow, FlowRecord, FlowHash> flow_cache_;
 };
 
@@ -132,3 +132,18 @@ DEFINE_int32(buffers, 262144,
              " must be a power of 2.");
 static const bool _buffers_dummy[[maybe_unused]] =
     google::RegisterFlagValidator(&FLAGS_buffers, &ValidateBuffersPerSocket);
+
+static bool ValidateReassemblyMegabytes(const char *, int32_t value) {
+  if (value <= 0) {
+    LOG(ERROR) << "Invalid memory size: " << value;
+    return false;
+  }
+
+  return true;
+}
+DEFINE_int32(reassembly_mem, 64,
+             "Specifies per-worker memory for TCP reassembly buffers (in MBs)."
+             " The least recently used flows are evicted beyond that.");
+static const bool _reassembly_mem_dummy[[maybe_unused]] =
+    google::RegisterFlagValidator(&FLAGS_reassembly_mem,
+                                  &ValidateReassemblyMegabytes);
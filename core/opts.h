@@ -49,6 +49,7 @@ DECLARE_string(modules);
 DECLARE_bool(core_dump);
 DECLARE_bool(no_crashlog);
 DECLARE_int32(buffers);
+DECLARE_int32(reassembly_mem);
 DECLARE_bool(dpdk);
 DECLARE_string(iova);
 
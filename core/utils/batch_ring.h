@@ -0,0 +1,239 @@
+#ifndef BESS_UTILS_BATCH_RING_H_
+#define BESS_UTILS_BATCH_RING_H_
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <glog/logging.h>
+
+namespace bess {
+namespace utils {
+
+// A bounded ring of pointers for software packet queues between cores.
+// There is always a single consumer; the producer mode (single or multi)
+// is selected per ring.
+//
+// Compared to llring:
+// - each side caches the other side's index, so a producer (consumer) only
+//   reads the consumer's (producer's) cache line when the ring looks full
+//   (empty);
+// - a producer reserves slots and fills them in place, so that a batch is
+//   written once instead of being staged in a PacketBatch and then copied;
+// - all |slots| slots are usable.
+//
+// Example usage:
+//
+//  BatchRing *q = BatchRing::Create(2048, true);
+//  BatchRing::Reservation r;
+//  q->Reserve(cnt, &r);
+//  for (uint32_t i = 0; i < r.cnt; i++) {
+//    r[i] = pkts[i];
+//  }
+//  q->Commit(&r, r.cnt);
+//  uint32_t n = q->DequeueBurst(objs, 32);
+//  BatchRing::Destroy(q);
+class alignas(64) BatchRing {
+ public:
+  // A range of reserved slots. Slots are contiguous modulo the ring size.
+  struct Reservation {
+    void *&operator[](uint32_t i) { return ring->slots_[(head + i) & ring->mask_]; }
+
+    BatchRing *ring;
+    uint32_t head;  // the first slot's (free-running) index
+    uint32_t cnt;
+  };
+
+  // |slots| must be a power of two. Returns nullptr on failure.
+  static BatchRing *Create(uint32_t slots, bool single_producer) {
+    if (slots < 2 || (slots & (slots - 1)) != 0) {
+      return nullptr;
+    }
+    void *mem = std::aligned_alloc(alignof(BatchRing), sizeof(BatchRing));
+    void **ring_slots = static_cast<void **>(
+        std::aligned_alloc(64, std::max<size_t>(64, sizeof(void *) * slots)));
+    if (mem == nullptr || ring_slots == nullptr) {
+      std::free(mem);
+      std::free(ring_slots);
+      return nullptr;
+    }
+    return new (mem) BatchRing(ring_slots, slots, single_producer);
+  }
+
+  // Does not free the pointers left in |ring|.
+  static void Destroy(BatchRing *ring) {
+    if (ring != nullptr) {
+      std::free(ring->slots_);
+      ring->~BatchRing();
+      std::free(ring);
+    }
+  }
+
+  BatchRing(const BatchRing &) = delete;
+  BatchRing &operator=(const BatchRing &) = delete;
+
+  /// Producer side.
+  // Reserves up to |n| slots, and returns the number of slots reserved.
+  // The caller must fill them and then call Commit() before reserving again.
+  // Multi-producer: other producers' slots become visible to the consumer
+  // only after the ones reserved earlier have been committed, so
+  // reservations must be short-lived.
+  uint32_t Reserve(uint32_t n, Reservation *r) {
+    r->ring = this;
+    if (single_producer_) {
+      uint32_t head = prod_.head.load(std::memory_order_relaxed);
+      uint32_t cnt = std::min(n, FreeSlots(head, prod_.cached_cons_tail));
+      if (cnt < n) {
+        prod_.cached_cons_tail = cons_.head.load(std::memory_order_acquire);
+        cnt = std::min(n, FreeSlots(head, prod_.cached_cons_tail));
+      }
+      r->head = head;
+      r->cnt = cnt;
+      return cnt;
+    }
+
+    uint32_t head = prod_.head.load(std::memory_order_relaxed);
+    uint32_t cnt;
+    do {
+      // A stale cached index only under-estimates the free slots.
+      // Acquire / release: the consumer is done with the slots before it
+      uint32_t cons_tail = prod_.shared_cons_tail.load(std::memory_order_acquire);
+      cnt = std::min(n, FreeSlots(head, cons_tail));
+      if (cnt < n) {
+        cons_tail = cons_.head.load(std::memory_order_acquire);
+        prod_.shared_cons_tail.store(cons_tail, std::memory_order_release);
+        cnt = std::min(n, FreeSlots(head, cons_tail));
+      }
+      if (cnt == 0) {
+        break;
+      }
+    } while (!prod_.head.compare_exchange_weak(head, head + cnt,
+                                               std::memory_order_relaxed));
+    r->head = head;
+    r->cnt = cnt;
+    return cnt;
+  }
+
+  // Makes the first |cnt| slots of |r| visible to the consumer.
+  // Single-producer: |cnt| may be less than |r->cnt|; the other slots are
+  // returned to the ring. Multi-producer: |cnt| must be |r->cnt|.
+  void Commit(Reservation *r, uint32_t cnt) {
+    DCHECK_LE(cnt, r->cnt);
+    if (single_producer_) {
+      prod_.head.store(r->head + cnt, std::memory_order_relaxed);
+      prod_.tail.store(r->head + cnt, std::memory_order_release);
+      return;
+    }
+
+    DCHECK_EQ(cnt, r->cnt);
+    if (cnt == 0) {
+      return;
+    }
+    // Wait for the producers that reserved earlier slots. Acquire: the
+    // release below then also publishes their slots
+    while (prod_.tail.load(std::memory_order_acquire) != r->head) {
+      _mm_pause();
+    }
+    prod_.tail.store(r->head + cnt, std::memory_order_release);
+  }
+
+  // Copies up to |n| objects into the ring. Returns the number enqueued.
+  uint32_t EnqueueBurst(void *const *objs, uint32_t n) {
+    Reservation r;
+    uint32_t cnt = Reserve(n, &r);
+    for (uint32_t i = 0; i < cnt; i++) {
+      r[i] = objs[i];
+    }
+    Commit(&r, cnt);
+    return cnt;
+  }
+
+  /// Consumer side.
+  // Returns up to |n| slots that can be read in place. Call Release() after
+  // reading them.
+  uint32_t Peek(uint32_t n, Reservation *r) {
+    uint32_t head = cons_.head.load(std::memory_order_relaxed);
+    uint32_t cnt = std::min(n, cons_.cached_prod_tail - head);
+    if (cnt < n) {
+      cons_.cached_prod_tail = prod_.tail.load(std::memory_order_acquire);
+      cnt = std::min(n, cons_.cached_prod_tail - head);
+    }
+    r->ring = this;
+    r->head = head;
+    r->cnt = cnt;
+    return cnt;
+  }
+
+  // Frees the first |cnt| slots returned by Peek().
+  void Release(uint32_t cnt) {
+    uint32_t head = cons_.head.load(std::memory_order_relaxed);
+    cons_.head.store(head + cnt, std::memory_order_release);
+  }
+
+  // Copies up to |n| objects out of the ring. Returns the number dequeued.
+  uint32_t DequeueBurst(void **objs, uint32_t n) {
+    Reservation r;
+    uint32_t cnt = Peek(n, &r);
+    for (uint32_t i = 0; i < cnt; i++) {
+      objs[i] = r[i];
+    }
+    Release(cnt);
+    return cnt;
+  }
+
+  /// Both sides. The result may be stale when the other side is running.
+  uint32_t Count() const {
+    return prod_.tail.load(std::memory_order_acquire) -
+           cons_.head.load(std::memory_order_acquire);
+  }
+  bool Empty() const { return Count() == 0; }
+  uint32_t Capacity() const { return mask_ + 1; }
+  bool single_producer() const { return single_producer_; }
+
+  // The producer's index that changes whenever objects become visible to
+  // the consumer, e.g., to be monitored by umonitor
+  const void *prod_tail_addr() const { return &prod_.tail; }
+
+ private:
+  BatchRing(void **slots, uint32_t size, bool single_producer)
+      : slots_(slots), mask_(size - 1), single_producer_(single_producer) {
+    prod_.head = 0;
+    prod_.tail = 0;
+    prod_.cached_cons_tail = 0;
+    prod_.shared_cons_tail = 0;
+    cons_.head = 0;
+    cons_.cached_prod_tail = 0;
+  }
+
+  // The number of free slots, given the producer's |head| and a (possibly
+  // stale) consumer index |cons_tail|
+  uint32_t FreeSlots(uint32_t head, uint32_t cons_tail) const {
+    int32_t free_slots = (int32_t)(mask_ + 1 + cons_tail - head);
+    return free_slots > 0 ? free_slots : 0;
+  }
+
+  void **slots_;
+  const uint32_t mask_;
+  const bool single_producer_;
+
+  struct alignas(64) Producer {
+    std::atomic<uint32_t> head;  // the next slot to reserve
+    std::atomic<uint32_t> tail;  // slots before |tail| are visible
+    uint32_t cached_cons_tail;   // single-producer only
+    std::atomic<uint32_t> shared_cons_tail;  // multi-producer only
+  } prod_;
+
+  struct alignas(64) Consumer {
+    std::atomic<uint32_t> head;  // the next slot to read
+    uint32_t cached_prod_tail;
+  } cons_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_BATCH_RING_H_
@@ -0,0 +1,131 @@
+#include "batch_ring.h"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using bess::utils::BatchRing;
+
+namespace {
+
+void *ToPtr(uintptr_t v) {
+  return reinterpret_cast<void *>(v);
+}
+
+TEST(BatchRingTest, Create) {
+  EXPECT_EQ(nullptr, BatchRing::Create(0, true));
+  EXPECT_EQ(nullptr, BatchRing::Create(100, true));
+
+  BatchRing *q = BatchRing::Create(64, false);
+  ASSERT_NE(nullptr, q);
+  EXPECT_EQ(64, q->Capacity());
+  EXPECT_FALSE(q->single_producer());
+  EXPECT_TRUE(q->Empty());
+  BatchRing::Destroy(q);
+}
+
+// All slots are usable, and objects come out in order across wrap-arounds
+TEST(BatchRingTest, BurstWrapAround) {
+  for (bool sp : {true, false}) {
+    BatchRing *q = BatchRing::Create(8, sp);
+    void *in[8];
+    void *out[8];
+    uintptr_t next_in = 1;
+    uintptr_t next_out = 1;
+    for (int round = 0; round < 20; round++) {
+      for (int i = 0; i < 5; i++) {
+        in[i] = ToPtr(next_in + i);
+      }
+      ASSERT_EQ(5, q->EnqueueBurst(in, 5));
+      next_in += 5;
+      ASSERT_EQ(5, q->Count());
+
+      ASSERT_EQ(5, q->DequeueBurst(out, 8));
+      for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(ToPtr(next_out++), out[i]);
+      }
+    }
+
+    for (int i = 0; i < 8; i++) {
+      in[i] = ToPtr(i + 1);
+    }
+    EXPECT_EQ(8, q->EnqueueBurst(in, 8));
+    EXPECT_EQ(0, q->EnqueueBurst(in, 1));
+    EXPECT_EQ(3, q->DequeueBurst(out, 3));
+    EXPECT_EQ(3, q->EnqueueBurst(in, 8));
+    EXPECT_EQ(8, q->Count());
+    BatchRing::Destroy(q);
+  }
+}
+
+// Single-producer rings fill slots in place and may commit fewer
+TEST(BatchRingTest, ReserveInPlace) {
+  BatchRing *q = BatchRing::Create(16, true);
+  BatchRing::Reservation r;
+  ASSERT_EQ(10, q->Reserve(10, &r));
+  for (uint32_t i = 0; i < r.cnt; i++) {
+    r[i] = ToPtr(100 + i);
+  }
+  EXPECT_TRUE(q->Empty());  // not visible until committed
+  q->Commit(&r, 4);
+  EXPECT_EQ(4, q->Count());
+
+  // The unused 6 slots are reserved again
+  ASSERT_EQ(12, q->Reserve(20, &r));
+  r[0] = ToPtr(200);
+  q->Commit(&r, 1);
+
+  BatchRing::Reservation c;
+  ASSERT_EQ(5, q->Peek(32, &c));
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_EQ(ToPtr(100 + i), c[i]);
+  }
+  EXPECT_EQ(ToPtr(200), c[4]);
+  q->Release(2);
+  EXPECT_EQ(3, q->Count());
+  BatchRing::Destroy(q);
+}
+
+// Many producers, one consumer: all objects arrive once and each producer's
+// objects arrive in order
+TEST(BatchRingTest, MultiProducer) {
+  const int kProducers = 4;
+  const uintptr_t kPerProducer = 10000;
+  BatchRing *q = BatchRing::Create(256, false);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; p++) {
+    producers.emplace_back([q, p, kPerProducer]() {
+      uintptr_t i = 0;
+      while (i < kPerProducer) {
+        void *objs[7];
+        uint32_t n = std::min<uintptr_t>(7, kPerProducer - i);
+        for (uint32_t j = 0; j < n; j++) {
+          objs[j] = ToPtr(((uintptr_t)p << 32) | (i + j));
+        }
+        i += q->EnqueueBurst(objs, n);
+      }
+    });
+  }
+
+  std::vector<uintptr_t> next(kProducers, 0);
+  uintptr_t total = 0;
+  void *objs[32];
+  while (total < kProducers * kPerProducer) {
+    uint32_t n = q->DequeueBurst(objs, 32);
+    for (uint32_t i = 0; i < n; i++) {
+      uintptr_t v = reinterpret_cast<uintptr_t>(objs[i]);
+      int p = v >> 32;
+      ASSERT_EQ(next[p]++, v & 0xffffffff);
+    }
+    total += n;
+  }
+  for (auto &t : producers) {
+    t.join();
+  }
+  EXPECT_TRUE(q->Empty());
+  BatchRing::Destroy(q);
+}
+
+}  // namespace (unnamed)
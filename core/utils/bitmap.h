@@ -0,0 +1,87 @@
+#ifndef BESS_UTILS_BITMAP_H_
+#define BESS_UTILS_BITMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <glog/logging.h>
+
+namespace bess {
+namespace utils {
+
+// A fixed-size set of small integers in [0, N), e.g., software queue IDs.
+// Membership tests are a single load, and iteration skips empty words, so
+// a Bitmap can replace a std::set of IDs on the packet path without tree
+// walks or node allocations.
+//
+// Example usage:
+//
+//  Bitmap<100> active;
+//  active.Set(3);
+//  active.Set(42);
+//  for (size_t i = active.NextSet(0); i < 100; i = active.NextSet(i + 1)) {
+//    ...  // visits 3 and 42
+//  }
+template <size_t N>
+class Bitmap {
+ public:
+  static const size_t kWords = (N + 63) / 64;
+
+  Bitmap() { Clear(); }
+
+  void Set(size_t i) {
+    DCHECK_LT(i, N);
+    words_[i >> 6] |= (1ull << (i & 63));
+  }
+
+  void Reset(size_t i) {
+    DCHECK_LT(i, N);
+    words_[i >> 6] &= ~(1ull << (i & 63));
+  }
+
+  bool Test(size_t i) const {
+    DCHECK_LT(i, N);
+    return words_[i >> 6] & (1ull << (i & 63));
+  }
+
+  void Clear() { memset(words_, 0, sizeof(words_)); }
+
+  bool Empty() const {
+    for (size_t w = 0; w < kWords; w++) {
+      if (words_[w]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t Count() const {
+    size_t cnt = 0;
+    for (size_t w = 0; w < kWords; w++) {
+      cnt += __builtin_popcountll(words_[w]);
+    }
+    return cnt;
+  }
+
+  // Returns the first set bit in [from, N), or N if there is none.
+  size_t NextSet(size_t from) const {
+    while (from < N) {
+      uint64_t word = words_[from >> 6] >> (from & 63);
+      if (word) {
+        from += __builtin_ctzll(word);
+        return from < N ? from : N;
+      }
+      from = (from | 63) + 1;
+    }
+    return N;
+  }
+
+ private:
+  uint64_t words_[kWords];
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_BITMAP_H_
@@ -0,0 +1,58 @@
+#include "bitmap.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using bess::utils::Bitmap;
+
+namespace {
+
+TEST(BitmapTest, SetAndReset) {
+  Bitmap<100> bm;
+  EXPECT_TRUE(bm.Empty());
+  EXPECT_EQ(0, bm.Count());
+
+  bm.Set(0);
+  bm.Set(63);
+  bm.Set(64);
+  bm.Set(99);
+  EXPECT_FALSE(bm.Empty());
+  EXPECT_EQ(4, bm.Count());
+  EXPECT_TRUE(bm.Test(63));
+  EXPECT_TRUE(bm.Test(64));
+  EXPECT_FALSE(bm.Test(65));
+
+  // Setting twice is idempotent
+  bm.Set(63);
+  EXPECT_EQ(4, bm.Count());
+
+  bm.Reset(63);
+  EXPECT_FALSE(bm.Test(63));
+  EXPECT_EQ(3, bm.Count());
+
+  bm.Clear();
+  EXPECT_TRUE(bm.Empty());
+}
+
+TEST(BitmapTest, NextSet) {
+  Bitmap<130> bm;
+  EXPECT_EQ(130, bm.NextSet(0));
+
+  bm.Set(5);
+  bm.Set(64);
+  bm.Set(129);
+
+  std::vector<size_t> found;
+  for (size_t i = bm.NextSet(0); i < 130; i = bm.NextSet(i + 1)) {
+    found.push_back(i);
+  }
+  EXPECT_EQ(std::vector<size_t>({5, 64, 129}), found);
+
+  EXPECT_EQ(64, bm.NextSet(6));
+  EXPECT_EQ(64, bm.NextSet(64));
+  EXPECT_EQ(129, bm.NextSet(65));
+  EXPECT_EQ(130, bm.NextSet(130));
+}
+
+}  // namespace (unnamed)
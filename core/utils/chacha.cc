@@ -0,0 +1,441 @@
+#include "chacha.h"
+
+#include <x86intrin.h>
+
+#include <cstring>
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+// Arguments: the input block (with counter 0), the number of rounds, and
+// a counter and a destination for each lane
+typedef void (*KernelFn)(const uint32_t *, int, const uint64_t *,
+                         uint8_t *const *);
+
+#define CHACHA_QUARTERROUND(a, b, c, d) \
+  a = ADD(a, b);                        \
+  d = ROTL(XOR(d, a), 16);              \
+  c = ADD(c, d);                        \
+  b = ROTL(XOR(b, c), 12);              \
+  a = ADD(a, b);                        \
+  d = ROTL(XOR(d, a), 8);               \
+  c = ADD(c, d);                        \
+  b = ROTL(XOR(b, c), 7);
+
+#define CHACHA_DOUBLEROUND(x)                      \
+  CHACHA_QUARTERROUND(x[0], x[4], x[8], x[12])     \
+  CHACHA_QUARTERROUND(x[1], x[5], x[9], x[13])     \
+  CHACHA_QUARTERROUND(x[2], x[6], x[10], x[14])    \
+  CHACHA_QUARTERROUND(x[3], x[7], x[11], x[15])    \
+  CHACHA_QUARTERROUND(x[0], x[5], x[10], x[15])    \
+  CHACHA_QUARTERROUND(x[1], x[6], x[11], x[12])    \
+  CHACHA_QUARTERROUND(x[2], x[7], x[8], x[13])     \
+  CHACHA_QUARTERROUND(x[3], x[4], x[9], x[14])
+
+// Scalar: one block
+
+#define ADD(a, b) ((a) + (b))
+#define XOR(a, b) ((a) ^ (b))
+#define ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+void XorScalar(const uint32_t *state, int rounds, const uint64_t *counters,
+               uint8_t *const *dst) {
+  uint32_t in[16];
+  uint32_t x[16];
+  memcpy(in, state, sizeof(in));
+  in[12] = static_cast<uint32_t>(counters[0]);
+  in[13] = static_cast<uint32_t>(counters[0] >> 32);
+  memcpy(x, in, sizeof(x));
+
+  for (int r = rounds; r > 0; r -= 2) {
+    CHACHA_DOUBLEROUND(x)
+  }
+
+  for (int i = 0; i < 16; i++) {
+    uint32_t w;
+    memcpy(&w, dst[0] + 4 * i, 4);
+    w ^= x[i] + in[i];
+    memcpy(dst[0] + 4 * i, &w, 4);
+  }
+}
+
+#undef ADD
+#undef XOR
+#undef ROTL
+
+// The vector kernels keep word i of all blocks in x[i], one block per
+// 32-bit lane, and transpose the keystream back to blocks at the end.
+
+// SSE: 4 blocks
+
+#define ADD(a, b) _mm_add_epi32(a, b)
+#define XOR(a, b) _mm_xor_si128(a, b)
+#define ROTL(v, n) \
+  _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+inline void Transpose4x4(__m128i *a, __m128i *b, __m128i *c, __m128i *d) {
+  __m128i t0 = _mm_unpacklo_epi32(*a, *b);
+  __m128i t1 = _mm_unpackhi_epi32(*a, *b);
+  __m128i t2 = _mm_unpacklo_epi32(*c, *d);
+  __m128i t3 = _mm_unpackhi_epi32(*c, *d);
+  *a = _mm_unpacklo_epi64(t0, t2);
+  *b = _mm_unpackhi_epi64(t0, t2);
+  *c = _mm_unpacklo_epi64(t1, t3);
+  *d = _mm_unpackhi_epi64(t1, t3);
+}
+
+inline void Xor128(uint8_t *p, __m128i k) {
+  __m128i *q = reinterpret_cast<__m128i *>(p);
+  _mm_storeu_si128(q, _mm_xor_si128(_mm_loadu_si128(q), k));
+}
+
+void XorSse(const uint32_t *state, int rounds, const uint64_t *counters,
+            uint8_t *const *dst) {
+  __m128i in[16];
+  __m128i x[16];
+  for (int i = 0; i < 16; i++) {
+    in[i] = _mm_set1_epi32(state[i]);
+  }
+  in[12] = _mm_set_epi32(counters[3], counters[2], counters[1], counters[0]);
+  in[13] = _mm_set_epi32(counters[3] >> 32, counters[2] >> 32,
+                         counters[1] >> 32, counters[0] >> 32);
+  for (int i = 0; i < 16; i++) {
+    x[i] = in[i];
+  }
+
+  for (int r = rounds; r > 0; r -= 2) {
+    CHACHA_DOUBLEROUND(x)
+  }
+
+  for (int i = 0; i < 16; i++) {
+    x[i] = _mm_add_epi32(x[i], in[i]);
+  }
+  for (int i = 0; i < 16; i += 4) {
+    Transpose4x4(&x[i], &x[i + 1], &x[i + 2], &x[i + 3]);
+  }
+
+  // x[k + 4j] is the j-th 16 bytes of block k
+  for (int k = 0; k < 4; k++) {
+    for (int j = 0; j < 4; j++) {
+      Xor128(dst[k] + 16 * j, x[k + 4 * j]);
+    }
+  }
+}
+
+#undef ADD
+#undef XOR
+#undef ROTL
+
+// AVX2: 8 blocks
+
+#define ADD(a, b) _mm256_add_epi32(a, b)
+#define XOR(a, b) _mm256_xor_si256(a, b)
+#define ROTL(v, n) Rotl256<n>(v)
+
+template <int n>
+__attribute__((target("avx2"))) inline __m256i Rotl256(__m256i v) {
+  // Rotations by whole bytes are a single shuffle
+  if (n == 16) {
+    return _mm256_shuffle_epi8(
+        v, _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3,
+                           2, 13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0,
+                           3, 2));
+  } else if (n == 8) {
+    return _mm256_shuffle_epi8(
+        v, _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0,
+                           3, 14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1,
+                           0, 3));
+  }
+  return _mm256_or_si256(_mm256_slli_epi32(v, n),
+                         _mm256_srli_epi32(v, 32 - n));
+}
+
+__attribute__((target("avx2"))) inline void Transpose4x4(__m256i *a,
+                                                         __m256i *b,
+                                                         __m256i *c,
+                                                         __m256i *d) {
+  __m256i t0 = _mm256_unpacklo_epi32(*a, *b);
+  __m256i t1 = _mm256_unpackhi_epi32(*a, *b);
+  __m256i t2 = _mm256_unpacklo_epi32(*c, *d);
+  __m256i t3 = _mm256_unpackhi_epi32(*c, *d);
+  *a = _mm256_unpacklo_epi64(t0, t2);
+  *b = _mm256_unpackhi_epi64(t0, t2);
+  *c = _mm256_unpacklo_epi64(t1, t3);
+  *d = _mm256_unpackhi_epi64(t1, t3);
+}
+
+__attribute__((target("avx2"))) inline void Xor256(uint8_t *p, __m256i k) {
+  __m256i *q = reinterpret_cast<__m256i *>(p);
+  _mm256_storeu_si256(q, _mm256_xor_si256(_mm256_loadu_si256(q), k));
+}
+
+__attribute__((target("avx2"))) void XorAvx2(const uint32_t *state,
+                                             int rounds,
+                                             const uint64_t *counters,
+                                             uint8_t *const *dst) {
+  alignas(32) uint32_t lo[8];
+  alignas(32) uint32_t hi[8];
+  for (int k = 0; k < 8; k++) {
+    lo[k] = counters[k];
+    hi[k] = counters[k] >> 32;
+  }
+
+  __m256i in[16];
+  __m256i x[16];
+  for (int i = 0; i < 16; i++) {
+    in[i] = _mm256_set1_epi32(state[i]);
+  }
+  in[12] = _mm256_load_si256(reinterpret_cast<const __m256i *>(lo));
+  in[13] = _mm256_load_si256(reinterpret_cast<const __m256i *>(hi));
+  for (int i = 0; i < 16; i++) {
+    x[i] = in[i];
+  }
+
+  for (int r = rounds; r > 0; r -= 2) {
+    CHACHA_DOUBLEROUND(x)
+  }
+
+  for (int i = 0; i < 16; i++) {
+    x[i] = _mm256_add_epi32(x[i], in[i]);
+  }
+  for (int i = 0; i < 16; i += 4) {
+    Transpose4x4(&x[i], &x[i + 1], &x[i + 2], &x[i + 3]);
+  }
+
+  // The low 128 bits of x[k + 4j] are the j-th 16 bytes of block k, the
+  // high 128 bits those of block k + 4
+  for (int k = 0; k < 4; k++) {
+    Xor256(dst[k], _mm256_permute2x128_si256(x[k], x[k + 4], 0x20));
+    Xor256(dst[k] + 32,
+           _mm256_permute2x128_si256(x[k + 8], x[k + 12], 0x20));
+    Xor256(dst[k + 4], _mm256_permute2x128_si256(x[k], x[k + 4], 0x31));
+    Xor256(dst[k + 4] + 32,
+           _mm256_permute2x128_si256(x[k + 8], x[k + 12], 0x31));
+  }
+}
+
+#undef ADD
+#undef XOR
+#undef ROTL
+
+// AVX-512: 16 blocks
+
+// GCC 12's AVX-512 intrinsics start from a self-initialized "undefined"
+// vector, which -Wuninitialized flags
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+#define ADD(a, b) _mm512_add_epi32(a, b)
+#define XOR(a, b) _mm512_xor_si512(a, b)
+#define ROTL(v, n) _mm512_rol_epi32(v, n)
+
+__attribute__((target("avx512f"))) inline void Transpose4x4(__m512i *a,
+                                                            __m512i *b,
+                                                            __m512i *c,
+                                                            __m512i *d) {
+  __m512i t0 = _mm512_unpacklo_epi32(*a, *b);
+  __m512i t1 = _mm512_unpackhi_epi32(*a, *b);
+  __m512i t2 = _mm512_unpacklo_epi32(*c, *d);
+  __m512i t3 = _mm512_unpackhi_epi32(*c, *d);
+  *a = _mm512_unpacklo_epi64(t0, t2);
+  *b = _mm512_unpackhi_epi64(t0, t2);
+  *c = _mm512_unpacklo_epi64(t1, t3);
+  *d = _mm512_unpackhi_epi64(t1, t3);
+}
+
+__attribute__((target("avx512f"))) inline void Xor512(uint8_t *p, __m512i k) {
+  _mm512_storeu_si512(p, _mm512_xor_si512(_mm512_loadu_si512(p), k));
+}
+
+__attribute__((target("avx512f"))) void XorAvx512(const uint32_t *state,
+                                                  int rounds,
+                                                  const uint64_t *counters,
+                                                  uint8_t *const *dst) {
+  alignas(64) uint32_t lo[16];
+  alignas(64) uint32_t hi[16];
+  for (int k = 0; k < 16; k++) {
+    lo[k] = counters[k];
+    hi[k] = counters[k] >> 32;
+  }
+
+  __m512i in[16];
+  __m512i x[16];
+  for (int i = 0; i < 16; i++) {
+    in[i] = _mm512_set1_epi32(state[i]);
+  }
+  in[12] = _mm512_load_si512(lo);
+  in[13] = _mm512_load_si512(hi);
+  for (int i = 0; i < 16; i++) {
+    x[i] = in[i];
+  }
+
+  for (int r = rounds; r > 0; r -= 2) {
+    CHACHA_DOUBLEROUND(x)
+  }
+
+  for (int i = 0; i < 16; i++) {
+    x[i] = _mm512_add_epi32(x[i], in[i]);
+  }
+  for (int i = 0; i < 16; i += 4) {
+    Transpose4x4(&x[i], &x[i + 1], &x[i + 2], &x[i + 3]);
+  }
+
+  // The l-th 128 bits of x[k + 4j] are the j-th 16 bytes of block k + 4l
+  for (int k = 0; k < 4; k++) {
+    __m512i a = _mm512_shuffle_i32x4(x[k], x[k + 4], 0x44);
+    __m512i b = _mm512_shuffle_i32x4(x[k + 8], x[k + 12], 0x44);
+    __m512i c = _mm512_shuffle_i32x4(x[k], x[k + 4], 0xee);
+    __m512i d = _mm512_shuffle_i32x4(x[k + 8], x[k + 12], 0xee);
+    Xor512(dst[k], _mm512_shuffle_i32x4(a, b, 0x88));
+    Xor512(dst[k + 4], _mm512_shuffle_i32x4(a, b, 0xdd));
+    Xor512(dst[k + 8], _mm512_shuffle_i32x4(c, d, 0x88));
+    Xor512(dst[k + 12], _mm512_shuffle_i32x4(c, d, 0xdd));
+  }
+}
+
+#pragma GCC diagnostic pop
+
+#undef ADD
+#undef XOR
+#undef ROTL
+#undef CHACHA_DOUBLEROUND
+#undef CHACHA_QUARTERROUND
+
+KernelFn GetKernelFn(ChaChaKernel kernel) {
+  switch (kernel) {
+    case ChaChaKernel::kAvx512:
+      return XorAvx512;
+    case ChaChaKernel::kAvx2:
+      return XorAvx2;
+    case ChaChaKernel::kSse:
+      return XorSse;
+    default:
+      return XorScalar;
+  }
+}
+
+const uint8_t kSigma[17] = "expand 32-byte k";
+const uint8_t kTau[17] = "expand 16-byte k";
+
+}  // namespace
+
+ChaCha::ChaCha() : rounds_(20), kernel_(BestKernel()) {
+  const uint8_t zeros[32] = {};
+  SetKey(zeros, sizeof(zeros), zeros, 20);
+}
+
+bool ChaCha::SetKey(const uint8_t *key, size_t key_len, const uint8_t *iv,
+                    int rounds) {
+  if ((key_len != 16 && key_len != 32) || rounds <= 0 || rounds % 2) {
+    return false;
+  }
+
+  // A 128-bit key fills both halves
+  memcpy(state_, key_len == 32 ? kSigma : kTau, 16);
+  memcpy(state_ + 4, key, 16);
+  memcpy(state_ + 8, key + key_len - 16, 16);
+  state_[12] = 0;
+  state_[13] = 0;
+  memcpy(state_ + 14, iv, 8);
+  rounds_ = rounds;
+  return true;
+}
+
+ChaChaKernel ChaCha::BestKernel() {
+  if (KernelSupported(ChaChaKernel::kAvx512)) {
+    return ChaChaKernel::kAvx512;
+  } else if (KernelSupported(ChaChaKernel::kAvx2)) {
+    return ChaChaKernel::kAvx2;
+  }
+  return ChaChaKernel::kSse;
+}
+
+bool ChaCha::KernelSupported(ChaChaKernel kernel) {
+  switch (kernel) {
+    case ChaChaKernel::kAvx512:
+      // Blocks that do not fill 16 lanes go to the AVX2 kernel
+      return __builtin_cpu_supports("avx512f") &&
+             __builtin_cpu_supports("avx2");
+    case ChaChaKernel::kAvx2:
+      return __builtin_cpu_supports("avx2");
+    default:
+      return true;
+  }
+}
+
+const char *ChaCha::KernelName(ChaChaKernel kernel) {
+  switch (kernel) {
+    case ChaChaKernel::kAvx512:
+      return "avx512";
+    case ChaChaKernel::kAvx2:
+      return "avx2";
+    case ChaChaKernel::kSse:
+      return "sse";
+    default:
+      return "scalar";
+  }
+}
+
+size_t ChaCha::KernelLanes(ChaChaKernel kernel) {
+  switch (kernel) {
+    case ChaChaKernel::kAvx512:
+      return 16;
+    case ChaChaKernel::kAvx2:
+      return 8;
+    case ChaChaKernel::kSse:
+      return 4;
+    default:
+      return 1;
+  }
+}
+
+bool ChaCha::set_kernel(ChaChaKernel kernel) {
+  if (!KernelSupported(kernel)) {
+    return false;
+  }
+  kernel_ = kernel;
+  return true;
+}
+
+void ChaCha::Run(uint8_t *const *dst, const uint64_t *counters,
+                 size_t n) const {
+  size_t i = 0;
+  ChaChaKernel kernel = kernel_;
+  for (;;) {
+    const size_t lanes = KernelLanes(kernel);
+    const KernelFn fn = GetKernelFn(kernel);
+    for (; i + lanes <= n; i += lanes) {
+      fn(state_, rounds_, counters + i, dst + i);
+    }
+    if (i == n) {
+      return;
+    }
+    // The enum goes from the widest kernel to the narrowest
+    kernel = static_cast<ChaChaKernel>(static_cast<int>(kernel) + 1);
+  }
+}
+
+void ChaCha::XorBatch(const ChaChaJob *jobs, size_t num_jobs) const {
+  uint8_t *dst[kMaxLanes];
+  uint64_t counters[kMaxLanes];
+  const size_t lanes = KernelLanes(kernel_);
+  size_t n = 0;
+
+  for (size_t j = 0; j < num_jobs; j++) {
+    for (uint32_t b = 0; b < jobs[j].blocks; b++) {
+      dst[n] = jobs[j].data + b * kBlockSize;
+      counters[n] = jobs[j].counter + b;
+      if (++n == lanes) {
+        Run(dst, counters, n);
+        n = 0;
+      }
+    }
+  }
+  Run(dst, counters, n);
+}
+
+}  // namespace utils
+}  // namespace bess
@@ -0,0 +1,93 @@
+#ifndef BESS_UTILS_CHACHA_H_
+#define BESS_UTILS_CHACHA_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bess {
+namespace utils {
+
+// Kernels that compute ChaCha keystream blocks, from the widest
+enum class ChaChaKernel {
+  kAvx512,  // 16 blocks at a time
+  kAvx2,    // 8 blocks at a time
+  kSse,     // 4 blocks at a time
+  kScalar,  // 1 block at a time
+};
+
+// A contiguous run of 64-byte blocks to encrypt (or decrypt) in place,
+// the first one with keystream block |counter|
+struct ChaChaJob {
+  uint8_t *data;
+  uint32_t blocks;
+  uint64_t counter;
+};
+
+// The ChaCha stream cipher (D. J. Bernstein's original variant: 64-bit
+// block counter and 64-bit IV) with 8, 12, or 20 rounds.
+//
+// Keystream blocks are computed several at a time, one block per SIMD lane,
+// with the widest kernel the CPU supports (checked at runtime, so a binary
+// built for an older CPU still uses AVX-512 where available). XorBatch()
+// fills the lanes with blocks of many buffers at once, so that short
+// packets keep the wide kernels busy too.
+//
+// A keyed cipher is read-only, so it can be shared by threads.
+//
+// Example usage:
+//
+//  ChaCha c;
+//  c.SetKey(key, 32, iv, 20);
+//  c.Xor(payload, payload_len / ChaCha::kBlockSize, 0);
+class ChaCha {
+ public:
+  static constexpr size_t kBlockSize = 64;
+  // Blocks of the widest kernel
+  static constexpr size_t kMaxLanes = 16;
+
+  ChaCha();
+
+  // |key_len| is 16 or 32 bytes; |iv| is 8 bytes. Returns false (and keeps
+  // the old key) for other key lengths or an odd number of rounds.
+  bool SetKey(const uint8_t *key, size_t key_len, const uint8_t *iv,
+              int rounds);
+
+  // XORs |blocks| 64-byte blocks at |data| with the keystream from block
+  // |counter| on
+  void Xor(uint8_t *data, size_t blocks, uint64_t counter) const {
+    ChaChaJob job = {data, static_cast<uint32_t>(blocks), counter};
+    XorBatch(&job, 1);
+  }
+
+  void XorBatch(const ChaChaJob *jobs, size_t num_jobs) const;
+
+  // The widest kernel this CPU supports
+  static ChaChaKernel BestKernel();
+  static bool KernelSupported(ChaChaKernel kernel);
+  static const char *KernelName(ChaChaKernel kernel);
+  static size_t KernelLanes(ChaChaKernel kernel);
+
+  ChaChaKernel kernel() const { return kernel_; }
+
+  // Returns false if the CPU does not support |kernel|. Narrower kernels
+  // still process the blocks that do not fill all lanes.
+  bool set_kernel(ChaChaKernel kernel);
+
+  int rounds() const { return rounds_; }
+
+  // The input block with counter 0
+  const uint32_t *state() const { return state_; }
+
+ private:
+  // Runs the kernel, and narrower ones for the rest, on |n| blocks
+  void Run(uint8_t *const *dst, const uint64_t *counters, size_t n) const;
+
+  alignas(64) uint32_t state_[16];
+  int rounds_;
+  ChaChaKernel kernel_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_CHACHA_H_
@@ -0,0 +1,96 @@
+// Benchmarks for ChaCha: each kernel on a batch of 32 packets of the given
+// payload size, in cycles per byte, and the old one-block-at-a-time loop
+// (the scalar kernel, one packet at a time) as the baseline.
+
+#include "chacha.h"
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "time.h"
+
+using bess::utils::ChaCha;
+using bess::utils::ChaChaJob;
+using bess::utils::ChaChaKernel;
+
+namespace {
+
+const int kBatchSize = 32;
+
+class ChaChaFixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &state) override {
+    size_t blocks = state.range(0) / ChaCha::kBlockSize;
+    bufs_.assign(kBatchSize, std::vector<uint8_t>(blocks * ChaCha::kBlockSize));
+    jobs_.clear();
+    for (std::vector<uint8_t> &b : bufs_) {
+      jobs_.push_back({b.data(), static_cast<uint32_t>(blocks), 0});
+    }
+  }
+
+ protected:
+  void Run(benchmark::State &state, ChaChaKernel kernel, bool batch) {
+    ChaCha c;
+    if (!c.set_kernel(kernel)) {
+      state.SkipWithError("not supported by this CPU");
+      return;
+    }
+    state.SetLabel(ChaCha::KernelName(kernel));
+
+    uint64_t cycles = 0;
+    while (state.KeepRunning()) {
+      uint64_t start = rdtsc();
+      if (batch) {
+        c.XorBatch(jobs_.data(), jobs_.size());
+      } else {
+        for (const ChaChaJob &job : jobs_) {
+          c.XorBatch(&job, 1);
+        }
+      }
+      cycles += rdtsc() - start;
+      benchmark::ClobberMemory();
+    }
+
+    size_t bytes = state.iterations() * kBatchSize * bufs_[0].size();
+    state.SetBytesProcessed(bytes);
+    state.counters["cycles/byte"] = static_cast<double>(cycles) / bytes;
+  }
+
+  std::vector<std::vector<uint8_t>> bufs_;
+  std::vector<ChaChaJob> jobs_;
+};
+
+}  // namespace
+
+BENCHMARK_DEFINE_F(ChaChaFixture, Scalar)(benchmark::State &state) {
+  Run(state, ChaChaKernel::kScalar, false);
+}
+
+BENCHMARK_DEFINE_F(ChaChaFixture, Sse)(benchmark::State &state) {
+  Run(state, ChaChaKernel::kSse, true);
+}
+
+BENCHMARK_DEFINE_F(ChaChaFixture, Avx2)(benchmark::State &state) {
+  Run(state, ChaChaKernel::kAvx2, true);
+}
+
+BENCHMARK_DEFINE_F(ChaChaFixture, Avx512)(benchmark::State &state) {
+  Run(state, ChaChaKernel::kAvx512, true);
+}
+
+// Per packet rather than per batch: lanes idle at the end of each packet
+BENCHMARK_DEFINE_F(ChaChaFixture, Avx512PerPacket)(benchmark::State &state) {
+  Run(state, ChaChaKernel::kAvx512, false);
+}
+
+BENCHMARK_REGISTER_F(ChaChaFixture, Scalar)->Arg(64)->Arg(256)->Arg(1472);
+BENCHMARK_REGISTER_F(ChaChaFixture, Sse)->Arg(64)->Arg(256)->Arg(1472);
+BENCHMARK_REGISTER_F(ChaChaFixture, Avx2)->Arg(64)->Arg(256)->Arg(1472);
+BENCHMARK_REGISTER_F(ChaChaFixture, Avx512)->Arg(64)->Arg(256)->Arg(1472);
+BENCHMARK_REGISTER_F(ChaChaFixture, Avx512PerPacket)
+    ->Arg(64)
+    ->Arg(256)
+    ->Arg(1472);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,149 @@
+#include "chacha.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using bess::utils::ChaCha;
+using bess::utils::ChaChaJob;
+using bess::utils::ChaChaKernel;
+
+namespace {
+
+const ChaChaKernel kKernels[] = {ChaChaKernel::kAvx512, ChaChaKernel::kAvx2,
+                                 ChaChaKernel::kSse, ChaChaKernel::kScalar};
+
+std::string Hex(const uint8_t *p, size_t len) {
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  for (size_t i = 0; i < len; i++) {
+    s.push_back(digits[p[i] >> 4]);
+    s.push_back(digits[p[i] & 0xf]);
+  }
+  return s;
+}
+
+// The keystream is what encrypting zeros gives
+std::string Keystream(const ChaCha &c, uint64_t counter) {
+  uint8_t block[ChaCha::kBlockSize] = {};
+  c.Xor(block, 1, counter);
+  return Hex(block, sizeof(block));
+}
+
+TEST(ChaChaTest, TestVectors) {
+  const uint8_t zeros[32] = {};
+  uint8_t key[32];
+  for (int i = 0; i < 32; i++) {
+    key[i] = i;
+  }
+  const uint8_t iv[8] = {0, 0, 0, 0x4a, 0, 0, 0, 0};
+
+  for (ChaChaKernel kernel : kKernels) {
+    ChaCha c;
+    if (!c.set_kernel(kernel)) {
+      continue;
+    }
+    SCOPED_TRACE(ChaCha::KernelName(kernel));
+
+    // Keyed with zeros by default
+    EXPECT_EQ(
+        "76b8e0ada0f13d90405d6ae55386bd28bdd219b8a08ded1aa836efcc8b770dc7"
+        "da41597c5157488d7724e03fb8d84a376a43b8f41518a11cc387b669b2ee6586",
+        Keystream(c, 0));
+
+    ASSERT_TRUE(c.SetKey(zeros, 32, zeros, 8));
+    EXPECT_EQ(
+        "3e00ef2f895f40d67f5bb8e81f09a5a12c840ec3ce9a7f3b181be188ef711a1e"
+        "984ce172b9216f419f445367456d5619314a42a3da86b001387bfdb80e0cfe42",
+        Keystream(c, 0));
+
+    ASSERT_TRUE(c.SetKey(zeros, 16, zeros, 20));
+    EXPECT_EQ(
+        "89670952608364fd00b2f90936f031c8e756e15dba04b8493d00429259b20f46"
+        "cc04f111246b6c2ce066be3bfb32d9aa0fddfbc12123d4b9e44f34dca05a103f",
+        Keystream(c, 0));
+
+    ASSERT_TRUE(c.SetKey(key, 32, iv, 20));
+    EXPECT_EQ(
+        "224f51f3401bd9e12fde276fb8631ded8c131f823d2c06e27e4fcaec9ef3cf78"
+        "8a3b0aa372600a92b57974cded2b9334794cba40c63e34cdea212c4cf07d41b7",
+        Keystream(c, 1));
+  }
+}
+
+TEST(ChaChaTest, BadKey) {
+  const uint8_t zeros[32] = {};
+  ChaCha c;
+  EXPECT_FALSE(c.SetKey(zeros, 24, zeros, 20));
+  EXPECT_FALSE(c.SetKey(zeros, 32, zeros, 7));
+  EXPECT_FALSE(c.SetKey(zeros, 32, zeros, 0));
+  EXPECT_EQ(20, c.rounds());
+}
+
+// All kernels agree with the scalar one on batches of odd-sized jobs,
+// including counters that carry into the high word
+TEST(ChaChaTest, Batch) {
+  std::mt19937 rng(5);
+  uint8_t key[32];
+  uint8_t iv[8];
+  for (uint8_t &b : key) {
+    b = rng();
+  }
+  for (uint8_t &b : iv) {
+    b = rng();
+  }
+
+  std::vector<std::vector<uint8_t>> bufs;
+  std::vector<uint64_t> counters;
+  for (int i = 0; i < 40; i++) {
+    bufs.emplace_back(ChaCha::kBlockSize * (rng() % 24));
+    for (uint8_t &b : bufs.back()) {
+      b = rng();
+    }
+    counters.push_back(i % 3 ? rng() % 100 : 0xfffffffaull + rng() % 4);
+  }
+
+  ChaCha ref;
+  ASSERT_TRUE(ref.set_kernel(ChaChaKernel::kScalar));
+  ASSERT_TRUE(ref.SetKey(key, 32, iv, 12));
+  std::vector<std::vector<uint8_t>> expected = bufs;
+  for (size_t i = 0; i < expected.size(); i++) {
+    ref.Xor(expected[i].data(), expected[i].size() / ChaCha::kBlockSize,
+            counters[i]);
+  }
+
+  for (ChaChaKernel kernel : kKernels) {
+    ChaCha c;
+    if (!c.set_kernel(kernel)) {
+      continue;
+    }
+    SCOPED_TRACE(ChaCha::KernelName(kernel));
+    ASSERT_TRUE(c.SetKey(key, 32, iv, 12));
+
+    std::vector<std::vector<uint8_t>> out = bufs;
+    std::vector<ChaChaJob> jobs;
+    for (size_t i = 0; i < out.size(); i++) {
+      jobs.push_back({out[i].data(),
+                      static_cast<uint32_t>(out[i].size() / ChaCha::kBlockSize),
+                      counters[i]});
+    }
+    c.XorBatch(jobs.data(), jobs.size());
+    EXPECT_EQ(expected, out);
+
+    // Decrypts back
+    c.XorBatch(jobs.data(), jobs.size());
+    EXPECT_EQ(bufs, out);
+  }
+}
+
+TEST(ChaChaTest, Kernels) {
+  EXPECT_TRUE(ChaCha::KernelSupported(ChaChaKernel::kScalar));
+  EXPECT_TRUE(ChaCha::KernelSupported(ChaCha::BestKernel()));
+  EXPECT_EQ(ChaCha::BestKernel(), ChaCha().kernel());
+  EXPECT_EQ(16, ChaCha::KernelLanes(ChaChaKernel::kAvx512));
+  EXPECT_EQ(1, ChaCha::KernelLanes(ChaChaKernel::kScalar));
+}
+
+}  // namespace
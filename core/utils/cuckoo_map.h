@@ -176,8 +176,14 @@ class CuckooMap {
 
   template <typename... Args>
   Entry* DoEmplace(const K& key, const H& hasher, const E& eq, Args&&... args) {
+    return DoEmplaceWithHash(Hash(key, hasher), key, hasher, eq,
+                             std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  Entry* DoEmplaceWithHash(HashResult primary, const K& key, const H& hasher,
+                           const E& eq, Args&&... args) {
     Entry* entry;
-    HashResult primary = Hash(key, hasher);
 
     EntryIndex idx = FindWithHash(primary, key, eq);
     if (idx != kInvalidEntryIdx) {
@@ -252,6 +258,95 @@ class CuckooMap {
     return ret;
   }
 
+  // Find many keys at once. This is equivalent to calling Find() for each of
+  // |keys[0..n-1]|, but all hashes are computed and the buckets and entries
+  // are prefetched before any key is resolved, so that the cache misses of
+  // different keys overlap instead of forming a chain.
+  // |entries[i]| is set to the entry of |keys[i]|, or nullptr if not exist.
+  // Returns the number of keys found.
+  size_t FindBatch(const K* keys, size_t n, Entry** entries,
+                   const H& hasher = H(), const E& eq = E()) {
+    HashResult hashes[kBatchSize];
+    size_t found = 0;
+
+    for (size_t base = 0; base < n; base += kBatchSize) {
+      size_t cnt = std::min(n - base, static_cast<size_t>(kBatchSize));
+      const K* batch_keys = keys + base;
+      Entry** batch_entries = entries + base;
+
+      // Stage 1: hash all keys and prefetch their primary buckets
+      for (size_t i = 0; i < cnt; i++) {
+        hashes[i] = Hash(batch_keys[i], hasher);
+        __builtin_prefetch(&buckets_[hashes[i] & bucket_mask_]);
+      }
+
+      // Stage 2: prefetch the candidate entries in the primary buckets
+      for (size_t i = 0; i < cnt; i++) {
+        const Bucket& bucket = buckets_[hashes[i] & bucket_mask_];
+        for (int j = 0; j < kEntriesPerBucket; j++) {
+          if (bucket.hash_values[j] == hashes[i]) {
+            __builtin_prefetch(&entries_[bucket.entry_indices[j]]);
+            break;
+          }
+        }
+      }
+
+      // Stage 3: resolve
+      for (size_t i = 0; i < cnt; i++) {
+        EntryIndex idx = FindWithHash(hashes[i], batch_keys[i], eq);
+        if (idx == kInvalidEntryIdx) {
+          batch_entries[i] = nullptr;
+        } else {
+          batch_entries[i] = &entries_[idx];
+          found++;
+        }
+      }
+    }
+    return found;
+  }
+
+  // Insert/update many key value pairs at once. This is equivalent to calling
+  // Insert(keys[i], values[i]) for i in [0, n) in order, but with all hashes
+  // computed and the primary buckets prefetched up front.
+  // |entries[i]| is set to the inserted entry, or nullptr on failure. All
+  // of |entries| stay valid even if the table expands in the middle.
+  // Returns the number of successful insertions.
+  size_t InsertBatch(const K* keys, const V* values, size_t n, Entry** entries,
+                     const H& hasher = H(), const E& eq = E()) {
+    HashResult hashes[kBatchSize];
+    size_t inserted = 0;
+    const Entry* old_entries = entries_.data();
+    HashResult old_mask = bucket_mask_;
+
+    for (size_t base = 0; base < n; base += kBatchSize) {
+      size_t cnt = std::min(n - base, static_cast<size_t>(kBatchSize));
+
+      for (size_t i = 0; i < cnt; i++) {
+        hashes[i] = Hash(keys[base + i], hasher);
+        __builtin_prefetch(&buckets_[hashes[i] & bucket_mask_]);
+      }
+
+      for (size_t i = 0; i < cnt; i++) {
+        Entry* entry = DoEmplaceWithHash(hashes[i], keys[base + i], hasher, eq,
+                                         values[base + i]);
+        entries[base + i] = entry;
+        inserted += (entry != nullptr);
+      }
+    }
+
+    // ExpandEntries() reallocates |entries_| and ExpandBuckets() rebuilds it,
+    // so the entries inserted before an expansion have moved. Rare enough to
+    // simply look them up again
+    if (entries_.data() != old_entries || bucket_mask_ != old_mask) {
+      for (size_t i = 0; i < n; i++) {
+        if (entries[i] != nullptr) {
+          entries[i] = Find(keys[i], hasher, eq);
+        }
+      }
+    }
+    return inserted;
+  }
+
   // Remove the stored entry by the key
   // Return false if not exist.
   bool Remove(const K& key, const H& hasher = H(), const E& eq = E()) {
@@ -300,6 +395,10 @@ class CuckooMap {
   // of insertion will grow exponentially, so be careful.
   static const int kMaxCuckooPath = 3;
 
+  // The number of keys hashed and prefetched together by FindBatch() and
+  // InsertBatch(). Larger batches are processed in chunks of this size.
+  static const int kBatchSize = 32;
+
   /* non-tunable macros */
   static const EntryIndex kInvalidEntryIdx =
       std::numeric_limits<EntryIndex>::max();
@@ -114,6 +114,39 @@ BENCHMARK_REGISTER_F(CuckooMapFixture, CuckooMapInlinedGet)
     ->RangeMultiplier(4)
     ->Range(4, 4 << 20);
 
+// Benchmarks the FindBatch() method in CuckooMap with 32 keys per call.
+BENCHMARK_DEFINE_F(CuckooMapFixture, CuckooMapFindBatch)
+(benchmark::State &state) {
+  const size_t kBatch = 32;
+  uint32_t keys[kBatch];
+  std::pair<uint32_t, value_t> *entries[kBatch];
+
+  while (true) {
+    const size_t n = state.range(0);
+    rng.SetSeed(0);
+
+    for (size_t i = 0; i < n; i += kBatch) {
+      size_t cnt = std::min(kBatch, n - i);
+      for (size_t j = 0; j < cnt; j++) {
+        keys[j] = rng.Get();
+      }
+
+      size_t found = cuckoo_->FindBatch(keys, cnt, entries);
+      benchmark::DoNotOptimize(found);
+      DCHECK_EQ(found, cnt);
+
+      if (!state.KeepRunningBatch(cnt)) {
+        state.SetItemsProcessed(state.iterations());
+        return;
+      }
+    }
+  }
+}
+
+BENCHMARK_REGISTER_F(CuckooMapFixture, CuckooMapFindBatch)
+    ->RangeMultiplier(4)
+    ->Range(4, 4 << 20);
+
 // Benchmarks the find method on the STL unordered_map.
 BENCHMARK_DEFINE_F(CuckooMapFixture, STLUnorderedMapGet)
 (benchmark::State &state) {
@@ -169,6 +169,69 @@ TEST(CuckooMapTest, Find) {
   EXPECT_EQ(cuckoo.Find(4), nullptr);
 }
 
+// Test FindBatch function
+TEST(CuckooMapTest, FindBatch) {
+  CuckooMap<uint32_t, uint16_t> cuckoo;
+  const size_t n = 100;  // spans several internal chunks
+  std::vector<uint32_t> keys;
+
+  for (uint32_t i = 0; i < n; i++) {
+    keys.push_back(i);
+    if (i % 3 != 0) {
+      cuckoo.Insert(i, i + 1);
+    }
+  }
+
+  std::vector<CuckooMap<uint32_t, uint16_t>::Entry *> entries(n);
+  EXPECT_EQ(n - 34, cuckoo.FindBatch(keys.data(), n, entries.data()));
+  for (uint32_t i = 0; i < n; i++) {
+    if (i % 3 == 0) {
+      EXPECT_EQ(nullptr, entries[i]);
+    } else {
+      ASSERT_NE(nullptr, entries[i]);
+      EXPECT_EQ(i, entries[i]->first);
+      EXPECT_EQ(i + 1, entries[i]->second);
+    }
+  }
+}
+
+// Test InsertBatch function
+TEST(CuckooMapTest, InsertBatch) {
+  CuckooMap<uint32_t, uint16_t> cuckoo;
+  const size_t n = 1000;  // forces the table to expand in the middle
+  std::vector<uint32_t> keys;
+  std::vector<uint16_t> values;
+
+  for (uint32_t i = 0; i < n; i++) {
+    keys.push_back(i);
+    values.push_back(i + 7);
+  }
+  // Duplicate keys in one batch: the last value wins, as with Insert()
+  keys.push_back(5);
+  values.push_back(1);
+
+  std::vector<CuckooMap<uint32_t, uint16_t>::Entry *> entries(n + 1);
+  EXPECT_EQ(n + 1, cuckoo.InsertBatch(keys.data(), values.data(), n + 1,
+                                      entries.data()));
+  EXPECT_EQ(n, cuckoo.Count());
+  EXPECT_EQ(1, cuckoo.Find(5)->second);
+  EXPECT_EQ(1, entries[n]->second);
+
+  for (uint32_t i = 0; i < n; i++) {
+    if (i != 5) {
+      EXPECT_EQ(i + 7, cuckoo.Find(i)->second);
+    }
+  }
+
+  // Entries inserted before the table expanded must not dangle
+  for (size_t i = 0; i < n + 1; i++) {
+    ASSERT_NE(nullptr, entries[i]);
+    EXPECT_EQ(cuckoo.Find(keys[i]), entries[i]);
+    EXPECT_EQ(keys[i], entries[i]->first);
+    EXPECT_EQ(keys[i] == 5 ? 1 : keys[i] + 7, entries[i]->second);
+  }
+}
+
 // Test Remove function
 TEST(CuckooMapTest, Remove) {
   CuckooMap<uint32_t, uint16_t> cuckoo;
@@ -187,7 +187,7 @@ class FlowRoutingRule {
 // Used by snort_ids, url_filter
 class FlowRecord {
  public:
-  FlowRecord() : encode_(0), pkt_cnt_(0), done_analyzing_(false), acl_pass_(false), buffer_(128), expiry_time_(0) {}
+  FlowRecord() : encode_(0), pkt_cnt_(0), done_analyzing_(false), acl_pass_(false), buffer_(ReassemblyArena::kMinBlockSize), expiry_time_(0), match_state_(0), scanned_len_(0) {}
 
   bool IsAnalyzed() { return done_analyzing_; }
   void SetAnalyzed() { done_analyzing_ = true; }
@@ -198,6 +198,14 @@ class FlowRecord {
   TcpFlowReconstruct &GetBuffer() { return buffer_; }
   uint64_t ExpiryTime() { return expiry_time_; }
   void SetExpiryTime(uint64_t time) { expiry_time_ = time; }
+  // Incremental payload matching: a MultiPatternMatcher state after the
+  // first |ScannedLen()| reassembled bytes
+  uint16_t MatchState() { return match_state_; }
+  size_t ScannedLen() { return scanned_len_; }
+  void SetMatchState(uint16_t state, size_t scanned_len) {
+    match_state_ = state;
+    scanned_len_ = scanned_len;
+  }
 
   uint8_t encode_;
   uint64_t pkt_cnt_;
@@ -207,6 +215,8 @@ class FlowRecord {
   be32_t dst_ip_;
   TcpFlowReconstruct buffer_;
   uint64_t expiry_time_;
+  uint16_t match_state_;
+  size_t scanned_len_;
 };
 
 } // namespace utils
@@ -0,0 +1,369 @@
+#ifndef BESS_UTILS_FLOW_TABLE_H_
+#define BESS_UTILS_FLOW_TABLE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <utility>
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <glog/logging.h>
+
+namespace bess {
+namespace utils {
+
+// A flat, open-addressing hash table for per-packet flow lookups (e.g., at
+// ingress modules). Keys and values are stored inline in one slot array, so
+// a lookup never chases a node pointer.
+//
+// Slots are organized in groups of kGroupSize. Each group has one byte of
+// metadata per slot: a 7-bit tag taken from the key's hash, or an empty /
+// deleted marker. A lookup compares the tag against the whole group with a
+// single SSE2 instruction, and only touches the slots whose tag matches.
+// Groups are probed linearly until a group with an empty slot is found.
+//
+// Entries can age out: if the table has a timeout, Lookup() and
+// LookupBatch() treat entries that have not been looked up for longer as
+// missing (and erase them), and Expire() evicts them incrementally.
+//
+// Lookups are thread-safe only if there is no concurrent update. Emplace()
+// may resize the table, which invalidates all Entry pointers.
+//
+// Example usage:
+//
+//  FlowTable<Flow, int, FlowHash> table(65536, 10 * 1000000000ULL);
+//  auto ret = table.Emplace(flow, now_ns, worker_id);  // {entry, inserted}
+//  FlowTable<Flow, int, FlowHash>::Entry *e = table.Lookup(flow, now_ns);
+//  table.Expire(now_ns, 16);  // sweep (at most) 16 groups
+template <typename K, typename V, typename H = std::hash<K>,
+          typename E = std::equal_to<K>>
+class FlowTable {
+ public:
+  struct Entry {
+    K key;
+    V value;
+    uint64_t last_ns;  // the last time that |this| was looked up or inserted
+  };
+
+  static constexpr size_t kGroupSize = 16;
+  static constexpr size_t kDefaultCapacity = 1024;
+  // The max # of keys that LookupBatch() processes in a single pass
+  static constexpr size_t kBatchSize = 32;
+
+  // |capacity|: the initial # of slots (rounded up to a power of two).
+  // |timeout_ns|: entries idle for longer age out. 0 disables aging.
+  explicit FlowTable(size_t capacity = kDefaultCapacity,
+                     uint64_t timeout_ns = 0, const H &hasher = H(),
+                     const E &eq = E())
+      : hasher_(hasher),
+        eq_(eq),
+        ctrl_(nullptr),
+        slots_(nullptr),
+        group_mask_(0),
+        size_(0),
+        deleted_(0),
+        timeout_ns_(timeout_ns),
+        expire_cursor_(0) {
+    Allocate(capacity);
+  }
+
+  ~FlowTable() {
+    DestroyAll();
+    std::free(ctrl_);
+    std::free(slots_);
+  }
+
+  FlowTable(const FlowTable &) = delete;
+  FlowTable &operator=(const FlowTable &) = delete;
+
+  // Returns the entry of |key| without aging it, or nullptr if not exist.
+  Entry *Find(const K &key) {
+    size_t idx = FindIndex(Hash(key), key);
+    return idx == kNotFound ? nullptr : &slots_[idx];
+  }
+
+  // Returns the live entry of |key| and refreshes its timestamp, or nullptr.
+  // An entry that has aged out is erased.
+  Entry *Lookup(const K &key, uint64_t now_ns) {
+    return LookupWithHash(Hash(key), key, now_ns);
+  }
+
+  // Equivalent to calling Lookup() for each of |keys[0..n-1]|, but all hashes
+  // are computed and the groups prefetched before any key is resolved, so
+  // that the cache misses of different keys overlap.
+  // |entries[i]| is set to the entry of |keys[i]|, or nullptr if not exist.
+  // Returns the number of keys found.
+  size_t LookupBatch(const K *keys, size_t n, uint64_t now_ns,
+                     Entry **entries) {
+    uint64_t hashes[kBatchSize];
+    size_t found = 0;
+
+    for (size_t base = 0; base < n; base += kBatchSize) {
+      size_t cnt = std::min(n - base, kBatchSize);
+
+      // Stage 1: hash all keys and prefetch their first groups
+      for (size_t i = 0; i < cnt; i++) {
+        hashes[i] = Hash(keys[base + i]);
+        size_t g = hashes[i] & group_mask_;
+        __builtin_prefetch(&ctrl_[g * kGroupSize]);
+        __builtin_prefetch(&slots_[g * kGroupSize]);
+      }
+
+      // Stage 2: resolve
+      for (size_t i = 0; i < cnt; i++) {
+        Entry *e = LookupWithHash(hashes[i], keys[base + i], now_ns);
+        entries[base + i] = e;
+        found += (e != nullptr);
+      }
+    }
+    return found;
+  }
+
+  // Returns the live entry of |key|, or inserts one whose value is
+  // constructed from |args|. Returns {entry, true} if inserted.
+  template <typename... Args>
+  std::pair<Entry *, bool> Emplace(const K &key, uint64_t now_ns,
+                                   Args &&... args) {
+    uint64_t hash = Hash(key);
+    Entry *e = LookupWithHash(hash, key, now_ns);
+    if (e != nullptr) {
+      return {e, false};
+    }
+
+    if (size_ + deleted_ >= MaxLoad()) {
+      // Reclaim tombstones if the table is not that full; grow otherwise
+      Rehash(size_ * 2 < MaxLoad() ? Capacity() : Capacity() * 2);
+    }
+
+    size_t idx = FindFreeIndex(hash);
+    if (ctrl_[idx] == kDeleted) {
+      deleted_--;
+    }
+    ctrl_[idx] = Tag(hash);
+    e = new (&slots_[idx]) Entry{key, V(std::forward<Args>(args)...), now_ns};
+    size_++;
+    return {e, true};
+  }
+
+  // Returns true if |key| was removed.
+  bool Erase(const K &key) {
+    size_t idx = FindIndex(Hash(key), key);
+    if (idx == kNotFound) {
+      return false;
+    }
+    EraseIndex(idx);
+    return true;
+  }
+
+  // |e| must point to an entry of |this| table.
+  void Erase(Entry *e) { EraseIndex(e - slots_); }
+
+  // Evicts entries that have aged out, sweeping at most |max_groups| groups
+  // from where the last call stopped. Returns the # of evicted entries.
+  size_t Expire(uint64_t now_ns, size_t max_groups) {
+    if (timeout_ns_ == 0) {
+      return 0;
+    }
+    size_t evicted = 0;
+    size_t groups = std::min(max_groups, group_mask_ + 1);
+    for (size_t i = 0; i < groups; i++) {
+      size_t base = expire_cursor_ * kGroupSize;
+      for (size_t j = base; j < base + kGroupSize; j++) {
+        if (IsFull(ctrl_[j]) && IsExpired(slots_[j], now_ns)) {
+          EraseIndex(j);
+          evicted++;
+        }
+      }
+      expire_cursor_ = (expire_cursor_ + 1) & group_mask_;
+    }
+    return evicted;
+  }
+
+  // Calls |fn(Entry &)| for every entry (including aged ones).
+  template <typename Fn>
+  void ForEach(Fn fn) {
+    for (size_t i = 0; i < Capacity(); i++) {
+      if (IsFull(ctrl_[i])) {
+        fn(slots_[i]);
+      }
+    }
+  }
+
+  void Clear() {
+    DestroyAll();
+    memset(ctrl_, kEmpty, Capacity());
+    size_ = 0;
+    deleted_ = 0;
+  }
+
+  size_t Count() const { return size_; }
+  size_t Capacity() const { return (group_mask_ + 1) * kGroupSize; }
+  uint64_t timeout_ns() const { return timeout_ns_; }
+  void set_timeout_ns(uint64_t timeout_ns) { timeout_ns_ = timeout_ns; }
+
+ private:
+  static constexpr int8_t kEmpty = -128;   // 0x80
+  static constexpr int8_t kDeleted = -2;   // 0xfe
+  static constexpr size_t kNotFound = SIZE_MAX;
+
+  static bool IsFull(int8_t c) { return c >= 0; }
+
+  // Mixes the user hash so that both the group index (low bits) and the tag
+  // (high bits) are well distributed, even for identity hashes of integers.
+  uint64_t Hash(const K &key) const {
+    uint64_t h = hasher_(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static int8_t Tag(uint64_t hash) { return hash >> 57; }
+
+  size_t MaxLoad() const { return Capacity() / 8 * 7; }
+
+  bool IsExpired(const Entry &e, uint64_t now_ns) const {
+    return timeout_ns_ > 0 && now_ns > e.last_ns + timeout_ns_;
+  }
+
+  // Returns a bitmask of the slots in group |g| whose metadata is |c|
+  uint32_t Match(size_t g, int8_t c) const {
+    const int8_t *group = &ctrl_[g * kGroupSize];
+#if __SSE2__
+    __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(group));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroupSize; i++) {
+      mask |= uint32_t(group[i] == c) << i;
+    }
+    return mask;
+#endif
+  }
+
+  size_t FindIndex(uint64_t hash, const K &key) const {
+    int8_t tag = Tag(hash);
+    size_t g = hash & group_mask_;
+    for (size_t probes = 0; probes <= group_mask_; probes++) {
+      for (uint32_t m = Match(g, tag); m != 0; m &= m - 1) {
+        size_t idx = g * kGroupSize + __builtin_ctz(m);
+        if (eq_(slots_[idx].key, key)) {
+          return idx;
+        }
+      }
+      if (Match(g, kEmpty) != 0) {
+        break;
+      }
+      g = (g + 1) & group_mask_;
+    }
+    return kNotFound;
+  }
+
+  // Returns the first empty or deleted slot on the probe sequence of |hash|
+  size_t FindFreeIndex(uint64_t hash) const {
+    size_t g = hash & group_mask_;
+    while (true) {
+      uint32_t m = Match(g, kEmpty) | Match(g, kDeleted);
+      if (m != 0) {
+        return g * kGroupSize + __builtin_ctz(m);
+      }
+      g = (g + 1) & group_mask_;
+    }
+  }
+
+  Entry *LookupWithHash(uint64_t hash, const K &key, uint64_t now_ns) {
+    size_t idx = FindIndex(hash, key);
+    if (idx == kNotFound) {
+      return nullptr;
+    }
+    Entry *e = &slots_[idx];
+    if (IsExpired(*e, now_ns)) {
+      EraseIndex(idx);
+      return nullptr;
+    }
+    e->last_ns = now_ns;
+    return e;
+  }
+
+  void EraseIndex(size_t idx) {
+    slots_[idx].~Entry();
+    // A slot can be marked empty (instead of deleted) only if no probe
+    // sequence has ever moved past its group
+    size_t g = idx / kGroupSize;
+    ctrl_[idx] = Match(g, kEmpty) != 0 ? kEmpty : kDeleted;
+    deleted_ += (ctrl_[idx] == kDeleted);
+    size_--;
+  }
+
+  void Allocate(size_t capacity) {
+    size_t groups = 1;
+    while (groups * kGroupSize < capacity) {
+      groups <<= 1;
+    }
+    group_mask_ = groups - 1;
+    size_t slots = groups * kGroupSize;
+    // aligned_alloc() needs the size to be a multiple of the alignment
+    ctrl_ = static_cast<int8_t *>(
+        std::aligned_alloc(64, (slots + 63) / 64 * 64));
+    slots_ = static_cast<Entry *>(std::aligned_alloc(
+        64, (sizeof(Entry) * slots + 63) / 64 * 64));
+    CHECK(ctrl_ != nullptr && slots_ != nullptr)
+        << "failed to allocate a flow table with " << slots << " slots";
+    memset(ctrl_, kEmpty, slots);
+    size_ = 0;
+    deleted_ = 0;
+    expire_cursor_ = 0;
+  }
+
+  void Rehash(size_t capacity) {
+    int8_t *old_ctrl = ctrl_;
+    Entry *old_slots = slots_;
+    size_t old_capacity = Capacity();
+
+    Allocate(capacity);
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (IsFull(old_ctrl[i])) {
+        uint64_t hash = Hash(old_slots[i].key);
+        size_t idx = FindFreeIndex(hash);
+        ctrl_[idx] = Tag(hash);
+        new (&slots_[idx]) Entry(std::move(old_slots[i]));
+        old_slots[i].~Entry();
+        size_++;
+      }
+    }
+    std::free(old_ctrl);
+    std::free(old_slots);
+  }
+
+  void DestroyAll() {
+    for (size_t i = 0; i < Capacity(); i++) {
+      if (IsFull(ctrl_[i])) {
+        slots_[i].~Entry();
+      }
+    }
+  }
+
+  H hasher_;
+  E eq_;
+
+  int8_t *ctrl_;   // one metadata byte per slot
+  Entry *slots_;
+  size_t group_mask_;
+  size_t size_;
+  size_t deleted_;
+  uint64_t timeout_ns_;
+  size_t expire_cursor_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_FLOW_TABLE_H_
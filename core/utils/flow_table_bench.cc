@@ -0,0 +1,197 @@
+// Benchmarks for FlowTable against the node-based STL maps that ingress
+// modules used as their flow caches.
+
+#include "flow_table.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include "random.h"
+
+using bess::utils::FlowTable;
+
+namespace {
+
+typedef uint16_t value_t;
+
+// A 16-byte 5-tuple, laid out like bess::utils::Flow
+struct FlowKey {
+  uint32_t src_ip;
+  uint32_t dst_ip;
+  uint16_t src_port;
+  uint16_t dst_port;
+  uint32_t proto;
+
+  bool operator==(const FlowKey &other) const {
+    return memcmp(this, &other, sizeof(*this)) == 0;
+  }
+};
+static_assert(sizeof(FlowKey) == 16, "FlowKey must be 16 bytes.");
+
+struct FlowKeyHash {
+  size_t operator()(const FlowKey &f) const {
+    uint64_t a = (uint64_t(f.src_ip) << 32) | f.dst_ip;
+    uint64_t b = (uint64_t(f.src_port) << 48) | (uint64_t(f.dst_port) << 32) |
+                 f.proto;
+    return a * 0x9e3779b97f4a7c15ULL ^ b;
+  }
+};
+
+inline FlowKey derive_key(uint32_t r) {
+  return FlowKey{r, ~r, uint16_t(r >> 16), uint16_t(r), 6};
+}
+
+inline value_t derive_val(uint32_t r) {
+  return (value_t)(r + 3);
+}
+
+Random rng;
+
+// Performs FlowTable setup / teardown.
+class FlowTableFixture : public benchmark::Fixture {
+ public:
+  FlowTableFixture() : table_(), stl_map_(), stl_ordered_map_() {}
+
+  virtual void SetUp(benchmark::State &state) {
+    table_ = new FlowTable<FlowKey, value_t, FlowKeyHash>();
+    stl_map_ = new std::unordered_map<FlowKey, value_t, FlowKeyHash>();
+    stl_ordered_map_ = new std::map<uint64_t, value_t>();
+
+    rng.SetSeed(0);
+    for (int i = 0; i < state.range(0); i++) {
+      uint32_t r = rng.Get();
+      table_->Emplace(derive_key(r), 0, derive_val(r));
+      (*stl_map_)[derive_key(r)] = derive_val(r);
+      (*stl_ordered_map_)[r] = derive_val(r);
+    }
+  }
+
+  virtual void TearDown(benchmark::State &) {
+    delete table_;
+    delete stl_map_;
+    delete stl_ordered_map_;
+  }
+
+ protected:
+  FlowTable<FlowKey, value_t, FlowKeyHash> *table_;
+  std::unordered_map<FlowKey, value_t, FlowKeyHash> *stl_map_;
+  std::map<uint64_t, value_t> *stl_ordered_map_;
+};
+
+// Benchmarks the Lookup() method in FlowTable (with aging).
+BENCHMARK_DEFINE_F(FlowTableFixture, FlowTableLookup)
+(benchmark::State &state) {
+  while (true) {
+    const size_t n = state.range(0);
+    rng.SetSeed(0);
+
+    for (size_t i = 0; i < n; i++) {
+      uint32_t r = rng.Get();
+      FlowTable<FlowKey, value_t, FlowKeyHash>::Entry *e;
+
+      benchmark::DoNotOptimize(e = table_->Lookup(derive_key(r), i));
+      DCHECK(e);
+      DCHECK_EQ(e->value, derive_val(r));
+
+      if (!state.KeepRunning()) {
+        state.SetItemsProcessed(state.iterations());
+        return;
+      }
+    }
+  }
+}
+
+BENCHMARK_REGISTER_F(FlowTableFixture, FlowTableLookup)
+    ->RangeMultiplier(4)
+    ->Range(4, 4 << 20);
+
+// Benchmarks the LookupBatch() method in FlowTable with 32 keys per call.
+BENCHMARK_DEFINE_F(FlowTableFixture, FlowTableLookupBatch)
+(benchmark::State &state) {
+  const size_t kBatch = 32;
+  FlowKey keys[kBatch];
+  FlowTable<FlowKey, value_t, FlowKeyHash>::Entry *entries[kBatch];
+
+  while (true) {
+    const size_t n = state.range(0);
+    rng.SetSeed(0);
+
+    for (size_t i = 0; i < n; i += kBatch) {
+      size_t cnt = std::min(kBatch, n - i);
+      for (size_t j = 0; j < cnt; j++) {
+        keys[j] = derive_key(rng.Get());
+      }
+
+      size_t found = table_->LookupBatch(keys, cnt, i, entries);
+      benchmark::DoNotOptimize(found);
+      DCHECK_EQ(found, cnt);
+
+      if (!state.KeepRunningBatch(cnt)) {
+        state.SetItemsProcessed(state.iterations());
+        return;
+      }
+    }
+  }
+}
+
+BENCHMARK_REGISTER_F(FlowTableFixture, FlowTableLookupBatch)
+    ->RangeMultiplier(4)
+    ->Range(4, 4 << 20);
+
+// Benchmarks the find method on the STL unordered_map (NFVIngress).
+BENCHMARK_DEFINE_F(FlowTableFixture, STLUnorderedMapFind)
+(benchmark::State &state) {
+  while (true) {
+    const size_t n = state.range(0);
+    rng.SetSeed(0);
+
+    for (size_t i = 0; i < n; i++) {
+      uint32_t r = rng.Get();
+      auto it = stl_map_->find(derive_key(r));
+      benchmark::DoNotOptimize(it);
+      DCHECK_EQ(it->second, derive_val(r));
+
+      if (!state.KeepRunning()) {
+        state.SetItemsProcessed(state.iterations());
+        return;
+      }
+    }
+  }
+}
+
+BENCHMARK_REGISTER_F(FlowTableFixture, STLUnorderedMapFind)
+    ->RangeMultiplier(4)
+    ->Range(4, 4 << 20);
+
+// Benchmarks the find method on the STL map (IronsideIngress).
+BENCHMARK_DEFINE_F(FlowTableFixture, STLMapFind)
+(benchmark::State &state) {
+  while (true) {
+    const size_t n = state.range(0);
+    rng.SetSeed(0);
+
+    for (size_t i = 0; i < n; i++) {
+      uint32_t r = rng.Get();
+      auto it = stl_ordered_map_->find(r);
+      benchmark::DoNotOptimize(it);
+      DCHECK_EQ(it->second, derive_val(r));
+
+      if (!state.KeepRunning()) {
+        state.SetItemsProcessed(state.iterations());
+        return;
+      }
+    }
+  }
+}
+
+BENCHMARK_REGISTER_F(FlowTableFixture, STLMapFind)
+    ->RangeMultiplier(4)
+    ->Range(4, 4 << 20);
+
+}  // namespace (unnamed)
+
+BENCHMARK_MAIN();
@@ -0,0 +1,171 @@
+#include "flow_table.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <gtest/gtest.h>
+
+#include "random.h"
+
+using bess::utils::FlowTable;
+
+namespace {
+
+// A 16-byte key, like bess::utils::Flow
+struct Key {
+  uint64_t a;
+  uint64_t b;
+
+  bool operator==(const Key &other) const {
+    return a == other.a && b == other.b;
+  }
+};
+
+struct KeyHash {
+  size_t operator()(const Key &k) const { return k.a * 31 + k.b; }
+};
+
+// All keys have the same hash
+struct BadHash {
+  size_t operator()(uint32_t) const { return 7; }
+};
+
+TEST(FlowTableTest, EmplaceAndFind) {
+  FlowTable<uint32_t, int> table;
+  auto ret = table.Emplace(1, 0, 10);
+  EXPECT_TRUE(ret.second);
+  EXPECT_EQ(10, ret.first->value);
+
+  ret = table.Emplace(1, 0, 20);
+  EXPECT_FALSE(ret.second);
+  EXPECT_EQ(10, ret.first->value);
+
+  ASSERT_NE(nullptr, table.Find(1));
+  EXPECT_EQ(nullptr, table.Find(2));
+  EXPECT_EQ(1, table.Count());
+
+  EXPECT_TRUE(table.Erase(1));
+  EXPECT_FALSE(table.Erase(1));
+  EXPECT_EQ(nullptr, table.Find(1));
+  EXPECT_EQ(0, table.Count());
+}
+
+TEST(FlowTableTest, Grow) {
+  FlowTable<Key, uint64_t, KeyHash> table(16);
+  for (uint64_t i = 0; i < 10000; i++) {
+    table.Emplace({i, i * 7}, 0, i);
+  }
+  EXPECT_EQ(10000, table.Count());
+  EXPECT_GE(table.Capacity(), 10000);
+  for (uint64_t i = 0; i < 10000; i++) {
+    FlowTable<Key, uint64_t, KeyHash>::Entry *e = table.Find({i, i * 7});
+    ASSERT_NE(nullptr, e);
+    EXPECT_EQ(i, e->value);
+  }
+  EXPECT_EQ(nullptr, table.Find({1, 1}));
+}
+
+TEST(FlowTableTest, Collisions) {
+  FlowTable<uint32_t, uint32_t, BadHash> table(64);
+  for (uint32_t i = 0; i < 100; i++) {
+    table.Emplace(i, 0, i);
+  }
+  for (uint32_t i = 0; i < 100; i += 2) {
+    EXPECT_TRUE(table.Erase(i));
+  }
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_EQ(i % 2 == 1, table.Find(i) != nullptr) << i;
+  }
+}
+
+TEST(FlowTableTest, RandomOps) {
+  FlowTable<uint32_t, uint32_t> table(64);
+  std::unordered_map<uint32_t, uint32_t> truth;
+  Random rng;
+  rng.SetSeed(1);
+
+  for (int i = 0; i < 200000; i++) {
+    uint32_t key = rng.GetRange(4096);
+    if (rng.GetRange(3) == 0) {
+      EXPECT_EQ(truth.erase(key) == 1, table.Erase(key));
+    } else {
+      auto ret = table.Emplace(key, 0, i);
+      EXPECT_EQ(truth.emplace(key, i).second, ret.second);
+      EXPECT_EQ(truth[key], ret.first->value);
+    }
+  }
+  EXPECT_EQ(truth.size(), table.Count());
+
+  size_t seen = 0;
+  table.ForEach([&](FlowTable<uint32_t, uint32_t>::Entry &e) {
+    EXPECT_EQ(truth[e.key], e.value);
+    seen++;
+  });
+  EXPECT_EQ(truth.size(), seen);
+}
+
+TEST(FlowTableTest, LookupBatch) {
+  FlowTable<uint32_t, uint32_t> table;
+  for (uint32_t i = 0; i < 100; i += 2) {
+    table.Emplace(i, 0, i + 1);
+  }
+
+  uint32_t keys[100];
+  FlowTable<uint32_t, uint32_t>::Entry *entries[100];
+  for (uint32_t i = 0; i < 100; i++) {
+    keys[i] = i;
+  }
+  EXPECT_EQ(50, table.LookupBatch(keys, 100, 0, entries));
+  for (uint32_t i = 0; i < 100; i++) {
+    if (i % 2 == 0) {
+      ASSERT_NE(nullptr, entries[i]);
+      EXPECT_EQ(i + 1, entries[i]->value);
+    } else {
+      EXPECT_EQ(nullptr, entries[i]);
+    }
+  }
+}
+
+TEST(FlowTableTest, Aging) {
+  FlowTable<uint32_t, int> table(64, 100);
+  table.Emplace(1, 0, 1);
+  table.Emplace(2, 0, 2);
+
+  // Looking up an entry keeps it alive
+  EXPECT_NE(nullptr, table.Lookup(1, 80));
+  EXPECT_NE(nullptr, table.Lookup(1, 160));
+
+  // Find() neither ages nor refreshes entries
+  EXPECT_NE(nullptr, table.Find(2));
+  EXPECT_EQ(nullptr, table.Lookup(2, 150));
+  EXPECT_EQ(1, table.Count());
+
+  table.Emplace(3, 200, 3);
+  EXPECT_EQ(1, table.Expire(261, 1000));
+  EXPECT_EQ(nullptr, table.Find(1));
+  EXPECT_NE(nullptr, table.Find(3));
+
+  // An expired entry is replaced
+  auto ret = table.Emplace(3, 1000, 4);
+  EXPECT_TRUE(ret.second);
+  EXPECT_EQ(4, ret.first->value);
+}
+
+TEST(FlowTableTest, NonTrivialValues) {
+  FlowTable<uint32_t, std::shared_ptr<std::string>> table(16);
+  std::shared_ptr<std::string> s = std::make_shared<std::string>("flow");
+  for (uint32_t i = 0; i < 100; i++) {
+    table.Emplace(i, 0, s);
+  }
+  EXPECT_EQ(101, s.use_count());
+  for (uint32_t i = 0; i < 50; i++) {
+    table.Erase(i);
+  }
+  EXPECT_EQ(51, s.use_count());
+  table.Clear();
+  EXPECT_EQ(1, s.use_count());
+  EXPECT_EQ(0, table.Count());
+}
+
+}  // namespace (unnamed)
@@ -0,0 +1,101 @@
+#ifndef BESS_UTILS_HYPERLOGLOG_H_
+#define BESS_UTILS_HYPERLOGLOG_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace bess {
+namespace utils {
+
+// A fixed-size, allocation-free distinct counter (HyperLogLog) with
+// 2^|kPrecision| one-byte registers. The relative standard error is about
+// 1.04 / sqrt(2^kPrecision), e.g., 4.6% with the default 512 registers.
+// Small cardinalities fall back to linear counting and are nearly exact.
+//
+// Each sketch is stamped with an epoch ID. Adding to or reading from a
+// sketch with a newer epoch implicitly resets it, so a set of sketches can
+// be cleared in O(1) by advancing the caller's epoch.
+//
+// Example usage:
+//
+//  HyperLogLog<> hll;
+//  hll.Add(hash_of_flow_a, epoch);
+//  hll.Add(hash_of_flow_b, epoch);
+//  hll.Estimate(epoch);      // ~2
+//  hll.Estimate(epoch + 1);  // 0
+template <int kPrecision = 9>
+class HyperLogLog {
+ public:
+  static_assert(kPrecision >= 7 && kPrecision <= 16,
+                "HyperLogLog precision must be in [7, 16]");
+  static const uint32_t kRegisters = 1u << kPrecision;
+
+  HyperLogLog() : epoch_(0) { Reset(0); }
+
+  // Clears all registers and stamps the sketch with |epoch|.
+  void Reset(uint32_t epoch) {
+    memset(registers_, 0, sizeof(registers_));
+    epoch_ = epoch;
+  }
+
+  // Records an element whose (not necessarily well-mixed) hash is |hash|.
+  void Add(uint64_t hash, uint32_t epoch) {
+    if (epoch != epoch_) {
+      Reset(epoch);
+    }
+
+    uint64_t h = Mix(hash);
+    uint32_t idx = h >> (64 - kPrecision);
+    uint64_t rest = h << kPrecision;
+    uint8_t rank = rest ? __builtin_clzll(rest) + 1 : 64 - kPrecision + 1;
+    if (rank > registers_[idx]) {
+      registers_[idx] = rank;
+    }
+  }
+
+  // Returns the estimated number of distinct elements added in |epoch|.
+  uint64_t Estimate(uint32_t epoch) const {
+    if (epoch != epoch_) {
+      return 0;
+    }
+
+    const double m = kRegisters;
+    double sum = 0;
+    uint32_t zeros = 0;
+    for (uint32_t i = 0; i < kRegisters; i++) {
+      sum += std::ldexp(1.0, -registers_[i]);
+      zeros += (registers_[i] == 0);
+    }
+
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+      // Small-range correction: linear counting over empty registers
+      estimate = m * std::log(m / zeros);
+    }
+    return static_cast<uint64_t>(estimate + 0.5);
+  }
+
+  uint32_t epoch() const { return epoch_; }
+
+ private:
+  // The 64-bit finalizer of MurmurHash3. NIC RSS hashes of flows in one
+  // bucket share their low bits, so the input must be mixed before use.
+  static uint64_t Mix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+  }
+
+  uint32_t epoch_;
+  uint8_t registers_[kRegisters];
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_HYPERLOGLOG_H_
@@ -0,0 +1,105 @@
+#include "hyperloglog.h"
+
+#include <cmath>
+#include <unordered_set>
+
+#include <gtest/gtest.h>
+
+#include "random.h"
+
+using bess::utils::HyperLogLog;
+
+namespace {
+
+// Emulates NIC RSS hashes of flows that fall into the same RSS bucket:
+// the low 9 bits (the RETA index) are identical for all of them.
+uint32_t BucketHash(Random *rng) {
+  return (rng->Get() << 9) | 0x5a;
+}
+
+// Adds |n| distinct hashes (each seen |dup| times) and compares the
+// estimate with the exact count.
+void CheckAccuracy(uint32_t n, int dup, double max_error) {
+  Random rng(n);
+  HyperLogLog<> hll;
+  std::unordered_set<uint32_t> exact;
+
+  while (exact.size() < n) {
+    uint32_t h = BucketHash(&rng);
+    exact.insert(h);
+    for (int i = 0; i < dup; i++) {
+      hll.Add(h, 1);
+    }
+  }
+
+  double estimate = hll.Estimate(1);
+  EXPECT_LE(std::fabs(estimate - n), max_error * n + 1)
+      << "n=" << n << ", estimate=" << estimate;
+}
+
+TEST(HyperLogLogTest, Empty) {
+  HyperLogLog<> hll;
+  EXPECT_EQ(0, hll.Estimate(0));
+}
+
+TEST(HyperLogLogTest, Duplicates) {
+  HyperLogLog<> hll;
+  for (int i = 0; i < 1000; i++) {
+    hll.Add(42, 0);
+  }
+  EXPECT_EQ(1, hll.Estimate(0));
+}
+
+TEST(HyperLogLogTest, SmallCardinality) {
+  // Linear counting is nearly exact when most registers are empty
+  CheckAccuracy(10, 3, 0.01);
+  CheckAccuracy(100, 3, 0.05);
+}
+
+TEST(HyperLogLogTest, LargeCardinality) {
+  // 4x the standard error of 512 registers (4.6%)
+  CheckAccuracy(1000, 2, 0.19);
+  CheckAccuracy(10000, 2, 0.19);
+  CheckAccuracy(100000, 1, 0.19);
+}
+
+TEST(HyperLogLogTest, AverageError) {
+  // Over many independent buckets, the mean relative error stays close
+  // to the theoretical standard error.
+  const int kBuckets = 64;
+  const uint32_t kFlows = 2000;
+  Random rng(7);
+  double sum_sq_error = 0;
+
+  for (int b = 0; b < kBuckets; b++) {
+    HyperLogLog<> hll;
+    std::unordered_set<uint32_t> exact;
+    while (exact.size() < kFlows) {
+      uint32_t h = BucketHash(&rng);
+      exact.insert(h);
+      hll.Add(h, 3);
+    }
+    double err = (double(hll.Estimate(3)) - kFlows) / kFlows;
+    sum_sq_error += err * err;
+  }
+  EXPECT_LT(std::sqrt(sum_sq_error / kBuckets), 0.06);
+}
+
+TEST(HyperLogLogTest, EpochReset) {
+  HyperLogLog<> hll;
+  for (uint32_t i = 0; i < 100; i++) {
+    hll.Add(i, 5);
+  }
+  EXPECT_NEAR(100, hll.Estimate(5), 5);
+
+  // Reading a newer epoch does not touch the registers
+  EXPECT_EQ(0, hll.Estimate(6));
+  EXPECT_NEAR(100, hll.Estimate(5), 5);
+
+  // Adding to a newer epoch drops everything from the old one
+  hll.Add(1000, 6);
+  EXPECT_EQ(1, hll.Estimate(6));
+  EXPECT_EQ(0, hll.Estimate(5));
+}
+
+}  // namespace (unnamed)
@@ -0,0 +1,105 @@
+// Replays a recorded trace against the Ironside control loop offline, e.g.,
+//
+//  ./ironside_replay_sim --trace=rates.txt
+//      --long_profile=nf_profiles/chain2/long_200_p50.pro
+//      --short_profile=nf_profiles/chain2/short_200_p50.pro
+//  ./ironside_replay_sim --trace=caida.pcap --trace_format=pcap
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include <gflags/gflags.h>
+
+#include "ironside_simulator.h"
+
+DEFINE_string(trace, "", "Per-shard rate trace or pcap file to replay");
+DEFINE_string(trace_format, "rate", "Trace format: rate or pcap");
+DEFINE_uint64(pcap_bin_us, 1000, "Length of a pcap trace sample in us");
+DEFINE_string(long_profile, "", "Long-term NF profile (packets per second)");
+DEFINE_string(short_profile, "", "Short-term NF profile (packets per epoch)");
+DEFINE_uint32(shards, 64, "Number of RSS shards (SHARD_NUM)");
+DEFINE_uint32(pkt_size, 0, "Packet size to look up the profiles with");
+DEFINE_uint32(ncores, 8, "Number of normal cores");
+DEFINE_int32(rcores, 4, "Number of rcores (software queues)");
+DEFINE_string(split_policy, "greedy", "Short-term split policy");
+DEFINE_uint64(short_epoch_us, 1000, "Short-term epoch length in us");
+DEFINE_uint64(long_epoch_ms, 500, "Long-term epoch length in ms");
+DEFINE_uint64(rss_delay_us, 2000, "Delay of a NIC RETA update in us");
+
+namespace {
+
+bool LoadModel(const std::string &path, bess::utils::NFPerfModel *model) {
+  if (path.empty()) {
+    return true;
+  }
+  if (!model->LoadProfile(path)) {
+    return false;
+  }
+  model->Build();
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  gflags::SetUsageMessage("Replays a trace against the Ironside control loop");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  bess::utils::ShardRateTrace trace;
+  bool ok = false;
+  if (FLAGS_trace_format == "rate") {
+    ok = bess::utils::LoadShardRateTrace(FLAGS_trace, FLAGS_shards, &trace);
+  } else if (FLAGS_trace_format == "pcap") {
+    ok = bess::utils::LoadPcapShardTrace(FLAGS_trace, FLAGS_shards,
+                                         FLAGS_pcap_bin_us * 1000, &trace);
+  }
+  if (!ok || trace.samples.empty()) {
+    fprintf(stderr, "Cannot load %s trace '%s'\n", FLAGS_trace_format.c_str(),
+            FLAGS_trace.c_str());
+    return 1;
+  }
+
+  bess::utils::NFPerfModel long_model;
+  bess::utils::NFPerfModel short_model;
+  if (!LoadModel(FLAGS_long_profile, &long_model) ||
+      !LoadModel(FLAGS_short_profile, &short_model)) {
+    fprintf(stderr, "Cannot load the NF profiles\n");
+    return 1;
+  }
+
+  bess::utils::IronsideSimConfig config;
+  config.num_shards = FLAGS_shards;
+  config.num_cores = FLAGS_ncores;
+  config.init_cores = std::min<uint32_t>(2, FLAGS_ncores);
+  config.num_rcores = FLAGS_rcores;
+  config.short_epoch_ns = FLAGS_short_epoch_us * 1000;
+  config.long_epoch_ns = FLAGS_long_epoch_ms * 1000000;
+  config.rss_update_delay_ns = FLAGS_rss_delay_us * 1000;
+  config.split_policy = FLAGS_split_policy;
+  config.long_term_model = &long_model;
+  config.short_term_model = &short_model;
+  config.pkt_size = FLAGS_pkt_size;
+
+  auto start = std::chrono::steady_clock::now();
+  bess::utils::IronsideSimResult r = bess::utils::RunIronsideSim(config, trace);
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+  if (r.short_epochs == 0) {
+    fprintf(stderr, "Invalid configuration\n");
+    return 1;
+  }
+
+  double sim_secs = r.sim_ns / 1e9;
+  printf("simulated %.3f s in %.3f s (%.0fx)\n", sim_secs, wall.count(),
+         sim_secs / wall.count());
+  printf("cores: avg %.2f, max %u; rcores: avg %.2f, max %u\n", r.avg_cores,
+         r.max_cores, r.avg_queues, r.max_queues);
+  printf("slo violations: %lu of %lu core-epochs\n", r.slo_violation_epochs,
+         r.short_epochs * config.num_cores);
+  printf("packets: offered %lu, offloaded %lu, boosted %lu, dropped %lu\n",
+         r.offered_packets, r.offloaded_packets, r.boosted_packets,
+         r.dropped_packets);
+  printf("moves: %lu (%.2f/s) in %lu RETA updates over %lu long epochs\n",
+         r.moves, r.moves_per_sec, r.rss_updates, r.long_epochs);
+  return 0;
+}
@@ -0,0 +1,640 @@
+#include "ironside_simulator.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <tuple>
+#include <unordered_set>
+
+#include "pcap.h"
+#include "split_policy.h"
+
+// Captures with nanosecond timestamps
+#define PCAP_MAGIC_NUMBER_NS 0xa1b23c4d
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+uint64_t Mix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// A fixed pool of software queues. The lowest free ID is handed out first,
+// so that runs are deterministic.
+class SimQueuePool final : public SplitQueuePool {
+ public:
+  explicit SimQueuePool(int num_queues) {
+    for (int qid = 0; qid < num_queues; qid++) {
+      free_.insert(qid);
+    }
+  }
+
+  int Request() override {
+    if (free_.empty()) {
+      return -1;
+    }
+    int qid = *free_.begin();
+    free_.erase(free_.begin());
+    return qid;
+  }
+
+  void Release(int qid) { free_.insert(qid); }
+
+ private:
+  std::set<int> free_;
+};
+
+// Events at the same time run in the order of their types
+enum EventType {
+  kTraceSample = 0,
+  kRetaUpdate,
+  kShortEpoch,
+  kLongEpoch,
+};
+
+struct Event {
+  uint64_t ts;
+  int type;
+  uint64_t seq;
+  size_t arg;
+
+  bool operator>(const Event &o) const {
+    return std::tie(ts, type, seq) > std::tie(o.ts, o.type, o.seq);
+  }
+};
+
+class Simulator {
+ public:
+  Simulator(const IronsideSimConfig &config, const ShardRateTrace &trace,
+            std::unique_ptr<SplitPolicy> policy);
+
+  IronsideSimResult Run();
+
+ private:
+  // A software queue and its rcore
+  struct Queue {
+    bool in_use = false;
+    uint16_t core = 0;  // the normal core that requested it
+    int idle_epochs = 0;
+    double backlog = 0;
+    double arrivals = 0;  // in the current short epoch
+  };
+
+  void Schedule(uint64_t ts, int type, size_t arg);
+
+  // Adds the packets that arrived since the last call to their core's (or
+  // software queue's) queues, following the current RETA.
+  void Accrue(uint64_t now);
+
+  void OnTraceSample(size_t idx);
+  void OnRetaUpdate(size_t idx);
+  void OnLongEpoch(uint64_t now);
+  void OnShortEpoch();
+
+  // NFVCore::ShortEpochProcess for |core|. Returns true if the core or one
+  // of its software queues cannot process its packets in this epoch.
+  bool ShortEpochProcess(uint16_t core);
+  void ReleaseQueue(int qid);
+
+  uint64_t LongTermCapacity(uint64_t flow_count) const;
+  uint32_t ShortTermBudget(uint64_t flow_count) const;
+
+  const IronsideSimConfig &config_;
+  const ShardRateTrace &trace_;
+  std::unique_ptr<SplitPolicy> policy_;
+
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+  uint64_t next_seq_ = 0;
+  uint64_t last_accrue_ns_ = 0;
+  uint64_t last_long_epoch_ns_ = 0;
+
+  // Per shard, from the trace
+  std::vector<uint64_t> pkt_rate_;
+  std::vector<uint64_t> flow_count_;
+  std::vector<double> long_epoch_pkts_;
+
+  // The fake NIC: shard -> core, and RETA updates that are not applied yet
+  std::vector<uint16_t> reta_;
+  std::vector<std::map<uint16_t, uint16_t>> reta_updates_;
+
+  // [core][shard]
+  std::vector<std::vector<double>> queued_;
+  std::vector<std::vector<int>> offload_;
+
+  std::vector<Queue> queues_;
+  SimQueuePool pool_;
+  ShardRebalancer rebalancer_;
+  uint32_t queue_budget_;
+
+  std::vector<SplitFlow> split_flows_;
+  std::vector<uint16_t> split_shards_;
+  std::vector<SplitQueue> split_queues_;
+
+  IronsideSimResult result_;
+  double offered_ = 0;
+  double overloaded_ = 0;
+  double offloaded_ = 0;
+  double boosted_ = 0;
+  double dropped_ = 0;
+  uint64_t core_samples_ = 0;
+  uint64_t queue_samples_ = 0;
+};
+
+Simulator::Simulator(const IronsideSimConfig &config,
+                     const ShardRateTrace &trace,
+                     std::unique_ptr<SplitPolicy> policy)
+    : config_(config),
+      trace_(trace),
+      policy_(std::move(policy)),
+      pkt_rate_(config.num_shards, 0),
+      flow_count_(config.num_shards, 0),
+      long_epoch_pkts_(config.num_shards, 0),
+      reta_(config.num_shards, 0),
+      queued_(config.num_cores, std::vector<double>(config.num_shards, 0)),
+      offload_(config.num_cores, std::vector<int>(config.num_shards, -1)),
+      queues_(config.num_rcores),
+      pool_(config.num_rcores) {
+  // As NFVCtrl::InitPMD: shards are spread over the first |init_cores|
+  rebalancer_.Init(config.num_shards, config.num_cores,
+                   [this](uint64_t fc) { return LongTermCapacity(fc); },
+                   config.rebalancer);
+  for (uint16_t core = 0; core < config.num_cores; core++) {
+    rebalancer_.SetCoreUsable(core, true);
+  }
+  for (uint16_t shard = 0; shard < config.num_shards; shard++) {
+    reta_[shard] = shard % config.init_cores;
+    rebalancer_.Assign(shard, reta_[shard]);
+  }
+  // As NFVCore: an rcore's budget is the short-term profile with no flows
+  queue_budget_ = ShortTermBudget(0);
+}
+
+uint64_t Simulator::LongTermCapacity(uint64_t flow_count) const {
+  const NFPerfModel *model = config_.long_term_model;
+  if (model == nullptr || model->empty()) {
+    return 1000000;
+  }
+  return model->Get(flow_count, config_.pkt_size);
+}
+
+uint32_t Simulator::ShortTermBudget(uint64_t flow_count) const {
+  const NFPerfModel *model = config_.short_term_model;
+  if (model == nullptr || model->empty()) {
+    return 512;
+  }
+  return model->Get(flow_count, config_.pkt_size);
+}
+
+void Simulator::Schedule(uint64_t ts, int type, size_t arg) {
+  events_.push({ts, type, next_seq_++, arg});
+}
+
+void Simulator::Accrue(uint64_t now) {
+  if (now <= last_accrue_ns_) {
+    return;
+  }
+  double secs = (now - last_accrue_ns_) / 1e9;
+  last_accrue_ns_ = now;
+
+  for (uint16_t shard = 0; shard < config_.num_shards; shard++) {
+    double pkts = pkt_rate_[shard] * secs;
+    if (pkts == 0) {
+      continue;
+    }
+    offered_ += pkts;
+    long_epoch_pkts_[shard] += pkts;
+
+    uint16_t core = reta_[shard];
+    int qid = offload_[core][shard];
+    if (qid >= 0) {
+      queues_[qid].arrivals += pkts;
+      offloaded_ += pkts;
+    } else {
+      queued_[core][shard] += pkts;
+    }
+  }
+}
+
+void Simulator::OnTraceSample(size_t idx) {
+  const ShardRateSample &sample = trace_.samples[idx];
+  pkt_rate_ = sample.pkt_rate;
+  flow_count_ = sample.flow_count;
+}
+
+void Simulator::OnRetaUpdate(size_t idx) {
+  for (const auto &it : reta_updates_[idx]) {
+    reta_[it.first] = it.second;
+  }
+  reta_updates_[idx].clear();
+  result_.rss_updates += 1;
+}
+
+void Simulator::OnLongEpoch(uint64_t now) {
+  double secs = (now - last_long_epoch_ns_) / 1e9;
+  last_long_epoch_ns_ = now;
+
+  // As NFVCtrl::LongEpochProcess: the controller's view changes at once,
+  // and the NIC follows after |rss_update_delay_ns|
+  for (uint16_t shard = 0; shard < config_.num_shards; shard++) {
+    rebalancer_.UpdateShard(shard, uint64_t(long_epoch_pkts_[shard] / secs),
+                            flow_count_[shard]);
+    long_epoch_pkts_[shard] = 0;
+  }
+  std::map<uint16_t, uint16_t> moves = rebalancer_.Rebalance();
+
+  result_.long_epochs += 1;
+  result_.moves += moves.size();
+  if (!moves.empty()) {
+    reta_updates_.push_back(std::move(moves));
+    Schedule(now + config_.rss_update_delay_ns, kRetaUpdate,
+             reta_updates_.size() - 1);
+  }
+}
+
+void Simulator::OnShortEpoch() {
+  uint64_t violations = 0;
+  for (uint16_t core = 0; core < config_.num_cores; core++) {
+    violations += ShortEpochProcess(core);
+  }
+  result_.short_epochs += 1;
+  result_.slo_violation_epochs += violations;
+
+  std::vector<bool> active(config_.num_cores, false);
+  for (uint16_t core : reta_) {
+    active[core] = true;
+  }
+  uint16_t cores = std::count(active.begin(), active.end(), true);
+  uint32_t in_use = 0;
+  for (const Queue &q : queues_) {
+    in_use += q.in_use;
+  }
+  core_samples_ += cores;
+  queue_samples_ += in_use;
+  result_.max_cores = std::max(result_.max_cores, cores);
+  result_.max_queues = std::max(result_.max_queues, in_use);
+}
+
+bool Simulator::ShortEpochProcess(uint16_t core) {
+  std::vector<double> &queued = queued_[core];
+
+  // Shards with packets at this core that are not offloaded yet
+  uint64_t local_flow_count = 0;
+  split_flows_.clear();
+  split_shards_.clear();
+  for (uint16_t shard = 0; shard < config_.num_shards; shard++) {
+    if (queued[shard] < 1) {
+      continue;
+    }
+    local_flow_count += flow_count_[shard];
+    if (offload_[core][shard] < 0) {
+      uint32_t size = std::min<double>(queued[shard], UINT32_MAX);
+      split_flows_.push_back({size, static_cast<uint32_t>(Mix64(shard)),
+                              SplitPolicy::kLocal});
+      split_shards_.push_back(shard);
+    }
+  }
+
+  split_queues_.clear();
+  for (int qid = 0; qid < config_.num_rcores; qid++) {
+    const Queue &q = queues_[qid];
+    if (q.in_use && q.core == core) {
+      uint32_t load = std::min<double>(q.backlog + q.arrivals, UINT32_MAX);
+      split_queues_.push_back({qid, load});
+    }
+  }
+
+  SplitBudget budget = {ShortTermBudget(local_flow_count), queue_budget_};
+  policy_->Split(&split_flows_, budget, &split_queues_, &pool_);
+
+  for (const SplitQueue &sq : split_queues_) {
+    Queue &q = queues_[sq.id];
+    if (!q.in_use) {
+      q = Queue();
+      q.in_use = true;
+      q.core = core;
+    }
+  }
+
+  // Packets of a flow that leaves the normal core go with it
+  for (size_t i = 0; i < split_flows_.size(); i++) {
+    uint16_t shard = split_shards_[i];
+    int decision = split_flows_[i].decision;
+    if (decision == SplitPolicy::kLocal) {
+      continue;
+    }
+    if (decision == SplitPolicy::kBoost) {
+      boosted_ += queued[shard];
+    } else if (decision == SplitPolicy::kDrop) {
+      dropped_ += queued[shard];
+    } else {
+      offload_[core][shard] = decision;
+      queues_[decision].arrivals += queued[shard];
+      offloaded_ += queued[shard];
+    }
+    queued[shard] = 0;
+  }
+
+  // The normal core processes up to its budget; the rest stays queued
+  bool violated = false;
+  double local_load = 0;
+  for (uint16_t shard = 0; shard < config_.num_shards; shard++) {
+    local_load += queued[shard];
+  }
+  double left = std::max(0.0, local_load - budget.local_pkt_thresh);
+  if (left >= 1) {
+    violated = true;
+    overloaded_ += left;
+    // A full queue drops packets
+    double kept = std::min<double>(left, config_.queue_size);
+    dropped_ += left - kept;
+    left = kept;
+  }
+  for (uint16_t shard = 0; shard < config_.num_shards; shard++) {
+    queued[shard] = (left >= 1) ? queued[shard] * (left / local_load) : 0;
+  }
+
+  // Each rcore does the same; idle ones are reclaimed
+  for (int qid = 0; qid < config_.num_rcores; qid++) {
+    Queue &q = queues_[qid];
+    if (!q.in_use || q.core != core) {
+      continue;
+    }
+    double load = q.backlog + q.arrivals;
+    q.backlog = std::max(0.0, load - queue_budget_);
+    if (q.backlog >= 1) {
+      violated = true;
+      overloaded_ += q.backlog;
+      dropped_ += std::max(0.0, q.backlog - config_.queue_size);
+      q.backlog = std::min<double>(q.backlog, config_.queue_size);
+    } else {
+      q.backlog = 0;
+    }
+    q.idle_epochs = (load < 1) ? q.idle_epochs + 1 : 0;
+    q.arrivals = 0;
+    if (q.idle_epochs >= config_.max_idle_epochs) {
+      ReleaseQueue(qid);
+    }
+  }
+  return violated;
+}
+
+void Simulator::ReleaseQueue(int qid) {
+  // The queue's flows go back to their normal core
+  for (auto &core_offload : offload_) {
+    std::replace(core_offload.begin(), core_offload.end(), qid, -1);
+  }
+  queues_[qid] = Queue();
+  pool_.Release(qid);
+}
+
+IronsideSimResult Simulator::Run() {
+  const uint64_t start = trace_.samples.front().ts_ns;
+  const uint64_t end = trace_.end_ns;
+  last_accrue_ns_ = start;
+  last_long_epoch_ns_ = start;
+
+  for (size_t i = 0; i < trace_.samples.size(); i++) {
+    Schedule(trace_.samples[i].ts_ns, kTraceSample, i);
+  }
+  Schedule(start + config_.short_epoch_ns, kShortEpoch, 0);
+  Schedule(start + config_.long_epoch_ns, kLongEpoch, 0);
+
+  while (!events_.empty() && events_.top().ts <= end) {
+    Event ev = events_.top();
+    events_.pop();
+    Accrue(ev.ts);
+
+    switch (ev.type) {
+      case kTraceSample:
+        OnTraceSample(ev.arg);
+        break;
+      case kRetaUpdate:
+        OnRetaUpdate(ev.arg);
+        break;
+      case kShortEpoch:
+        OnShortEpoch();
+        Schedule(ev.ts + config_.short_epoch_ns, kShortEpoch, 0);
+        break;
+      case kLongEpoch:
+        OnLongEpoch(ev.ts);
+        Schedule(ev.ts + config_.long_epoch_ns, kLongEpoch, 0);
+        break;
+    }
+  }
+  Accrue(end);
+
+  result_.sim_ns = end - start;
+  result_.offered_packets = offered_;
+  result_.overloaded_packets = overloaded_;
+  result_.offloaded_packets = offloaded_;
+  result_.boosted_packets = boosted_;
+  result_.dropped_packets = dropped_;
+  if (result_.short_epochs) {
+    result_.avg_cores = double(core_samples_) / result_.short_epochs;
+    result_.avg_queues = double(queue_samples_) / result_.short_epochs;
+  }
+  if (result_.sim_ns) {
+    result_.moves_per_sec = result_.moves / (result_.sim_ns / 1e9);
+  }
+  return result_;
+}
+
+bool ValidTrace(const ShardRateTrace &trace, uint16_t num_shards) {
+  if (trace.samples.empty() || trace.end_ns <= trace.samples.front().ts_ns) {
+    return false;
+  }
+  uint64_t ts = 0;
+  for (const ShardRateSample &sample : trace.samples) {
+    if (sample.ts_ns < ts || sample.pkt_rate.size() != num_shards ||
+        sample.flow_count.size() != num_shards) {
+      return false;
+    }
+    ts = sample.ts_ns;
+  }
+  return true;
+}
+
+}  // namespace
+
+IronsideSimResult RunIronsideSim(const IronsideSimConfig &config,
+                                 const ShardRateTrace &trace) {
+  std::unique_ptr<SplitPolicy> policy = SplitPolicy::Create(config.split_policy);
+  if (!policy || config.num_shards == 0 || config.num_cores == 0 ||
+      config.init_cores == 0 || config.init_cores > config.num_cores ||
+      config.num_rcores < 0 || config.short_epoch_ns == 0 ||
+      config.long_epoch_ns == 0 || !ValidTrace(trace, config.num_shards)) {
+    return IronsideSimResult();
+  }
+  Simulator sim(config, trace, std::move(policy));
+  return sim.Run();
+}
+
+bool LoadShardRateTrace(const std::string &path, uint16_t num_shards,
+                        ShardRateTrace *trace) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream tokens(line);
+    std::string token;
+    if (!(tokens >> token) || token[0] == '#') {
+      continue;
+    }
+
+    ShardRateSample sample;
+    sample.pkt_rate.assign(num_shards, 0);
+    sample.flow_count.assign(num_shards, 0);
+    try {
+      sample.ts_ns = uint64_t(std::stod(token) * 1000000);
+      while (tokens >> token) {
+        size_t sep = token.find(':');
+        if (sep == std::string::npos) {
+          return false;
+        }
+        size_t sep2 = token.find(':', sep + 1);
+        unsigned long shard = std::stoul(token.substr(0, sep));
+        if (shard >= num_shards) {
+          return false;
+        }
+        sample.pkt_rate[shard] = std::stoull(token.substr(sep + 1, sep2 - sep - 1));
+        sample.flow_count[shard] = (sep2 == std::string::npos)
+                                       ? (sample.pkt_rate[shard] > 0)
+                                       : std::stoull(token.substr(sep2 + 1));
+      }
+    } catch (const std::exception &) {
+      return false;
+    }
+    if (!trace->samples.empty() && sample.ts_ns < trace->samples.back().ts_ns) {
+      return false;
+    }
+    trace->samples.push_back(std::move(sample));
+  }
+
+  size_t n = trace->samples.size();
+  if (n == 1) {
+    trace->end_ns = trace->samples[0].ts_ns + 1000000000;
+  } else if (n > 1) {
+    trace->end_ns = 2 * trace->samples[n - 1].ts_ns - trace->samples[n - 2].ts_ns;
+  }
+  return true;
+}
+
+bool LoadPcapShardTrace(const std::string &path, uint16_t num_shards,
+                        uint64_t bin_ns, ShardRateTrace *trace) {
+  std::ifstream file(path, std::ios::binary);
+  pcap_hdr hdr;
+  if (num_shards == 0 || bin_ns == 0 || !file.is_open() ||
+      !file.read(reinterpret_cast<char *>(&hdr), sizeof(hdr))) {
+    return false;
+  }
+  if ((hdr.magic_number != PCAP_MAGIC_NUMBER &&
+       hdr.magic_number != PCAP_MAGIC_NUMBER_NS) ||
+      hdr.network != PCAP_NETWORK) {
+    return false;
+  }
+  const uint64_t frac_ns = (hdr.magic_number == PCAP_MAGIC_NUMBER) ? 1000 : 1;
+
+  // The current bin
+  uint64_t start_ns = 0;
+  uint64_t bin = 0;
+  std::vector<uint64_t> pkts(num_shards, 0);
+  std::vector<std::unordered_set<uint64_t>> flows(num_shards);
+  auto flush = [&]() {
+    ShardRateSample sample;
+    sample.ts_ns = bin * bin_ns;
+    for (uint16_t shard = 0; shard < num_shards; shard++) {
+      sample.pkt_rate.push_back(pkts[shard] * 1000000000 / bin_ns);
+      sample.flow_count.push_back(flows[shard].size());
+      pkts[shard] = 0;
+      flows[shard].clear();
+    }
+    trace->samples.push_back(std::move(sample));
+  };
+
+  pcap_rec_hdr rec;
+  std::vector<uint8_t> data;
+  bool first = true;
+  while (file.read(reinterpret_cast<char *>(&rec), sizeof(rec))) {
+    if (rec.incl_len > PCAP_SNAPLEN * 4) {
+      return false;
+    }
+    data.resize(rec.incl_len);
+    if (!file.read(reinterpret_cast<char *>(data.data()), rec.incl_len)) {
+      break;  // a truncated capture
+    }
+
+    uint64_t ts_ns = rec.ts_sec * 1000000000ULL + rec.ts_usec * frac_ns;
+    if (first) {
+      start_ns = ts_ns;
+      first = false;
+    }
+    // Out-of-order packets are counted in the current bin
+    uint64_t pkt_bin = (ts_ns > start_ns) ? (ts_ns - start_ns) / bin_ns : 0;
+    if (pkt_bin > bin) {
+      flush();
+      // A gap without packets
+      if (pkt_bin > bin + 1) {
+        bin += 1;
+        flush();
+      }
+      bin = pkt_bin;
+    }
+
+    // Ethernet (with an optional VLAN tag), IPv4, and then TCP/UDP ports
+    size_t off = 14;
+    if (data.size() < off) {
+      continue;
+    }
+    uint16_t ether_type = (data[12] << 8) | data[13];
+    if (ether_type == 0x8100 && data.size() >= 18) {
+      ether_type = (data[16] << 8) | data[17];
+      off = 18;
+    }
+    if (ether_type != 0x0800 || data.size() < off + 20) {
+      continue;
+    }
+    const uint8_t *ip = &data[off];
+    size_t ihl = (ip[0] & 0xf) * 4;
+    uint8_t proto = ip[9];
+    uint64_t addrs = 0;
+    for (int i = 12; i < 20; i++) {
+      addrs = (addrs << 8) | ip[i];
+    }
+    uint32_t ports = 0;
+    bool first_frag = ((ip[6] & 0x1f) | ip[7]) == 0;
+    if ((proto == 6 || proto == 17) && first_frag &&
+        data.size() >= off + ihl + 4) {
+      const uint8_t *l4 = ip + ihl;
+      ports = (l4[0] << 24) | (l4[1] << 16) | (l4[2] << 8) | l4[3];
+    }
+
+    // The NIC uses Toeplitz, but any well-mixed hash spreads the flows
+    // over shards in the same way
+    uint64_t flow = Mix64(addrs ^ Mix64((uint64_t(ports) << 8) | proto));
+    uint16_t shard = flow % num_shards;
+    pkts[shard] += 1;
+    flows[shard].insert(flow);
+  }
+
+  if (!first) {
+    flush();
+    trace->end_ns = (bin + 1) * bin_ns;
+  }
+  return true;
+}
+
+}  // namespace utils
+}  // namespace bess
@@ -0,0 +1,115 @@
+#ifndef BESS_UTILS_IRONSIDE_SIMULATOR_H_
+#define BESS_UTILS_IRONSIDE_SIMULATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "nf_perf_model.h"
+#include "shard_rebalancer.h"
+
+namespace bess {
+namespace utils {
+
+// An offline, deterministic discrete-event simulation of the Ironside
+// control loop, for tuning policies against recorded traffic without NICs.
+//
+// The simulator runs the same policy code as the datapath:
+// - long-term (NFVCtrl): ShardRebalancer packs RSS shards into normal cores
+//   at every long epoch, using the long-term NF profile as core capacity;
+// - short-term (NFVCore): SplitPolicy offloads shards that a normal core
+//   cannot process within an epoch to a shared pool of software queues
+//   (rcores), using the short-term NF profile as the per-epoch budget.
+// The NIC is a fake RETA: shard moves take effect |rss_update_delay_ns|
+// after the long epoch that decides them. Packets are a fluid; a shard's
+// packets that a core cannot process in an epoch stay queued, up to
+// |queue_size| packets per queue.
+//
+// Example usage:
+//
+//  ShardRateTrace trace;
+//  LoadShardRateTrace("trace.txt", SHARD_NUM, &trace);
+//  IronsideSimConfig config;
+//  config.long_term_model = &long_model;
+//  IronsideSimResult r = RunIronsideSim(config, trace);
+
+// Per-shard load from |ts_ns| until the next sample (or the trace's end).
+struct ShardRateSample {
+  uint64_t ts_ns;
+  std::vector<uint64_t> pkt_rate;    // packets per second
+  std::vector<uint64_t> flow_count;  // active flows
+};
+
+struct ShardRateTrace {
+  std::vector<ShardRateSample> samples;  // in time order
+  uint64_t end_ns = 0;
+};
+
+// Reads a trace with one sample per line: a timestamp in ms, and then a
+// "shard:pkt_rate[:flow_count]" token per shard with traffic, e.g.,
+// "100 0:250000:40 7:1200000:300". The last sample lasts as long as the
+// one before it. Returns false if the file cannot be parsed.
+bool LoadShardRateTrace(const std::string &path, uint16_t num_shards,
+                        ShardRateTrace *trace);
+
+// Reads an Ethernet pcap file and bins its packets into |bin_ns| samples.
+// A packet's shard is a hash of its IPv4 5-tuple; non-IPv4 packets are
+// skipped. Returns false if the file is not a pcap file.
+bool LoadPcapShardTrace(const std::string &path, uint16_t num_shards,
+                        uint64_t bin_ns, ShardRateTrace *trace);
+
+struct IronsideSimConfig {
+  uint16_t num_shards = 64;
+  uint16_t num_cores = 8;       // normal cores
+  uint16_t init_cores = 2;      // cores with shards at start (as NFVCtrl)
+  int num_rcores = 4;           // software queues shared by normal cores
+  uint64_t short_epoch_ns = 1000000;
+  uint64_t long_epoch_ns = 500000000;
+  uint64_t rss_update_delay_ns = 2000000;
+  int max_idle_epochs = 10;
+  uint32_t queue_size = 2048;   // packets; more are dropped
+  std::string split_policy = "greedy";
+  ShardRebalancerOptions rebalancer;
+
+  // Either may be nullptr or empty; the defaults are NFVRuntime's
+  const NFPerfModel *long_term_model = nullptr;
+  const NFPerfModel *short_term_model = nullptr;
+  uint32_t pkt_size = 0;
+};
+
+struct IronsideSimResult {
+  uint64_t sim_ns = 0;
+  uint64_t short_epochs = 0;
+  uint64_t long_epochs = 0;
+
+  // Normal cores with shards in the RETA, sampled every short epoch
+  double avg_cores = 0;
+  uint16_t max_cores = 0;
+  // Software queues (rcores) in use, sampled every short epoch
+  double avg_queues = 0;
+  uint32_t max_queues = 0;
+
+  // Normal core-epochs in which the core or one of its software queues got
+  // more packets than it can process within the epoch
+  uint64_t slo_violation_epochs = 0;
+  uint64_t offered_packets = 0;
+  // Packets left queued at the end of an epoch, summed over epochs
+  uint64_t overloaded_packets = 0;
+  uint64_t offloaded_packets = 0;
+  uint64_t boosted_packets = 0;
+  uint64_t dropped_packets = 0;
+
+  uint64_t moves = 0;        // shard moves
+  uint64_t rss_updates = 0;  // RETA updates with at least one move
+  double moves_per_sec = 0;
+};
+
+// Returns an empty result if |config| or |trace| is invalid (e.g., an
+// unknown split policy).
+IronsideSimResult RunIronsideSim(const IronsideSimConfig &config,
+                                 const ShardRateTrace &trace);
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_IRONSIDE_SIMULATOR_H_
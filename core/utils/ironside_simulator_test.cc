@@ -0,0 +1,212 @@
+#include "ironside_simulator.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include "pcap.h"
+
+using bess::utils::IronsideSimConfig;
+using bess::utils::IronsideSimResult;
+using bess::utils::NFPerfModel;
+using bess::utils::ShardRateTrace;
+
+namespace {
+
+const uint16_t kShards = 64;
+
+// |steps|: (time in ms, packets per second of every shard)
+ShardRateTrace MakeTrace(const std::vector<std::pair<uint64_t, uint64_t>> &steps,
+                         uint64_t end_ms) {
+  ShardRateTrace trace;
+  for (const auto &step : steps) {
+    trace.samples.push_back({step.first * 1000000,
+                             std::vector<uint64_t>(kShards, step.second),
+                             std::vector<uint64_t>(kShards, 10)});
+  }
+  trace.end_ns = end_ms * 1000000;
+  return trace;
+}
+
+class IronsideSimTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // A core sustains 1 Mpps, i.e., 1000 packets per 1-ms epoch
+    long_model_.AddProfile(0, {{0, 1000000}, {10000, 1000000}});
+    long_model_.Build();
+    short_model_.AddProfile(0, {{0, 1000}, {10000, 1000}});
+    short_model_.Build();
+    config_.long_term_model = &long_model_;
+    config_.short_term_model = &short_model_;
+  }
+
+  NFPerfModel long_model_;
+  NFPerfModel short_model_;
+  IronsideSimConfig config_;
+};
+
+TEST_F(IronsideSimTest, InvalidInput) {
+  ShardRateTrace trace = MakeTrace({{0, 1000}}, 100);
+  config_.split_policy = "nonexistent";
+  EXPECT_EQ(0, bess::utils::RunIronsideSim(config_, trace).short_epochs);
+
+  config_.split_policy = "greedy";
+  EXPECT_EQ(0, bess::utils::RunIronsideSim(config_, ShardRateTrace()).short_epochs);
+  trace.samples[0].pkt_rate.pop_back();
+  EXPECT_EQ(0, bess::utils::RunIronsideSim(config_, trace).short_epochs);
+}
+
+TEST_F(IronsideSimTest, LightLoad) {
+  // 320 Kpps in total
+  ShardRateTrace trace = MakeTrace({{0, 5000}}, 2000);
+  IronsideSimResult r = bess::utils::RunIronsideSim(config_, trace);
+
+  EXPECT_EQ(2000000000, r.sim_ns);
+  EXPECT_EQ(2000, r.short_epochs);
+  EXPECT_EQ(4, r.long_epochs);
+  EXPECT_NEAR(640000, r.offered_packets, 1);
+  EXPECT_EQ(0, r.slo_violation_epochs);
+  EXPECT_EQ(0, r.dropped_packets);
+  EXPECT_EQ(0, r.max_queues);
+  EXPECT_LE(r.max_cores, 2);
+  EXPECT_GE(r.avg_cores, 1);
+}
+
+TEST_F(IronsideSimTest, ScaleOut) {
+  // 320 Kpps, and then 3.84 and 5.76 Mpps
+  ShardRateTrace trace = MakeTrace({{0, 5000}, {200, 60000}, {300, 90000}}, 3000);
+  IronsideSimResult r = bess::utils::RunIronsideSim(config_, trace);
+
+  // Rcores absorb some of the burst until the RETA is updated
+  EXPECT_GT(r.offloaded_packets, 0);
+  EXPECT_GT(r.slo_violation_epochs, 0);
+  EXPECT_GT(r.moves, 0);
+  EXPECT_GT(r.rss_updates, 0);
+  EXPECT_NEAR(r.moves / 3.0, r.moves_per_sec, 1e-6);
+  EXPECT_GE(r.max_cores, 4);
+  EXPECT_LE(r.max_cores, config_.num_cores);
+  EXPECT_LE(r.max_queues, config_.num_rcores);
+
+  // Deterministic
+  IronsideSimResult again = bess::utils::RunIronsideSim(config_, trace);
+  EXPECT_EQ(r.slo_violation_epochs, again.slo_violation_epochs);
+  EXPECT_EQ(r.moves, again.moves);
+  EXPECT_EQ(r.offloaded_packets, again.offloaded_packets);
+  EXPECT_EQ(r.avg_cores, again.avg_cores);
+
+  // The NIC's RETA update latency matters
+  config_.rss_update_delay_ns = 300000000;
+  IronsideSimResult slow = bess::utils::RunIronsideSim(config_, trace);
+  EXPECT_GT(slow.slo_violation_epochs, r.slo_violation_epochs);
+}
+
+TEST_F(IronsideSimTest, NoRCores) {
+  ShardRateTrace trace = MakeTrace({{0, 60000}}, 200);
+  config_.num_rcores = 0;
+  IronsideSimResult r = bess::utils::RunIronsideSim(config_, trace);
+  EXPECT_EQ(0, r.offloaded_packets);
+  EXPECT_GT(r.dropped_packets, 0);
+  EXPECT_EQ(0, r.max_queues);
+}
+
+TEST(IronsideTraceTest, LoadShardRateTrace) {
+  char path[] = "/tmp/shard_trace_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    std::ofstream f(path);
+    f << "# ts_ms shard:pkt_rate[:flow_count]\n0 0:1000:5 3:20\n\n100.5 1:7\n";
+  }
+
+  ShardRateTrace trace;
+  ASSERT_TRUE(bess::utils::LoadShardRateTrace(path, 4, &trace));
+  ASSERT_EQ(2, trace.samples.size());
+  EXPECT_EQ(0, trace.samples[0].ts_ns);
+  EXPECT_EQ((std::vector<uint64_t>{1000, 0, 0, 20}), trace.samples[0].pkt_rate);
+  EXPECT_EQ((std::vector<uint64_t>{5, 0, 0, 1}), trace.samples[0].flow_count);
+  EXPECT_EQ(100500000, trace.samples[1].ts_ns);
+  EXPECT_EQ(201000000, trace.end_ns);
+
+  {
+    std::ofstream f(path);
+    f << "0 4:1000\n";
+  }
+  trace = ShardRateTrace();
+  EXPECT_FALSE(bess::utils::LoadShardRateTrace(path, 4, &trace));
+  {
+    std::ofstream f(path);
+    f << "10 0:1\n5 0:1\n";
+  }
+  trace = ShardRateTrace();
+  EXPECT_FALSE(bess::utils::LoadShardRateTrace(path, 4, &trace));
+  std::remove(path);
+
+  EXPECT_FALSE(bess::utils::LoadShardRateTrace("/nonexistent/trace", 4, &trace));
+}
+
+TEST(IronsideTraceTest, LoadPcapShardTrace) {
+  char path[] = "/tmp/shard_pcap_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    std::ofstream f(path, std::ios::binary);
+    pcap_hdr hdr = {PCAP_MAGIC_NUMBER, PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR,
+                    PCAP_THISZONE,     PCAP_SIGFIGS,       PCAP_SNAPLEN,
+                    PCAP_NETWORK};
+    f.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+
+    // Ethernet + IPv4 + UDP ports; |sport| tells the flows apart
+    auto write_pkt = [&f](uint32_t usec, uint8_t sport) {
+      uint8_t pkt[38] = {};
+      pkt[12] = 0x08;
+      pkt[14] = 0x45;
+      pkt[23] = 17;
+      pkt[26] = 10;
+      pkt[30] = 10;
+      pkt[35] = sport;
+      pkt[37] = 80;
+      pcap_rec_hdr rec = {1, usec, sizeof(pkt), sizeof(pkt)};
+      f.write(reinterpret_cast<const char *>(&rec), sizeof(rec));
+      f.write(reinterpret_cast<const char *>(pkt), sizeof(pkt));
+    };
+    // Bin 0: 3 packets of 2 flows; bin 1: none; bin 2: 1 packet
+    write_pkt(0, 1);
+    write_pkt(100, 1);
+    write_pkt(900, 2);
+    write_pkt(2500, 1);
+  }
+
+  ShardRateTrace trace;
+  ASSERT_TRUE(bess::utils::LoadPcapShardTrace(path, 1, 1000000, &trace));
+  ASSERT_EQ(3, trace.samples.size());
+  EXPECT_EQ(0, trace.samples[0].ts_ns);
+  EXPECT_EQ(3000, trace.samples[0].pkt_rate[0]);
+  EXPECT_EQ(2, trace.samples[0].flow_count[0]);
+  EXPECT_EQ(1000000, trace.samples[1].ts_ns);
+  EXPECT_EQ(0, trace.samples[1].pkt_rate[0]);
+  EXPECT_EQ(1000, trace.samples[2].pkt_rate[0]);
+  EXPECT_EQ(3000000, trace.end_ns);
+
+  // Flows are spread over shards
+  trace = ShardRateTrace();
+  ASSERT_TRUE(bess::utils::LoadPcapShardTrace(path, 64, 1000000, &trace));
+  uint64_t total = 0;
+  for (uint64_t rate : trace.samples[0].pkt_rate) {
+    total += rate;
+  }
+  EXPECT_EQ(3000, total);
+
+  {
+    std::ofstream f(path);
+    f << "not a pcap file";
+  }
+  EXPECT_FALSE(bess::utils::LoadPcapShardTrace(path, 64, 1000000, &trace));
+  std::remove(path);
+}
+
+}  // namespace (unnamed)
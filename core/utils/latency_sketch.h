@@ -0,0 +1,149 @@
+#ifndef BESS_UTILS_LATENCY_SKETCH_H_
+#define BESS_UTILS_LATENCY_SKETCH_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace bess {
+namespace utils {
+
+// A fixed-size, allocation-free quantile sketch for latencies (in ns), in
+// the style of an HDR histogram. Values below 2^kSubBucketBits are counted
+// exactly; larger values fall into log-spaced groups (one per power of two),
+// each split into 2^kSubBucketBits linear sub-buckets. A quantile is thus
+// within 1 / 2^kSubBucketBits (1.6%) of the true value. Values at or above
+// 2^kMaxBits (~18 min) are clamped.
+//
+// Add() is O(1). Quantile() walks at most one group array and one group's
+// sub-buckets, so it is O(1) regardless of the number of samples.
+// Sketches with the same parameters can be merged, e.g., to fold a
+// per-epoch sketch into a long-running one before resetting it.
+//
+// Example usage:
+//
+//  LatencySketch epoch;
+//  epoch.Add(pkt_delay_ns);
+//  uint64_t p99 = epoch.Quantile(0.99);
+//  total.Merge(epoch);
+//  epoch.Reset();
+class LatencySketch {
+ public:
+  static constexpr int kSubBucketBits = 6;
+  static constexpr int kMaxBits = 40;
+  static constexpr uint64_t kSubBuckets = 1ULL << kSubBucketBits;
+  // Group 0 holds exact values; group g > 0 holds [2^(g+5), 2^(g+6))
+  static constexpr int kGroups = kMaxBits - kSubBucketBits + 1;
+  static constexpr int kBuckets = kGroups * kSubBuckets;
+  static constexpr uint64_t kMaxValue = (1ULL << kMaxBits) - 1;
+
+  LatencySketch() {
+    memset(buckets_, 0, sizeof(buckets_));
+    memset(groups_, 0, sizeof(groups_));
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+  }
+
+  void Add(uint64_t value) {
+    value = std::min(value, kMaxValue);
+    int idx = BucketOf(value);
+    buckets_[idx]++;
+    groups_[idx >> kSubBucketBits]++;
+    count_++;
+    sum_ += value;
+    max_ = std::max(max_, value);
+  }
+
+  void Merge(const LatencySketch &other) {
+    for (int g = 0; g < kGroups; g++) {
+      if (other.groups_[g] == 0) {
+        continue;
+      }
+      groups_[g] += other.groups_[g];
+      for (uint64_t i = g * kSubBuckets; i < (g + 1) * kSubBuckets; i++) {
+        buckets_[i] += other.buckets_[i];
+      }
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  // Only clears the groups that have samples, so resetting a sketch with
+  // a narrow latency range is cheap.
+  void Reset() {
+    for (int g = 0; g < kGroups; g++) {
+      if (groups_[g] != 0) {
+        memset(&buckets_[g * kSubBuckets], 0,
+               sizeof(buckets_[0]) * kSubBuckets);
+        groups_[g] = 0;
+      }
+    }
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+  }
+
+  // Returns the smallest value v such that at least |q| of all samples are
+  // <= v (up to the bucket resolution), for |q| in [0, 1]. 0 if empty.
+  uint64_t Quantile(double q) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    q = std::min(std::max(q, 0.0), 1.0);
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(q * count_));
+
+    uint64_t seen = 0;
+    int g = 0;
+    while (seen + groups_[g] < rank) {
+      seen += groups_[g];
+      g++;
+    }
+    uint64_t i = g * kSubBuckets;
+    while (seen + buckets_[i] < rank) {
+      seen += buckets_[i];
+      i++;
+    }
+    // Never report more than the largest sample
+    return std::min(ValueOf(i), max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  uint64_t mean() const { return count_ ? sum_ / count_ : 0; }
+
+ private:
+  static int BucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kSubBucketBits;
+    // The top kSubBucketBits + 1 bits of |value|, without the leading one
+    uint64_t sub = (value >> shift) - kSubBuckets;
+    return (shift + 1) * kSubBuckets + sub;
+  }
+
+  // Returns the midpoint of bucket |idx|
+  static uint64_t ValueOf(uint64_t idx) {
+    if (idx < kSubBuckets) {
+      return idx;
+    }
+    int shift = (idx >> kSubBucketBits) - 1;
+    uint64_t lower = (kSubBuckets + (idx & (kSubBuckets - 1))) << shift;
+    return lower + ((1ULL << shift) >> 1);
+  }
+
+  uint64_t buckets_[kBuckets];
+  uint64_t groups_[kGroups];
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t max_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_LATENCY_SKETCH_H_
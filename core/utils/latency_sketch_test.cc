@@ -0,0 +1,84 @@
+#include "latency_sketch.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using bess::utils::LatencySketch;
+
+namespace {
+
+TEST(LatencySketchTest, Empty) {
+  LatencySketch s;
+  EXPECT_EQ(0, s.count());
+  EXPECT_EQ(0, s.Quantile(0.5));
+  EXPECT_EQ(0, s.mean());
+}
+
+TEST(LatencySketchTest, SmallValuesAreExact) {
+  LatencySketch s;
+  for (uint64_t i = 1; i <= 50; i++) {
+    s.Add(i);
+  }
+  EXPECT_EQ(25, s.Quantile(0.5));
+  EXPECT_EQ(50, s.Quantile(0.99));
+  EXPECT_EQ(1, s.Quantile(0));
+  EXPECT_EQ(50, s.max());
+}
+
+TEST(LatencySketchTest, RelativeError) {
+  std::mt19937_64 rng(1);
+  std::lognormal_distribution<double> dist(11, 1.5);  // ~60 us median
+  std::vector<uint64_t> samples;
+  LatencySketch s;
+  for (int i = 0; i < 100000; i++) {
+    uint64_t v = dist(rng);
+    samples.push_back(v);
+    s.Add(v);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    uint64_t truth = samples[size_t(q * samples.size()) - 1];
+    double err = std::abs(double(s.Quantile(q)) - truth) / truth;
+    EXPECT_LT(err, 1.0 / LatencySketch::kSubBuckets) << q;
+  }
+  EXPECT_EQ(samples.back(), s.max());
+  EXPECT_EQ(samples.back(), s.Quantile(1));
+}
+
+TEST(LatencySketchTest, Clamped) {
+  LatencySketch s;
+  s.Add(UINT64_MAX);
+  EXPECT_EQ(LatencySketch::kMaxValue, s.max());
+  EXPECT_GE(s.Quantile(0.5),
+            LatencySketch::kMaxValue - LatencySketch::kMaxValue / 64);
+}
+
+TEST(LatencySketchTest, MergeAndReset) {
+  LatencySketch total;
+  LatencySketch epoch;
+  for (uint64_t i = 0; i < 1000; i++) {
+    epoch.Add(1000);
+  }
+  total.Merge(epoch);
+  epoch.Reset();
+  EXPECT_EQ(0, epoch.count());
+  EXPECT_EQ(0, epoch.Quantile(0.99));
+
+  for (uint64_t i = 0; i < 1000; i++) {
+    epoch.Add(100000);
+  }
+  EXPECT_NEAR(100000, epoch.Quantile(0.5), 100000 / 64);
+  total.Merge(epoch);
+
+  EXPECT_EQ(2000, total.count());
+  EXPECT_NEAR(1000, total.Quantile(0.5), 1000 / 64);
+  EXPECT_NEAR(100000, total.Quantile(0.99), 100000 / 64);
+  EXPECT_EQ(50500, total.mean());
+  EXPECT_EQ(100000, total.max());
+}
+
+}  // namespace (unnamed)
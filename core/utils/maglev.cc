@@ -0,0 +1,74 @@
+#include "maglev.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+// MurmurHash3's 64-bit finalizer
+inline uint64_t Mix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+}  // namespace
+
+bool MaglevTable::Build(const std::vector<uint64_t> &ids,
+                        const std::vector<uint32_t> &weights) {
+  DCHECK_EQ(ids.size(), weights.size());
+  DCHECK_LT(ids.size(), kNoBackend);
+  table_.clear();
+
+  size_t n = ids.size();
+  uint32_t max_weight = 0;
+  for (uint32_t w : weights) {
+    max_weight = std::max(max_weight, w);
+  }
+  if (max_weight == 0) {
+    return false;
+  }
+
+  // Backend |i| prefers slots offset[i] + j * skip[i] (mod size_), j = 0, 1..
+  std::vector<uint32_t> offset(n);
+  std::vector<uint32_t> skip(n);
+  std::vector<uint32_t> next(n, 0);
+  std::vector<uint64_t> claimed(n, 0);
+  for (size_t i = 0; i < n; i++) {
+    offset[i] = Mix(ids[i]) % size_;
+    skip[i] = Mix(ids[i] ^ 0x9e3779b97f4a7c15ULL) % (size_ - 1) + 1;
+  }
+
+  std::vector<uint16_t> table(size_, kNoBackend);
+  uint32_t filled = 0;
+  for (uint64_t round = 1; filled < size_; round++) {
+    for (size_t i = 0; i < n && filled < size_; i++) {
+      // A backend claims (at most) one slot per round, until it has
+      // claimed round * weight / max_weight slots
+      if (claimed[i] * max_weight >= round * weights[i]) {
+        continue;
+      }
+      uint32_t slot;
+      do {
+        slot = (offset[i] + uint64_t(next[i]) * skip[i]) % size_;
+        next[i]++;
+      } while (table[slot] != kNoBackend);
+      table[slot] = i;
+      claimed[i]++;
+      filled++;
+    }
+  }
+
+  table_.swap(table);
+  return true;
+}
+
+}  // namespace utils
+}  // namespace bess
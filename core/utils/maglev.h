@@ -0,0 +1,82 @@
+#ifndef BESS_UTILS_MAGLEV_H_
+#define BESS_UTILS_MAGLEV_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A weighted Maglev lookup table for consistent hashing over a small set of
+// backends (e.g., workers in the cluster).
+//
+// Each backend has a pseudo-random preference order over all slots, derived
+// from its stable |id| only. Backends take turns to claim their next
+// preferred free slot, in proportion to their weights, until the table is
+// full. As a result, every backend owns ~(weight / total weight) of the
+// slots, and adding, removing or re-weighting one backend only remaps
+// slots from / to that backend (plus a small fraction of others).
+//
+// LookupBounded() implements consistent hashing with bounded loads: if the
+// slot's backend is full, the next slots are tried in order, so the excess
+// spills over to other backends deterministically.
+//
+// Example usage:
+//
+//  MaglevTable table;
+//  table.Build({mac_hash0, mac_hash1}, {2, 1});
+//  uint16_t b = table.Lookup(flow_hash);
+//  b = table.LookupBounded(flow_hash, [&](uint16_t b) { return load[b] > 9; });
+class MaglevTable {
+ public:
+  // Must be a prime; much larger than the # of backends
+  static constexpr uint32_t kDefaultSize = 65537;
+  static constexpr uint16_t kNoBackend = UINT16_MAX;
+
+  explicit MaglevTable(uint32_t size = kDefaultSize) : size_(size) {}
+
+  // Re-populates the table. Backends are indexed by their position in |ids|.
+  // A backend with weight 0 owns no slots. Returns false (and leaves the
+  // table empty) if no backend has a positive weight.
+  bool Build(const std::vector<uint64_t> &ids,
+             const std::vector<uint32_t> &weights);
+
+  // Returns the backend of |hash|, or kNoBackend if the table is empty.
+  uint16_t Lookup(uint64_t hash) const {
+    return table_.empty() ? kNoBackend : table_[hash % size_];
+  }
+
+  // Returns the first backend (starting from the slot of |hash|) for which
+  // |is_full| returns false. Falls back to Lookup() if all are full.
+  template <typename Fn>
+  uint16_t LookupBounded(uint64_t hash, Fn is_full) const {
+    if (table_.empty()) {
+      return kNoBackend;
+    }
+    uint32_t slot = hash % size_;
+    uint16_t prev = kNoBackend;
+    for (uint32_t i = 0; i < size_; i++) {
+      uint16_t b = table_[slot];
+      // Adjacent slots often have the same backend
+      if (b != prev && !is_full(b)) {
+        return b;
+      }
+      prev = b;
+      slot = (slot + 1 == size_) ? 0 : slot + 1;
+    }
+    return table_[hash % size_];
+  }
+
+  uint32_t size() const { return size_; }
+  bool empty() const { return table_.empty(); }
+  const std::vector<uint16_t> &table() const { return table_; }
+
+ private:
+  uint32_t size_;
+  std::vector<uint16_t> table_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_MAGLEV_H_
@@ -0,0 +1,82 @@
+#include "maglev.h"
+
+#include <gtest/gtest.h>
+
+using bess::utils::MaglevTable;
+
+namespace {
+
+std::vector<uint32_t> CountSlots(const MaglevTable &t, size_t n) {
+  std::vector<uint32_t> cnts(n, 0);
+  for (uint16_t b : t.table()) {
+    cnts[b]++;
+  }
+  return cnts;
+}
+
+TEST(MaglevTest, Empty) {
+  MaglevTable t;
+  EXPECT_FALSE(t.Build({1, 2}, {0, 0}));
+  EXPECT_TRUE(t.empty());
+  EXPECT_EQ(MaglevTable::kNoBackend, t.Lookup(42));
+}
+
+TEST(MaglevTest, Weights) {
+  MaglevTable t;
+  ASSERT_TRUE(t.Build({11, 22, 33, 44}, {1, 1, 2, 0}));
+  std::vector<uint32_t> cnts = CountSlots(t, 4);
+  EXPECT_NEAR(t.size() / 4, cnts[0], t.size() / 100);
+  EXPECT_NEAR(t.size() / 4, cnts[1], t.size() / 100);
+  EXPECT_NEAR(t.size() / 2, cnts[2], t.size() / 100);
+  EXPECT_EQ(0, cnts[3]);
+}
+
+TEST(MaglevTest, MinimalDisruption) {
+  MaglevTable before;
+  MaglevTable after;
+  ASSERT_TRUE(before.Build({11, 22, 33, 44, 55}, {1, 1, 1, 1, 1}));
+  // Backend 4 leaves
+  ASSERT_TRUE(after.Build({11, 22, 33, 44, 55}, {1, 1, 1, 1, 0}));
+
+  uint32_t moved = 0;
+  for (uint32_t i = 0; i < before.size(); i++) {
+    if (before.table()[i] == 4) {
+      EXPECT_NE(4, after.table()[i]);
+    } else if (before.table()[i] != after.table()[i]) {
+      moved++;
+    }
+  }
+  // Slots of remaining backends rarely move
+  EXPECT_LT(moved, before.size() / 20);
+
+  // ... and it comes back
+  MaglevTable again;
+  ASSERT_TRUE(again.Build({11, 22, 33, 44, 55}, {1, 1, 1, 1, 1}));
+  EXPECT_EQ(before.table(), again.table());
+}
+
+TEST(MaglevTest, BoundedLoads) {
+  MaglevTable t(251);
+  ASSERT_TRUE(t.Build({11, 22, 33}, {1, 1, 1}));
+
+  // Without bounds, lookups follow the table
+  for (uint64_t h = 0; h < 1000; h++) {
+    EXPECT_EQ(t.Lookup(h), t.LookupBounded(h, [](uint16_t) { return false; }));
+  }
+
+  std::vector<uint32_t> loads(3, 0);
+  const uint32_t kBound = 400;
+  for (uint64_t h = 0; h < 1200; h++) {
+    // Pretend that all flows hash to one slot
+    uint16_t b = t.LookupBounded(7, [&](uint16_t w) {
+      return loads[w] >= kBound;
+    });
+    loads[b]++;
+  }
+  EXPECT_EQ(std::vector<uint32_t>({kBound, kBound, kBound}), loads);
+
+  // All full: use the table
+  EXPECT_EQ(t.Lookup(7), t.LookupBounded(7, [](uint16_t) { return true; }));
+}
+
+}  // namespace (unnamed)
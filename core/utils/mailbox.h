@@ -0,0 +1,163 @@
+#ifndef BESS_UTILS_MAILBOX_H_
+#define BESS_UTILS_MAILBOX_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bess {
+namespace utils {
+
+// A bounded single-producer single-consumer ring of small records (e.g.,
+// control messages). The producer's and the consumer's indices are on
+// separate cache lines, and each side caches the other side's index.
+template <typename T, uint32_t kSlots = 16>
+class SpscRing {
+  static_assert((kSlots & (kSlots - 1)) == 0, "kSlots must be a power of 2");
+
+ public:
+  SpscRing() : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {}
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  // Producer. Returns the number of records pushed.
+  uint32_t PushBatch(const T *recs, uint32_t n) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ + n > kSlots) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+    }
+    uint32_t room = kSlots - (tail - cached_head_);
+    n = n < room ? n : room;
+    for (uint32_t i = 0; i < n; i++) {
+      slots_[(tail + i) & (kSlots - 1)] = recs[i];
+    }
+    tail_.store(tail + n, std::memory_order_release);
+    return n;
+  }
+  bool Push(const T &rec) { return PushBatch(&rec, 1) == 1; }
+
+  // Consumer. Returns the number of records popped.
+  uint32_t PopBatch(T *recs, uint32_t n) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < n) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    }
+    uint32_t avail = cached_tail_ - head;
+    n = n < avail ? n : avail;
+    for (uint32_t i = 0; i < n; i++) {
+      recs[i] = slots_[(head + i) & (kSlots - 1)];
+    }
+    head_.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+  // May be stale when the other side is running
+  bool Empty() const {
+    return tail_.load(std::memory_order_acquire) ==
+           head_.load(std::memory_order_acquire);
+  }
+
+ private:
+  // Consumer
+  alignas(64) std::atomic<uint32_t> head_;
+  uint32_t cached_tail_;
+  // Producer
+  alignas(64) std::atomic<uint32_t> tail_;
+  uint32_t cached_head_;
+
+  alignas(64) T slots_[kSlots];
+};
+
+// A per-receiver mailbox with one SPSC lane per sender. Each lane carries
+// commands (sender -> receiver) and completions (receiver -> sender).
+//
+// A sender rings a shared doorbell bit after posting, so that the receiver
+// checks a single word per poll, and then only drains the lanes that have
+// commands. The receiver handles commands in batches, in order per lane.
+//
+// Example usage:
+//
+//  Mailbox<Msg, 8> mb;
+//  mb.Post(3, Msg{kStop});                      // sender on lane 3
+//  mb.Poll([&](uint32_t lane, const Msg &m) {   // receiver
+//    mb.Complete(lane, m);
+//  });
+//  Msg done;
+//  while (mb.PollDone(3, &done, 1) == 0) {}     // sender on lane 3
+template <typename T, uint32_t kLanes, uint32_t kSlots = 16>
+class Mailbox {
+  static_assert(kLanes <= 64, "one doorbell bit per lane");
+
+ public:
+  Mailbox() : doorbell_(0) {}
+
+  Mailbox(const Mailbox &) = delete;
+  Mailbox &operator=(const Mailbox &) = delete;
+
+  /// Sender of |lane|.
+  // Returns false if the lane is full.
+  bool Post(uint32_t lane, const T &cmd) {
+    if (!lanes_[lane].cmd.Push(cmd)) {
+      return false;
+    }
+    doorbell_.fetch_or(1ULL << lane, std::memory_order_release);
+    return true;
+  }
+
+  // Pops up to |n| completions of |lane|. Returns the number popped.
+  uint32_t PollDone(uint32_t lane, T *done, uint32_t n) {
+    return lanes_[lane].done.PopBatch(done, n);
+  }
+
+  /// Receiver.
+  // Cheap enough to check in every round of a datapath loop
+  bool Pending() const {
+    return doorbell_.load(std::memory_order_relaxed) != 0;
+  }
+
+  // Calls |fn(lane, cmd)| for all posted commands. Returns the number of
+  // commands handled.
+  template <typename Fn>
+  uint32_t Poll(Fn fn) {
+    if (!Pending()) {
+      return 0;
+    }
+    // A bit set after the exchange is seen in the next poll
+    uint64_t bits = doorbell_.exchange(0, std::memory_order_acquire);
+    uint32_t handled = 0;
+    while (bits) {
+      uint32_t lane = __builtin_ctzll(bits);
+      bits &= bits - 1;
+
+      T cmds[kSlots];
+      uint32_t cnt;
+      while ((cnt = lanes_[lane].cmd.PopBatch(cmds, kSlots)) > 0) {
+        for (uint32_t i = 0; i < cnt; i++) {
+          fn(lane, cmds[i]);
+        }
+        handled += cnt;
+      }
+    }
+    return handled;
+  }
+
+  // Returns false if the lane's completions are full.
+  bool Complete(uint32_t lane, const T &done) {
+    return lanes_[lane].done.Push(done);
+  }
+
+ private:
+  struct Lane {
+    SpscRing<T, kSlots> cmd;
+    SpscRing<T, kSlots> done;
+  };
+
+  alignas(64) std::atomic<uint64_t> doorbell_;
+  Lane lanes_[kLanes];
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_MAILBOX_H_
@@ -0,0 +1,111 @@
+#include "mailbox.h"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using bess::utils::Mailbox;
+using bess::utils::SpscRing;
+
+namespace {
+
+struct Msg {
+  uint32_t type;
+  uint32_t val;
+};
+
+TEST(SpscRingTest, PushPop) {
+  SpscRing<uint32_t, 8> r;
+  EXPECT_TRUE(r.Empty());
+
+  uint32_t in[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  uint32_t out[10];
+  EXPECT_EQ(8, r.PushBatch(in, 10));
+  EXPECT_FALSE(r.Push(42));
+  EXPECT_EQ(3, r.PopBatch(out, 3));
+  EXPECT_EQ(2, out[2]);
+  EXPECT_EQ(2, r.PushBatch(in + 8, 2));
+  EXPECT_EQ(7, r.PopBatch(out, 10));
+  EXPECT_EQ(3, out[0]);
+  EXPECT_EQ(9, out[6]);
+  EXPECT_TRUE(r.Empty());
+}
+
+TEST(MailboxTest, LanesAndCompletions) {
+  Mailbox<Msg, 4, 4> mb;
+  EXPECT_FALSE(mb.Pending());
+  EXPECT_EQ(0, mb.Poll([](uint32_t, const Msg &) { FAIL(); }));
+
+  EXPECT_TRUE(mb.Post(3, {1, 30}));
+  EXPECT_TRUE(mb.Post(1, {1, 10}));
+  EXPECT_TRUE(mb.Post(3, {2, 31}));
+  EXPECT_TRUE(mb.Pending());
+
+  std::vector<std::pair<uint32_t, uint32_t>> seen;
+  EXPECT_EQ(3, mb.Poll([&](uint32_t lane, const Msg &m) {
+    seen.emplace_back(lane, m.val);
+    mb.Complete(lane, m);
+  }));
+  // Lanes in order of their index; in order within a lane
+  EXPECT_EQ((std::vector<std::pair<uint32_t, uint32_t>>{{1, 10}, {3, 30}, {3, 31}}),
+            seen);
+  EXPECT_FALSE(mb.Pending());
+
+  Msg done[4];
+  EXPECT_EQ(0, mb.PollDone(0, done, 4));
+  EXPECT_EQ(2, mb.PollDone(3, done, 4));
+  EXPECT_EQ(31, done[1].val);
+
+  // A full lane does not block other lanes
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(mb.Post(2, {0, i}));
+  }
+  EXPECT_FALSE(mb.Post(2, {0, 4}));
+  EXPECT_TRUE(mb.Post(0, {0, 0}));
+  EXPECT_EQ(5, mb.Poll([](uint32_t, const Msg &) {}));
+}
+
+// Each sender gets exactly its own completions back
+TEST(MailboxTest, ManySenders) {
+  const uint32_t kSenders = 3;
+  const uint32_t kPerSender = 2000;
+  Mailbox<Msg, kSenders> mb;
+
+  std::vector<std::thread> senders;
+  for (uint32_t s = 0; s < kSenders; s++) {
+    senders.emplace_back([&mb, s, kPerSender]() {
+      uint32_t posted = 0;
+      uint32_t done_cnt = 0;
+      while (done_cnt < kPerSender) {
+        if (posted < kPerSender && mb.Post(s, {s, posted})) {
+          posted++;
+        }
+        Msg done[16];
+        uint32_t cnt = mb.PollDone(s, done, 16);
+        for (uint32_t i = 0; i < cnt; i++) {
+          ASSERT_EQ(s, done[i].type);
+          ASSERT_EQ(done_cnt++, done[i].val);
+        }
+      }
+    });
+  }
+
+  uint32_t total = 0;
+  std::vector<uint32_t> next(kSenders, 0);
+  while (total < kSenders * kPerSender) {
+    total += mb.Poll([&](uint32_t lane, const Msg &m) {
+      ASSERT_EQ(lane, m.type);
+      ASSERT_EQ(next[lane]++, m.val);
+      // The sender drains its completions as fast as it posts
+      while (!mb.Complete(lane, m)) {
+      }
+    });
+  }
+  for (auto &t : senders) {
+    t.join();
+  }
+  EXPECT_FALSE(mb.Pending());
+}
+
+}  // namespace (unnamed)
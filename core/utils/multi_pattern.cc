@@ -0,0 +1,191 @@
+#include "multi_pattern.h"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+
+namespace bess {
+namespace utils {
+
+void MultiPatternMatcher::Clear() {
+  pattern_count_ = 0;
+  min_len_ = 0;
+  state_count_ = 1;
+  class_count_ = 1;
+  accept_base_ = 1;
+  memset(byte_class_, 0, sizeof(byte_class_));
+  delta_.assign(1, kRootState);
+  out_begin_.assign(1, 0);
+  out_ids_.clear();
+  fp_len_ = 0;
+  memset(lo_mask_, 0, sizeof(lo_mask_));
+  memset(hi_mask_, 0, sizeof(hi_mask_));
+}
+
+bool MultiPatternMatcher::Build(const std::vector<std::string> &patterns,
+                                bool prefilter) {
+  Clear();
+
+  // Bytes that appear in no pattern all lead back to the root
+  size_t total_len = 0;
+  size_t classes = 1;
+  for (const std::string &pattern : patterns) {
+    for (unsigned char c : pattern) {
+      if (byte_class_[c] == 0) {
+        byte_class_[c] = classes++;
+      }
+    }
+    total_len += pattern.size();
+  }
+  if (total_len + 1 > kMaxStates) {
+    Clear();
+    return false;
+  }
+
+  // The trie. |go| is -1 where there is no edge.
+  const size_t C = classes;
+  std::vector<int32_t> go(C, -1);
+  std::vector<std::vector<uint32_t>> outs(1);
+  size_t min_len = SIZE_MAX;
+  size_t count = 0;
+  for (size_t i = 0; i < patterns.size(); i++) {
+    const std::string &pattern = patterns[i];
+    if (pattern.empty()) {
+      continue;
+    }
+    int32_t s = 0;
+    for (unsigned char c : pattern) {
+      int32_t &next = go[s * C + byte_class_[c]];
+      if (next == -1) {
+        next = outs.size();
+        outs.emplace_back();
+        go.resize(go.size() + C, -1);
+      }
+      s = go[s * C + byte_class_[c]];
+    }
+    outs[s].push_back(i);
+    min_len = std::min(min_len, pattern.size());
+    count++;
+  }
+  if (count == 0) {
+    Clear();
+    return true;
+  }
+
+  // Failure links in BFS order turn the trie into a DFA. A state's failure
+  // state is shallower, so its row and matches are final by then.
+  const size_t n = outs.size();
+  std::vector<int32_t> fail(n, 0);
+  std::vector<int32_t> order;
+  order.reserve(n);
+  std::queue<int32_t> q;
+  q.push(0);
+  while (!q.empty()) {
+    int32_t s = q.front();
+    q.pop();
+    order.push_back(s);
+    for (size_t c = 0; c < C; c++) {
+      int32_t &t = go[s * C + c];
+      if (t == -1) {
+        t = (s == 0) ? 0 : go[fail[s] * C + c];
+        continue;
+      }
+      fail[t] = (s == 0) ? 0 : go[fail[s] * C + c];
+      outs[t].insert(outs[t].end(), outs[fail[t]].begin(), outs[fail[t]].end());
+      q.push(t);
+    }
+  }
+
+  // Renumber: non-accepting states first, so that a scan tells accepting
+  // states by a single comparison
+  std::vector<State> id(n);
+  State next_id = 0;
+  for (int32_t s : order) {
+    if (outs[s].empty()) {
+      id[s] = next_id++;
+    }
+  }
+  accept_base_ = next_id;
+  for (int32_t s : order) {
+    if (!outs[s].empty()) {
+      id[s] = next_id++;
+    }
+  }
+
+  delta_.assign(n * C, kRootState);
+  out_begin_.assign(n - accept_base_ + 1, 0);
+  std::vector<int32_t> by_id(n);
+  for (size_t s = 0; s < n; s++) {
+    by_id[id[s]] = s;
+    for (size_t c = 0; c < C; c++) {
+      delta_[id[s] * C + c] = id[go[s * C + c]];
+    }
+  }
+  for (size_t i = accept_base_; i < n; i++) {
+    std::vector<uint32_t> &ids = outs[by_id[i]];
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    out_ids_.insert(out_ids_.end(), ids.begin(), ids.end());
+    out_begin_[i - accept_base_ + 1] = out_ids_.size();
+  }
+
+  pattern_count_ = count;
+  min_len_ = min_len;
+  state_count_ = n;
+  class_count_ = C;
+  if (prefilter) {
+    BuildPrefilter(patterns);
+  }
+  return true;
+}
+
+void MultiPatternMatcher::BuildPrefilter(
+    const std::vector<std::string> &patterns) {
+  int fp_len = std::min<size_t>(kMaxFingerprint, min_len_);
+
+  // Similar fingerprints share a bucket, so that their nibble masks cover
+  // fewer unrelated byte strings
+  std::vector<std::string> fps;
+  for (const std::string &pattern : patterns) {
+    if (!pattern.empty()) {
+      fps.push_back(pattern.substr(0, fp_len));
+    }
+  }
+  std::sort(fps.begin(), fps.end());
+  fps.erase(std::unique(fps.begin(), fps.end()), fps.end());
+
+  for (size_t i = 0; i < fps.size(); i++) {
+    uint8_t bit = 1 << (i * kBuckets / fps.size());
+    for (int j = 0; j < fp_len; j++) {
+      unsigned char c = fps[i][j];
+      lo_mask_[j][c & 0xf] |= bit;
+      hi_mask_[j][c >> 4] |= bit;
+    }
+  }
+
+  // The chance that a random position is a candidate. With too many
+  // patterns, most positions are, and plain DFA steps are faster.
+  double hit = 0;
+  for (int b = 0; b < kBuckets; b++) {
+    double p = 1;
+    for (int j = 0; j < fp_len; j++) {
+      int lo = 0;
+      int hi = 0;
+      for (int k = 0; k < 16; k++) {
+        lo += (lo_mask_[j][k] >> b) & 1;
+        hi += (hi_mask_[j][k] >> b) & 1;
+      }
+      p *= lo * hi / 256.0;
+    }
+    hit += p;
+  }
+  if (hit > 0.25) {
+    memset(lo_mask_, 0, sizeof(lo_mask_));
+    memset(hi_mask_, 0, sizeof(hi_mask_));
+    return;
+  }
+  fp_len_ = fp_len;
+}
+
+}  // namespace utils
+}  // namespace bess
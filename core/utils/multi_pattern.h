@@ -0,0 +1,201 @@
+#ifndef BESS_UTILS_MULTI_PATTERN_H_
+#define BESS_UTILS_MULTI_PATTERN_H_
+
+#include <x86intrin.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// Matches many byte-string patterns at once (e.g., IDS keywords).
+//
+// The patterns are compiled into an Aho-Corasick DFA with 16-bit states and
+// byte classes (bytes that no pattern tells apart share a column), so that
+// a step is one table lookup. While the DFA is at its root, a Teddy-style
+// SIMD prefilter skips ahead to the next position where a pattern can
+// start: the first (up to) 3 bytes of the patterns are spread over 8
+// buckets, and pshufb lookups on the low and high nibbles of 16 (32 with
+// AVX2) input bytes find the candidate positions.
+//
+// A built matcher is read-only, so it can be shared by threads. Scans can
+// be split across buffers by keeping the state between calls.
+//
+// Example usage:
+//
+//  MultiPatternMatcher m;
+//  m.Build({"attack", "exploit"});
+//  MultiPatternMatcher::State s = 0;
+//  m.Scan(buf, len, &s, [](uint32_t pattern, size_t end) {
+//    return false;  // stop at the first match
+//  });
+class MultiPatternMatcher {
+ public:
+  using State = uint16_t;
+
+  static constexpr State kRootState = 0;
+  static constexpr size_t kMaxStates = UINT16_MAX + 1;
+
+  MultiPatternMatcher() { Clear(); }
+
+  // Replaces the patterns. Empty patterns are ignored. Returns false (and
+  // matches nothing) if the DFA would have more than kMaxStates states.
+  bool Build(const std::vector<std::string> &patterns, bool prefilter = true);
+
+  void Clear();
+
+  // Scans |len| bytes from |*state| on, and updates |*state|. Calls
+  // |fn(pattern, end)| for every match, with |end| the offset of the byte
+  // after the match in |data|; |fn| returns false to stop the scan. Returns
+  // the number of bytes scanned.
+  template <typename Fn>
+  size_t Scan(const void *data, size_t len, State *state, Fn fn) const;
+
+  // Returns true if any pattern occurs in |data|.
+  bool Matches(const void *data, size_t len) const {
+    State s = kRootState;
+    bool found = false;
+    Scan(data, len, &s, [&found](uint32_t, size_t) {
+      found = true;
+      return false;
+    });
+    return found;
+  }
+
+  size_t pattern_count() const { return pattern_count_; }
+  size_t min_pattern_len() const { return min_len_; }
+  size_t state_count() const { return state_count_; }
+  size_t class_count() const { return class_count_; }
+  bool has_prefilter() const { return fp_len_ > 0; }
+  bool empty() const { return pattern_count_ == 0; }
+
+ private:
+  static constexpr int kBuckets = 8;
+  static constexpr int kMaxFingerprint = 3;
+
+  State Next(State s, uint8_t c) const {
+    return delta_[s * class_count_ + byte_class_[c]];
+  }
+
+  // Bit i of the result is set if a pattern may start at |p + i|.
+  // Reads kMultiPatternBlock + |fp_len_| - 1 bytes from |p|.
+  uint32_t Candidates(const uint8_t *p) const;
+
+  void BuildPrefilter(const std::vector<std::string> &patterns);
+
+  size_t pattern_count_;
+  size_t min_len_;
+  size_t state_count_;
+  size_t class_count_;
+  // States from |accept_base_| on have matches
+  State accept_base_;
+
+  // Class 0 is for bytes in no pattern. 257 classes if all bytes are used
+  uint16_t byte_class_[256];
+  std::vector<State> delta_;
+  // Matches of accepting state s: out_ids_[out_begin_[s - accept_base_]...
+  // out_begin_[s - accept_base_ + 1])
+  std::vector<uint32_t> out_begin_;
+  std::vector<uint32_t> out_ids_;
+
+  // The prefilter's nibble masks for the i-th fingerprint byte
+  int fp_len_;
+  alignas(16) uint8_t lo_mask_[kMaxFingerprint][16];
+  alignas(16) uint8_t hi_mask_[kMaxFingerprint][16];
+};
+
+#if __AVX2__
+constexpr size_t kMultiPatternBlock = 32;
+#else
+constexpr size_t kMultiPatternBlock = 16;
+#endif
+
+inline uint32_t MultiPatternMatcher::Candidates(const uint8_t *p) const {
+#if __AVX2__
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i res = _mm256_set1_epi8(static_cast<char>(0xff));
+  for (int i = 0; i < fp_len_; i++) {
+    __m256i lo = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i *>(lo_mask_[i])));
+    __m256i hi = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i *>(hi_mask_[i])));
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+    __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble));
+    __m256i h = _mm256_shuffle_epi8(
+        hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    res = _mm256_and_si256(res, _mm256_and_si256(l, h));
+  }
+  __m256i none = _mm256_cmpeq_epi8(res, _mm256_setzero_si256());
+  return ~static_cast<uint32_t>(_mm256_movemask_epi8(none));
+#else
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  __m128i res = _mm_set1_epi8(static_cast<char>(0xff));
+  for (int i = 0; i < fp_len_; i++) {
+    __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i *>(lo_mask_[i]));
+    __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i *>(hi_mask_[i]));
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nibble));
+    __m128i h =
+        _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    res = _mm_and_si128(res, _mm_and_si128(l, h));
+  }
+  __m128i none = _mm_cmpeq_epi8(res, _mm_setzero_si128());
+  return ~static_cast<uint32_t>(_mm_movemask_epi8(none)) & 0xffff;
+#endif
+}
+
+template <typename Fn>
+size_t MultiPatternMatcher::Scan(const void *data, size_t len, State *state,
+                                 Fn fn) const {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  State s = *state;
+  size_t pos = 0;
+
+  // The prefilter needs a few bytes after each block. Blocks start before
+  // |simd_end|.
+  size_t simd_end = 0;
+  if (fp_len_ > 0 && len >= kMultiPatternBlock + fp_len_ - 1) {
+    simd_end = len - kMultiPatternBlock - fp_len_ + 2;
+  }
+  size_t block = 0;  // start of the last prefiltered block
+  uint32_t cands = 0;
+  bool have_block = false;
+
+  while (pos < len) {
+    // At the root, no pattern is in progress: jump to the next candidate
+    if (s == kRootState && pos < simd_end) {
+      if (!have_block || pos >= block + kMultiPatternBlock) {
+        block = pos;
+        cands = Candidates(p + pos);
+        have_block = true;
+      }
+      uint32_t rest = cands >> (pos - block);
+      if (rest == 0) {
+        pos = block + kMultiPatternBlock;
+        continue;
+      }
+      pos += __builtin_ctz(rest);
+    }
+
+    s = Next(s, p[pos++]);
+    if (s >= accept_base_) {
+      uint32_t i = s - accept_base_;
+      for (uint32_t j = out_begin_[i]; j < out_begin_[i + 1]; j++) {
+        if (!fn(out_ids_[j], pos)) {
+          *state = s;
+          return pos;
+        }
+      }
+    }
+  }
+  *state = s;
+  return pos;
+}
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_MULTI_PATTERN_H_
@@ -0,0 +1,172 @@
+#include "multi_pattern.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+using bess::utils::MultiPatternMatcher;
+
+namespace {
+
+using Match = std::pair<uint32_t, size_t>;  // (pattern, end)
+
+std::vector<Match> Naive(const std::vector<std::string> &patterns,
+                         const std::string &text) {
+  std::vector<Match> matches;
+  for (size_t end = 1; end <= text.size(); end++) {
+    for (uint32_t i = 0; i < patterns.size(); i++) {
+      const std::string &p = patterns[i];
+      if (!p.empty() && p.size() <= end &&
+          text.compare(end - p.size(), p.size(), p) == 0) {
+        matches.emplace_back(i, end);
+      }
+    }
+  }
+  return matches;
+}
+
+// Scans |text| in chunks of |chunk| bytes
+std::vector<Match> ScanAll(const MultiPatternMatcher &m, const std::string &text,
+                           size_t chunk) {
+  std::vector<Match> matches;
+  MultiPatternMatcher::State s = MultiPatternMatcher::kRootState;
+  for (size_t off = 0; off < text.size(); off += chunk) {
+    size_t len = std::min(chunk, text.size() - off);
+    EXPECT_EQ(len, m.Scan(text.data() + off, len, &s, [&](uint32_t p, size_t end) {
+      matches.emplace_back(p, off + end);
+      return true;
+    }));
+  }
+  std::sort(matches.begin(), matches.end(),
+            [](const Match &a, const Match &b) {
+              return std::tie(a.second, a.first) < std::tie(b.second, b.first);
+            });
+  return matches;
+}
+
+std::string RandomString(std::mt19937 *rng, size_t len, int alphabet) {
+  std::string s;
+  for (size_t i = 0; i < len; i++) {
+    s.push_back(static_cast<char>('a' + (*rng)() % alphabet));
+  }
+  return s;
+}
+
+TEST(MultiPatternTest, Empty) {
+  MultiPatternMatcher m;
+  EXPECT_TRUE(m.empty());
+  EXPECT_FALSE(m.Matches("anything", 8));
+
+  ASSERT_TRUE(m.Build({"", ""}));
+  EXPECT_TRUE(m.empty());
+  EXPECT_FALSE(m.Matches("anything", 8));
+}
+
+TEST(MultiPatternTest, Overlaps) {
+  std::vector<std::string> patterns = {"he", "she", "his", "hers", "", "e"};
+  MultiPatternMatcher m;
+  ASSERT_TRUE(m.Build(patterns));
+  EXPECT_EQ(5, m.pattern_count());
+  EXPECT_EQ(1, m.min_pattern_len());
+  // 'h', 'e', 's', 'i', 'r', and all other bytes
+  EXPECT_EQ(6, m.class_count());
+
+  std::string text = "ushers and his hershey";
+  EXPECT_EQ(Naive(patterns, text), ScanAll(m, text, text.size()));
+  EXPECT_TRUE(m.Matches("xhex", 4));
+  EXPECT_FALSE(m.Matches("xhx", 3));
+
+  // Stops early
+  size_t calls = 0;
+  MultiPatternMatcher::State s = 0;
+  EXPECT_EQ(4, m.Scan(text.data(), text.size(), &s, [&](uint32_t, size_t) {
+    return ++calls < 2;
+  }));
+}
+
+TEST(MultiPatternTest, BinaryAndLongText) {
+  std::vector<std::string> patterns = {std::string("\x00\xff\x80", 3),
+                                       std::string("\x7f\x00", 2), "GET /",
+                                       "attack"};
+  MultiPatternMatcher m;
+  ASSERT_TRUE(m.Build(patterns));
+  EXPECT_TRUE(m.has_prefilter());
+
+  std::mt19937 rng(7);
+  std::string text;
+  for (int i = 0; i < 5000; i++) {
+    text.push_back(static_cast<char>(rng()));
+    if (i % 777 == 0) {
+      text += patterns[(i / 777) % patterns.size()];
+    }
+  }
+  std::vector<Match> expected = Naive(patterns, text);
+  EXPECT_GE(expected.size(), 7);
+  for (size_t chunk : {size_t(1), size_t(7), size_t(33), size_t(1500), text.size()}) {
+    EXPECT_EQ(expected, ScanAll(m, text, chunk)) << "chunk " << chunk;
+  }
+}
+
+// Every byte value in use: no two bytes may share a class
+TEST(MultiPatternTest, AllBytes) {
+  std::string all;
+  for (int c = 0; c < 256; c++) {
+    all.push_back(static_cast<char>(c));
+  }
+  std::vector<std::string> patterns = {all, "\xff\xff\xff\xff"};
+  MultiPatternMatcher m;
+  ASSERT_TRUE(m.Build(patterns));
+  EXPECT_EQ(257, m.class_count());
+
+  EXPECT_FALSE(m.Matches(std::string(64, '\0').data(), 64));
+  EXPECT_FALSE(m.Matches("\xfe\xff\xff\xff", 4));
+  std::string text = std::string(100, '\xfe') + all + std::string(5, '\xff');
+  std::vector<Match> expected = Naive(patterns, text);
+  EXPECT_EQ(4, expected.size());
+  EXPECT_EQ(expected, ScanAll(m, text, text.size()));
+}
+
+// Many patterns on a small alphabet, with and without the prefilter
+TEST(MultiPatternTest, Random) {
+  std::mt19937 rng(42);
+  for (int round = 0; round < 20; round++) {
+    int alphabet = 2 + round % 6;
+    size_t count = 1 + rng() % (round < 10 ? 8 : 300);
+    std::vector<std::string> patterns;
+    for (size_t i = 0; i < count; i++) {
+      patterns.push_back(RandomString(&rng, 1 + rng() % 8, alphabet + 2));
+    }
+    std::string text = RandomString(&rng, 2000, alphabet + 4);
+    std::vector<Match> expected = Naive(patterns, text);
+
+    for (bool prefilter : {true, false}) {
+      MultiPatternMatcher m;
+      ASSERT_TRUE(m.Build(patterns, prefilter));
+      EXPECT_EQ(expected, ScanAll(m, text, text.size()));
+      EXPECT_EQ(expected, ScanAll(m, text, 1 + rng() % 100));
+    }
+  }
+}
+
+TEST(MultiPatternTest, ManyRules) {
+  std::vector<std::string> patterns;
+  for (int i = 0; i < 2000; i++) {
+    patterns.push_back("rule" + std::to_string(i) + ";");
+  }
+  MultiPatternMatcher m;
+  ASSERT_TRUE(m.Build(patterns));
+  EXPECT_EQ(2000, m.pattern_count());
+
+  std::string text = "xx rule1999; rule7; rule70";
+  std::vector<Match> expected = {{1999, 12}, {7, 19}};
+  EXPECT_EQ(expected, ScanAll(m, text, text.size()));
+
+  // Too many states for 16 bits
+  patterns.assign(1, std::string(MultiPatternMatcher::kMaxStates, 'a'));
+  EXPECT_FALSE(m.Build(patterns));
+  EXPECT_TRUE(m.empty());
+}
+
+}  // namespace (unnamed)
@@ -0,0 +1,218 @@
+#include "nf_perf_model.h"
+
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace bess {
+namespace utils {
+
+bool MonotoneSpline::Fit(const std::vector<double> &xs,
+                         const std::vector<double> &ys) {
+  if (xs.empty() || xs.size() != ys.size()) {
+    return false;
+  }
+  for (size_t i = 1; i < xs.size(); i++) {
+    if (xs[i] <= xs[i - 1]) {
+      return false;
+    }
+  }
+
+  size_t n = xs.size();
+  xs_ = xs;
+  ys_ = ys;
+  ms_.assign(n, 0);
+  if (n == 1) {
+    return true;
+  }
+
+  // Secant slopes, then tangents as their average (zero at local extrema)
+  std::vector<double> d(n - 1);
+  for (size_t i = 0; i < n - 1; i++) {
+    d[i] = (ys[i + 1] - ys[i]) / (xs[i + 1] - xs[i]);
+  }
+  ms_[0] = d[0];
+  ms_[n - 1] = d[n - 2];
+  for (size_t i = 1; i < n - 1; i++) {
+    ms_[i] = (d[i - 1] * d[i] <= 0) ? 0 : (d[i - 1] + d[i]) / 2;
+  }
+
+  // Limit the tangents so that each segment stays monotone
+  for (size_t i = 0; i < n - 1; i++) {
+    if (d[i] == 0) {
+      ms_[i] = 0;
+      ms_[i + 1] = 0;
+      continue;
+    }
+    double a = ms_[i] / d[i];
+    double b = ms_[i + 1] / d[i];
+    double h = a * a + b * b;
+    if (h > 9) {
+      double t = 3 / std::sqrt(h);
+      ms_[i] = t * a * d[i];
+      ms_[i + 1] = t * b * d[i];
+    }
+  }
+  return true;
+}
+
+double MonotoneSpline::Eval(double x) const {
+  if (xs_.empty()) {
+    return 0;
+  }
+  if (x <= xs_.front()) {
+    return ys_.front();
+  }
+  if (x >= xs_.back()) {
+    return ys_.back();
+  }
+
+  size_t i = std::upper_bound(xs_.begin(), xs_.end(), x) - xs_.begin() - 1;
+  double h = xs_[i + 1] - xs_[i];
+  double t = (x - xs_[i]) / h;
+  double t2 = t * t;
+  double t3 = t2 * t;
+  // Cubic Hermite basis
+  return (2 * t3 - 3 * t2 + 1) * ys_[i] + (t3 - 2 * t2 + t) * h * ms_[i] +
+         (-2 * t3 + 3 * t2) * ys_[i + 1] + (t3 - t2) * h * ms_[i + 1];
+}
+
+void NFPerfModel::AddProfile(uint32_t pkt_size,
+                             const std::map<uint64_t, uint64_t> &points) {
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (const auto &it : points) {
+    xs.push_back(it.first);
+    ys.push_back(it.second);
+  }
+
+  MonotoneSpline spline;
+  if (spline.Fit(xs, ys)) {
+    profiles_[pkt_size] = spline;
+  }
+  lut_.clear();
+}
+
+bool NFPerfModel::LoadProfile(const std::string &path,
+                              uint32_t default_pkt_size) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::map<uint32_t, std::map<uint64_t, uint64_t>> points;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream tokens(line);
+    uint64_t flow_count;
+    uint64_t load;
+    if (!(tokens >> flow_count)) {
+      // Skip empty lines and comments
+      std::istringstream rest(line);
+      std::string token;
+      if (!(rest >> token) || token[0] == '#') {
+        continue;
+      }
+      return false;
+    }
+    if (!(tokens >> load)) {
+      return false;
+    }
+    uint32_t pkt_size = default_pkt_size;
+    if (!(tokens >> pkt_size)) {
+      pkt_size = default_pkt_size;
+    }
+    points[pkt_size][flow_count] = load;
+  }
+
+  for (const auto &it : points) {
+    AddProfile(it.first, it.second);
+  }
+  return !points.empty();
+}
+
+NFPerfModel NFPerfModel::Compose(const std::vector<const NFPerfModel *> &nfs) {
+  NFPerfModel chain;
+  if (nfs.empty() || nfs[0]->empty()) {
+    return chain;
+  }
+
+  std::set<uint64_t> flow_counts;
+  for (const NFPerfModel *nf : nfs) {
+    std::vector<uint64_t> fcs = nf->FlowCounts();
+    flow_counts.insert(fcs.begin(), fcs.end());
+  }
+
+  for (const auto &it : nfs[0]->profiles_) {
+    uint32_t pkt_size = it.first;
+    std::map<uint64_t, uint64_t> points;
+    for (uint64_t fc : flow_counts) {
+      double cost = 0;  // seconds (or epochs) per packet
+      for (const NFPerfModel *nf : nfs) {
+        double load = nf->Eval(fc, pkt_size);
+        cost += (load > 0) ? 1 / load : INFINITY;
+      }
+      points[fc] = std::isinf(cost) ? 0 : uint64_t(1 / cost);
+    }
+    chain.AddProfile(pkt_size, points);
+  }
+  return chain;
+}
+
+void NFPerfModel::Build(size_t rows) {
+  lut_.clear();
+  if (profiles_.empty()) {
+    return;
+  }
+
+  std::vector<uint64_t> fcs = FlowCounts();
+  max_flow_count_ = fcs.back();
+  rows_ = std::max<size_t>(rows, 2);
+  flow_step_ = std::max<uint64_t>(
+      (max_flow_count_ + rows_ - 2) / (rows_ - 1), 1);
+  cols_ = (profiles_.size() == 1) ? 1 : kMaxPktSize / kPktSizeStep + 1;
+
+  uint32_t only_pkt_size = profiles_.begin()->first;
+  lut_.resize(rows_ * cols_);
+  for (size_t r = 0; r < rows_; r++) {
+    for (size_t c = 0; c < cols_; c++) {
+      uint32_t pkt_size = (cols_ == 1) ? only_pkt_size : c * kPktSizeStep;
+      double load = Eval(r * flow_step_, pkt_size);
+      lut_[r * cols_ + c] = load > 0 ? uint64_t(load) : 0;
+    }
+  }
+}
+
+double NFPerfModel::Eval(double flow_count, uint32_t pkt_size) const {
+  if (profiles_.empty()) {
+    return 0;
+  }
+
+  auto hi = profiles_.lower_bound(pkt_size);
+  if (hi == profiles_.end()) {
+    return std::prev(hi)->second.Eval(flow_count);
+  }
+  if (hi->first == pkt_size || hi == profiles_.begin()) {
+    return hi->second.Eval(flow_count);
+  }
+
+  // Linear between the two closest measured packet sizes
+  auto lo = std::prev(hi);
+  double w = double(pkt_size - lo->first) / (hi->first - lo->first);
+  return (1 - w) * lo->second.Eval(flow_count) +
+         w * hi->second.Eval(flow_count);
+}
+
+std::vector<uint64_t> NFPerfModel::FlowCounts() const {
+  std::set<uint64_t> fcs;
+  for (const auto &it : profiles_) {
+    for (double x : it.second.xs()) {
+      fcs.insert(uint64_t(x));
+    }
+  }
+  return std::vector<uint64_t>(fcs.begin(), fcs.end());
+}
+
+}  // namespace utils
+}  // namespace bess
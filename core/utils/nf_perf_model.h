@@ -0,0 +1,125 @@
+#ifndef BESS_UTILS_NF_PERF_MODEL_H_
+#define BESS_UTILS_NF_PERF_MODEL_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A monotone piecewise-cubic interpolant (Fritsch-Carlson). Unlike a natural
+// cubic spline, it never overshoots: between two knots, the curve stays
+// within their values, so a profile that drops with the flow count never
+// predicts more capacity than was measured.
+class MonotoneSpline {
+ public:
+  // |xs| must be strictly increasing and have the same size as |ys|.
+  // Returns false otherwise.
+  bool Fit(const std::vector<double> &xs, const std::vector<double> &ys);
+
+  // Values outside the knots are clamped to the first/last knot.
+  double Eval(double x) const;
+
+  bool empty() const { return xs_.empty(); }
+  const std::vector<double> &xs() const { return xs_; }
+
+ private:
+  std::vector<double> xs_;
+  std::vector<double> ys_;
+  std::vector<double> ms_;  // tangents at the knots
+};
+
+// An NF (chain) performance model: the max load that one core sustains
+// within the latency SLO, as a function of the flow count and the packet
+// size. The load is packets per second for long-term profiles, and packets
+// per epoch for short-term profiles.
+//
+// Profiles are measured offline at a few flow counts for each packet size.
+// The model interpolates them with monotone splines along the flow count and
+// linearly along the packet size, and precomputes a lookup table so that
+// Get() is O(1) on the datapath.
+//
+// Example usage:
+//
+//  NFPerfModel model;
+//  model.LoadProfile("nf_profiles/chain2/long_200_p50.pro");
+//  model.Build();
+//  uint64_t pps = model.Get(flow_count);
+class NFPerfModel {
+ public:
+  // The packet-size granularity of the lookup table
+  static constexpr uint32_t kPktSizeStep = 64;
+  static constexpr uint32_t kMaxPktSize = 1536;
+  // The number of flow-count rows of the lookup table
+  static constexpr size_t kDefaultLutRows = 1024;
+
+  NFPerfModel() : rows_(0), cols_(0), flow_step_(1), max_flow_count_(0) {}
+
+  // Adds measurements taken with |pkt_size|-byte packets (0 if unknown):
+  // flow count -> max load. Replaces any previous points for |pkt_size|.
+  void AddProfile(uint32_t pkt_size,
+                  const std::map<uint64_t, uint64_t> &points);
+
+  // Reads a profile with one "flow_count load [pkt_size]" line per point.
+  // Lines without a packet size use |default_pkt_size|. Returns false if the
+  // file cannot be opened or parsed.
+  bool LoadProfile(const std::string &path, uint32_t default_pkt_size = 0);
+
+  // Returns the model of a chain of NFs that run to completion on one core.
+  // The per-packet costs of the NFs add up, i.e., 1 / load = sum(1 / load_i).
+  // The chain is profiled at every flow count measured for any NF, and at
+  // every packet size measured for the first NF.
+  static NFPerfModel Compose(const std::vector<const NFPerfModel *> &nfs);
+
+  // Precomputes the lookup table with |rows| flow counts, evenly spaced up to
+  // the largest measured flow count. Must be called before Get().
+  void Build(size_t rows = kDefaultLutRows);
+
+  // O(1). Returns the max load under |flow_count| flows of |pkt_size|-byte
+  // packets, or 0 if the model is empty.
+  uint64_t Get(uint64_t flow_count, uint32_t pkt_size = 0) const {
+    if (lut_.empty()) {
+      return 0;
+    }
+    size_t col = 0;
+    if (cols_ > 1) {
+      col = std::min<size_t>(pkt_size / kPktSizeStep, cols_ - 1);
+    }
+    size_t row = flow_count / flow_step_;
+    if (row >= rows_ - 1) {
+      return lut_[(rows_ - 1) * cols_ + col];
+    }
+    // Linear between two rows that are only |flow_step_| flows apart
+    double lo = lut_[row * cols_ + col];
+    double hi = lut_[(row + 1) * cols_ + col];
+    double frac = double(flow_count - row * flow_step_) / flow_step_;
+    return uint64_t(lo + (hi - lo) * frac);
+  }
+
+  // Evaluates the splines directly, without the lookup table.
+  double Eval(double flow_count, uint32_t pkt_size = 0) const;
+
+  bool empty() const { return profiles_.empty(); }
+  uint64_t max_flow_count() const { return max_flow_count_; }
+
+ private:
+  // Measured flow counts of all profiles
+  std::vector<uint64_t> FlowCounts() const;
+
+  std::map<uint32_t, MonotoneSpline> profiles_;  // pkt_size -> spline
+
+  // Row-major: rows are flow counts, columns are packet sizes
+  std::vector<uint64_t> lut_;
+  size_t rows_;
+  size_t cols_;
+  uint64_t flow_step_;
+  uint64_t max_flow_count_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_NF_PERF_MODEL_H_
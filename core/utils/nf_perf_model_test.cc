@@ -0,0 +1,150 @@
+#include "nf_perf_model.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+using bess::utils::MonotoneSpline;
+using bess::utils::NFPerfModel;
+
+namespace {
+
+TEST(MonotoneSplineTest, Knots) {
+  MonotoneSpline s;
+  ASSERT_TRUE(s.Fit({500, 1000, 1500, 2000}, {740, 720, 680, 660}));
+  EXPECT_DOUBLE_EQ(740, s.Eval(500));
+  EXPECT_DOUBLE_EQ(680, s.Eval(1500));
+  // Clamped outside the knots
+  EXPECT_DOUBLE_EQ(740, s.Eval(0));
+  EXPECT_DOUBLE_EQ(660, s.Eval(10000));
+}
+
+TEST(MonotoneSplineTest, InvalidInput) {
+  MonotoneSpline s;
+  EXPECT_FALSE(s.Fit({}, {}));
+  EXPECT_FALSE(s.Fit({1, 2}, {1}));
+  EXPECT_FALSE(s.Fit({1, 1}, {1, 2}));
+  EXPECT_EQ(0, s.Eval(1));
+}
+
+TEST(MonotoneSplineTest, NoOvershoot) {
+  // A step-like profile: a natural cubic spline would overshoot here
+  std::vector<double> xs = {0, 100, 200, 300, 400, 500};
+  std::vector<double> ys = {1000, 1000, 1000, 200, 200, 200};
+  MonotoneSpline s;
+  ASSERT_TRUE(s.Fit(xs, ys));
+
+  double prev = s.Eval(0);
+  for (double x = 0; x <= 500; x += 1) {
+    double y = s.Eval(x);
+    EXPECT_LE(y, 1000 + 1e-9);
+    EXPECT_GE(y, 200 - 1e-9);
+    EXPECT_LE(y, prev + 1e-9) << x;
+    prev = y;
+  }
+  // Flat segments stay flat
+  EXPECT_DOUBLE_EQ(1000, s.Eval(150));
+  EXPECT_DOUBLE_EQ(200, s.Eval(450));
+}
+
+TEST(NFPerfModelTest, InterpolatesBetweenPoints) {
+  NFPerfModel model;
+  EXPECT_EQ(0, model.Get(100));
+
+  model.AddProfile(0, {{1000, 2000000}, {2000, 1000000}});
+  model.Build();
+  EXPECT_EQ(2000000, model.Get(0));
+  EXPECT_EQ(2000000, model.Get(1000));
+  EXPECT_EQ(1000000, model.Get(5000));
+  // A step function would return 1000000 here
+  uint64_t mid = model.Get(1500);
+  EXPECT_NEAR(1500000, mid, 2000);
+}
+
+TEST(NFPerfModelTest, LutMatchesSpline) {
+  NFPerfModel model;
+  model.AddProfile(0, {{500, 740000},
+                       {1000, 720000},
+                       {1500, 680000},
+                       {2000, 660000},
+                       {6000, 660000}});
+  model.Build();
+  for (uint64_t fc = 0; fc < 7000; fc += 37) {
+    EXPECT_NEAR(model.Eval(fc), model.Get(fc), 100) << fc;
+  }
+}
+
+TEST(NFPerfModelTest, PacketSizes) {
+  NFPerfModel model;
+  model.AddProfile(64, {{100, 4000}, {1000, 2000}});
+  model.AddProfile(1024, {{100, 1000}, {1000, 500}});
+  model.Build();
+
+  EXPECT_EQ(4000, model.Get(100, 64));
+  EXPECT_EQ(1000, model.Get(100, 1024));
+  // Clamped to the closest measured size
+  EXPECT_EQ(4000, model.Get(100, 0));
+  EXPECT_EQ(1000, model.Get(100, 1500));
+  // Larger packets, lower rate
+  uint64_t prev = model.Get(500, 64);
+  for (uint32_t size = 128; size <= 1024; size += 64) {
+    EXPECT_LT(model.Get(500, size), prev);
+    prev = model.Get(500, size);
+  }
+}
+
+TEST(NFPerfModelTest, Compose) {
+  NFPerfModel a;
+  NFPerfModel b;
+  a.AddProfile(0, {{100, 1000}, {1000, 500}});
+  b.AddProfile(0, {{100, 1000}, {500, 1000}});
+  a.Build();
+  b.Build();
+
+  NFPerfModel chain = NFPerfModel::Compose({&a, &b});
+  chain.Build();
+  // Per-packet costs add up: 1 / (1/1000 + 1/1000)
+  EXPECT_EQ(500, chain.Get(100));
+  // 1 / (1/500 + 1/1000)
+  EXPECT_EQ(333, chain.Get(1000));
+  // The chain is never faster than its slowest NF
+  for (uint64_t fc = 0; fc < 2000; fc += 50) {
+    EXPECT_LE(chain.Get(fc), std::min(a.Get(fc), b.Get(fc)));
+  }
+
+  EXPECT_TRUE(NFPerfModel::Compose({}).empty());
+}
+
+TEST(NFPerfModelTest, LoadProfile) {
+  char path[] = "/tmp/nf_profile_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    std::ofstream f(path);
+    f << "# flow_count pps [pkt_size]\n500 740000\n1000 720000\n\n"
+      << "500 400000 1024\n1000 380000 1024\n";
+  }
+
+  NFPerfModel model;
+  ASSERT_TRUE(model.LoadProfile(path, 64));
+  model.Build();
+  EXPECT_EQ(740000, model.Get(500, 64));
+  EXPECT_EQ(380000, model.Get(1000, 1024));
+  EXPECT_EQ(1000, model.max_flow_count());
+
+  {
+    std::ofstream f(path);
+    f << "500 bad\n";
+  }
+  NFPerfModel bad;
+  EXPECT_FALSE(bad.LoadProfile(path));
+  std::remove(path);
+
+  EXPECT_FALSE(bad.LoadProfile("/nonexistent/profile"));
+}
+
+}  // namespace (unnamed)
@@ -0,0 +1,236 @@
+#ifndef BESS_UTILS_PERFECT_HASH_H_
+#define BESS_UTILS_PERFECT_HASH_H_
+
+#include <x86intrin.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A read-only map from byte strings to values, compiled once with a
+// hash-and-displace perfect hash. A lookup hashes the key once (CRC32-C),
+// reads the displacement of its bucket, and compares exactly one slot, so
+// it neither probes nor needs the key as a std::string.
+//
+// Rebuild the whole map to change it. Lookups on a built map are
+// read-only, so it can be shared by threads.
+//
+// Example usage:
+//
+//  PerfectHashMap<int> m;
+//  m.Build({{"example.com", 1}, {"example.org", 2}});
+//  const int *v = m.Find(host, host_len);  // nullptr if not found
+template <typename T>
+class PerfectHashMap {
+ public:
+  PerfectHashMap() { Clear(); }
+
+  // Replaces the contents. Returns false (and leaves the map empty) if a
+  // key appears twice, or in the unlikely case that no perfect hash is
+  // found.
+  bool Build(const std::vector<std::pair<std::string, T>> &entries);
+
+  void Clear() {
+    seed_ = 0;
+    mask_ = 0;
+    disp_.assign(1, 0);
+    slots_.assign(1, Slot{0, 0, kNoKey, 0});
+    keys_.clear();
+    values_.clear();
+  }
+
+  // Returns the value of |key|, or nullptr
+  const T *Find(const char *key, size_t len) const {
+    uint32_t h = Hash(key, len, seed_);
+    const Slot &s = slots_[SlotOf(h, disp_[BucketOf(h)])];
+    if (s.hash == h && s.len == len &&
+        memcmp(keys_.data() + s.offset, key, len) == 0) {
+      return &values_[s.index];
+    }
+    return nullptr;
+  }
+
+  const T *Find(const std::string &key) const {
+    return Find(key.data(), key.size());
+  }
+
+  size_t size() const { return values_.size(); }
+  size_t slot_count() const { return slots_.size(); }
+  bool empty() const { return values_.empty(); }
+
+ private:
+  // Marks a free slot; no key is this long
+  static constexpr uint32_t kNoKey = UINT32_MAX;
+  // Average keys per bucket
+  static constexpr size_t kBucketSize = 4;
+  static constexpr uint32_t kMaxDisplacement = 1 << 16;
+  static constexpr int kMaxSeeds = 16;
+
+  struct Slot {
+    uint32_t hash;
+    uint32_t offset;  // of the key in |keys_|
+    uint32_t len;
+    uint32_t index;  // of the value in |values_|
+  };
+
+  static uint32_t Hash(const char *key, size_t len, uint32_t seed) {
+    uint64_t crc = seed;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+      uint64_t w;
+      memcpy(&w, key + i, 8);
+      crc = _mm_crc32_u64(crc, w);
+    }
+    uint32_t crc32 = static_cast<uint32_t>(crc);
+    for (; i < len; i++) {
+      crc32 = _mm_crc32_u8(crc32, key[i]);
+    }
+    return crc32;
+  }
+
+  // The finalizer of MurmurHash3
+  static uint32_t Mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+  }
+
+  uint32_t BucketOf(uint32_t h) const {
+    return (static_cast<uint64_t>(h) * disp_.size()) >> 32;
+  }
+
+  uint32_t SlotOf(uint32_t h, uint32_t d) const {
+    return Mix(h + d * 0x9e3779b9) & mask_;
+  }
+
+  // Places every key with |seed|. Returns false if a bucket finds no
+  // displacement.
+  bool Place(const std::vector<std::pair<std::string, T>> &entries,
+             uint32_t seed, size_t num_slots);
+
+  uint32_t seed_;
+  uint32_t mask_;
+  std::vector<uint32_t> disp_;
+  std::vector<Slot> slots_;
+  std::string keys_;
+  std::vector<T> values_;
+};
+
+template <typename T>
+bool PerfectHashMap<T>::Build(
+    const std::vector<std::pair<std::string, T>> &entries) {
+  Clear();
+  if (entries.empty()) {
+    return true;
+  }
+
+  std::vector<const std::string *> sorted;
+  for (const auto &e : entries) {
+    sorted.push_back(&e.first);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::string *a, const std::string *b) { return *a < *b; });
+  for (size_t i = 1; i < sorted.size(); i++) {
+    if (*sorted[i - 1] == *sorted[i]) {
+      return false;
+    }
+  }
+
+  // A load factor of at most 0.8. If no seed works (e.g., two keys share
+  // a CRC), more room makes the next round easier.
+  size_t num_slots = 1;
+  while (num_slots < entries.size() + entries.size() / 4) {
+    num_slots <<= 1;
+  }
+  for (; num_slots <= entries.size() * 64; num_slots <<= 1) {
+    for (uint32_t seed = 0; seed < kMaxSeeds; seed++) {
+      if (Place(entries, seed, num_slots)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename T>
+bool PerfectHashMap<T>::Place(
+    const std::vector<std::pair<std::string, T>> &entries, uint32_t seed,
+    size_t num_slots) {
+  const size_t n = entries.size();
+  seed_ = seed;
+  mask_ = num_slots - 1;
+  disp_.assign((n + kBucketSize - 1) / kBucketSize, 0);
+  slots_.assign(num_slots, Slot{0, 0, kNoKey, 0});
+
+  std::vector<uint32_t> hashes(n);
+  std::vector<std::vector<uint32_t>> buckets(disp_.size());
+  for (size_t i = 0; i < n; i++) {
+    const std::string &key = entries[i].first;
+    hashes[i] = Hash(key.data(), key.size(), seed);
+    buckets[BucketOf(hashes[i])].push_back(i);
+  }
+
+  // Larger buckets are harder to place, so they go first
+  std::vector<uint32_t> order(buckets.size());
+  for (size_t b = 0; b < order.size(); b++) {
+    order[b] = b;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  std::vector<bool> taken(num_slots, false);
+  std::vector<uint32_t> pos;
+  for (uint32_t b : order) {
+    const std::vector<uint32_t> &keys = buckets[b];
+    if (keys.empty()) {
+      break;
+    }
+    uint32_t d = 0;
+    for (; d < kMaxDisplacement; d++) {
+      pos.clear();
+      for (uint32_t i : keys) {
+        uint32_t s = SlotOf(hashes[i], d);
+        if (taken[s] || std::find(pos.begin(), pos.end(), s) != pos.end()) {
+          break;
+        }
+        pos.push_back(s);
+      }
+      if (pos.size() == keys.size()) {
+        break;
+      }
+    }
+    if (d == kMaxDisplacement) {
+      Clear();
+      return false;
+    }
+    disp_[b] = d;
+    for (size_t j = 0; j < keys.size(); j++) {
+      taken[pos[j]] = true;
+      const std::string &key = entries[keys[j]].first;
+      slots_[pos[j]] =
+          Slot{hashes[keys[j]], static_cast<uint32_t>(keys_.size()),
+               static_cast<uint32_t>(key.size()), keys[j]};
+      keys_.append(key);
+    }
+  }
+
+  for (const auto &e : entries) {
+    values_.push_back(e.second);
+  }
+  return true;
+}
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_PERFECT_HASH_H_
@@ -0,0 +1,76 @@
+#include "perfect_hash.h"
+
+#include <random>
+#include <set>
+
+#include <gtest/gtest.h>
+
+using bess::utils::PerfectHashMap;
+
+namespace {
+
+TEST(PerfectHashTest, Empty) {
+  PerfectHashMap<int> m;
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(nullptr, m.Find(""));
+  EXPECT_EQ(nullptr, m.Find("example.com"));
+
+  ASSERT_TRUE(m.Build({}));
+  EXPECT_EQ(nullptr, m.Find(""));
+}
+
+TEST(PerfectHashTest, Find) {
+  PerfectHashMap<int> m;
+  ASSERT_TRUE(m.Build({{"example.com", 1}, {"example.org", 2}, {"", 3}}));
+  EXPECT_EQ(3, m.size());
+
+  ASSERT_NE(nullptr, m.Find("example.com"));
+  EXPECT_EQ(1, *m.Find("example.com"));
+  EXPECT_EQ(2, *m.Find("example.org"));
+  EXPECT_EQ(3, *m.Find(""));
+
+  // Not copied out of a longer buffer
+  const char buf[] = "example.org:8080";
+  EXPECT_EQ(2, *m.Find(buf, 11));
+  EXPECT_EQ(nullptr, m.Find(buf, 10));
+  EXPECT_EQ(nullptr, m.Find("example.net"));
+  EXPECT_EQ(nullptr, m.Find("Example.com"));
+}
+
+TEST(PerfectHashTest, Duplicates) {
+  PerfectHashMap<int> m;
+  EXPECT_FALSE(m.Build({{"a", 1}, {"b", 2}, {"a", 3}}));
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(nullptr, m.Find("b"));
+}
+
+TEST(PerfectHashTest, ManyKeys) {
+  std::mt19937 rng(3);
+  std::set<std::string> keys;
+  while (keys.size() < 10000) {
+    std::string k;
+    size_t len = 1 + rng() % 40;
+    for (size_t i = 0; i < len; i++) {
+      k.push_back(static_cast<char>('a' + rng() % 26));
+    }
+    keys.insert(k + ".com");
+  }
+
+  std::vector<std::pair<std::string, int>> entries;
+  for (const std::string &k : keys) {
+    entries.emplace_back(k, entries.size());
+  }
+  PerfectHashMap<int> m;
+  ASSERT_TRUE(m.Build(entries));
+  EXPECT_EQ(entries.size(), m.size());
+  EXPECT_LE(m.slot_count(), 2 * entries.size());
+
+  for (const auto &e : entries) {
+    const int *v = m.Find(e.first);
+    ASSERT_NE(nullptr, v) << e.first;
+    EXPECT_EQ(e.second, *v);
+    EXPECT_EQ(nullptr, m.Find(e.first + "."));
+  }
+}
+
+}  // namespace
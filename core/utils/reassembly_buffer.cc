@@ -0,0 +1,285 @@
+#include "reassembly_buffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+size_t default_arena_budget = ReassemblyArena::kDefaultBudget;
+
+// See the note on current_worker in worker.h for why this is not
+// thread_local
+__thread ReassemblyArena *local_arena;
+
+}  // namespace
+
+const char ReassemblyBuffer::kEmpty[1] = {0};
+
+ReassemblyArena::ReassemblyArena(size_t budget)
+    : budget_(budget),
+      used_(0),
+      cached_(0),
+      buffer_count_(0),
+      evictions_(0),
+      free_(),
+      lru_head_(nullptr),
+      lru_tail_(nullptr) {}
+
+ReassemblyArena::~ReassemblyArena() {
+  // Buffers that outlive the arena simply lose their data
+  while (EvictOne(nullptr)) {
+  }
+  TrimCache();
+}
+
+ReassemblyArena *ReassemblyArena::Local() {
+  if (!local_arena) {
+    local_arena = new ReassemblyArena();
+  }
+  return local_arena;
+}
+
+size_t ReassemblyArena::default_budget() {
+  return default_arena_budget;
+}
+
+void ReassemblyArena::SetDefaultBudget(size_t bytes) {
+  default_arena_budget = bytes;
+}
+
+void ReassemblyArena::SetBudget(size_t bytes) {
+  budget_ = bytes;
+  while (used_ + cached_ > budget_) {
+    if (cached_ > 0) {
+      TrimCache();
+    } else if (!EvictOne(nullptr)) {
+      break;
+    }
+  }
+}
+
+int ReassemblyArena::ClassOf(size_t size) {
+  int cls = 0;
+  while (cls < kNumClasses - 1 && BlockSize(cls) < size) {
+    cls++;
+  }
+  return cls;
+}
+
+char *ReassemblyArena::Alloc(int cls, const ReassemblyBuffer *keep) {
+  const size_t size = BlockSize(cls);
+  for (;;) {
+    if (free_[cls]) {
+      FreeBlock *b = free_[cls];
+      free_[cls] = b->next;
+      cached_ -= size;
+      used_ += size;
+      return reinterpret_cast<char *>(b);
+    }
+
+    if (used_ + cached_ + size <= budget_) {
+      char *b = static_cast<char *>(malloc(size));
+      if (b) {
+        used_ += size;
+      }
+      return b;
+    }
+
+    // Evicted blocks land in the cache, so look there again first
+    if (cached_ > 0) {
+      TrimCache();
+    } else if (!EvictOne(keep)) {
+      return nullptr;
+    }
+  }
+}
+
+void ReassemblyArena::Free(char *block, int cls) {
+  FreeBlock *b = reinterpret_cast<FreeBlock *>(block);
+  b->next = free_[cls];
+  free_[cls] = b;
+  used_ -= BlockSize(cls);
+  cached_ += BlockSize(cls);
+}
+
+void ReassemblyArena::TrimCache() {
+  for (int cls = 0; cls < kNumClasses; cls++) {
+    while (free_[cls]) {
+      FreeBlock *b = free_[cls];
+      free_[cls] = b->next;
+      free(b);
+    }
+  }
+  cached_ = 0;
+}
+
+bool ReassemblyArena::EvictOne(const ReassemblyBuffer *keep) {
+  ReassemblyBuffer *victim = lru_tail_;
+  if (victim && victim == keep) {
+    victim = victim->lru_prev_;
+  }
+  if (!victim) {
+    return false;
+  }
+  victim->Evict();
+  evictions_++;
+  return true;
+}
+
+void ReassemblyArena::Touch(ReassemblyBuffer *b) {
+  if (lru_head_ == b) {
+    return;
+  }
+  if (b->lru_prev_) {
+    Unlink(b);
+  }
+  b->lru_prev_ = nullptr;
+  b->lru_next_ = lru_head_;
+  if (lru_head_) {
+    lru_head_->lru_prev_ = b;
+  } else {
+    lru_tail_ = b;
+  }
+  lru_head_ = b;
+  buffer_count_++;
+}
+
+void ReassemblyArena::Unlink(ReassemblyBuffer *b) {
+  if (b->lru_prev_) {
+    b->lru_prev_->lru_next_ = b->lru_next_;
+  } else {
+    lru_head_ = b->lru_next_;
+  }
+  if (b->lru_next_) {
+    b->lru_next_->lru_prev_ = b->lru_prev_;
+  } else {
+    lru_tail_ = b->lru_prev_;
+  }
+  b->lru_prev_ = nullptr;
+  b->lru_next_ = nullptr;
+  buffer_count_--;
+}
+
+ReassemblyBuffer::ReassemblyBuffer(size_t size_hint, size_t max_bytes)
+    : block_(nullptr),
+      arena_(nullptr),
+      cls_(0),
+      num_segs_(0),
+      truncated_(false),
+      evicted_(false),
+      size_hint_(std::min(size_hint, ReassemblyArena::kMaxBlockSize)),
+      max_bytes_(0),
+      lru_prev_(nullptr),
+      lru_next_(nullptr) {
+  set_max_bytes(max_bytes);
+}
+
+void ReassemblyBuffer::set_max_bytes(size_t max_bytes) {
+  max_bytes_ = std::min(max_bytes, ReassemblyArena::kMaxBlockSize);
+}
+
+bool ReassemblyBuffer::Insert(uint32_t offset, const void *data,
+                              uint32_t len) {
+  if (evicted_) {
+    return false;
+  }
+
+  uint64_t end = static_cast<uint64_t>(offset) + len;
+  if (end > max_bytes_) {
+    truncated_ = true;
+    if (offset >= max_bytes_) {
+      return true;
+    }
+    end = max_bytes_;
+  }
+  if (end == offset) {
+    return true;
+  }
+
+  if (!Reserve(end) || !AddSegment(offset, end)) {
+    return false;
+  }
+  memcpy(block_ + offset, data, end - offset);
+  return true;
+}
+
+void ReassemblyBuffer::Release() {
+  if (block_) {
+    arena_->Unlink(this);
+    arena_->Free(block_, cls_);
+    block_ = nullptr;
+  }
+  num_segs_ = 0;
+  truncated_ = false;
+  evicted_ = false;
+}
+
+void ReassemblyBuffer::Evict() {
+  Release();
+  evicted_ = true;
+}
+
+bool ReassemblyBuffer::Reserve(size_t len) {
+  if (!arena_) {
+    arena_ = ReassemblyArena::Local();
+  }
+  if (block_ && ReassemblyArena::BlockSize(cls_) >= len) {
+    arena_->Touch(this);
+    return true;
+  }
+
+  // Keep this buffer out of the way of the eviction below
+  if (block_) {
+    arena_->Touch(this);
+  }
+  int cls = ReassemblyArena::ClassOf(std::max<size_t>(len, size_hint_));
+  char *block = arena_->Alloc(cls, this);
+  if (!block) {
+    return false;
+  }
+  if (block_) {
+    if (num_segs_ > 0) {
+      memcpy(block, block_, segs_[num_segs_ - 1].end);
+    }
+    arena_->Free(block_, cls_);
+  }
+  block_ = block;
+  cls_ = cls;
+  arena_->Touch(this);
+  return true;
+}
+
+bool ReassemblyBuffer::AddSegment(uint32_t start, uint32_t end) {
+  // Segments [i, j) overlap or touch the new one
+  int i = 0;
+  while (i < num_segs_ && segs_[i].end < start) {
+    i++;
+  }
+  int j = i;
+  while (j < num_segs_ && segs_[j].start <= end) {
+    j++;
+  }
+
+  if (i == j) {
+    if (num_segs_ == kMaxSegments) {
+      return false;
+    }
+    memmove(&segs_[i + 1], &segs_[i], (num_segs_ - i) * sizeof(Segment));
+    segs_[i] = {start, end};
+    num_segs_++;
+    return true;
+  }
+
+  segs_[i].start = std::min(segs_[i].start, start);
+  segs_[i].end = std::max(segs_[j - 1].end, end);
+  memmove(&segs_[i + 1], &segs_[j], (num_segs_ - j) * sizeof(Segment));
+  num_segs_ -= j - i - 1;
+  return true;
+}
+
+}  // namespace utils
+}  // namespace bess
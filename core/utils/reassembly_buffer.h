@@ -0,0 +1,183 @@
+#ifndef BESS_UTILS_REASSEMBLY_BUFFER_H_
+#define BESS_UTILS_REASSEMBLY_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common.h"
+
+namespace bess {
+namespace utils {
+
+class ReassemblyBuffer;
+
+// A per-worker pool of stream reassembly blocks with a memory budget.
+//
+// Blocks come in power-of-two size classes from kMinBlockSize to
+// kMaxBlockSize and are recycled through per-class free lists, so a busy
+// worker stops calling malloc() once warm. The bytes held by the arena
+// (handed out plus cached) never exceed the budget: when a new block does
+// not fit, the arena first drops its cache and then evicts the least
+// recently used buffers. An evicted buffer rejects further data, which
+// its owner treats like any other reassembly failure.
+//
+// Not thread-safe. Every worker uses its own arena (Local()), and a buffer
+// must be used and destroyed by the worker that filled it.
+class ReassemblyArena {
+ public:
+  static constexpr size_t kMinBlockSize = 256;
+  static constexpr int kNumClasses = 9;
+  static constexpr size_t kMaxBlockSize = kMinBlockSize << (kNumClasses - 1);
+  static constexpr size_t kDefaultBudget = 64ull << 20;
+
+  explicit ReassemblyArena(size_t budget = default_budget());
+  ~ReassemblyArena();
+
+  // The arena of the calling thread, created on first use
+  static ReassemblyArena *Local();
+
+  // The budget of arenas created from now on (e.g., by Local())
+  static size_t default_budget();
+  static void SetDefaultBudget(size_t bytes);
+
+  // Shrinks or grows the budget, evicting buffers if needed
+  void SetBudget(size_t bytes);
+
+  size_t budget() const { return budget_; }
+  size_t used_bytes() const { return used_; }
+  size_t cached_bytes() const { return cached_; }
+  // Number of buffers that hold a block
+  size_t buffer_count() const { return buffer_count_; }
+  uint64_t evictions() const { return evictions_; }
+
+  static size_t BlockSize(int cls) { return kMinBlockSize << cls; }
+
+  // The smallest class that holds |size| bytes (up to kMaxBlockSize)
+  static int ClassOf(size_t size);
+
+ private:
+  friend class ReassemblyBuffer;
+
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  // Returns a block of class |cls|, or nullptr if the budget cannot fit it
+  // without evicting |keep|
+  char *Alloc(int cls, const ReassemblyBuffer *keep);
+  void Free(char *block, int cls);
+
+  // Returns the cached blocks to the system
+  void TrimCache();
+
+  // Evicts the least recently used buffer but |keep|. Returns false if
+  // there is none.
+  bool EvictOne(const ReassemblyBuffer *keep);
+
+  // Maintains the LRU list of buffers that hold a block
+  void Touch(ReassemblyBuffer *b);
+  void Unlink(ReassemblyBuffer *b);
+
+  size_t budget_;
+  size_t used_;
+  size_t cached_;
+  size_t buffer_count_;
+  uint64_t evictions_;
+
+  FreeBlock *free_[kNumClasses];
+
+  // Most and least recently used
+  ReassemblyBuffer *lru_head_;
+  ReassemblyBuffer *lru_tail_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReassemblyArena);
+};
+
+// Bytes of a stream (e.g., a TCP flow) put back in order.
+//
+// Takes no memory until the first data arrives. The data lives in one
+// arena block that doubles in size as needed, up to |max_bytes|: bytes
+// beyond that are dropped, and truncated() becomes true. Received ranges
+// are kept in a small inline list of up to kMaxSegments disjoint segments.
+class ReassemblyBuffer {
+ public:
+  static constexpr int kMaxSegments = 8;
+  static constexpr size_t kDefaultMaxBytes = 16384;
+
+  // |size_hint| is the size of the first block
+  explicit ReassemblyBuffer(size_t size_hint = ReassemblyArena::kMinBlockSize,
+                            size_t max_bytes = kDefaultMaxBytes);
+
+  ~ReassemblyBuffer() { Release(); }
+
+  // Copies |len| bytes to stream offset |offset|. Returns false if the
+  // buffer was evicted, if the arena is out of budget, or if the data would
+  // leave more than kMaxSegments segments.
+  bool Insert(uint32_t offset, const void *data, uint32_t len);
+
+  // Frees the block and forgets all data; the buffer can be reused.
+  void Release();
+
+  // The reassembled bytes. Not guaranteed to return the same pointer
+  // between calls to Insert().
+  const char *data() const { return block_ ? block_ : kEmpty; }
+
+  // Size of the current block; 0 until data arrives
+  size_t size() const {
+    return block_ ? ReassemblyArena::BlockSize(cls_) : 0;
+  }
+
+  // Length of the data received without holes from offset 0 on
+  size_t contiguous_len() const {
+    return (num_segs_ > 0 && segs_[0].start == 0) ? segs_[0].end : 0;
+  }
+
+  int segment_count() const { return num_segs_; }
+
+  size_t max_bytes() const { return max_bytes_; }
+
+  // Takes effect for data inserted from now on; at most kMaxBlockSize
+  void set_max_bytes(size_t max_bytes);
+
+  bool truncated() const { return truncated_; }
+  bool evicted() const { return evicted_; }
+
+ private:
+  friend class ReassemblyArena;
+
+  struct Segment {
+    uint32_t start;
+    uint32_t end;  // exclusive
+  };
+
+  static const char kEmpty[1];
+
+  // Makes the block hold at least |len| bytes
+  bool Reserve(size_t len);
+
+  // Adds [start, end) to the segment list, merging where they touch
+  bool AddSegment(uint32_t start, uint32_t end);
+
+  // Called by the arena
+  void Evict();
+
+  char *block_;
+  ReassemblyArena *arena_;
+  int8_t cls_;
+  int8_t num_segs_;
+  bool truncated_;
+  bool evicted_;
+  uint32_t size_hint_;
+  uint32_t max_bytes_;
+  Segment segs_[kMaxSegments];
+
+  ReassemblyBuffer *lru_prev_;
+  ReassemblyBuffer *lru_next_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReassemblyBuffer);
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_REASSEMBLY_BUFFER_H_
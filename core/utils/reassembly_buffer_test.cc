@@ -0,0 +1,158 @@
+#include "reassembly_buffer.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace bess {
+namespace utils {
+namespace {
+
+const size_t kMinBlock = ReassemblyArena::kMinBlockSize;
+
+TEST(ReassemblyBufferTest, Lazy) {
+  ReassemblyBuffer b;
+  EXPECT_EQ(0, b.size());
+  EXPECT_EQ(0, b.contiguous_len());
+  EXPECT_NE(nullptr, b.data());
+}
+
+TEST(ReassemblyBufferTest, Holes) {
+  ReassemblyArena *arena = ReassemblyArena::Local();
+  size_t used = arena->used_bytes();
+
+  ReassemblyBuffer b;
+  ASSERT_TRUE(b.Insert(10, "klmno", 5));
+  EXPECT_EQ(kMinBlock, b.size());
+  EXPECT_EQ(used + kMinBlock, arena->used_bytes());
+  EXPECT_EQ(0, b.contiguous_len());
+
+  ASSERT_TRUE(b.Insert(0, "abcde", 5));
+  EXPECT_EQ(5, b.contiguous_len());
+  EXPECT_EQ(2, b.segment_count());
+
+  // Fills the hole and overlaps both neighbors
+  ASSERT_TRUE(b.Insert(3, "defghijk", 8));
+  EXPECT_EQ(1, b.segment_count());
+  ASSERT_EQ(15, b.contiguous_len());
+  EXPECT_EQ("abcdefghijklmno", std::string(b.data(), 15));
+
+  b.Release();
+  EXPECT_EQ(0, b.size());
+  EXPECT_EQ(used, arena->used_bytes());
+}
+
+TEST(ReassemblyBufferTest, Reordered) {
+  std::string stream;
+  for (int i = 0; i < 3000; i++) {
+    stream.push_back(static_cast<char>('a' + i % 26));
+  }
+  std::vector<uint32_t> offsets;
+  for (uint32_t off = 0; off < stream.size(); off += 100) {
+    offsets.push_back(off);
+  }
+
+  std::mt19937 rng(1);
+  for (int round = 0; round < 20; round++) {
+    // Swaps neighbors, so that few holes are open at a time
+    for (size_t i = round % 2; i + 1 < offsets.size(); i += 2) {
+      if (rng() % 2) {
+        std::swap(offsets[i], offsets[i + 1]);
+      }
+    }
+    ReassemblyBuffer b(1);
+    for (uint32_t off : offsets) {
+      ASSERT_TRUE(b.Insert(off, stream.data() + off, 100));
+    }
+    ASSERT_EQ(stream.size(), b.contiguous_len());
+    EXPECT_EQ(4096, b.size());
+    EXPECT_EQ(stream, std::string(b.data(), stream.size()));
+    std::sort(offsets.begin(), offsets.end());
+  }
+}
+
+TEST(ReassemblyBufferTest, TooManyHoles) {
+  ReassemblyBuffer b;
+  for (int i = 0; i < ReassemblyBuffer::kMaxSegments; i++) {
+    ASSERT_TRUE(b.Insert(i * 10 + 5, "x", 1));
+  }
+  EXPECT_FALSE(b.Insert(200, "y", 1));
+  // Merging into an existing segment still works
+  EXPECT_TRUE(b.Insert(6, "x", 1));
+}
+
+TEST(ReassemblyBufferTest, MaxBytes) {
+  ReassemblyBuffer b(kMinBlock, 600);
+  EXPECT_EQ(600, b.max_bytes());
+  std::string data(500, 'z');
+  ASSERT_TRUE(b.Insert(0, data.data(), 500));
+  ASSERT_TRUE(b.Insert(500, data.data(), 500));
+  EXPECT_TRUE(b.truncated());
+  EXPECT_EQ(600, b.contiguous_len());
+  EXPECT_EQ(1024, b.size());
+  ASSERT_TRUE(b.Insert(700, data.data(), 10));
+  EXPECT_EQ(1, b.segment_count());
+
+  b.set_max_bytes(1 << 30);
+  EXPECT_EQ(ReassemblyArena::kMaxBlockSize, b.max_bytes());
+}
+
+TEST(ReassemblyBufferTest, Budget) {
+  // Buffers take their blocks from the calling thread's arena
+  std::string data(kMinBlock, 'q');
+  ReassemblyArena *local = ReassemblyArena::Local();
+  size_t old_budget = local->budget();
+  size_t used = local->used_bytes();
+  local->SetBudget(used + 4 * kMinBlock);
+
+  {
+    ReassemblyBuffer a, c, d;
+    ASSERT_TRUE(a.Insert(0, data.data(), kMinBlock));
+    ASSERT_TRUE(c.Insert(0, data.data(), kMinBlock));
+    ASSERT_TRUE(d.Insert(0, data.data(), 2 * kMinBlock));
+    EXPECT_EQ(used + 4 * kMinBlock, local->used_bytes());
+    EXPECT_EQ(0, local->evictions());
+
+    // |a| is the least recently used, and makes room for |e|
+    ASSERT_TRUE(c.Insert(kMinBlock - 1, "q", 1));
+    ReassemblyBuffer e;
+    ASSERT_TRUE(e.Insert(0, data.data(), 10));
+    EXPECT_EQ(1, local->evictions());
+    EXPECT_TRUE(a.evicted());
+    EXPECT_FALSE(a.Insert(kMinBlock, "q", 1));
+    EXPECT_FALSE(c.evicted());
+    EXPECT_LE(local->used_bytes() + local->cached_bytes(),
+              local->budget());
+
+    // A buffer cannot grow past the budget by evicting itself
+    local->SetBudget(used + kMinBlock);
+    EXPECT_EQ(1, local->buffer_count());
+    EXPECT_FALSE(e.Insert(0, data.data(), 2 * kMinBlock));
+    EXPECT_FALSE(e.evicted());
+
+    a.Release();
+    EXPECT_FALSE(a.evicted());
+    EXPECT_TRUE(a.Insert(0, "a", 1));
+  }
+  EXPECT_EQ(used, local->used_bytes());
+  local->SetBudget(old_budget);
+}
+
+TEST(ReassemblyBufferTest, Classes) {
+  ReassemblyArena::SetDefaultBudget(1 << 20);
+  EXPECT_EQ(1 << 20, ReassemblyArena::default_budget());
+  ReassemblyArena::SetDefaultBudget(ReassemblyArena::kDefaultBudget);
+
+  EXPECT_EQ(0, ReassemblyArena::ClassOf(1));
+  EXPECT_EQ(0, ReassemblyArena::ClassOf(kMinBlock));
+  EXPECT_EQ(1, ReassemblyArena::ClassOf(kMinBlock + 1));
+  EXPECT_EQ(ReassemblyArena::kNumClasses - 1,
+            ReassemblyArena::ClassOf(ReassemblyArena::kMaxBlockSize));
+}
+
+}  // namespace
+}  // namespace utils
+}  // namespace bess
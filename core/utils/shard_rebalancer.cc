@@ -0,0 +1,253 @@
+#include "shard_rebalancer.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace bess {
+namespace utils {
+
+void ShardRebalancer::Init(uint16_t num_shards, uint16_t num_cores,
+                           CapacityFunc capacity,
+                           const ShardRebalancerOptions &opts) {
+  capacity_ = capacity;
+  opts_ = opts;
+  shards_.assign(num_shards, Shard());
+  cores_.assign(num_cores, Core());
+  total_pkt_rate_ = 0;
+  origins_.clear();
+}
+
+void ShardRebalancer::SetCoreUsable(uint16_t core, bool usable) {
+  DCHECK_LT(core, cores_.size());
+  cores_[core].usable = usable;
+}
+
+void ShardRebalancer::Assign(uint16_t shard, uint16_t core) {
+  DCHECK_LT(shard, shards_.size());
+  DCHECK_LT(core, cores_.size());
+  Detach(shard);
+  Attach(shard, core);
+}
+
+void ShardRebalancer::UpdateShard(uint16_t shard, uint64_t pkt_rate,
+                                  uint64_t flow_count) {
+  Shard &s = shards_[shard];
+  total_pkt_rate_ += pkt_rate - s.pkt_rate;
+  if (s.core != kNoCore) {
+    Core &c = cores_[s.core];
+    c.pkt_rate += pkt_rate - s.pkt_rate;
+    c.flow_count += flow_count - s.flow_count;
+  }
+  s.pkt_rate = pkt_rate;
+  s.flow_count = flow_count;
+}
+
+uint16_t ShardRebalancer::ActiveCoreCount() const {
+  uint16_t cnt = 0;
+  for (const Core &c : cores_) {
+    cnt += !c.shards.empty();
+  }
+  return cnt;
+}
+
+void ShardRebalancer::Detach(uint16_t shard) {
+  Shard &s = shards_[shard];
+  if (s.core == kNoCore) {
+    return;
+  }
+  Core &c = cores_[s.core];
+  c.pkt_rate -= s.pkt_rate;
+  c.flow_count -= s.flow_count;
+  c.shards.erase(std::find(c.shards.begin(), c.shards.end(), shard));
+  s.core = kNoCore;
+}
+
+void ShardRebalancer::Attach(uint16_t shard, uint16_t core) {
+  Shard &s = shards_[shard];
+  Core &c = cores_[core];
+  if (c.shards.empty()) {
+    c.stable_epochs = 0;
+  }
+  c.pkt_rate += s.pkt_rate;
+  c.flow_count += s.flow_count;
+  c.shards.push_back(shard);
+  s.core = core;
+}
+
+void ShardRebalancer::Move(uint16_t shard, uint16_t core) {
+  origins_.emplace(shard, shards_[shard].core);
+  Detach(shard);
+  Attach(shard, core);
+}
+
+uint16_t ShardRebalancer::LargestShard(uint16_t core) const {
+  const std::vector<uint16_t> &shards = cores_[core].shards;
+  return *std::max_element(shards.begin(), shards.end(),
+                           [this](uint16_t a, uint16_t b) {
+                             return shards_[a].pkt_rate < shards_[b].pkt_rate;
+                           });
+}
+
+bool ShardRebalancer::Fits(uint16_t shard, uint16_t core,
+                           double head_room) const {
+  const Shard &s = shards_[shard];
+  const Core &c = cores_[core];
+  return c.pkt_rate + s.pkt_rate <
+         capacity_(c.flow_count + s.flow_count) * (1 - head_room);
+}
+
+uint16_t ShardRebalancer::FirstFit(uint16_t shard, uint16_t exclude,
+                                   bool allow_new) const {
+  for (uint16_t i = 0; i < cores_.size(); i++) {
+    if (i != exclude && cores_[i].usable && !cores_[i].shards.empty() &&
+        Fits(shard, i, opts_.assign_head_room)) {
+      return i;
+    }
+  }
+  if (allow_new) {
+    for (uint16_t i = 0; i < cores_.size(); i++) {
+      if (i != exclude && cores_[i].usable && cores_[i].shards.empty()) {
+        return i;
+      }
+    }
+  }
+  return kNoCore;
+}
+
+std::map<uint16_t, uint16_t> ShardRebalancer::CollectMoves() {
+  std::map<uint16_t, uint16_t> moves;
+  for (const auto &it : origins_) {
+    uint16_t core = shards_[it.first].core;
+    if (core != it.second) {
+      moves[it.first] = core;
+    }
+  }
+  origins_.clear();
+  return moves;
+}
+
+std::map<uint16_t, uint16_t> ShardRebalancer::Rebalance() {
+  origins_.clear();
+  for (Core &c : cores_) {
+    if (!c.shards.empty()) {
+      c.stable_epochs += 1;
+    }
+  }
+
+  // 1) Overloaded cores shed their largest shards. A core with a single
+  // shard is left alone, as moving the shard cannot help.
+  std::vector<std::pair<uint16_t, uint16_t>> to_move;  // (shard, origin)
+  for (uint16_t i = 0; i < cores_.size(); i++) {
+    Core &c = cores_[i];
+    while (c.shards.size() > 1 &&
+           c.pkt_rate >
+               capacity_(c.flow_count) * (1 - opts_.migrate_head_room)) {
+      uint16_t shard = LargestShard(i);
+      Detach(shard);
+      to_move.emplace_back(shard, i);
+      c.stable_epochs = 0;
+    }
+  }
+
+  // 2) Place them, largest first; a shard that fits nowhere stays put
+  std::sort(to_move.begin(), to_move.end(),
+            [this](const std::pair<uint16_t, uint16_t> &a,
+                   const std::pair<uint16_t, uint16_t> &b) {
+              return shards_[a.first].pkt_rate > shards_[b.first].pkt_rate;
+            });
+  int skipped = 0;
+  for (const auto &it : to_move) {
+    uint16_t core = FirstFit(it.first, it.second, true);
+    if (core == kNoCore) {
+      core = it.second;
+      skipped += 1;
+    }
+    origins_.emplace(it.first, it.second);
+    Attach(it.first, core);
+  }
+  if (skipped > 0) {
+    LOG(INFO) << "No idle ncore found for " << skipped
+              << " shards; active ncores: " << ActiveCoreCount();
+  }
+
+  if (ActiveCoreCount() <= 1) {
+    return CollectMoves();
+  }
+
+  // 3) Try to reclaim the least-loaded stable core
+  uint16_t min_core = kNoCore;
+  for (uint16_t i = 0; i < cores_.size(); i++) {
+    const Core &c = cores_[i];
+    if (c.shards.empty() || c.stable_epochs <= opts_.min_reclaim_epochs) {
+      continue;
+    }
+    if (min_core == kNoCore || c.pkt_rate < cores_[min_core].pkt_rate) {
+      min_core = i;
+    }
+  }
+
+  // Do nothing to avoid oscillations if the core is still busy
+  if (min_core == kNoCore ||
+      cores_[min_core].pkt_rate > capacity_(cores_[min_core].flow_count) / 2) {
+    return CollectMoves();
+  }
+
+  std::vector<uint16_t> pack = cores_[min_core].shards;
+  std::sort(pack.begin(), pack.end(), [this](uint16_t a, uint16_t b) {
+    return shards_[a].pkt_rate > shards_[b].pkt_rate;
+  });
+  std::vector<uint16_t> packed;
+  for (uint16_t shard : pack) {
+    uint16_t core = FirstFit(shard, min_core, false);
+    if (core == kNoCore) {
+      break;
+    }
+    Detach(shard);
+    Attach(shard, core);
+    packed.push_back(shard);
+  }
+
+  if (packed.size() == pack.size()) {
+    for (uint16_t shard : pack) {
+      origins_.emplace(shard, min_core);
+    }
+  } else {
+    // Undo the trial
+    for (uint16_t shard : packed) {
+      Detach(shard);
+      Attach(shard, min_core);
+    }
+  }
+
+  return CollectMoves();
+}
+
+std::map<uint16_t, uint16_t> ShardRebalancer::Offload(uint16_t core) {
+  origins_.clear();
+
+  uint16_t target = kNoCore;
+  for (uint16_t i = 0; i < cores_.size(); i++) {
+    if (i == core || !cores_[i].usable) {
+      continue;
+    }
+    if (target == kNoCore || cores_[i].pkt_rate < cores_[target].pkt_rate) {
+      target = i;
+    }
+  }
+  if (target == kNoCore) {
+    return CollectMoves();
+  }
+
+  Core &c = cores_[core];
+  uint64_t target_pkt_rate = c.pkt_rate / 2;
+  while (c.shards.size() > 1 && c.pkt_rate > target_pkt_rate) {
+    Move(LargestShard(core), target);
+  }
+  c.stable_epochs = 0;
+
+  return CollectMoves();
+}
+
+}  // namespace utils
+}  // namespace bess
@@ -0,0 +1,136 @@
+#ifndef BESS_UTILS_SHARD_REBALANCER_H_
+#define BESS_UTILS_SHARD_REBALANCER_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+struct ShardRebalancerOptions {
+  // Shards are moved away from a core above (1 - migrate) * capacity
+  double migrate_head_room = 0.15;
+  // Shards are moved to a core only if it stays below (1 - assign) * capacity
+  double assign_head_room = 0.25;
+  // A core is reclaimed only if it has been stable for more epochs
+  uint32_t min_reclaim_epochs = 4;
+};
+
+// An incremental optimizer that packs RSS shards onto as few normal cores as
+// possible without overloading any of them.
+//
+// Per-shard stats can be updated at any time (e.g., as soon as one core
+// reports). Each update adjusts the owning core's aggregated load in O(1),
+// so Rebalance() never rescans all shards: it only looks at overloaded
+// cores and at the least-loaded core, and returns the shards whose core
+// has changed (a minimal delta for the NIC's redirection table).
+//
+// Example usage:
+//
+//  ShardRebalancer rb;
+//  rb.Init(64, 8, [](uint64_t flows) { return 1000000; });
+//  rb.SetCoreUsable(0, true);
+//  rb.Assign(shard, 0);
+//  rb.UpdateShard(shard, pkt_rate, flow_count);
+//  std::map<uint16_t, uint16_t> moves = rb.Rebalance();  // shard -> core
+class ShardRebalancer {
+ public:
+  static constexpr uint16_t kNoCore = UINT16_MAX;
+
+  // Returns the max packet rate of a core that handles |flow_count| flows.
+  using CapacityFunc = std::function<uint64_t(uint64_t flow_count)>;
+
+  ShardRebalancer() = default;
+
+  // Drops all state. All cores start unusable and without shards.
+  void Init(uint16_t num_shards, uint16_t num_cores, CapacityFunc capacity,
+            const ShardRebalancerOptions &opts = ShardRebalancerOptions());
+
+  // Only usable cores can take over shards.
+  void SetCoreUsable(uint16_t core, bool usable);
+
+  // Sets the owner of |shard| without reporting it as a move, e.g., to load
+  // the NIC's initial redirection table.
+  void Assign(uint16_t shard, uint16_t core);
+
+  // Replaces the stats of |shard|.
+  void UpdateShard(uint16_t shard, uint64_t pkt_rate, uint64_t flow_count);
+
+  // Runs one long-term epoch:
+  // 1) overloaded cores shed their largest shards until they fit;
+  // 2) shed shards go to the first core with room, or to a new core;
+  // 3) the least-loaded core is reclaimed if its shards fit elsewhere.
+  // Returns the moved shards and their new cores.
+  std::map<uint16_t, uint16_t> Rebalance();
+
+  // Moves the largest shards of |core| to the least-loaded other usable core
+  // until |core|'s load is halved. Used for on-demand rebalancing.
+  std::map<uint16_t, uint16_t> Offload(uint16_t core);
+
+  uint16_t CoreOf(uint16_t shard) const { return shards_[shard].core; }
+  const std::vector<uint16_t> &ShardsOf(uint16_t core) const {
+    return cores_[core].shards;
+  }
+  uint64_t ShardPktRate(uint16_t shard) const {
+    return shards_[shard].pkt_rate;
+  }
+  uint64_t ShardFlowCount(uint16_t shard) const {
+    return shards_[shard].flow_count;
+  }
+  uint64_t CorePktRate(uint16_t core) const { return cores_[core].pkt_rate; }
+  uint64_t CoreFlowCount(uint16_t core) const {
+    return cores_[core].flow_count;
+  }
+  bool IsActive(uint16_t core) const { return !cores_[core].shards.empty(); }
+  uint16_t ActiveCoreCount() const;
+  uint64_t TotalPktRate() const { return total_pkt_rate_; }
+
+ private:
+  struct Shard {
+    uint16_t core = kNoCore;
+    uint64_t pkt_rate = 0;
+    uint64_t flow_count = 0;
+  };
+
+  struct Core {
+    bool usable = false;
+    uint32_t stable_epochs = 0;  // epochs without shedding shards
+    uint64_t pkt_rate = 0;
+    uint64_t flow_count = 0;
+    std::vector<uint16_t> shards;
+  };
+
+  void Detach(uint16_t shard);
+  void Attach(uint16_t shard, uint16_t core);
+
+  // Moves |shard| to |core| and remembers its original core in |origins_|
+  void Move(uint16_t shard, uint16_t core);
+
+  // Returns the largest shard of |core|
+  uint16_t LargestShard(uint16_t core) const;
+
+  bool Fits(uint16_t shard, uint16_t core, double head_room) const;
+
+  // Returns the first active core other than |exclude| with room for
+  // |shard|, or a new usable core if |allow_new|. kNoCore if none.
+  uint16_t FirstFit(uint16_t shard, uint16_t exclude, bool allow_new) const;
+
+  // Returns the moves since |origins_| was cleared
+  std::map<uint16_t, uint16_t> CollectMoves();
+
+  CapacityFunc capacity_;
+  ShardRebalancerOptions opts_;
+  std::vector<Shard> shards_;
+  std::vector<Core> cores_;
+  uint64_t total_pkt_rate_ = 0;
+
+  // shard -> core before the current operation
+  std::map<uint16_t, uint16_t> origins_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_SHARD_REBALANCER_H_
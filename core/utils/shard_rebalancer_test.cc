@@ -0,0 +1,177 @@
+#include "shard_rebalancer.h"
+
+#include <gtest/gtest.h>
+
+using bess::utils::ShardRebalancer;
+
+namespace {
+
+// Every core can process 1000 pps, whatever its flow count
+uint64_t FixedCapacity(uint64_t) {
+  return 1000;
+}
+
+class ShardRebalancerTest : public ::testing::Test {
+ protected:
+  // 8 shards and 4 usable cores; all shards start on core 0
+  void SetUp() override {
+    rb_.Init(8, 4, FixedCapacity);
+    for (uint16_t i = 0; i < 4; i++) {
+      rb_.SetCoreUsable(i, true);
+    }
+    for (uint16_t i = 0; i < 8; i++) {
+      rb_.Assign(i, 0);
+    }
+  }
+
+  ShardRebalancer rb_;
+};
+
+TEST_F(ShardRebalancerTest, Aggregates) {
+  rb_.UpdateShard(0, 100, 10);
+  rb_.UpdateShard(1, 200, 20);
+  EXPECT_EQ(300, rb_.CorePktRate(0));
+  EXPECT_EQ(30, rb_.CoreFlowCount(0));
+
+  rb_.UpdateShard(1, 50, 5);
+  EXPECT_EQ(150, rb_.CorePktRate(0));
+  EXPECT_EQ(15, rb_.CoreFlowCount(0));
+  EXPECT_EQ(150, rb_.TotalPktRate());
+
+  rb_.Assign(1, 2);
+  EXPECT_EQ(100, rb_.CorePktRate(0));
+  EXPECT_EQ(50, rb_.CorePktRate(2));
+  EXPECT_EQ(2, rb_.CoreOf(1));
+  EXPECT_EQ(2, rb_.ActiveCoreCount());
+  EXPECT_EQ(7, rb_.ShardsOf(0).size());
+}
+
+TEST_F(ShardRebalancerTest, NoMovesWhenBalanced) {
+  for (uint16_t i = 0; i < 8; i++) {
+    rb_.UpdateShard(i, 50, 1);
+  }
+  EXPECT_TRUE(rb_.Rebalance().empty());
+  EXPECT_EQ(1, rb_.ActiveCoreCount());
+}
+
+TEST_F(ShardRebalancerTest, OverloadShedsLargestShards) {
+  for (uint16_t i = 0; i < 8; i++) {
+    rb_.UpdateShard(i, 100, 1);
+  }
+  rb_.UpdateShard(3, 400, 1);  // 1100 pps on core 0
+
+  std::map<uint16_t, uint16_t> moves = rb_.Rebalance();
+  // Moving the largest shard alone is enough
+  ASSERT_EQ(1, moves.size());
+  EXPECT_EQ(1, moves[3]);
+  EXPECT_EQ(700, rb_.CorePktRate(0));
+  EXPECT_EQ(400, rb_.CorePktRate(1));
+  EXPECT_EQ(2, rb_.ActiveCoreCount());
+}
+
+TEST_F(ShardRebalancerTest, FirstFitPrefersActiveCores) {
+  for (uint16_t i = 0; i < 8; i++) {
+    rb_.UpdateShard(i, 10, 1);
+  }
+  rb_.Assign(7, 2);
+  rb_.UpdateShard(0, 500, 1);
+  rb_.UpdateShard(1, 400, 1);  // 950 pps on core 0
+
+  std::map<uint16_t, uint16_t> moves = rb_.Rebalance();
+  ASSERT_EQ(1, moves.size());
+  EXPECT_EQ(2, moves[0]);  // core 2 is active and has room
+}
+
+TEST_F(ShardRebalancerTest, SingleShardStays) {
+  rb_.UpdateShard(0, 5000, 1);
+  for (uint16_t i = 1; i < 8; i++) {
+    rb_.Assign(i, 1);
+  }
+  EXPECT_TRUE(rb_.Rebalance().empty());
+  EXPECT_EQ(0, rb_.CoreOf(0));
+}
+
+TEST_F(ShardRebalancerTest, NoIdleCore) {
+  rb_.SetCoreUsable(1, false);
+  rb_.SetCoreUsable(2, false);
+  rb_.SetCoreUsable(3, false);
+  for (uint16_t i = 0; i < 8; i++) {
+    rb_.UpdateShard(i, 200, 1);
+  }
+  EXPECT_TRUE(rb_.Rebalance().empty());
+  EXPECT_EQ(8, rb_.ShardsOf(0).size());
+  EXPECT_EQ(1600, rb_.CorePktRate(0));
+}
+
+TEST_F(ShardRebalancerTest, ReclaimAfterStableEpochs) {
+  for (uint16_t i = 0; i < 8; i++) {
+    rb_.UpdateShard(i, 50, 1);
+  }
+  rb_.Assign(6, 1);
+  rb_.Assign(7, 1);
+
+  // Core 1 is lightly loaded but has not been stable long enough
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(rb_.Rebalance().empty());
+  }
+  std::map<uint16_t, uint16_t> moves = rb_.Rebalance();
+  ASSERT_EQ(2, moves.size());
+  EXPECT_EQ(0, moves[6]);
+  EXPECT_EQ(0, moves[7]);
+  EXPECT_EQ(1, rb_.ActiveCoreCount());
+  EXPECT_EQ(400, rb_.CorePktRate(0));
+}
+
+TEST_F(ShardRebalancerTest, ReclaimRollsBack) {
+  for (uint16_t i = 0; i < 6; i++) {
+    rb_.UpdateShard(i, 110, 1);  // 660 pps on core 0
+  }
+  rb_.UpdateShard(6, 60, 1);
+  rb_.UpdateShard(7, 60, 1);
+  rb_.Assign(6, 1);
+  rb_.Assign(7, 1);
+
+  // Core 0 can take one more shard below 750 pps, but not both
+  for (int i = 0; i < 8; i++) {
+    EXPECT_TRUE(rb_.Rebalance().empty());
+  }
+  EXPECT_EQ(660, rb_.CorePktRate(0));
+  EXPECT_EQ(120, rb_.CorePktRate(1));
+  EXPECT_EQ(2, rb_.ActiveCoreCount());
+}
+
+TEST_F(ShardRebalancerTest, CapacityDependsOnFlows) {
+  rb_.Init(4, 2, [](uint64_t flows) { return flows > 100 ? 500 : 1000; });
+  rb_.SetCoreUsable(0, true);
+  rb_.SetCoreUsable(1, true);
+  for (uint16_t i = 0; i < 4; i++) {
+    rb_.Assign(i, 0);
+    rb_.UpdateShard(i, 120, 10);
+  }
+  EXPECT_TRUE(rb_.Rebalance().empty());
+
+  // Same packet rate, but more flows
+  rb_.UpdateShard(0, 120, 80);
+  std::map<uint16_t, uint16_t> moves = rb_.Rebalance();
+  ASSERT_EQ(1, moves.size());
+  EXPECT_EQ(1, moves.begin()->second);
+}
+
+TEST_F(ShardRebalancerTest, Offload) {
+  for (uint16_t i = 0; i < 8; i++) {
+    rb_.UpdateShard(i, 100, 1);
+  }
+  rb_.Assign(7, 1);
+  rb_.UpdateShard(7, 300, 1);
+
+  std::map<uint16_t, uint16_t> moves = rb_.Offload(0);
+  // Core 2 and 3 are idle; core 2 comes first
+  EXPECT_EQ(4, moves.size());
+  for (const auto &it : moves) {
+    EXPECT_EQ(2, it.second);
+  }
+  EXPECT_EQ(300, rb_.CorePktRate(0));
+  EXPECT_EQ(400, rb_.CorePktRate(2));
+}
+
+}  // namespace (unnamed)
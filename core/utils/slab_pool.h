@@ -0,0 +1,159 @@
+#ifndef BESS_UTILS_SLAB_POOL_H_
+#define BESS_UTILS_SLAB_POOL_H_
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "common.h"
+
+namespace bess {
+namespace utils {
+
+// A fixed-capacity object pool carved out of a single memory region that is
+// provided by the caller (e.g., a hugepage-backed block from rte_malloc).
+// Alloc() and Free() are O(1) and never call into the system allocator, so
+// the pool can be used on the packet path. It is not thread-safe: a pool is
+// owned by one core.
+//
+// Example usage:
+//
+//  size_t bytes = SlabPool<Foo>::BytesWithCapacity(n);
+//  void *mem = rte_zmalloc(nullptr, bytes, 64);
+//  SlabPool<Foo> pool;
+//  pool.Init(mem, n);
+//  Foo *foo = pool.Alloc(arg1, arg2);
+//  pool.Free(foo);
+template <typename T>
+class SlabPool {
+ public:
+  static constexpr size_t kAlign = 64;
+
+  // Returns the size of the memory region needed to hold |capacity| objects
+  // and the pool's bookkeeping.
+  static size_t BytesWithCapacity(uint32_t capacity) {
+    return ObjectBytes(capacity) + FreeListBytes(capacity) +
+           BitmapBytes(capacity);
+  }
+
+  SlabPool()
+      : objs_(nullptr),
+        free_list_(nullptr),
+        in_use_(nullptr),
+        capacity_(0),
+        free_count_(0) {}
+
+  SlabPool(const SlabPool &) = delete;
+  SlabPool &operator=(const SlabPool &) = delete;
+
+  // |mem| must be 64-byte aligned and have at least
+  // BytesWithCapacity(capacity) bytes. The pool does not own |mem|; call
+  // Reset() to destroy live objects before releasing it.
+  void Init(void *mem, uint32_t capacity) {
+    CHECK_EQ(reinterpret_cast<uintptr_t>(mem) % kAlign, 0);
+    Reset();
+
+    char *p = reinterpret_cast<char *>(mem);
+    objs_ = reinterpret_cast<T *>(p);
+    free_list_ = reinterpret_cast<uint32_t *>(p + ObjectBytes(capacity));
+    in_use_ = reinterpret_cast<uint64_t *>(p + ObjectBytes(capacity) +
+                                           FreeListBytes(capacity));
+    capacity_ = capacity;
+    Rebuild();
+  }
+
+  // Destroys all live objects and returns every slot to the free list.
+  void Reset() {
+    if (objs_ == nullptr) {
+      return;
+    }
+    for (uint32_t i = NextInUse(0, capacity_); i < capacity_;
+         i = NextInUse(i + 1, capacity_)) {
+      objs_[i].~T();
+    }
+    Rebuild();
+  }
+
+  // Constructs a new object in a free slot.
+  // Returns nullptr if the pool is exhausted.
+  template <typename... Args>
+  T *Alloc(Args &&... args) {
+    if (unlikely(free_count_ == 0)) {
+      return nullptr;
+    }
+    uint32_t idx = free_list_[--free_count_];
+    in_use_[idx >> 6] |= (1ull << (idx & 63));
+    return new (&objs_[idx]) T(std::forward<Args>(args)...);
+  }
+
+  // Destroys |obj| and returns its slot to the pool.
+  void Free(T *obj) {
+    uint32_t idx = Index(obj);
+    DCHECK_LT(idx, capacity_);
+    DCHECK(IsInUse(idx));
+    obj->~T();
+    in_use_[idx >> 6] &= ~(1ull << (idx & 63));
+    free_list_[free_count_++] = idx;
+  }
+
+  uint32_t Index(const T *obj) const { return obj - objs_; }
+
+  bool IsInUse(uint32_t idx) const {
+    return in_use_[idx >> 6] & (1ull << (idx & 63));
+  }
+
+  // Returns the live object at slot |idx|, or nullptr if the slot is free.
+  T *Get(uint32_t idx) { return IsInUse(idx) ? &objs_[idx] : nullptr; }
+
+  // Returns the first in-use slot in [from, end), or |end| if there is none.
+  // Free slots are skipped 64 at a time.
+  uint32_t NextInUse(uint32_t from, uint32_t end) const {
+    while (from < end) {
+      uint64_t word = in_use_[from >> 6] >> (from & 63);
+      if (word) {
+        from += __builtin_ctzll(word);
+        return from < end ? from : end;
+      }
+      from = (from | 63) + 1;
+    }
+    return end;
+  }
+
+  uint32_t Capacity() const { return capacity_; }
+  uint32_t Size() const { return capacity_ - free_count_; }
+  uint32_t Available() const { return free_count_; }
+
+ private:
+  static size_t ObjectBytes(uint32_t capacity) {
+    return align_ceil(sizeof(T) * capacity, kAlign);
+  }
+  static size_t FreeListBytes(uint32_t capacity) {
+    return align_ceil(sizeof(uint32_t) * capacity, kAlign);
+  }
+  static size_t BitmapBytes(uint32_t capacity) {
+    return align_ceil(sizeof(uint64_t) * ((capacity + 63) / 64), kAlign);
+  }
+
+  // Marks all slots free. Lower slots are handed out first.
+  void Rebuild() {
+    memset(in_use_, 0, BitmapBytes(capacity_));
+    for (uint32_t i = 0; i < capacity_; i++) {
+      free_list_[i] = capacity_ - 1 - i;
+    }
+    free_count_ = capacity_;
+  }
+
+  T *objs_;
+  uint32_t *free_list_;  // a stack of free slot indices
+  uint64_t *in_use_;     // 1 bit per slot
+  uint32_t capacity_;
+  uint32_t free_count_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_SLAB_POOL_H_
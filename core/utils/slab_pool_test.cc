@@ -0,0 +1,119 @@
+#include "slab_pool.h"
+
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using bess::utils::SlabPool;
+
+namespace {
+
+struct Counted {
+  static int live;
+
+  Counted() : value(0) { live++; }
+  explicit Counted(int v) : value(v) { live++; }
+  ~Counted() { live--; }
+
+  int value;
+};
+
+int Counted::live = 0;
+
+class SlabPoolTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Counted::live = 0;
+    mem_ = std::aligned_alloc(SlabPool<Counted>::kAlign,
+                              SlabPool<Counted>::BytesWithCapacity(kCapacity));
+    pool_.Init(mem_, kCapacity);
+  }
+
+  void TearDown() override {
+    pool_.Reset();
+    std::free(mem_);
+  }
+
+  static constexpr uint32_t kCapacity = 200;
+
+  void *mem_;
+  SlabPool<Counted> pool_;
+};
+
+TEST_F(SlabPoolTest, AllocAndFree) {
+  EXPECT_EQ(kCapacity, pool_.Capacity());
+  EXPECT_EQ(0, pool_.Size());
+
+  Counted *a = pool_.Alloc(7);
+  ASSERT_NE(nullptr, a);
+  EXPECT_EQ(7, a->value);
+  EXPECT_EQ(1, Counted::live);
+  EXPECT_EQ(1, pool_.Size());
+  EXPECT_EQ(a, pool_.Get(pool_.Index(a)));
+
+  uint32_t idx = pool_.Index(a);
+  pool_.Free(a);
+  EXPECT_EQ(0, Counted::live);
+  EXPECT_EQ(0, pool_.Size());
+  EXPECT_EQ(nullptr, pool_.Get(idx));
+
+  // A freed slot is reused first
+  Counted *b = pool_.Alloc();
+  EXPECT_EQ(idx, pool_.Index(b));
+}
+
+TEST_F(SlabPoolTest, Exhaustion) {
+  std::set<Counted *> objs;
+  for (uint32_t i = 0; i < kCapacity; i++) {
+    Counted *c = pool_.Alloc(i);
+    ASSERT_NE(nullptr, c);
+    objs.insert(c);
+  }
+  EXPECT_EQ(kCapacity, objs.size());
+  EXPECT_EQ(0, pool_.Available());
+  EXPECT_EQ(nullptr, pool_.Alloc());
+
+  pool_.Free(*objs.begin());
+  EXPECT_NE(nullptr, pool_.Alloc());
+  EXPECT_EQ(nullptr, pool_.Alloc());
+}
+
+TEST_F(SlabPoolTest, NextInUse) {
+  std::vector<Counted *> objs;
+  for (uint32_t i = 0; i < kCapacity; i++) {
+    objs.push_back(pool_.Alloc(i));
+  }
+  // Keep slots 3, 64, 130 and 199 only
+  for (uint32_t i = 0; i < kCapacity; i++) {
+    if (i != 3 && i != 64 && i != 130 && i != 199) {
+      pool_.Free(objs[i]);
+    }
+  }
+
+  std::vector<uint32_t> found;
+  for (uint32_t i = pool_.NextInUse(0, kCapacity); i < kCapacity;
+       i = pool_.NextInUse(i + 1, kCapacity)) {
+    found.push_back(i);
+  }
+  EXPECT_EQ(std::vector<uint32_t>({3, 64, 130, 199}), found);
+
+  EXPECT_EQ(64, pool_.NextInUse(4, 100));
+  EXPECT_EQ(100, pool_.NextInUse(65, 100));
+  EXPECT_EQ(130, pool_.NextInUse(130, 131));
+}
+
+TEST_F(SlabPoolTest, Reset) {
+  for (uint32_t i = 0; i < kCapacity / 2; i++) {
+    pool_.Alloc(i);
+  }
+  EXPECT_EQ(kCapacity / 2, Counted::live);
+
+  pool_.Reset();
+  EXPECT_EQ(0, Counted::live);
+  EXPECT_EQ(0, pool_.Size());
+  EXPECT_EQ(kCapacity, pool_.NextInUse(0, kCapacity));
+}
+
+}  // namespace (unnamed)
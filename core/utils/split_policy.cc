@@ -0,0 +1,361 @@
+#include "split_policy.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+// Greedy bin-packing: flows are kept on the normal core in arrival order
+// until it is full; the rest go to the first queue with enough room.
+class GreedySplitPolicy final : public SplitPolicy {
+ public:
+  const char *name() const override { return "greedy"; }
+
+  void Split(std::vector<SplitFlow> *flows, const SplitBudget &budget,
+             std::vector<SplitQueue> *queues, SplitQueuePool *pool) override {
+    uint32_t local_pkt_assigned = 0;
+    for (SplitFlow &flow : *flows) {
+      if (flow.size > budget.queue_pkt_thresh) {
+        flow.decision = kBoost;
+      } else if (local_pkt_assigned + flow.size < budget.local_pkt_thresh) {
+        local_pkt_assigned += flow.size;
+        flow.decision = kLocal;
+      } else {
+        FirstFit(&flow, budget, queues, pool);
+      }
+    }
+  }
+};
+
+// Consistent-hash spreading: the normal core is filled as in the greedy
+// policy. Then, enough queues for all remaining packets are set up at once,
+// and each remaining flow goes to the queue picked by its hash (or the next
+// one with room), so that flows spread evenly instead of filling the first
+// queue up.
+class ConsistentHashSplitPolicy final : public SplitPolicy {
+ public:
+  const char *name() const override { return "consistent_hash"; }
+
+  void Split(std::vector<SplitFlow> *flows, const SplitBudget &budget,
+             std::vector<SplitQueue> *queues, SplitQueuePool *pool) override {
+    uint32_t local_pkt_assigned = 0;
+    uint64_t overflow_pkts = 0;
+    overflow_.clear();
+    for (size_t i = 0; i < flows->size(); i++) {
+      SplitFlow &flow = (*flows)[i];
+      if (flow.size > budget.queue_pkt_thresh) {
+        flow.decision = kBoost;
+      } else if (local_pkt_assigned + flow.size < budget.local_pkt_thresh) {
+        local_pkt_assigned += flow.size;
+        flow.decision = kLocal;
+      } else {
+        overflow_.push_back(i);
+        overflow_pkts += flow.size;
+      }
+    }
+    if (overflow_.empty()) {
+      return;
+    }
+
+    uint64_t spare_pkts = 0;
+    for (const SplitQueue &q : *queues) {
+      if (q.load < budget.queue_pkt_thresh) {
+        spare_pkts += budget.queue_pkt_thresh - q.load;
+      }
+    }
+    while (spare_pkts < overflow_pkts && AddQueue(queues, pool)) {
+      spare_pkts += budget.queue_pkt_thresh;
+    }
+
+    for (size_t i : overflow_) {
+      SplitFlow &flow = (*flows)[i];
+      size_t n = queues->size();
+      flow.decision = kDrop;
+      for (size_t j = 0; j < n; j++) {
+        SplitQueue &q = (*queues)[(flow.hash + j) % n];
+        if (q.load + flow.size < budget.queue_pkt_thresh) {
+          q.load += flow.size;
+          flow.decision = q.id;
+          break;
+        }
+      }
+      if (flow.decision == kDrop) {
+        FirstFit(&flow, budget, queues, pool);
+      }
+    }
+  }
+
+ private:
+  std::vector<size_t> overflow_;
+};
+
+// Largest-flow-first: the largest flows are moved (first-fit decreasing)
+// until the rest fit on the normal core. This moves as few flows as
+// possible, which keeps per-flow state migrations and reordering low.
+class LargestFirstSplitPolicy final : public SplitPolicy {
+ public:
+  const char *name() const override { return "largest_first"; }
+
+  void Split(std::vector<SplitFlow> *flows, const SplitBudget &budget,
+             std::vector<SplitQueue> *queues, SplitQueuePool *pool) override {
+    uint64_t remaining_pkts = 0;
+    order_.clear();
+    for (size_t i = 0; i < flows->size(); i++) {
+      SplitFlow &flow = (*flows)[i];
+      if (flow.size > budget.queue_pkt_thresh) {
+        flow.decision = kBoost;
+      } else {
+        flow.decision = kLocal;
+        remaining_pkts += flow.size;
+        order_.push_back(i);
+      }
+    }
+
+    // Ties are broken by arrival order to keep the result deterministic
+    std::stable_sort(order_.begin(), order_.end(), [flows](size_t a, size_t b) {
+      return (*flows)[a].size > (*flows)[b].size;
+    });
+
+    for (size_t i : order_) {
+      if (remaining_pkts < budget.local_pkt_thresh) {
+        break;
+      }
+      SplitFlow &flow = (*flows)[i];
+      remaining_pkts -= flow.size;
+      FirstFit(&flow, budget, queues, pool);
+    }
+  }
+
+ private:
+  std::vector<size_t> order_;
+};
+
+// The 64-bit finalizer of MurmurHash3
+uint32_t MixFlowId(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return static_cast<uint32_t>(k);
+}
+
+// A fixed set of queue IDs [0, |num_queues|); the lowest free ID is used first
+class ReplayQueuePool final : public SplitQueuePool {
+ public:
+  explicit ReplayQueuePool(int num_queues) {
+    for (int i = 0; i < num_queues; i++) {
+      free_.insert(i);
+    }
+  }
+
+  int Request() override {
+    if (free_.empty()) {
+      return -1;
+    }
+    int qid = *free_.begin();
+    free_.erase(free_.begin());
+    return qid;
+  }
+
+  void Release(int qid) { free_.insert(qid); }
+
+ private:
+  std::set<int> free_;
+};
+
+}  // namespace
+
+std::unique_ptr<SplitPolicy> SplitPolicy::Create(const std::string &name) {
+  if (name == "greedy") {
+    return std::unique_ptr<SplitPolicy>(new GreedySplitPolicy());
+  }
+  if (name == "consistent_hash") {
+    return std::unique_ptr<SplitPolicy>(new ConsistentHashSplitPolicy());
+  }
+  if (name == "largest_first") {
+    return std::unique_ptr<SplitPolicy>(new LargestFirstSplitPolicy());
+  }
+  return nullptr;
+}
+
+void SplitPolicy::FirstFit(SplitFlow *flow, const SplitBudget &budget,
+                           std::vector<SplitQueue> *queues,
+                           SplitQueuePool *pool) {
+  // Prioritize queues that are active
+  for (SplitQueue &q : *queues) {
+    if (q.load + flow->size < budget.queue_pkt_thresh) {
+      q.load += flow->size;
+      flow->decision = q.id;
+      return;
+    }
+  }
+
+  if (AddQueue(queues, pool)) {
+    queues->back().load = flow->size;
+    flow->decision = queues->back().id;
+  } else {
+    // All rcores are busy now! Need to clean this flow anyway.
+    flow->decision = kDrop;
+  }
+}
+
+bool SplitPolicy::AddQueue(std::vector<SplitQueue> *queues,
+                           SplitQueuePool *pool) {
+  int qid = pool->Request();
+  if (qid < 0) {
+    return false;
+  }
+  queues->push_back({qid, 0});
+  return true;
+}
+
+SplitReplayResult ReplaySplitTrace(SplitPolicy *policy,
+                                   const std::vector<SplitTraceEpoch> &trace,
+                                   const SplitBudget &budget, int num_queues,
+                                   int max_idle_epochs) {
+  SplitReplayResult result;
+  ReplayQueuePool pool(num_queues);
+  std::vector<bool> in_use(num_queues, false);
+  std::vector<int> idle_epochs(num_queues, 0);
+  std::vector<uint64_t> queue_load(num_queues, 0);
+  std::unordered_map<uint64_t, int> flow_to_queue;
+
+  std::vector<SplitFlow> flows;
+  std::vector<uint64_t> flow_ids;
+  std::vector<SplitQueue> queues;
+
+  for (const SplitTraceEpoch &epoch : trace) {
+    std::fill(queue_load.begin(), queue_load.end(), 0);
+    flows.clear();
+    flow_ids.clear();
+
+    // Flows on software queues stay there
+    for (const SplitTraceFlow &f : epoch) {
+      auto it = flow_to_queue.find(f.flow_id);
+      if (it != flow_to_queue.end()) {
+        queue_load[it->second] += f.packets;
+        result.offloaded_packets += f.packets;
+      } else {
+        flows.push_back({f.packets, MixFlowId(f.flow_id), SplitPolicy::kLocal});
+        flow_ids.push_back(f.flow_id);
+      }
+    }
+
+    queues.clear();
+    for (int qid = 0; qid < num_queues; qid++) {
+      if (in_use[qid]) {
+        uint32_t load = std::min<uint64_t>(queue_load[qid], UINT32_MAX);
+        queues.push_back({qid, load});
+      }
+    }
+    policy->Split(&flows, budget, &queues, &pool);
+
+    for (const SplitQueue &q : queues) {
+      if (!in_use[q.id]) {
+        in_use[q.id] = true;
+        idle_epochs[q.id] = 0;
+      }
+    }
+
+    uint64_t local_load = 0;
+    for (size_t i = 0; i < flows.size(); i++) {
+      const SplitFlow &flow = flows[i];
+      if (flow.decision == SplitPolicy::kLocal) {
+        local_load += flow.size;
+      } else if (flow.decision == SplitPolicy::kBoost) {
+        result.boosted_packets += flow.size;
+      } else if (flow.decision == SplitPolicy::kDrop) {
+        result.dropped_packets += flow.size;
+      } else {
+        flow_to_queue[flow_ids[i]] = flow.decision;
+        queue_load[flow.decision] += flow.size;
+        result.offloaded_packets += flow.size;
+      }
+    }
+
+    // SLO violations
+    uint64_t overloaded = 0;
+    if (local_load > budget.local_pkt_thresh) {
+      overloaded += local_load - budget.local_pkt_thresh;
+    }
+    uint32_t active_queues = 0;
+    for (int qid = 0; qid < num_queues; qid++) {
+      if (!in_use[qid]) {
+        continue;
+      }
+      active_queues += 1;
+      if (queue_load[qid] > budget.queue_pkt_thresh) {
+        overloaded += queue_load[qid] - budget.queue_pkt_thresh;
+      }
+    }
+    result.epochs += 1;
+    result.overloaded_packets += overloaded;
+    result.slo_violation_epochs += (overloaded > 0);
+    result.queue_epochs += active_queues;
+    result.max_queues = std::max(result.max_queues, active_queues);
+
+    // Reclaim idle queues; their flows go back to the normal core
+    for (int qid = 0; qid < num_queues; qid++) {
+      if (!in_use[qid]) {
+        continue;
+      }
+      idle_epochs[qid] = (queue_load[qid] == 0) ? idle_epochs[qid] + 1 : 0;
+      if (idle_epochs[qid] >= max_idle_epochs) {
+        in_use[qid] = false;
+        pool.Release(qid);
+      }
+    }
+    for (auto it = flow_to_queue.begin(); it != flow_to_queue.end();) {
+      if (!in_use[it->second]) {
+        it = flow_to_queue.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  return result;
+}
+
+bool LoadSplitTrace(const std::string &path,
+                    std::vector<SplitTraceEpoch> *trace) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty() && line[0] == '#') {
+      continue;
+    }
+
+    SplitTraceEpoch epoch;
+    std::istringstream tokens(line);
+    std::string token;
+    while (tokens >> token) {
+      size_t sep = token.find(':');
+      if (sep == std::string::npos) {
+        return false;
+      }
+      try {
+        epoch.push_back({std::stoull(token.substr(0, sep)),
+                         static_cast<uint32_t>(std::stoul(token.substr(sep + 1)))});
+      } catch (const std::exception &) {
+        return false;
+      }
+    }
+    trace->push_back(std::move(epoch));
+  }
+  return true;
+}
+
+}  // namespace utils
+}  // namespace bess
@@ -0,0 +1,125 @@
+#ifndef BESS_UTILS_SPLIT_POLICY_H_
+#define BESS_UTILS_SPLIT_POLICY_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A flow to be placed by a short-term split policy.
+// |size|: the number of queued packets of the flow;
+// |hash|: a well-mixed flow hash (used by hash-based policies);
+// |decision|: the output, i.e. a software queue ID or one of the
+// SplitPolicy::k* constants.
+struct SplitFlow {
+  uint32_t size;
+  uint32_t hash;
+  int decision;
+};
+
+// A software queue that flows can be offloaded to.
+// |load| is the number of packets assigned to the queue in this epoch.
+struct SplitQueue {
+  int id;
+  uint32_t load;
+};
+
+// Per-epoch capacities, found using offline profiling.
+// |local_pkt_thresh|: packets that the normal core itself can absorb;
+// |queue_pkt_thresh|: packets that one software queue (rcore) can absorb.
+struct SplitBudget {
+  uint32_t local_pkt_thresh;
+  uint32_t queue_pkt_thresh;
+};
+
+// The source of additional software queues, i.e. NFVCtrl's rcore pool.
+class SplitQueuePool {
+ public:
+  virtual ~SplitQueuePool() {}
+
+  // Returns the ID of a newly assigned software queue, or -1 if none is left.
+  virtual int Request() = 0;
+};
+
+// A short-term split policy decides, at the end of each short-term epoch,
+// which of the flows that are still handled by a normal core are moved to
+// software queues (and their rcores) so that the queued packets can be
+// processed within the latency SLO.
+class SplitPolicy {
+ public:
+  // Keep the flow on the normal core
+  static constexpr int kLocal = -1;
+  // The flow alone overloads a single rcore; send it to boost-mode rcores
+  static constexpr int kBoost = -2;
+  // No rcore is available; drop the flow's packets
+  static constexpr int kDrop = -3;
+
+  virtual ~SplitPolicy() {}
+
+  // Returns a policy by its name ("greedy", "consistent_hash" or
+  // "largest_first"), or nullptr if the name is unknown.
+  static std::unique_ptr<SplitPolicy> Create(const std::string &name);
+
+  virtual const char *name() const = 0;
+
+  // Sets |decision| of every flow in |flows|. |queues| holds the queues that
+  // are already in use with their current load; queues obtained from |pool|
+  // are appended to it, and the loads of all queues are updated.
+  virtual void Split(std::vector<SplitFlow> *flows, const SplitBudget &budget,
+                     std::vector<SplitQueue> *queues,
+                     SplitQueuePool *pool) = 0;
+
+ protected:
+  // Places |flow| on the first queue in |queues| with enough room for it,
+  // requesting a new queue from |pool| if none has.
+  static void FirstFit(SplitFlow *flow, const SplitBudget &budget,
+                       std::vector<SplitQueue> *queues, SplitQueuePool *pool);
+
+  // Appends a new queue from |pool| to |queues|.
+  // Returns false if |pool| has run out of queues.
+  static bool AddQueue(std::vector<SplitQueue> *queues, SplitQueuePool *pool);
+};
+
+// Replays recorded per-epoch flow statistics against a policy without a NIC.
+// Each epoch is a list of (flow ID, queued packets). A fixed pool of
+// |num_queues| software queues is shared across epochs; like NFVCore, a
+// flow stays on its software queue while the queue is in use, and a queue
+// that has no packets for |max_idle_epochs| epochs is returned to the pool.
+// The replay is deterministic.
+struct SplitTraceFlow {
+  uint64_t flow_id;
+  uint32_t packets;
+};
+using SplitTraceEpoch = std::vector<SplitTraceFlow>;
+
+struct SplitReplayResult {
+  uint64_t epochs = 0;
+  // Epochs in which the normal core or a software queue got more packets
+  // than it can process within the SLO
+  uint64_t slo_violation_epochs = 0;
+  uint64_t overloaded_packets = 0;
+  uint64_t dropped_packets = 0;
+  uint64_t boosted_packets = 0;
+  uint64_t offloaded_packets = 0;
+  // Sum of in-use software queues (rcores) over all epochs
+  uint64_t queue_epochs = 0;
+  uint32_t max_queues = 0;
+};
+
+SplitReplayResult ReplaySplitTrace(SplitPolicy *policy,
+                                   const std::vector<SplitTraceEpoch> &trace,
+                                   const SplitBudget &budget, int num_queues,
+                                   int max_idle_epochs);
+
+// Reads a trace with one epoch per line and a "flow_id:packets" token per
+// flow, e.g., "1:20 2:3 7:120". Returns false if the file cannot be parsed.
+bool LoadSplitTrace(const std::string &path,
+                    std::vector<SplitTraceEpoch> *trace);
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_SPLIT_POLICY_H_
@@ -0,0 +1,221 @@
+#include "split_policy.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include "random.h"
+
+using bess::utils::SplitBudget;
+using bess::utils::SplitFlow;
+using bess::utils::SplitPolicy;
+using bess::utils::SplitQueue;
+using bess::utils::SplitQueuePool;
+using bess::utils::SplitReplayResult;
+using bess::utils::SplitTraceEpoch;
+
+namespace {
+
+class FakeQueuePool final : public SplitQueuePool {
+ public:
+  explicit FakeQueuePool(int n) : next_(0), n_(n) {}
+  int Request() override { return next_ < n_ ? next_++ : -1; }
+
+ private:
+  int next_;
+  int n_;
+};
+
+std::vector<SplitFlow> MakeFlows(const std::vector<uint32_t> &sizes) {
+  std::vector<SplitFlow> flows;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    flows.push_back({sizes[i], static_cast<uint32_t>(i * 2654435761u),
+                     SplitPolicy::kLocal});
+  }
+  return flows;
+}
+
+TEST(SplitPolicyTest, Create) {
+  EXPECT_STREQ("greedy", SplitPolicy::Create("greedy")->name());
+  EXPECT_STREQ("consistent_hash",
+               SplitPolicy::Create("consistent_hash")->name());
+  EXPECT_STREQ("largest_first", SplitPolicy::Create("largest_first")->name());
+  EXPECT_EQ(nullptr, SplitPolicy::Create("foo"));
+}
+
+TEST(SplitPolicyTest, Greedy) {
+  auto policy = SplitPolicy::Create("greedy");
+  std::vector<SplitFlow> flows = MakeFlows({40, 40, 40, 300, 30, 30});
+  std::vector<SplitQueue> queues;
+  FakeQueuePool pool(8);
+
+  policy->Split(&flows, {100, 64}, &queues, &pool);
+  EXPECT_EQ(SplitPolicy::kLocal, flows[0].decision);
+  EXPECT_EQ(SplitPolicy::kLocal, flows[1].decision);
+  EXPECT_EQ(0, flows[2].decision);
+  EXPECT_EQ(SplitPolicy::kBoost, flows[3].decision);
+  EXPECT_EQ(1, flows[4].decision);
+  EXPECT_EQ(1, flows[5].decision);  // fits on q1 (30 + 30 < 64)
+  ASSERT_EQ(2, queues.size());
+  EXPECT_EQ(40, queues[0].load);
+  EXPECT_EQ(60, queues[1].load);
+}
+
+TEST(SplitPolicyTest, GreedyOutOfQueues) {
+  auto policy = SplitPolicy::Create("greedy");
+  std::vector<SplitFlow> flows = MakeFlows({60, 50, 50});
+  std::vector<SplitQueue> queues;
+  FakeQueuePool pool(1);
+
+  policy->Split(&flows, {100, 64}, &queues, &pool);
+  EXPECT_EQ(SplitPolicy::kLocal, flows[0].decision);
+  EXPECT_EQ(0, flows[1].decision);
+  EXPECT_EQ(SplitPolicy::kDrop, flows[2].decision);
+}
+
+TEST(SplitPolicyTest, ConsistentHashSpreads) {
+  auto policy = SplitPolicy::Create("consistent_hash");
+  std::vector<SplitFlow> flows = MakeFlows({30, 10, 10, 10, 10, 10, 10, 10});
+  std::vector<SplitQueue> queues;
+  FakeQueuePool pool(8);
+
+  policy->Split(&flows, {40, 32}, &queues, &pool);
+  // 70 packets overflow: three queues are set up at once and flows spread
+  ASSERT_EQ(3, queues.size());
+  uint32_t total = 0;
+  int used = 0;
+  for (const SplitQueue &q : queues) {
+    total += q.load;
+    used += (q.load > 0);
+  }
+  EXPECT_EQ(70, total);
+  EXPECT_GE(used, 2);
+}
+
+TEST(SplitPolicyTest, LargestFirstMovesFewestFlows) {
+  auto policy = SplitPolicy::Create("largest_first");
+  std::vector<SplitFlow> flows = MakeFlows({10, 10, 10, 10, 50, 10, 10, 10, 10});
+  std::vector<SplitQueue> queues;
+  FakeQueuePool pool(8);
+
+  policy->Split(&flows, {100, 64}, &queues, &pool);
+  int moved = 0;
+  for (const SplitFlow &flow : flows) {
+    moved += (flow.decision >= 0);
+  }
+  EXPECT_EQ(1, moved);
+  EXPECT_EQ(0, flows[4].decision);
+
+  // The greedy policy moves the tail flows instead
+  auto greedy = SplitPolicy::Create("greedy");
+  flows = MakeFlows({10, 10, 10, 10, 50, 10, 10, 10, 10});
+  queues.clear();
+  FakeQueuePool pool2(8);
+  greedy->Split(&flows, {100, 64}, &queues, &pool2);
+  moved = 0;
+  for (const SplitFlow &flow : flows) {
+    moved += (flow.decision >= 0);
+  }
+  EXPECT_EQ(4, moved);
+}
+
+TEST(SplitPolicyTest, ExistingQueuesFirst) {
+  auto policy = SplitPolicy::Create("greedy");
+  std::vector<SplitFlow> flows = MakeFlows({60, 30, 20});
+  std::vector<SplitQueue> queues = {{5, 30}};
+  FakeQueuePool pool(8);
+
+  policy->Split(&flows, {100, 64}, &queues, &pool);
+  EXPECT_EQ(5, flows[2].decision);
+  ASSERT_EQ(1, queues.size());
+  EXPECT_EQ(50, queues[0].load);
+}
+
+// A bursty trace: 64 steady mice and a few elephants that come and go
+std::vector<SplitTraceEpoch> MakeTrace() {
+  Random rng(42);
+  std::vector<SplitTraceEpoch> trace;
+  for (int e = 0; e < 200; e++) {
+    SplitTraceEpoch epoch;
+    for (uint64_t f = 0; f < 64; f++) {
+      epoch.push_back({f, 1 + rng.GetRange(4)});
+    }
+    for (uint64_t f = 1000; f < 1008; f++) {
+      if (rng.GetRange(4) == 0) {
+        epoch.push_back({f, 20 + rng.GetRange(60)});
+      }
+    }
+    trace.push_back(epoch);
+  }
+  return trace;
+}
+
+TEST(SplitPolicyTest, ReplayIsDeterministic) {
+  std::vector<SplitTraceEpoch> trace = MakeTrace();
+  for (const char *name : {"greedy", "consistent_hash", "largest_first"}) {
+    auto policy = SplitPolicy::Create(name);
+    SplitReplayResult a =
+        bess::utils::ReplaySplitTrace(policy.get(), trace, {200, 128}, 8, 10);
+    SplitReplayResult b =
+        bess::utils::ReplaySplitTrace(policy.get(), trace, {200, 128}, 8, 10);
+    EXPECT_EQ(200, a.epochs) << name;
+    EXPECT_EQ(a.slo_violation_epochs, b.slo_violation_epochs) << name;
+    EXPECT_EQ(a.overloaded_packets, b.overloaded_packets) << name;
+    EXPECT_EQ(a.queue_epochs, b.queue_epochs) << name;
+    EXPECT_LE(a.max_queues, 8) << name;
+    EXPECT_GT(a.offloaded_packets, 0) << name;
+  }
+}
+
+TEST(SplitPolicyTest, ReplayConservesPackets) {
+  std::vector<SplitTraceEpoch> trace = MakeTrace();
+  uint64_t total = 0;
+  for (const SplitTraceEpoch &epoch : trace) {
+    for (const auto &f : epoch) {
+      total += f.packets;
+    }
+  }
+
+  auto policy = SplitPolicy::Create("largest_first");
+  // With a single queue, some flows must be dropped
+  SplitReplayResult r =
+      bess::utils::ReplaySplitTrace(policy.get(), trace, {100, 64}, 1, 10);
+  EXPECT_GT(r.dropped_packets, 0);
+  EXPECT_LE(r.dropped_packets + r.boosted_packets + r.offloaded_packets, total);
+  EXPECT_EQ(1, r.max_queues);
+}
+
+TEST(SplitPolicyTest, LoadTrace) {
+  char path[] = "/tmp/split_trace_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    std::ofstream f(path);
+    f << "# flow_id:packets\n1:20 2:3\n\n7:120\n";
+  }
+
+  std::vector<SplitTraceEpoch> trace;
+  ASSERT_TRUE(bess::utils::LoadSplitTrace(path, &trace));
+  ASSERT_EQ(3, trace.size());
+  ASSERT_EQ(2, trace[0].size());
+  EXPECT_EQ(2, trace[0][1].flow_id);
+  EXPECT_EQ(3, trace[0][1].packets);
+  EXPECT_EQ(0, trace[1].size());
+  EXPECT_EQ(120, trace[2][0].packets);
+
+  {
+    std::ofstream f(path);
+    f << "1:20 bad\n";
+  }
+  trace.clear();
+  EXPECT_FALSE(bess::utils::LoadSplitTrace(path, &trace));
+  std::remove(path);
+
+  EXPECT_FALSE(bess::utils::LoadSplitTrace("/nonexistent/trace", &trace));
+}
+
+}  // namespace (unnamed)
@@ -6,6 +6,7 @@
 #include <shared_mutex>
 
 #include "flow.h"
+#include "hyperloglog.h"
 #include "lock_less_queue.h"
 
 #define RETA_SIZE 512
@@ -30,7 +31,7 @@ struct Snapshot {
 struct CoreSnapshot {
   CoreSnapshot(uint32_t t_id) {
     epoch_id = t_id;
-    slo_violation = 0; packet_delay_error = 0; packet_delay_max = 0;
+    slo_violation = 0; packet_delay_error = 0; packet_delay_max = 0; packet_delay_p99 = 0;
     active_flow_count = 0; bursty_flow_count = 0;
     packet_rate = 0; packet_processed = 0; packet_queued = 0;
   };
@@ -40,6 +41,7 @@ struct CoreSnapshot {
   uint16_t slo_violation; // Number of packets with SLO violations
   uint16_t packet_delay_error; // Number of packets with a wrong timestamp
   uint16_t packet_delay_max; // Max per-packet latency
+  uint32_t packet_delay_p99; // P99 per-packet latency (ns)
   uint16_t active_flow_count; // Number of active flows
   uint16_t bursty_flow_count ; // Number of bursty flows
   uint16_t packet_rate; // Sum of a core's packet rate
@@ -69,15 +71,29 @@ class CoreStats {
 
 class BucketStats {
  public:
-  BucketStats() {}
+  BucketStats() : flow_epoch_(0) {}
   // [0, SHARD_NUM - 1]
   uint32_t RSSHashToID(uint32_t hash) {
     return (hash & (RETA_SIZE - 1)) % SHARD_NUM;
   }
 
+  // Record a flow (identified by its NIC RSS hash) in bucket |id|.
+  void AddFlow(uint32_t id, uint32_t rss_hash) {
+    per_bucket_flow_sketch[id].Add(rss_hash, flow_epoch_);
+  }
+  // The (estimated) number of distinct flows in bucket |id| since the last reset.
+  uint64_t FlowCount(uint32_t id) const {
+    return per_bucket_flow_sketch[id].Estimate(flow_epoch_);
+  }
+  // Reset all per-bucket flow counts in O(1).
+  void ResetFlowCount() { flow_epoch_ += 1; }
+
   uint64_t per_bucket_packet_counter[RETA_SIZE] = {0};
-  std::unordered_map<Flow, bool, FlowHash> per_bucket_flow_cache[RETA_SIZE];
+  HyperLogLog<> per_bucket_flow_sketch[RETA_SIZE];
   std::shared_mutex bucket_table_lock;
+
+ private:
+  uint32_t flow_epoch_;
 };
 
 // Used to maintain packet counts per RSS bucket
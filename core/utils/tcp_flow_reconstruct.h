@@ -30,24 +30,28 @@
 #ifndef BESS_UTILS_TCP_FLOW_RECONSTRUCT_H_
 #define BESS_UTILS_TCP_FLOW_RECONSTRUCT_H_
 
-#include <vector>
-
 #include "../packet.h"
-#include "copy.h"
 #include "ether.h"
 #include "ip.h"
+#include "reassembly_buffer.h"
 #include "tcp.h"
 
 namespace bess {
 namespace utils {
 
 // A utility class that accumulates TCP packet data in the correct order.
+//
+// The data is kept in a ReassemblyBuffer, so it takes no memory until the
+// first payload arrives, stops at |max_bytes|, and comes out of the
+// per-worker ReassemblyArena budget.
 class TcpFlowReconstruct {
  public:
-  // Constructs a TCP flow reconstruction object that can hold initial_buflen
-  // bytes to start with.
-  explicit TcpFlowReconstruct(size_t initial_buflen = 1024)
-      : initialized_(false), init_seq_(0), buf_(initial_buflen) {}
+  // Constructs a TCP flow reconstruction object whose buffer starts at
+  // initial_buflen bytes once data arrives and holds at most max_bytes.
+  explicit TcpFlowReconstruct(
+      size_t initial_buflen = 1024,
+      size_t max_bytes = ReassemblyBuffer::kDefaultMaxBytes)
+      : initialized_(false), init_seq_(0), buf_(initial_buflen, max_bytes) {}
 
   virtual ~TcpFlowReconstruct() {}
 
@@ -55,25 +59,35 @@ class TcpFlowReconstruct {
   // to return the same pointer between calls to InsertPacket().
   const char *buf() const { return buf_.data(); }
 
-  // Returns the size of the underlying buffer
+  // Returns the size of the underlying buffer (0 until data arrives)
   size_t buf_size() const { return buf_.size(); }
 
+  // Returns true once a SYN has been seen.
+  bool initialized() const { return initialized_; }
+
   // Returns the initial data sequence number extracted from the SYN.
   uint32_t init_seq() const { return init_seq_; }
 
   // Returns the length of contiguous data available in the buffer starting from
   // the beginning.  Updated every time InsertPacket() is called.
-  size_t contiguous_len() const {
-    const auto it = received_map_.begin();
-    return (it == received_map_.end()) ? 0 : (it->second - it->first);
-  }
+  size_t contiguous_len() const { return buf_.contiguous_len(); }
+
+  // The per-flow byte cap. Data beyond it is dropped, and truncated() is set.
+  size_t max_bytes() const { return buf_.max_bytes(); }
+  void set_max_bytes(size_t max_bytes) { buf_.set_max_bytes(max_bytes); }
+  bool truncated() const { return buf_.truncated(); }
+
+  // Returns the buffer to the arena, e.g., once the flow has been analyzed.
+  // Data inserted afterwards starts over at an empty buffer.
+  void ReleaseBuffer() { buf_.Release(); }
 
   // Adds the data of the given packet based upon its TCP sequence number.  If
   // the packet is a SYN then we use the SYN to set the initial sequence number
   // offset.
   //
   // Returns true upon success.  Returns false if the given packet is not a SYN
-  // but if we have not been given a SYN previously.
+  // but if we have not been given a SYN previously, or if the buffer cannot
+  // take the data (too many holes, or evicted under memory pressure).
   //
   // Behavior is undefined the packet is not a TCP packet.
   bool InsertPacket(Packet *p) {
@@ -116,44 +130,11 @@ class TcpFlowReconstruct {
       return true;
     }
 
-    // If we will run out of space, make more room.
-    if ((buf_offset + datalen) > buf_.size()) {
-      size_t new_buflen = (buf_offset + datalen) * 2;
-      buf_.resize(new_buflen);
-    }
-
-    bess::utils::CopyInlined(buf_.data() + buf_offset, datastart, datalen);
-
-    uint32_t start = buf_offset;
-    uint32_t end = buf_offset + datalen;
-
-    // Merge the new new data with existing segments
-    // new segment                           |-------------|
-    // existing segments with a hole   |---A---|   |--B--|-C-|
-    //                                             ^
-    //                                             lower_bound(start)
-    auto it = received_map_.lower_bound(start);
-    if (it != received_map_.begin()) {
-      auto it_prev = it;
-      it_prev--;
-      if (it_prev->second >= start) {
-        // The segment right before the lower_bound(start) may partially overlap
-        // with the new segment (e.g., segment A in the above figure).
-        // Include the segment for merging
-        start = it_prev->first;
-        it = it_prev;
-      }
-    }
-
-    // Remove all ovlerapping segments
-    while (it != received_map_.end() && it->first <= end) {
-      end = std::max(end, it->second);
-      it = received_map_.erase(it);
+    if (!buf_.Insert(buf_offset, datastart, datalen)) {
+      VLOG(1) << "Reassembly buffer full or evicted. Offset: " << buf_offset
+              << ", Segments: " << buf_.segment_count();
+      return false;
     }
-
-    // Insert the merged segment
-    received_map_.emplace(start, end);
-
     return true;
   }
 
@@ -165,13 +146,8 @@ class TcpFlowReconstruct {
   // The initial sequence number of data bytes in the TCP flow.
   uint32_t init_seq_;
 
-  // A buffer (potentially with holes) of received data.
-  std::vector<char> buf_;
-
-  // Sorted list of received segments. Segments are merged as necessary.
-  // Key: offset from init_seq_
-  // T: end offset of the segment
-  std::map<uint32_t, uint32_t> received_map_;
+  // Received data (potentially with holes), keyed by offset from init_seq_
+  ReassemblyBuffer buf_;
 
   DISALLOW_COPY_AND_ASSIGN(TcpFlowReconstruct);
 };
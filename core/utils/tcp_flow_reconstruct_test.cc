@@ -35,6 +35,7 @@
 #include <gtest/gtest.h>
 #include <pcap/pcap.h>
 
+#include "copy.h"
 #include "packet_pool.h"
 
 namespace bess {
@@ -94,12 +95,38 @@ class TcpFlowReconstructTest : public ::testing::TestWithParam<const char *> {
   pcap_t *handle_;
 };
 
-// Tests that the constructor initializes the underlying buffers to the
-// specified initial size.
+// Tests that the constructor allocates nothing up front.
 TEST(TcpFlowReconstruct, Constructor) {
-  TcpFlowReconstruct t1, t2(7);
-  EXPECT_EQ(1024, t1.buf_size());
-  EXPECT_EQ(7, t2.buf_size());
+  TcpFlowReconstruct t1, t2(7, 100);
+  EXPECT_EQ(0, t1.buf_size());
+  EXPECT_EQ(0, t2.buf_size());
+  EXPECT_EQ(ReassemblyBuffer::kDefaultMaxBytes, t1.max_bytes());
+  EXPECT_EQ(100, t2.max_bytes());
+}
+
+// Tests that the buffer starts at the initial size once data arrives.
+TEST_F(TcpFlowReconstructTest, InitialSize) {
+  TcpFlowReconstruct t;
+  for (Packet *p : pkts_) {
+    ASSERT_TRUE(t.InsertPacket(p));
+  }
+  EXPECT_EQ(1024, t.buf_size());
+  EXPECT_FALSE(t.truncated());
+
+  t.ReleaseBuffer();
+  EXPECT_EQ(0, t.buf_size());
+  EXPECT_EQ(0, t.contiguous_len());
+}
+
+// Tests that data beyond the per-flow cap is dropped.
+TEST_F(TcpFlowReconstructTest, MaxBytes) {
+  TcpFlowReconstruct t(1, 300);
+  for (Packet *p : pkts_) {
+    ASSERT_TRUE(t.InsertPacket(p));
+  }
+  EXPECT_TRUE(t.truncated());
+  ASSERT_EQ(300, t.contiguous_len());
+  EXPECT_EQ(0, memcmp(t.buf(), bytestream_.data(), 300));
 }
 
 // Tests that reconstructed flows contain the right data when done in order.
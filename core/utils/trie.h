@@ -90,7 +90,12 @@ class Trie {
   void Insert(const std::string& key, const T& val, bool prefix);
 
   // Returns true if the key is in the trie.
-  bool Match(const std::string& key);
+  bool Match(const std::string& key) const {
+    return Match(key.data(), key.size());
+  }
+
+  // Same as above, for a key that is not a std::string (e.g., in a packet).
+  bool Match(const char* key, size_t len) const;
 
   // Returns true if there is a key in the trie that begins with the given
   // prefix.
@@ -147,14 +152,14 @@ inline void Trie<T>::Insert(const std::string& key, const T& val, bool prefix) {
 }
 
 template <typename T>
-inline bool Trie<T>::Match(const std::string& key) {
-  Node* cur = &root_;
+inline bool Trie<T>::Match(const char* key, size_t len) const {
+  const Node* cur = &root_;
   if (cur->prefix) {
     return true;
   }
 
-  for (const char& c : key) {
-    size_t idx = c;
+  for (const char* c = key; c < key + len; c++) {
+    size_t idx = *c;
     if (cur->children[idx] == nullptr) {
       return false;
     }
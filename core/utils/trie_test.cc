@@ -49,6 +49,10 @@ TEST(TrieTest, Match) {
 
   EXPECT_TRUE(trie.Match("Hello world!"));
   EXPECT_TRUE(trie.Match("123456"));
+
+  // Keys in a larger buffer
+  EXPECT_TRUE(trie.Match("1234567", 6));
+  EXPECT_FALSE(trie.Match("1234567", 7));
 }
 
 TEST(TrieTest, MatchPrefix) {